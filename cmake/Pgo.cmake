@@ -0,0 +1,88 @@
+# cmake/Pgo.cmake
+#
+# Provides:
+#   - Options: DRUNK_ENABLE_LTO, DRUNK_PGO (OFF/GENERATE/USE), DRUNK_PGO_DIR
+#   - Applies to every target declared after include(Pgo), core libraries included, since the hot code
+#     (process_runner.h, processor_types.h, spsc.h) is templates that get instantiated in each executable.
+#
+# cmake/pgo_build.sh drives the whole instrument -> train -> rebuild -> compare cycle.
+
+# -------------------------
+# Options
+# -------------------------
+option(DRUNK_ENABLE_LTO "Enable link time optimization (IPO)" OFF)
+set(DRUNK_PGO "OFF" CACHE STRING "Profile guided optimization phase: OFF, GENERATE (instrument) or USE (rebuild with profiles)")
+set_property(CACHE DRUNK_PGO PROPERTY STRINGS OFF GENERATE USE)
+set(DRUNK_PGO_DIR "${CMAKE_BINARY_DIR}/pgo-profiles" CACHE PATH "Where GENERATE writes profiles and USE reads them")
+
+# -------------------------
+# LTO
+# -------------------------
+if(DRUNK_ENABLE_LTO)
+  include(CheckIPOSupported)
+  check_ipo_supported(RESULT DRUNK_IPO_SUPPORTED OUTPUT DRUNK_IPO_ERROR LANGUAGES CXX)
+  if(NOT DRUNK_IPO_SUPPORTED)
+    message(FATAL_ERROR "LTO requested but not supported by this toolchain: ${DRUNK_IPO_ERROR}")
+  endif()
+
+  # Static libs (drunk_core, backends) go through gcc-ar/llvm-ar, CMake picks those up for IPO.
+  set(CMAKE_INTERPROCEDURAL_OPTIMIZATION ON)
+endif()
+
+# -------------------------
+# PGO validation
+# -------------------------
+if(NOT DRUNK_PGO MATCHES "^(OFF|GENERATE|USE)$")
+  message(FATAL_ERROR "DRUNK_PGO must be OFF, GENERATE or USE (got ${DRUNK_PGO})")
+endif()
+
+if(NOT DRUNK_PGO STREQUAL "OFF")
+  if(NOT (CMAKE_CXX_COMPILER_ID STREQUAL "GNU" OR CMAKE_CXX_COMPILER_ID MATCHES ".*Clang"))
+    message(FATAL_ERROR "PGO needs GCC or Clang. Current compiler: ${CMAKE_CXX_COMPILER_ID}")
+  endif()
+
+  # Profiles of a sanitized binary describe the sanitizer, not us.
+  if(DRUNK_ENABLE_ASAN OR DRUNK_ENABLE_UBSAN OR DRUNK_ENABLE_TSAN OR DRUNK_ENABLE_MSAN)
+    message(FATAL_ERROR "PGO cannot be combined with sanitizers. Use a separate build directory.")
+  endif()
+endif()
+
+# -------------------------
+# PGO flags
+# -------------------------
+if(DRUNK_PGO STREQUAL "GENERATE")
+  file(MAKE_DIRECTORY "${DRUNK_PGO_DIR}")
+
+  if(CMAKE_CXX_COMPILER_ID MATCHES ".*Clang")
+    set(DRUNK_PGO_FLAGS -fprofile-generate=${DRUNK_PGO_DIR})
+  else()
+    # Sampler + consumer threads bump the same counters, atomic updates keep the profile consistent.
+    set(DRUNK_PGO_FLAGS -fprofile-generate -fprofile-update=atomic -fprofile-dir=${DRUNK_PGO_DIR})
+  endif()
+
+  add_compile_options(${DRUNK_PGO_FLAGS})
+  add_link_options(${DRUNK_PGO_FLAGS})
+  message(STATUS "PGO: instrumenting, profiles go to ${DRUNK_PGO_DIR}")
+
+elseif(DRUNK_PGO STREQUAL "USE")
+  if(CMAKE_CXX_COMPILER_ID MATCHES ".*Clang")
+    # llvm-profdata merge -o drunk.profdata *.profraw (pgo_build.sh does this)
+    set(DRUNK_PGO_PROFDATA "${DRUNK_PGO_DIR}/drunk.profdata")
+    if(NOT EXISTS "${DRUNK_PGO_PROFDATA}")
+      message(FATAL_ERROR "PGO: ${DRUNK_PGO_PROFDATA} not found, run a GENERATE build + training first")
+    endif()
+    set(DRUNK_PGO_FLAGS -fprofile-use=${DRUNK_PGO_PROFDATA} -Wno-profile-instr-unprofiled -Wno-profile-instr-out-of-date)
+  else()
+    # GCC keys .gcda files on the object path, so USE has to be the same build directory GENERATE was.
+    file(GLOB DRUNK_PGO_GCDA "${DRUNK_PGO_DIR}/*.gcda")
+    if(NOT DRUNK_PGO_GCDA)
+      message(FATAL_ERROR "PGO: no .gcda profiles in ${DRUNK_PGO_DIR}, run a GENERATE build + training first")
+    endif()
+    # Code the training never reached keeps its normal -O2 treatment instead of being optimized for size.
+    set(DRUNK_PGO_FLAGS -fprofile-use -fprofile-dir=${DRUNK_PGO_DIR} -fprofile-partial-training -fprofile-correction -Wno-missing-profile)
+  endif()
+
+  add_compile_options(${DRUNK_PGO_FLAGS})
+  add_link_options(${DRUNK_PGO_FLAGS})
+  message(STATUS "PGO: optimizing with profiles from ${DRUNK_PGO_DIR}")
+endif()
@@ -0,0 +1,78 @@
+#!/usr/bin/env bash
+# PGO + LTO build driven by replay workloads, then a side by side against a plain Release build.
+#
+#   cmake/pgo_build.sh [out_dir] [extra cmake args...]      (default out_dir: build-pgo)
+#
+#   <out>/base      plain Release (-O2, no LTO), the baseline
+#   <out>/pgo       Release + LTO, built instrumented, trained, rebuilt with the profiles (same dir, GCC needs that)
+#   <out>/workload  synthetic sessions from drunk_siggen: train.drec for training, eval.drec (other seed) for scoring
+#
+# Training runs the instrumented binaries over the same paths the Pi hits: the ProcessRunner + RuntimeProcess replay
+# (drunk_regress), the offline analyzers (drunk_offline) and the threaded Sampler -> ring -> runner pipeline
+# (drunk_e2e). Scoring uses eval.drec so we don't grade on the training data: drunk_regress checks the PGO build's
+# windows/events still match the baseline's and gates on pipeline samples/s, drunk_bench then prints per component
+# ns/op against the baseline for information (it isn't trained on, and the ring microbenches are noisy).
+#
+# Exit: 0 PGO build matches and is at least as fast, 2 output differs, 3 pipeline got slower, 1 build / IO error.
+set -euo pipefail
+
+SRC_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+OUT_DIR="$(mkdir -p "${1:-build-pgo}" && cd "${1:-build-pgo}" && pwd)"
+shift || true
+EXTRA_ARGS=("$@")
+
+BASE="${OUT_DIR}/base"
+PGO="${OUT_DIR}/pgo"
+PROFILES="${PGO}/pgo-profiles"
+WORK="${OUT_DIR}/workload"
+JOBS="$(nproc)"
+
+step() { echo; echo "==> $*"; }
+
+step "Baseline Release build"
+cmake -S "${SRC_DIR}" -B "${BASE}" -DCMAKE_BUILD_TYPE=Release -DDRUNK_PGO=OFF -DDRUNK_ENABLE_LTO=OFF "${EXTRA_ARGS[@]}"
+cmake --build "${BASE}" -j"${JOBS}"
+
+step "Workload"
+mkdir -p "${WORK}/golden" "${WORK}/train-golden"
+"${BASE}/drunk_siggen" "${WORK}/train.drec" --hours 2 --every 180 --seed 11
+"${BASE}/drunk_siggen" "${WORK}/eval.drec" --hours 12 --every 240 --seed 23 --bac 0.03,0.07,0.1
+
+step "Instrumented build (LTO + -fprofile-generate)"
+rm -rf "${PROFILES}"
+cmake -S "${SRC_DIR}" -B "${PGO}" -DCMAKE_BUILD_TYPE=Release -DDRUNK_ENABLE_LTO=ON -DDRUNK_PGO=GENERATE -DDRUNK_PGO_DIR="${PROFILES}" "${EXTRA_ARGS[@]}"
+cmake --build "${PGO}" -j"${JOBS}"
+
+step "Training"
+"${PGO}/drunk_regress" --update --golden-dir "${WORK}/train-golden" --repeat 3 "${WORK}/train.drec"
+"${PGO}/drunk_offline" "${WORK}/train.drec" > /dev/null
+"${PGO}/drunk_e2e" --rates 128,10000,1000000 --batch 256 --ring 4096 --tick 50 --idle 1 --seconds 1 > /dev/null
+
+# Clang leaves .profraw files that need merging, GCC's .gcda are read as they are.
+if ls "${PROFILES}"/*.profraw > /dev/null 2>&1; then
+    PROFDATA="$(command -v llvm-profdata || true)"
+    if [ -z "${PROFDATA}" ]; then echo "Error: clang profiles need llvm-profdata on PATH" >&2; exit 1; fi
+    "${PROFDATA}" merge -o "${PROFILES}/drunk.profdata" "${PROFILES}"/*.profraw
+fi
+
+step "Optimized build (LTO + -fprofile-use)"
+cmake -S "${SRC_DIR}" -B "${PGO}" -DDRUNK_PGO=USE
+cmake --build "${PGO}" -j"${JOBS}"
+
+step "Compare: replay pipeline (eval.drec, baseline goldens)"
+"${BASE}/drunk_regress" --update --golden-dir "${WORK}/golden" --repeat 9 "${WORK}/eval.drec"
+status=0
+"${PGO}/drunk_regress" --golden-dir "${WORK}/golden" --repeat 9 --max-slowdown 0 "${WORK}/eval.drec" || status=$?
+
+step "Compare: component benchmarks"
+"${BASE}/drunk_bench" --json "${OUT_DIR}/bench-base.json" > /dev/null
+"${PGO}/drunk_bench" --json "${OUT_DIR}/bench-pgo.json" --baseline "${OUT_DIR}/bench-base.json" --max-regression 1000 || true
+
+echo
+case "${status}" in
+    0) echo "PGO + LTO binaries: ${PGO}" ;;
+    2) echo "Error: PGO build output differs from the baseline" >&2 ;;
+    3) echo "Error: PGO build is slower than the baseline on the replay pipeline" >&2 ;;
+    *) echo "Error: drunk_regress failed (${status})" >&2 ;;
+esac
+exit "${status}"
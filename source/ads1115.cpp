@@ -1,13 +1,19 @@
+#include <algorithm>
+#include <cerrno>
 #include <chrono>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <fmt/format.h>
+#include <fstream>
 #include <linux/i2c-dev.h>
 #include <memory>
 #include <sys/ioctl.h>
 #include <thread>
 #include "ads1115.h"
+#include "clock.h"
+#include "config_settings.h"
+#include "gpio_bank.h"
 
 namespace DrunkAPI {
 
@@ -16,20 +22,22 @@ namespace DrunkAPI {
 
     i2c_handle ADS1115_i2c::open_i2c_device(const int device_num, SlaveAddress device_address)
     {
+        // Not fatal, Init fails on it at startup and the recovery just tries again later.
         const auto filehandle = open(fmt::format("/dev/i2c-{}", device_num).c_str(),O_RDWR);
 
         if(filehandle < 0)
         {
             std::string errmsg = fmt::format("Unable to open /dev/i2c-{} for read/write",device_num);
             std::perror(errmsg.c_str());
-            exit(1);
+            return -1;
         }
 
         if(ioctl(filehandle, I2C_SLAVE, device_address) < 0)
         {
             std::string errmsg = fmt::format("Unable to set I2C_SLAVE addr to {}", static_cast<int>(device_address));
             std::perror(errmsg.c_str());
-            exit(1);
+            ::close(filehandle);
+            return -1;
         }
 
         //std::puts("i2c handle opened successfully");
@@ -38,15 +46,45 @@ namespace DrunkAPI {
 
         return filehandle;
     };
-    
+
+    ADS1115::~ADS1115() = default;
+
+    bool ADS1115::AttachReadyLine(const char* gpio_chip, unsigned int offset)
+    {
+        auto line = std::make_unique<GpioEdgeLine>(gpio_chip, offset);
+        if (!line->Init("drunk_app_rdy")) {return false;}
+
+        ready_line = std::move(line);
+        fmt::print("Hardware Init: Ads1115 ALERT/RDY on gpio {}, samples stamped by the kernel\n", offset);
+        return true;
+    }
+
+    void ADS1115::DetachReadyLine()
+    {
+        ready_line.reset();
+    }
+
+    void ADS1115::DrainReadyEdges() const
+    {
+        if (ready_line) {ready_line->Drain();}
+    }
+
+    bool ADS1115::WaitReadyEdge(std::chrono::microseconds timeout, std::uint64_t& out_t_us) const
+    {
+        return ready_line && ready_line->Wait(timeout, out_t_us);
+    }
+
     bool ADS1115::Init(const int dev_num, i2c_device::SlaveAddress dev_adr)
     {
         if(!dev) {dev = std::make_unique<i2c_device>();}
+        bus_num = dev_num;
+        bus_addr = dev_adr;
 
         dev->handle = dev->open_i2c_device(dev_num,dev_adr);
 
         if(dev->handle >=0)
         {
+            recovery.StartSession(static_cast<std::uint64_t>(SteadyClock::now().count()));
             std::puts("Hardware Init: Ads1115 Handle Successful!");
             return true;
         } 
@@ -61,7 +99,11 @@ namespace DrunkAPI {
         uint8_t reg, 
         uint16_t value) const
     {
-        if (!dev || dev->handle < 0){return false;}
+        if (!dev || dev->handle < 0)
+        {
+            Fail(EBADF);
+            return false;
+        }
 
         constexpr uint8_t LSB = 0XFF;
         constexpr uint8_t MSB = 8;
@@ -78,12 +120,10 @@ namespace DrunkAPI {
         msg.len   = static_cast<__u16>(sizeof(buf));
         msg.buf   = buf;
 
-        i2c_rdwr_ioctl_data xfer{};
-        xfer.msgs  = &msg;
-        xfer.nmsgs = 1;
-
-        int status = ioctl(dev->handle, I2C_RDWR, &xfer);
-        return status >= 0;
+        const auto start_us = static_cast<std::uint64_t>(SteadyClock::now().count());
+        if (!Transfer(&msg, 1)) {return false;}
+        timing.writes.Add(static_cast<std::uint64_t>(SteadyClock::now().count()) - start_us);
+        return true;
     }
 
     bool ADS1115::i2c_read_word(
@@ -91,7 +131,11 @@ namespace DrunkAPI {
         uint8_t reg, 
         uint16_t& out_conversion) const
     {
-        if (!dev || dev->handle < 0) {return false;}
+        if (!dev || dev->handle < 0)
+        {
+            Fail(EBADF);
+            return false;
+        }
 
         uint8_t wbuf[1] = { reg };
         uint8_t rbuf[2] = { 0, 0 };
@@ -107,20 +151,170 @@ namespace DrunkAPI {
         msgs[1].len   = 2;
         msgs[1].buf   = rbuf;
 
-        i2c_rdwr_ioctl_data xfer{}; 
-        xfer.msgs  = msgs;
-        xfer.nmsgs = 2;
-
-        if (ioctl(dev->handle, I2C_RDWR, &xfer) < 0) {
-            std::fprintf(stderr, "I2C_RDWR read_reg16 failed: %s\n", std::strerror(errno));
-            return false;
-        }
+        // Failures are counted and reported by the recovery, a flaky bus would flood stderr otherwise.
+        const auto start_us = static_cast<std::uint64_t>(SteadyClock::now().count());
+        if (!Transfer(msgs, 2)) {return false;}
+        timing.reads.Add(static_cast<std::uint64_t>(SteadyClock::now().count()) - start_us);
 
         constexpr uint16_t MSB_SHIFT = 8;
         out_conversion = static_cast<std::uint16_t>((static_cast<std::uint16_t>(rbuf[0]) << MSB_SHIFT) | static_cast<std::uint16_t>(rbuf[1])); // MSB first
         return true;
     }
     
+    bool ADS1115::Transfer(i2c_msg* msgs, std::size_t n) const
+    {
+        // The master code is addressed to nobody, IGNORE_NAK carries on to the real transaction after it with a
+        // repeated START, which keeps the chip in high speed mode for the lot.
+        constexpr std::size_t MaxMsgs = 3;
+        i2c_msg all[MaxMsgs]{};
+        std::size_t count = 0;
+        if (bHsMasterCode)
+        {
+            all[count].addr = static_cast<__u16>(Config::I2cHsMasterCode >> 1);
+            all[count].flags = I2C_M_IGNORE_NAK;
+            ++count;
+        }
+        for (std::size_t i = 0; i < n && count < MaxMsgs; ++i) {all[count++] = msgs[i];}
+
+        i2c_rdwr_ioctl_data xfer{};
+        xfer.msgs  = all;
+        xfer.nmsgs = static_cast<__u32>(count);
+
+        if (ioctl(dev->handle, I2C_RDWR, &xfer) < 0)
+        {
+            Fail(errno);
+            return false;
+        }
+        return true;
+    }
+
+    std::uint32_t ADS1115::NegotiateBusSpeed(const std::uint32_t wanted_hz)
+    {
+        // The kernel doesn't let us pick the clock per transfer, the adapter runs at its device tree
+        // clock-frequency (big endian u32, dtparam=i2c_arm_baudrate on the Pi).
+        std::uint32_t adapter_hz = 0;
+        std::ifstream node(fmt::format("/sys/class/i2c-adapter/i2c-{}/of_node/clock-frequency", bus_num), std::ios::binary);
+        unsigned char be[4] = {0, 0, 0, 0};
+        if (node.read(reinterpret_cast<char*>(be), sizeof(be)))
+        {
+            adapter_hz = (std::uint32_t{be[0]} << 24) | (std::uint32_t{be[1]} << 16) | (std::uint32_t{be[2]} << 8) | std::uint32_t{be[3]};
+        }
+
+        if (adapter_hz == 0)
+        {
+            fmt::print(stderr, "Warning: /dev/i2c-{} doesn't say its clock, taking {} Hz on trust\n", bus_num, wanted_hz);
+            adapter_hz = wanted_hz;
+        }
+        else if (adapter_hz != wanted_hz)
+        {
+            fmt::print(stderr, "Warning: /dev/i2c-{} is clocked at {} Hz, not the {} asked for\n", bus_num, adapter_hz, wanted_hz);
+        }
+
+        // Budgets are worked out at what the chip can keep up with, same as the emulator.
+        if (adapter_hz > MaxBusHz)
+        {
+            fmt::print(stderr, "Warning: {} Hz is past the ADS1115's {} Hz, expect NACKs. Budgeting at {} Hz\n", adapter_hz, MaxBusHz, MaxBusHz);
+        }
+        bus_hz = std::min(adapter_hz, MaxBusHz);
+        bHsMasterCode = false;
+
+        if (BusModeAt(bus_hz) == BusMode::High && Config::I2cHsSoftwareMasterCode)
+        {
+            unsigned long funcs = 0;
+            if (dev && dev->handle >= 0 && ioctl(dev->handle, I2C_FUNCS, &funcs) >= 0 && (funcs & I2C_FUNC_PROTOCOL_MANGLING) != 0)
+            {
+                bHsMasterCode = true;
+            }
+            else
+            {
+                fmt::print(stderr, "Warning: /dev/i2c-{} can't send the HS master code for us (no protocol mangling)\n", bus_num);
+            }
+        }
+
+        if (BusModeAt(bus_hz) == BusMode::High)
+        {
+            fmt::print("Hardware Init: I2C high speed mode, master code 0x{:02x} {}\n", Config::I2cHsMasterCode, bHsMasterCode ? "sent ahead of every transfer" : "left to the controller");
+        }
+        return bus_hz;
+    }
+
+    void ADS1115::Fail(int err) const
+    {
+        switch (err)
+        {
+            case ENXIO:
+            case EREMOTEIO: last_fault = I2cFault::Nack; break;
+            case ETIMEDOUT:
+            case EAGAIN: last_fault = I2cFault::BusTimeout; break;
+            default: last_fault = I2cFault::Io; break;
+        }
+    }
+
+    bool ADS1115::AttachBusRecovery(const char* gpio_chip, int scl_gpio, int sda_gpio, const char* adapter_driver, const char* adapter_device)
+    {
+        if (adapter_device == nullptr || adapter_device[0] == '\0' || scl_gpio < 0 || sda_gpio < 0) {return false;}
+
+        bus_pins = BusPins{gpio_chip, static_cast<unsigned int>(scl_gpio), static_cast<unsigned int>(sda_gpio), adapter_driver, adapter_device};
+        fmt::print("Hardware Init: I2C bus recovery on gpio {} (SCL) / {} (SDA) through {}\n", scl_gpio, sda_gpio, adapter_device);
+        return true;
+    }
+
+    bool ADS1115::Reopen() const
+    {
+        if (!dev) {return false;}
+
+        if (dev->handle >= 0)
+        {
+            i2c_device::close(dev->handle);
+            dev->handle = -1;
+        }
+        return dev->open_i2c_device(bus_num, bus_addr) >= 0;
+    }
+
+    bool ADS1115::RecoverBus() const
+    {
+        if (!bus_pins) {return Reopen();}
+
+        // i2c-dev drops the adapter under us on unbind, the fd is no good after it anyway.
+        if (dev && dev->handle >= 0)
+        {
+            i2c_device::close(dev->handle);
+            dev->handle = -1;
+        }
+
+        auto write_sysfs = [](const std::string& path, const std::string& value)
+        {
+            std::ofstream file(path);
+            file << value;
+            file.flush();
+            return static_cast<bool>(file);
+        };
+
+        // Unbound, the pins are plain GPIOs. Binding again probes the adapter, which puts them back on the I2C function.
+        if (!write_sysfs(bus_pins->adapter_driver + "/unbind", bus_pins->adapter_device))
+        {
+            fmt::print(stderr, "Error: Unable to unbind {} for bus recovery\n", bus_pins->adapter_device);
+            return Reopen();
+        }
+
+        const bool bFreed = ClockOutI2cBus(bus_pins->gpio_chip.c_str(), bus_pins->scl, bus_pins->sda);
+        if (!bFreed) {fmt::print(stderr, "Warning: SDA still held low after clocking the I2C bus\n");}
+
+        if (!write_sysfs(bus_pins->adapter_driver + "/bind", bus_pins->adapter_device))
+        {
+            fmt::print(stderr, "Error: Unable to bind {} again, I2C is down until it is\n", bus_pins->adapter_device);
+            return false;
+        }
+
+        // /dev/i2c-N comes back once the adapter has probed.
+        const std::string node = fmt::format("/dev/i2c-{}", bus_num);
+        for (int tries = 0; tries < 100 && access(node.c_str(), R_OK | W_OK) != 0; ++tries)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return Reopen();
+    }
+
     bool ADS1115::ReadSingleShot(
         i2c_device::SlaveAddress s_address,
         Mux mux,
@@ -1,9 +1,10 @@
 #pragma once
+#include <algorithm>
+#include <chrono>
 #include <memory>
-extern "C" 
-{
-    #include <i2c/smbus.h> // option if you want smbus for reading bytes I warn against SMBUS. Pretty sure its not supported with ADS1115
-}
+#include <optional>
+#include <string>
+#include <vector>
 
 #include <cstdint>
 #include <cstdio>
@@ -18,9 +19,40 @@ extern "C"
 #include <sys/ioctl.h>			
 #include <linux/i2c-dev.h>		
 #include <linux/i2c.h>
+#include "clock.h"
+#include "i2c_recovery.h"
+#include "sampler.h"
 
 namespace DrunkAPI {
 
+    class GpioEdgeLine; // gpio_bank.h, kept out of here so host builds don't need libgpiod
+
+    // Bus time of one kind of transaction as the caller sees it, ioctl in to ioctl out (driver overhead included).
+    struct I2cTransactionTiming
+    {
+        std::uint64_t count = 0;
+        std::uint64_t total_us = 0;
+        std::uint64_t min_us = UINT64_MAX;
+        std::uint64_t max_us = 0;
+
+        void Add(std::uint64_t us)
+        {
+            ++count;
+            total_us += us;
+            min_us = std::min(min_us, us);
+            max_us = std::max(max_us, us);
+        }
+
+        double MeanUs() const { return count > 0 ? static_cast<double>(total_us) / static_cast<double>(count) : 0.0; }
+    };
+
+    // Good transactions only, a NACK comes back early and would flatter the numbers. Sampler thread.
+    struct I2cBusTiming
+    {
+        I2cTransactionTiming writes; // Register writes (config, thresholds)
+        I2cTransactionTiming reads; // Register reads (OS polls, conversions)
+    };
+
     class ADS1115 final
     {
         public:
@@ -114,6 +146,7 @@ namespace DrunkAPI {
             };
 
             ADS1115() = default;
+            ~ADS1115();
 
             // Build a config word 
             static constexpr uint16_t MakeConfig(
@@ -146,6 +179,12 @@ namespace DrunkAPI {
             }
 
             bool Init(int dev_num, i2c_device::SlaveAddress dev_adr);
+            // AINn against GND, n = 0..3
+            static constexpr Mux SingleEndedMux(std::uint8_t channel)
+            {
+                return static_cast<Mux>(static_cast<uint16_t>(Mux::AIN0_GND) + (static_cast<uint16_t>(channel & 0x3U) << 12));
+            }
+
             bool ReadSingleShot(i2c_device::SlaveAddress s_address,Mux mux,Pga pga, DataRate daterate, uint16_t& out_raw) const;
     
             static double Convert_Volts_FS4_096(uint16_t raw_u16)
@@ -166,16 +205,478 @@ namespace DrunkAPI {
                 return Rate_lookup[idx];
             }
 
+            // Slowest data rate that keeps up with sps_hz, SPS_860 past that.
+            static constexpr DataRate DataRateAtLeast(std::uint32_t sps_hz)
+            {
+                constexpr std::uint8_t Rates = 8;
+                for (std::uint8_t idx = 0; idx < Rates; ++idx)
+                {
+                    const auto datarate = static_cast<DataRate>(idx << 5);
+                    if (static_cast<std::uint32_t>(Get_SpsRate(datarate)) >= sps_hz) {return datarate;}
+                }
+                return DataRate::SPS_860;
+            }
+
             static constexpr int ConversionTimeMs(ADS1115::DataRate datarate)
             {
                 const int sps_rate = Get_SpsRate(datarate);
                 return (1000 + sps_rate - 1) / sps_rate; // Ceil tricks: by subtracting -1 we can avoid rounding when dividing by just 1000
             }
 
+            // Nominal, the chip's oscillator is only good to +-10% (ConversionTimer learns the real one).
+            static constexpr std::uint64_t ConversionTimeUs(ADS1115::DataRate datarate)
+            {
+                const auto sps_rate = static_cast<std::uint64_t>(Get_SpsRate(datarate));
+                return (1'000'000 + sps_rate - 1) / sps_rate;
+            }
+
+            // Speed classes the chip takes. High speed is entered with the HS master code (0000 1xxx at <= 400kHz,
+            // nobody ACKs it) and left at the next STOP, so every transaction pays for the preamble.
+            enum struct BusMode : uint8_t { Standard, Fast, High };
+            static constexpr std::uint32_t MaxBusHz = 3'400'000;
+
+            static constexpr BusMode BusModeAt(std::uint32_t i2c_hz)
+            {
+                if (i2c_hz > 400'000) {return BusMode::High;}
+                return i2c_hz > 100'000 ? BusMode::Fast : BusMode::Standard;
+            }
+
+            static constexpr const char* BusModeName(BusMode mode)
+            {
+                switch (mode)
+                {
+                    case BusMode::Standard: return "standard";
+                    case BusMode::Fast: return "fast";
+                    case BusMode::High: return "high speed";
+                }
+                return "?";
+            }
+
+            enum struct Transaction : uint8_t { WriteWord, ReadWord };
+
+            // Wire time of one transaction, START / Sr / STOP a bit time each and 9 per byte with the ACK.
+            // Write: S addr reg msb lsb P. Read: S addr reg Sr addr msb lsb P. Plus the master code in high speed mode.
+            static constexpr double TransactionUs(Transaction kind, std::uint32_t i2c_hz)
+            {
+                constexpr double ByteBits = 9.0;
+                const double bits = kind == Transaction::WriteWord ? 1.0 + (4.0 * ByteBits) + 1.0 : 1.0 + (2.0 * ByteBits) + 1.0 + (3.0 * ByteBits) + 1.0;
+                double wire_us = bits * 1e6 / static_cast<double>(i2c_hz);
+                if (BusModeAt(i2c_hz) == BusMode::High) {wire_us += (1.0 + ByteBits) * 1e6 / 400'000.0;}
+                return wire_us;
+            }
+
+            // A whole single shot on the bus: the conversion plus the config write, an OS poll and the result read.
+            static constexpr std::uint64_t ReadTimeUs(ADS1115::DataRate datarate, std::uint32_t i2c_hz)
+            {
+                const double bus_us = TransactionUs(Transaction::WriteWord, i2c_hz) + (2.0 * TransactionUs(Transaction::ReadWord, i2c_hz));
+                const auto whole_us = static_cast<std::uint64_t>(bus_us);
+                return ConversionTimeUs(datarate) + whole_us + (static_cast<double>(whole_us) < bus_us ? 1 : 0);
+            }
+
             bool i2c_write_word(i2c_device::SlaveAddress s_address, uint8_t reg, uint16_t value) const;
             bool i2c_read_word(i2c_device::SlaveAddress s_address, uint8_t reg, uint16_t& out_conversion) const;
+
+            // ALERT/RDY wired to a GPIO: conversions are then stamped with the kernel's timestamp of the falling edge.
+            // Boards sharing a bus can share the line too (it's open drain), a bus only runs one conversion at a time.
+            bool AttachReadyLine(const char* gpio_chip, unsigned int offset);
+            void DetachReadyLine();
+            bool HasReadyLine() const noexcept { return ready_line != nullptr; }
+            void DrainReadyEdges() const;
+            bool WaitReadyEdge(std::chrono::microseconds timeout, std::uint64_t& out_t_us) const;
            
+            // Fault recovery (i2c_recovery.h), sampler thread. Reopen closes and reopens /dev/i2c-N. RecoverBus also
+            // clocks SCL until a stuck slave lets go of SDA, once AttachBusRecovery has the pins (reopen only without).
+            bool AttachBusRecovery(const char* gpio_chip, int scl_gpio, int sda_gpio, const char* adapter_driver, const char* adapter_device);
+            bool Reopen() const;
+            bool RecoverBus() const;
+            I2cFault LastFault() const noexcept { return last_fault; }
+            I2cRecovery& Recovery() const noexcept { return recovery; }
+
+            // Settles the speed with the adapter after Init: its clock-frequency from the device tree (asked for
+            // wanted_hz if it doesn't say), capped at what the chip takes. In high speed mode the master code goes
+            // ahead of every transaction from here on when Config::I2cHsSoftwareMasterCode asks for it.
+            // BusSelfTest checks the result.
+            std::uint32_t NegotiateBusSpeed(std::uint32_t wanted_hz);
+            std::uint32_t BusHz() const noexcept { return bus_hz; }
+            const I2cBusTiming& Timing() const noexcept { return timing; }
+
             std::unique_ptr<i2c_device> dev = nullptr;
+
+        private:
+            struct BusPins
+            {
+                std::string gpio_chip;
+                unsigned int scl = 0;
+                unsigned int sda = 0;
+                std::string adapter_driver; // sysfs driver dir, bind / unbind live in it
+                std::string adapter_device;
+            };
+
+            void Fail(int err) const;
+            bool Transfer(i2c_msg* msgs, std::size_t n) const; // I2C_RDWR, master code first when it's ours to send
+
+            std::unique_ptr<GpioEdgeLine> ready_line;
+            int bus_num = 1;
+            i2c_device::SlaveAddress bus_addr = i2c_device::SlaveAddress::ADDR_GND;
+            std::optional<BusPins> bus_pins;
+            mutable I2cRecovery recovery;
+            mutable I2cFault last_fault = I2cFault::Io; // Of the last failed transaction
+            std::uint32_t bus_hz = Config::I2cBusHz;
+            bool bHsMasterCode = false;
+            mutable I2cBusTiming timing;
+    };
+
+    // One conversion's timeline, all steady clock us.
+    struct ConversionStamp
+    {
+        std::uint64_t start_us = 0; // Config write (OS=1) returned, the conversion is running
+        std::uint64_t done_us = 0; // Conversion complete, what the sample is stamped with
+        std::uint64_t read_us = 0; // Conversion register read back, where the sample used to be stamped
+        std::uint32_t uncertainty_us = 0; // +- on done_us when it's an estimate, 0 for an edge
+        bool bEdge = false; // done_us is the ALERT/RDY edge
+        bool bEdgeMissed = false; // Line attached but no edge in time, fell back to the estimate
+        bool bTimedOut = false; // OS never came back set, the read failed on that rather than the bus
+    };
+
+    // Learns how long this chip's conversions actually take from the OS bit polls. Every conversion brackets it: still
+    // busy at the start of the last poll that said so, done by the end of the first one that didn't. The intersection
+    // of the brackets is the duration. It's relaxed by 1us per conversion so temperature drift can't wedge it, and a
+    // bracket that doesn't overlap starts it over.
+    class ConversionTimer
+    {
+        public:
+            // busy_us/done_us relative to ConversionStamp::start_us, poll_us = how long one OS poll takes on this bus
+            void Observe(std::uint64_t busy_us, std::uint64_t done_us, std::uint64_t poll_us)
+            {
+                last_poll_us = poll_us;
+                if (!bLearned || busy_us > hi_us + 1 || done_us + 1 < lo_us)
+                {
+                    lo_us = busy_us;
+                    hi_us = std::max(busy_us, done_us);
+                    bLearned = true;
+                    return;
+                }
+                lo_us = std::max(lo_us > 0 ? lo_us - 1 : 0, busy_us);
+                hi_us = std::max(lo_us, std::min(hi_us + 1, done_us));
+            }
+
+            void Reset() { bLearned = false; }
+
+            std::uint64_t DurationUs(std::uint64_t nominal_us) const { return bLearned ? (lo_us + hi_us) / 2 : nominal_us; }
+            std::uint32_t UncertaintyUs(std::uint64_t nominal_us) const { return static_cast<std::uint32_t>(bLearned ? (hi_us - lo_us + 1) / 2 : nominal_us / 10); }
+
+            // Where the first poll goes: one poll short of the fastest this chip has been, or -15% of nominal.
+            std::uint64_t FirstPollUs(std::uint64_t nominal_us) const
+            {
+                if (!bLearned) {return nominal_us * 85 / 100;}
+                return lo_us > last_poll_us ? lo_us - last_poll_us : 0;
+            }
+
+        private:
+            bool bLearned = false;
+            std::uint64_t lo_us = 0;
+            std::uint64_t hi_us = 0;
+            std::uint64_t last_poll_us = 0;
+    };
+
+    // Comparator thresholds for conversion ready mode: Hi_thresh MSB 1, Lo_thresh MSB 0. ALERT/RDY then pulls low at
+    // the end of every conversion started with COMP_QUE != Disable. Device is ADS1115 or Ads1115Emu.
+    // They're lost on a power cycle, so the device's recovery writes them again after an outage.
+    template<class Device>
+    bool EnableConversionReady(const Device& dev, ADS1115::i2c_device::SlaveAddress s_address)
+    {
+        if constexpr (requires { dev.Recovery(); })
+        {
+            dev.Recovery().Remember(static_cast<std::uint8_t>(s_address), static_cast<uint8_t>(ADS1115::Reg::HiThresh), 0x8000U);
+            dev.Recovery().Remember(static_cast<std::uint8_t>(s_address), static_cast<uint8_t>(ADS1115::Reg::LoThresh), 0x0000U);
+        }
+        return dev.i2c_write_word(s_address, static_cast<uint8_t>(ADS1115::Reg::HiThresh), 0x8000U)
+            && dev.i2c_write_word(s_address, static_cast<uint8_t>(ADS1115::Reg::LoThresh), 0x0000U);
+    }
+
+    // What BusSelfTest found. Times are medians, ioctl in to ioctl out.
+    struct I2cBusCheck
+    {
+        std::uint32_t bus_hz = 0;
+        bool bEcho = false; // The config register read back what was written, every round
+        bool bSpeed = false; // Reads beat what the wire alone takes one mode down
+        double write_us = 0.0;
+        double read_us = 0.0;
+    };
+
+    // Proves the negotiated speed. A config word the chip never comes up with (AIN3, 0.256V, 8 SPS, OS clear so
+    // nothing starts) is written and read back, then the power on config goes back in. An adapter that isn't really
+    // at bus_hz, or a chip that never saw the master code, shows up as a NACK, a bad echo or reads too slow for it.
+    template<class Device>
+    I2cBusCheck BusSelfTest(const Device& dev, ADS1115::i2c_device::SlaveAddress s_address, std::uint32_t bus_hz, std::size_t rounds = 16)
+    {
+        constexpr uint16_t OSMASK = 0x8000U;
+        constexpr uint16_t Pattern = ADS1115::MakeConfig(ADS1115::Mux::AIN3_GND, ADS1115::Pga::FS_0_256V, ADS1115::Mode::SingleShot, ADS1115::DataRate::SPS_8);
+        constexpr uint16_t PowerOnConfig = 0x0583U; // Datasheet reset value with OS clear
+        const auto config_reg = static_cast<uint8_t>(ADS1115::Reg::Config);
+        auto now_us = []{ return static_cast<std::uint64_t>(SteadyClock::now().count()); };
+
+        I2cBusCheck check{};
+        check.bus_hz = bus_hz;
+        check.bEcho = true;
+        std::vector<std::uint64_t> writes_us;
+        std::vector<std::uint64_t> reads_us;
+
+        for (std::size_t round = 0; round < rounds && check.bEcho; ++round)
+        {
+            uint16_t echo = 0;
+            const std::uint64_t start_us = now_us();
+            const bool bWrote = dev.i2c_write_word(s_address, config_reg, Pattern);
+            const std::uint64_t wrote_us = now_us();
+            const bool bRead = bWrote && dev.i2c_read_word(s_address, config_reg, echo);
+            const std::uint64_t read_us = now_us();
+
+            check.bEcho = bRead && (echo & ~OSMASK) == Pattern;
+            writes_us.push_back(wrote_us - start_us);
+            reads_us.push_back(read_us - wrote_us);
+        }
+        dev.i2c_write_word(s_address, config_reg, PowerOnConfig);
+        if (!check.bEcho) {return check;}
+
+        auto median = [](std::vector<std::uint64_t>& values)
+        {
+            const auto mid = values.begin() + static_cast<std::ptrdiff_t>(values.size() / 2);
+            std::nth_element(values.begin(), mid, values.end());
+            return static_cast<double>(*mid);
+        };
+        check.write_us = median(writes_us);
+        check.read_us = median(reads_us);
+
+        // Standard mode has nothing slower to be mistaken for.
+        const ADS1115::BusMode mode = ADS1115::BusModeAt(bus_hz);
+        const std::uint32_t slower_hz = mode == ADS1115::BusMode::High ? 400'000U : (mode == ADS1115::BusMode::Fast ? 100'000U : 0U);
+        check.bSpeed = slower_hz == 0 || check.read_us < ADS1115::TransactionUs(ADS1115::Transaction::ReadWord, slower_hz);
+        return check;
+    }
+
+    // Backend Init, before the first read (the self test leaves the config register at its reset value): settle the
+    // speed, prove it and say so. False when the self test failed, the reads still go ahead but BusHz() can't be
+    // trusted to budget the bus with. A slower bus than asked for is fine, the budgets (flow reads per tick,
+    // max_rate_hz) are worked out from BusHz() after this.
+    template<class Device>
+    bool VerifyI2cBus(Device& dev, ADS1115::i2c_device::SlaveAddress s_address, std::uint32_t wanted_hz)
+    {
+        const std::uint32_t bus_hz = dev.NegotiateBusSpeed(wanted_hz);
+        const char* mode = ADS1115::BusModeName(ADS1115::BusModeAt(bus_hz));
+        const I2cBusCheck check = BusSelfTest(dev, s_address, bus_hz);
+        if (!check.bEcho)
+        {
+            fmt::print(stderr, "Warning: I2C self test, 0x{:02x} didn't read its config back in {} mode at {} Hz\n", static_cast<int>(s_address), mode, bus_hz);
+            return false;
+        }
+
+        fmt::print("Hardware Init: I2C {} mode at {} Hz, register write {:.0f}us / read {:.0f}us (wire {:.0f}us / {:.0f}us)\n", mode, bus_hz,
+            check.write_us, check.read_us, ADS1115::TransactionUs(ADS1115::Transaction::WriteWord, bus_hz), ADS1115::TransactionUs(ADS1115::Transaction::ReadWord, bus_hz));
+        if (!check.bSpeed)
+        {
+            fmt::print(stderr, "Warning: I2C reads take {:.0f}us, no faster than one mode down, the bus isn't really at {} Hz\n", check.read_us, bus_hz);
+        }
+        if (bus_hz < wanted_hz)
+        {
+            fmt::print(stderr, "Warning: I2C at {} Hz rather than {}, fewer reads fit in a sample period\n", bus_hz, wanted_hz);
+        }
+        return check.bSpeed;
+    }
+
+    // ReadSingleShot that also says when the conversion finished. The readout lands a bus transaction plus however
+    // long we were scheduled out after the conversion, so stamping after the read smears window edges and slopes.
+    // With the RDY line attached it's the edge's kernel timestamp, otherwise the config write + the ConversionTimer's
+    // learned duration.
+    template<class Device>
+    bool ReadConversionStamped(
+        const Device& dev,
+        ADS1115::i2c_device::SlaveAddress s_address,
+        ADS1115::Mux mux,
+        ADS1115::Pga pga,
+        ADS1115::DataRate daterate,
+        uint16_t& out_raw,
+        ConversionTimer& timer,
+        ConversionStamp& stamp)
+    {
+        constexpr uint16_t OSMASK = 0x8000U;
+        auto now_us = []{ return static_cast<std::uint64_t>(SteadyClock::now().count()); };
+
+        const bool bEdge = dev.HasReadyLine();
+        const uint16_t config = ADS1115::StartSingleConversion(ADS1115::MakeConfig(mux, pga, ADS1115::Mode::SingleShot, daterate,
+            bEdge ? ADS1115::CompQueue::Assert1 : ADS1115::CompQueue::Disable));
+
+        // An edge left over from a conversion we gave up on would stamp this one.
+        if (bEdge) {dev.DrainReadyEdges();}
+        stamp = ConversionStamp{};
+        if (!dev.i2c_write_word(s_address, static_cast<uint8_t>(ADS1115::Reg::Config), config)) {return false;}
+
+        stamp.start_us = now_us();
+        const std::uint64_t nominal_us = ADS1115::ConversionTimeUs(daterate);
+        const std::uint64_t timeout_us = nominal_us + nominal_us / 5 + 5'000; // Slow oscillator + scheduling margin
+
+        if (bEdge)
+        {
+            std::uint64_t edge_us = 0;
+            if (dev.WaitReadyEdge(std::chrono::microseconds(timeout_us), edge_us) && edge_us >= stamp.start_us)
+            {
+                stamp.done_us = edge_us;
+                stamp.bEdge = true;
+                timer.Observe(edge_us - stamp.start_us, edge_us - stamp.start_us, 0); // Keeps the fallback warm
+            }
+            else
+            {
+                stamp.bEdgeMissed = true;
+            }
+        }
+
+        if (!stamp.bEdge)
+        {
+            // Sleep through most of the conversion, then poll back to back so the finish is bracketed by one poll.
+            const std::uint64_t first_poll_us = stamp.start_us + timer.FirstPollUs(nominal_us);
+            const std::uint64_t woke_us = now_us();
+            if (first_poll_us > woke_us) {SteadyClock::sleep_for(std::chrono::microseconds(first_poll_us - woke_us));}
+
+            std::uint64_t busy_us = 0;
+            while (true)
+            {
+                const std::uint64_t poll_start_us = now_us();
+                uint16_t read_cfg = 0;
+                if (!dev.i2c_read_word(s_address, static_cast<uint8_t>(ADS1115::Reg::Config), read_cfg)) {return false;}
+                const std::uint64_t poll_end_us = now_us();
+
+                if ((read_cfg & OSMASK) != 0U)
+                {
+                    timer.Observe(busy_us, poll_end_us - stamp.start_us, poll_end_us - poll_start_us);
+                    break;
+                }
+
+                busy_us = poll_start_us - stamp.start_us;
+                if (poll_end_us - stamp.start_us >= timeout_us)
+                {
+                    stamp.bTimedOut = true;
+                    return false;
+                }
+            }
+
+            stamp.done_us = stamp.start_us + timer.DurationUs(nominal_us);
+            stamp.uncertainty_us = timer.UncertaintyUs(nominal_us);
+        }
+
+        if (!dev.i2c_read_word(s_address, static_cast<uint8_t>(ADS1115::Reg::Conversion), out_raw)) {return false;}
+        stamp.read_us = now_us();
+        return true;
+    }
+
+    // Sampler source for an ADS1115, Device is ADS1115 on the Pi or Ads1115Emu (ads1115_emu.h) in host mode.
+    template<class Device = ADS1115>
+    struct Ads1115_Source
+    {
+        Device& ads;
+
+        ADS1115::i2c_device::SlaveAddress addr;
+        ADS1115::Mux mux;
+        ADS1115::Pga pga;
+        ADS1115::DataRate rate;
+
+        Ads1115_Source(Device& ads_in,
+                    ADS1115::i2c_device::SlaveAddress addr_in,
+                    ADS1115::Mux mux_in,
+                    ADS1115::Pga pga_in,
+                    ADS1115::DataRate rate_in): ads(ads_in), addr(addr_in), mux(mux_in), pga(pga_in), rate(rate_in){}
+
+        bool sample_value(Sample& out) const
+        {
+            uint16_t out_val = 0;
+            if(!ReadRecovering(out_val)) {return false;}
+
+            out.raw = static_cast<int16_t>(out_val);
+            out.volts = static_cast<float>(ADS1115::Convert_Volts_FS4_096(out_val));
+
+            // Monotonic timestamp of when the conversion finished, not when we got round to reading it
+            out.t_us = last.done_us;
+
+            return true;
+        }
+
+        // Sampler thread only, between reads. The learned conversion time was for the old rate.
+        void set_rate_hz(std::uint32_t hz)
+        {
+            const ADS1115::DataRate next = ADS1115::DataRateAtLeast(hz);
+            if (next == rate) {return;}
+            rate = next;
+            timer.Reset();
+        }
+
+        // Back to back single shots at 860 SPS, what a rate request gets capped to. At the speed the bus was actually
+        // negotiated at (VerifyI2cBus in Init), a 100kHz bus fits a lot fewer of them than the configured one.
+        std::uint32_t max_rate_hz() const
+        {
+            std::uint32_t bus_hz = Config::I2cBusHz;
+            if constexpr (requires { ads.BusHz(); }) {bus_hz = ads.BusHz();}
+            return static_cast<std::uint32_t>(1'000'000 / ADS1115::ReadTimeUs(ADS1115::DataRate::SPS_860, bus_hz));
+        }
+
+        // Last read's timeline, sampler thread only (drunk_adc_timing reads it between samples).
+        const ConversionStamp& LastStamp() const noexcept { return last; }
+
+        private:
+            // ReadConversionStamped with the device's fault recovery around it (i2c_recovery.h). The recovery is per
+            // device, so every source on a bus counts towards the same outage.
+            bool ReadRecovering(uint16_t& out_val) const
+            {
+                if constexpr (requires { ads.Recovery(); ads.LastFault(); ads.Reopen(); ads.RecoverBus(); })
+                {
+                    I2cRecovery& recovery = ads.Recovery();
+                    for (std::uint8_t attempt = 0;; ++attempt)
+                    {
+                        if (ReadConversionStamped(ads, addr, mux, pga, rate, out_val, timer, last))
+                        {
+                            if (const auto outage = recovery.OnRead(last.read_us, attempt > 0)) {EndOutage(recovery, *outage);}
+                            return true;
+                        }
+
+                        const I2cFault fault = last.bTimedOut ? I2cFault::ConversionTimeout : ads.LastFault();
+                        if (recovery.OnFault(fault, attempt) != I2cAction::Retry) {break;}
+                    }
+
+                    const I2cAction action = recovery.OnReadFailed(static_cast<std::uint64_t>(SteadyClock::now().count()));
+                    if (action == I2cAction::Reopen || action == I2cAction::RecoverBus)
+                    {
+                        fmt::print(stderr, "Warning: I2C 0x{:02x} not answering ({}), {}\n", static_cast<int>(addr), I2cFaultName(ads.LastFault()),
+                            action == I2cAction::Reopen ? "reopening the bus" : "clocking the bus free");
+                        recovery.OnRecovery(action, action == I2cAction::Reopen ? ads.Reopen() : ads.RecoverBus());
+                        timer.Reset(); // Could be a different chip (or the same one after a power cycle) when it's back
+                    }
+                    return false;
+                }
+                else
+                {
+                    return ReadConversionStamped(ads, addr, mux, pga, rate, out_val, timer, last);
+                }
+            }
+
+            // The chip may have lost power in there, its persistent registers go back in before the next read.
+            void EndOutage(I2cRecovery& recovery, const I2cOutage& outage) const
+            {
+                for (const auto& write : recovery.Programmed())
+                {
+                    ads.i2c_write_word(static_cast<ADS1115::i2c_device::SlaveAddress>(write.addr), write.reg, write.value);
+                }
+                if (!recovery.Programmed().empty()) {recovery.OnReprogram();}
+
+                const I2cHealth health = recovery.Health(last.read_us);
+                if (outage.actions > 0 || !health.bSloMet)
+                {
+                    fmt::print(stderr, "Warning: I2C 0x{:02x} back after {:.2f}s ({} failed reads), bus availability {:.3f}% over {:.0f}s ({})\n",
+                        static_cast<int>(addr), static_cast<double>(outage.duration_us) / 1e6, outage.failed_reads,
+                        health.availability * 100.0, static_cast<double>(health.session_us) / 1e6,
+                        health.bSloJudged ? fmt::format("SLO {:.3f}%", recovery.GetConfig().availability_slo * 100.0) : std::string{"too early for the SLO"});
+                }
+            }
+
+            mutable ConversionTimer timer; // Per channel, the sampler thread is the only caller
+            mutable ConversionStamp last{};
+
     };
 
 }
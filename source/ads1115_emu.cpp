@@ -0,0 +1,247 @@
+#include "ads1115_emu.h"
+#include "clock.h"
+#include <algorithm>
+#include <cmath>
+#include <fmt/core.h>
+#include <thread>
+#include <utility>
+
+namespace DrunkAPI
+{
+    namespace
+    {
+        constexpr uint16_t PgaMask = 0b111U << 9;
+        constexpr uint16_t MuxMask = 0b111U << 12;
+        constexpr uint16_t RateMask = 0b111U << 5;
+        constexpr uint16_t CompQueueMask = 0b11U;
+
+        double FullScaleVolts(uint16_t config)
+        {
+            constexpr double Lookup[8] = {6.144, 4.096, 2.048, 1.024, 0.512, 0.256, 0.256, 0.256};
+            return Lookup[(config & PgaMask) >> 9];
+        }
+    }
+
+    Ads1115Emu::Ads1115Emu(Ads1115Emu_Config in_cfg, Signal_Config signal, std::vector<BreathSpec> script, Signal_Config reference_signal)
+        : cfg(in_cfg), generator(signal, std::move(script)), reference_generator(reference_signal), flow_sensor(in_cfg.flow_zero_volts, in_cfg.flow_noise_volts) {}
+
+    bool Ads1115Emu::Init([[maybe_unused]] const int dev_num, ADS1115::i2c_device::SlaveAddress dev_adr)
+    {
+        if (dev_adr != cfg.addr)
+        {
+            fmt::print(stderr, "Error: No ADS1115 emulator at 0x{:02x}\n", static_cast<int>(dev_adr));
+            return false;
+        }
+
+        bInit = true;
+        recovery.StartSession(static_cast<std::uint64_t>(SteadyClock::now().count()));
+        std::puts("Hardware Init: Ads1115 Emulator Ready!");
+        return true;
+    }
+
+    double Ads1115Emu::SessionS() const
+    {
+        if (t0_us == 0) {return -1.0;}
+        return static_cast<double>(static_cast<std::uint64_t>(SteadyClock::now().count()) - t0_us) / 1'000'000.0;
+    }
+
+    bool Ads1115Emu::Unplugged() const
+    {
+        if (cfg.unplug_at_s < 0.0) {return false;}
+
+        const double t_s = SessionS();
+        return t_s >= cfg.unplug_at_s && t_s < cfg.unplug_at_s + cfg.unplug_for_s;
+    }
+
+    bool Ads1115Emu::Acked(ADS1115::i2c_device::SlaveAddress s_address) const
+    {
+        const double t_s = SessionS();
+        if (cfg.lose_fd_at_s >= 0.0 && !bFdLossDone && t_s >= cfg.lose_fd_at_s) {bFdLost = bFdLossDone = true;}
+        if (cfg.wedge_at_s >= 0.0 && !bWedgeDone && t_s >= cfg.wedge_at_s) {bWedged = bWedgeDone = true;}
+
+        // Back on the bus after being pulled = powered up again, registers at their reset values.
+        const bool bUnplugged = Unplugged();
+        if (bWasUnplugged && !bUnplugged)
+        {
+            config_reg = PowerOnConfig;
+            lo_thresh_reg = 0x8000U;
+            hi_thresh_reg = 0x7FFFU;
+            bRdyArmed = false;
+        }
+        bWasUnplugged = bUnplugged;
+
+        if (!bInit || bFdLost) {last_fault = I2cFault::Io;}
+        else if (bWedged) {last_fault = I2cFault::BusTimeout;}
+        else if (s_address != cfg.addr || bUnplugged) {last_fault = I2cFault::Nack;}
+        else {return true;}
+        return false;
+    }
+
+    bool Ads1115Emu::Reopen() const
+    {
+        if (!bInit) {return false;}
+        bFdLost = false;
+        return true;
+    }
+
+    bool Ads1115Emu::RecoverBus() const
+    {
+        // The slave finishes its byte on the clocks and lets go of SDA, the STOP resets it.
+        bWedged = false;
+        return Reopen();
+    }
+
+    bool Ads1115Emu::StartConversion(uint16_t config) const
+    {
+        const auto now = SteadyClock::now();
+        const auto now_us = static_cast<std::uint64_t>(now.count());
+        if (t0_us == 0) {t0_us = now_us;}
+
+        // The sensor sits on AIN0, the reference and the pressure sensor (if any) on their channels, the rest are grounded.
+        double volts = 0.0;
+        Sample sample{};
+        const uint16_t mux = config & MuxMask;
+        const bool bMain = mux == static_cast<uint16_t>(ADS1115::Mux::AIN0_GND);
+        const bool bReference = !bMain && cfg.reference_channel >= 0
+            && mux == static_cast<uint16_t>(ADS1115::SingleEndedMux(static_cast<std::uint8_t>(cfg.reference_channel)));
+        const bool bSensor = bMain || bReference;
+        const bool bFlow = !bSensor && cfg.flow_channel >= 0
+            && mux == static_cast<uint16_t>(ADS1115::SingleEndedMux(static_cast<std::uint8_t>(cfg.flow_channel)));
+        if (bSensor)
+        {
+            // A dropped read in the model NACKs the config write, same as a flaky bus.
+            SignalGenerator& source = bMain ? generator : reference_generator;
+            if (!source.Step(source.GetConfig().start_us + (now_us - t0_us), sample)) {return false;}
+            volts = static_cast<double>(sample.volts);
+        }
+        else if (bFlow)
+        {
+            volts = flow_sensor.Volts(generator.Script(), static_cast<double>(now_us - t0_us) / 1'000'000.0);
+        }
+
+        // The model quantizes at FS 4.096V already, other ranges are requantized from its volts.
+        const bool bNativePga = (config & PgaMask) == static_cast<uint16_t>(ADS1115::Pga::FS_4_096V);
+        if (bSensor && bNativePga) {pending_reg = static_cast<uint16_t>(sample.raw);}
+        else {pending_reg = static_cast<uint16_t>(static_cast<int16_t>(std::clamp(std::lround(volts * 32768.0 / FullScaleVolts(config)), -32768L, 32767L)));}
+
+        const auto nominal_us = static_cast<double>(ADS1115::ConversionTimeUs(static_cast<ADS1115::DataRate>(config & RateMask)));
+        ready_at = cfg.bRealTime ? now + std::chrono::microseconds(std::llround(nominal_us * (1.0 + cfg.osc_error_pct / 100.0))) : now;
+
+        // Conversion ready mode: comparator on, Hi_thresh MSB set, Lo_thresh MSB clear.
+        bRdyArmed = (config & CompQueueMask) != CompQueueMask && (hi_thresh_reg & OsMask) != 0U && (lo_thresh_reg & OsMask) == 0U;
+        ++conversions;
+        return true;
+    }
+
+    std::uint32_t Ads1115Emu::NegotiateBusSpeed(std::uint32_t wanted_hz)
+    {
+        bus_hz = cfg.bus_hz != 0 ? cfg.bus_hz : std::min(wanted_hz, ADS1115::MaxBusHz);
+        if (bus_hz != wanted_hz) {fmt::print(stderr, "Warning: Emulated I2C adapter is clocked at {} Hz, not the {} asked for\n", bus_hz, wanted_hz);}
+        return bus_hz;
+    }
+
+    std::chrono::nanoseconds Ads1115Emu::TransactionTime(ADS1115::Transaction kind) const
+    {
+        const std::chrono::nanoseconds driver = cfg.bus_time;
+        if (cfg.bus_hz == 0) {return driver;}
+        return driver + std::chrono::nanoseconds(std::llround(ADS1115::TransactionUs(kind, cfg.bus_hz) * 1000.0));
+    }
+
+    void Ads1115Emu::BusTime(std::chrono::nanoseconds duration) const
+    {
+        if (!cfg.bRealTime || duration.count() <= 0) {return;}
+
+        // A high speed transaction is a few tens of us, less than the sleep's own wakeup slop. Sleep the bulk, spin the
+        // rest, so the benchmark sees the bus and not the scheduler.
+        constexpr std::chrono::microseconds SpinUs{100};
+        const auto until = std::chrono::steady_clock::now() + duration;
+        if (duration > SpinUs) {std::this_thread::sleep_for(duration - SpinUs);}
+        while (std::chrono::steady_clock::now() < until) {}
+    }
+
+    bool Ads1115Emu::WaitReadyEdge(std::chrono::microseconds timeout, std::uint64_t& out_t_us) const
+    {
+        const auto now = SteadyClock::now();
+        if (!cfg.bReadyPin || !bRdyArmed || ready_at > now + timeout || Unplugged())
+        {
+            SteadyClock::sleep_for(timeout);
+            return false;
+        }
+
+        // The edge is stamped when it happens, however late we wake up for it.
+        if (ready_at > now) {SteadyClock::sleep_for(ready_at - now);}
+        bRdyArmed = false;
+        out_t_us = static_cast<std::uint64_t>(ready_at.count());
+        return true;
+    }
+
+    bool Ads1115Emu::i2c_write_word(ADS1115::i2c_device::SlaveAddress s_address, uint8_t reg, uint16_t value) const
+    {
+        // The chip latches the write at the STOP, so the whole transaction goes by first.
+        const auto start_us = static_cast<std::uint64_t>(SteadyClock::now().count());
+        BusTime(TransactionTime(ADS1115::Transaction::WriteWord));
+        if (!Acked(s_address)) {return false;}
+
+        if (reg == static_cast<uint8_t>(ADS1115::Reg::LoThresh)) {lo_thresh_reg = value;}
+        if (reg == static_cast<uint8_t>(ADS1115::Reg::HiThresh)) {hi_thresh_reg = value;}
+        if (reg == static_cast<uint8_t>(ADS1115::Reg::Config))
+        {
+            if ((value & OsMask) != 0U && !StartConversion(value))
+            {
+                last_fault = I2cFault::Nack;
+                return false;
+            }
+            config_reg = static_cast<uint16_t>(value & ~OsMask);
+            if ((value & OsMask) == 0U) {config_reg |= OsMask;}
+        }
+        timing.writes.Add(static_cast<std::uint64_t>(SteadyClock::now().count()) - start_us);
+        return true;
+    }
+
+    bool Ads1115Emu::i2c_read_word(ADS1115::i2c_device::SlaveAddress s_address, uint8_t reg, uint16_t& out_conversion) const
+    {
+        // Pointer write first, the register is shifted out in the second half.
+        const auto start_us = static_cast<std::uint64_t>(SteadyClock::now().count());
+        const std::chrono::nanoseconds bus = TransactionTime(ADS1115::Transaction::ReadWord);
+        BusTime(bus / 2);
+        if (!Acked(s_address)) {return false;}
+
+        if ((config_reg & OsMask) == 0U && SteadyClock::now() >= ready_at)
+        {
+            conversion_reg = pending_reg;
+            config_reg |= OsMask;
+        }
+
+        switch (static_cast<ADS1115::Reg>(reg))
+        {
+            case ADS1115::Reg::Conversion: out_conversion = conversion_reg; break;
+            case ADS1115::Reg::Config: out_conversion = config_reg; break;
+            case ADS1115::Reg::LoThresh: out_conversion = lo_thresh_reg; break;
+            case ADS1115::Reg::HiThresh: out_conversion = hi_thresh_reg; break;
+            default: out_conversion = 0; break;
+        }
+
+        BusTime(bus - bus / 2);
+        timing.reads.Add(static_cast<std::uint64_t>(SteadyClock::now().count()) - start_us);
+        return true;
+    }
+
+    bool Ads1115Emu::ReadSingleShot(
+        ADS1115::i2c_device::SlaveAddress s_address,
+        ADS1115::Mux mux,
+        ADS1115::Pga pga,
+        ADS1115::DataRate daterate,
+        uint16_t& out_raw) const
+    {
+        // Same transaction as ADS1115::ReadSingleShot, minus the poll loop: we know when OS flips.
+        const uint16_t config = ADS1115::StartSingleConversion(ADS1115::MakeConfig(mux, pga, ADS1115::Mode::SingleShot, daterate, ADS1115::CompQueue::Disable));
+        if (!i2c_write_word(s_address, static_cast<uint8_t>(ADS1115::Reg::Config), config)) {return false;}
+
+        const auto now = SteadyClock::now();
+        if (ready_at > now) {SteadyClock::sleep_for(ready_at - now);}
+
+        uint16_t read_cfg = 0;
+        if (!i2c_read_word(s_address, static_cast<uint8_t>(ADS1115::Reg::Config), read_cfg) || (read_cfg & OsMask) == 0U) {return false;}
+        return i2c_read_word(s_address, static_cast<uint8_t>(ADS1115::Reg::Conversion), out_raw);
+    }
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "ads1115.h"
+#include "flow_gate.h"
+#include "signal_gen.h"
+
+// Register level stand in for the ADS1115 so the whole app runs off the Pi. Same calls as ADS1115, writing the
+// config register with OS set starts a single shot, OS reads back 0 until the conversion time for the data rate
+// has passed, then the conversion register holds the SignalGenerator's reading at the requested PGA (AIN0, plus an
+// optional reference sensor and a mouthpiece pressure sensor on other inputs). Timing can be
+// made chip like: a slow/fast oscillator, I2C transactions that take bus time, and an ALERT/RDY pin whose edge comes
+// stamped with the exact conversion end (what the kernel's edge timestamp gives on the Pi).
+namespace DrunkAPI
+{
+    struct Ads1115Emu_Config
+    {
+        ADS1115::i2c_device::SlaveAddress addr = ADS1115::i2c_device::SlaveAddress::ADDR_GND; // Anything else NACKs
+        bool bRealTime = true; // Wait out the conversion like the chip, off to run as fast as the host goes
+
+        // Pull the board off the bus for a while (session seconds), every transaction NACKs. -1 = never. It comes
+        // back from a power cycle, the thresholds are at their reset values until written again.
+        double unplug_at_s = -1.0;
+        double unplug_for_s = 0.0;
+
+        // Faults only the recovery gets out of (i2c_recovery.h), session seconds, -1 = never. A wedged bus (SDA held
+        // low) times every transaction out until RecoverBus, a lost fd fails them until Reopen.
+        double wedge_at_s = -1.0;
+        double lose_fd_at_s = -1.0;
+
+        bool bReadyPin = false; // ALERT/RDY wired, edges once the comparator is in conversion ready mode
+        double osc_error_pct = 0.0; // Conversions take nominal * (1 + this/100), the datasheet allows +-10
+        std::chrono::microseconds bus_time{0}; // Per transaction, ~300us for a register read at 100kHz
+
+        // Adapter clock. Set, a transaction takes its wire time at this speed (ADS1115::TransactionUs, the HS master
+        // code included) on top of bus_time, which is then the driver's share. 0 = bus_time is the whole thing.
+        std::uint32_t bus_hz = 0;
+
+        int reference_channel = -1; // AINn with a second (reference) sensor on it, fed by its own generator. -1 = grounded
+
+        // AINn with the mouthpiece pressure sensor, blowing along with the main sensor's script (BreathSpec::flow_lps)
+        int flow_channel = -1;
+        double flow_zero_volts = 2.52; // Sensor output at 0 Pa, 2.5V +- the part's offset
+        double flow_noise_volts = 0.003; // sigma, at the sensor
+    };
+
+    class Ads1115Emu final
+    {
+        public:
+            explicit Ads1115Emu(Ads1115Emu_Config in_cfg = {}, Signal_Config signal = {}, std::vector<BreathSpec> script = {}, Signal_Config reference_signal = {});
+
+            Ads1115Emu(const Ads1115Emu&) = delete;
+            Ads1115Emu& operator=(const Ads1115Emu&) = delete;
+            Ads1115Emu(Ads1115Emu&&) = delete;
+            Ads1115Emu& operator=(Ads1115Emu&&) = delete;
+
+            bool Init(int dev_num, ADS1115::i2c_device::SlaveAddress dev_adr);
+            bool ReadSingleShot(ADS1115::i2c_device::SlaveAddress s_address, ADS1115::Mux mux, ADS1115::Pga pga, ADS1115::DataRate daterate, uint16_t& out_raw) const;
+
+            bool i2c_write_word(ADS1115::i2c_device::SlaveAddress s_address, uint8_t reg, uint16_t value) const;
+            bool i2c_read_word(ADS1115::i2c_device::SlaveAddress s_address, uint8_t reg, uint16_t& out_conversion) const;
+
+            // Same recovery hooks as ADS1115, the "fd" and the bus wedge are emulated.
+            bool Reopen() const;
+            bool RecoverBus() const;
+            I2cFault LastFault() const noexcept { return last_fault; }
+            I2cRecovery& Recovery() const noexcept { return recovery; }
+
+            // Same as ADS1115's, the adapter runs at cfg.bus_hz (whatever's asked for when that's 0).
+            std::uint32_t NegotiateBusSpeed(std::uint32_t wanted_hz);
+            std::uint32_t BusHz() const noexcept { return bus_hz; }
+            const I2cBusTiming& Timing() const noexcept { return timing; }
+
+            bool HasReadyLine() const noexcept { return cfg.bReadyPin; }
+            void DrainReadyEdges() const {}
+            bool WaitReadyEdge(std::chrono::microseconds timeout, std::uint64_t& out_t_us) const;
+
+            std::uint64_t Conversions() const noexcept { return conversions; }
+            std::uint64_t LastConversionDoneUs() const noexcept { return static_cast<std::uint64_t>(ready_at.count()); } // Ground truth for drunk_adc_timing
+            const SignalGenerator& Generator() const noexcept { return generator; }
+
+        private:
+            static constexpr uint16_t OsMask = 0x8000U;
+            static constexpr uint16_t PowerOnConfig = 0x8583U; // Datasheet reset value
+
+            bool Acked(ADS1115::i2c_device::SlaveAddress s_address) const;
+            bool Unplugged() const;
+            double SessionS() const; // -1 before the first conversion
+            bool StartConversion(uint16_t config) const;
+            std::chrono::nanoseconds TransactionTime(ADS1115::Transaction kind) const;
+            void BusTime(std::chrono::nanoseconds duration) const;
+
+            Ads1115Emu_Config cfg;
+            bool bInit = false;
+            std::uint32_t bus_hz = Config::I2cBusHz;
+            mutable I2cBusTiming timing;
+
+            // Chip state, the real one is mutated through a const handle too.
+            mutable SignalGenerator generator;
+            mutable SignalGenerator reference_generator; // Never blown into, only sees the room
+            mutable FlowSensorModel flow_sensor;
+            mutable uint16_t config_reg = PowerOnConfig;
+            mutable uint16_t conversion_reg = 0;
+            mutable uint16_t pending_reg = 0;
+            mutable uint16_t lo_thresh_reg = 0x8000U;
+            mutable uint16_t hi_thresh_reg = 0x7FFFU;
+            mutable bool bRdyArmed = false; // Running conversion will pull ALERT/RDY
+            mutable std::chrono::microseconds ready_at{0}; // Conversion done, OS back to 1
+            mutable std::uint64_t t0_us = 0; // First conversion = session time 0
+            mutable std::uint64_t conversions = 0;
+
+            // Bus faults
+            mutable I2cRecovery recovery;
+            mutable I2cFault last_fault = I2cFault::Io;
+            mutable bool bWasUnplugged = false;
+            mutable bool bWedged = false;
+            mutable bool bWedgeDone = false;
+            mutable bool bFdLost = false;
+            mutable bool bFdLossDone = false;
+    };
+}
@@ -11,6 +11,7 @@
 namespace DrunkAPI
 {
     constexpr float us_to_sec = 1'000'000.0;
+    constexpr double noise_alpha = 0.1; // Adaptive window noise estimates, per quiet window
 
     void WelfordAnalyzer::reset()
     {
@@ -19,6 +20,31 @@ namespace DrunkAPI
         stable_window_count = 0;
         window_start_micro_sec = 0;
         window_end_micro_sec = 0;
+        window_len_us = cfg.window_micro;
+        prev_window_len_us = cfg.window_micro;
+        window_origin_us = 0;
+        windows_at_len = 0;
+        noise_var = std::numeric_limits<double>::quiet_NaN();
+        mean_var = std::numeric_limits<double>::quiet_NaN();
+        sample_hz = cfg.sample_rate_hz;
+        switch_floor_hz = cfg.sample_rate_hz;
+        rate_settled_us = 0;
+    }
+
+    void WelfordAnalyzer::SetSampleRate(double hz, uint64_t from_us)
+    {
+        if (hz <= 0.0 || hz == sample_hz) {return;}
+
+        // Back to back switches (a short blow) keep the slowest until the last one has settled.
+        const double floor_hz = from_us < rate_settled_us ? std::min(switch_floor_hz, sample_hz) : sample_hz;
+        switch_floor_hz = std::min(floor_hz, hz);
+        sample_hz = hz;
+        rate_settled_us = from_us + window_len_us;
+    }
+
+    double WelfordAnalyzer::WindowRateHz(uint64_t window_start_us) const noexcept
+    {
+        return window_start_us < rate_settled_us ? switch_floor_hz : sample_hz;
     }
 
     StepResult<WindowResult> WelfordAnalyzer::AnalyzeBatch(const Sample* Samples, size_t n, double(*get_value)(const Sample&))
@@ -51,16 +77,18 @@ namespace DrunkAPI
         if(window_start_micro_sec == 0){
             // fresh window
             window_start_micro_sec = t_micro.count;
+            window_origin_us = t_micro.count;
         }
 
         StepResult<WindowResult> out{};
 
         // If we have exceeded the window period then finalize.
-        while (t_micro.count - window_start_micro_sec >= cfg.window_micro) 
+        while (t_micro.count - window_start_micro_sec >= window_len_us) 
         {
             // Finalize
             out = FinalizeWindow();
-            window_start_micro_sec += cfg.window_micro; // Increment TimeStep
+            window_start_micro_sec += window_len_us; // Increment TimeStep
+            if (cfg.bAdaptiveWindow) {AdaptWindow(out.result, WfS);}
             WfS.reset();
         }
 
@@ -75,37 +103,51 @@ namespace DrunkAPI
     }
 
     StepResult<WindowResult> WelfordAnalyzer::FinalizeWindow()
+    {
+        return FinalizeStats(WfS, window_start_micro_sec);
+    }
+
+    StepResult<WindowResult> WelfordAnalyzer::FinalizeStats(const WelfordStats& stats, std::uint64_t window_start_us)
     {
         StepResult<WindowResult> window{};
 
-        window.result.window_start_us = window_start_micro_sec;
-        window.result.window_end_us = window_start_micro_sec + cfg.window_micro;
+        window.result.window_start_us = window_start_us;
+        window.result.window_end_us = window_start_us + window_len_us;
+
+        // Thresholds are per window_micro. A longer window is allowed more sample noise as long as its mean is as
+        // steady: stddev / sqrt(n) <= stddev_max / sqrt(n at window_micro). Both are no-ops at window_micro.
+        // min_window_sample_size is also per sample_rate_hz, a window at a quarter of the rate needs a quarter of it.
+        const double len_ratio = (double)window_len_us / (double)cfg.window_micro;
+        const double rate_ratio = WindowRateHz(window_start_us) / cfg.sample_rate_hz;
+        const double stddev_limit = cfg.stddev_max * std::sqrt(len_ratio);
+        const auto min_samples = static_cast<size_t>(std::llround((double)cfg.min_window_sample_size * len_ratio * rate_ratio));
 
-        size_t num_samples = WfS.num_samples;
+        size_t num_samples = stats.num_samples;
 
-        if (num_samples < cfg.min_window_sample_size) 
+        if (num_samples < min_samples) 
         {
             // There is Not enough data so don’t evaluate for stability
             stable_window_count = 0;
             window.result.stable = false;
-            window.result.mean = WfS.mean;
-            window.result.stddev = WfS.stddev_sample();
+            window.result.mean = stats.mean;
+            window.result.stddev = stats.stddev_sample();
             window.result.mean_prev = prev_window_mean;
             window.result.drift_per_sec = 0.0;
             return window;
         }
 
-        const double mean = WfS.mean;
-        const double standard_deviation = WfS.stddev_sample(); 
+        const double mean = stats.mean;
+        const double standard_deviation = stats.stddev_sample(); 
         double drift_per_sec = 0.0F;
 
         if(std::isfinite(prev_window_mean))
         {
-            const double dt_second = (double)cfg.window_micro / us_to_sec;
+            // Centre to centre, the same as the window length while they're all one length.
+            const double dt_second = ((double)(prev_window_len_us + window_len_us) / 2.0) / us_to_sec;
             drift_per_sec = std::abs(mean - prev_window_mean) / dt_second;
         }
 
-        const bool bWindowStable = (static_cast<int>(standard_deviation <= cfg.stddev_max) & static_cast<int>(!std::isfinite(prev_window_mean) || drift_per_sec <= cfg.drift_per_sec_max)) != 0;
+        const bool bWindowStable = (static_cast<int>(standard_deviation <= stddev_limit) & static_cast<int>(!std::isfinite(prev_window_mean) || drift_per_sec <= cfg.drift_per_sec_max)) != 0;
 
         if(bWindowStable)
         {
@@ -124,20 +166,84 @@ namespace DrunkAPI
         window.result.stable = (stable_window_count >= cfg.stable_consecutive_windows_req);
         
         // could expose a finalize window call back
-        fmt::print("DBG window [{}..{}] mean={:.6f} prev={:.6f} dt_s={:.3f} drift={:.6f}\n",
-        window.result.window_start_us,
-        window.result.window_end_us,
-        mean,
-        (std::isfinite(prev_window_mean) ? prev_window_mean : -1.0),
-        (double)cfg.window_micro / us_to_sec,
-        drift_per_sec);
+        if (cfg.bDebugPrint)
+        {
+            fmt::print("DBG window [{}..{}] mean={:.6f} prev={:.6f} dt_s={:.3f} drift={:.6f}\n",
+            window.result.window_start_us,
+            window.result.window_end_us,
+            mean,
+            (std::isfinite(prev_window_mean) ? prev_window_mean : -1.0),
+            (double)window_len_us / us_to_sec,
+            drift_per_sec);
+        }
 
         prev_window_mean = mean;
+        prev_window_len_us = window_len_us;
 
         return window;
 
     }
 
+    // Picks the next window's length from the noise, the shortest one where both stability tests have the noise at
+    // noise_target of their limit:
+    //   sample stddev vs stddev_max * sqrt(len / window_micro)
+    //   window to window mean jitter / len (what a flat signal reads as drift) vs drift_per_sec_max
+    // The jitter is measured, not derived from the stddev, 1/f noise doesn't average down like white noise does. It
+    // comes from second differences of the window means so a real slope (heater settling, baseline drift) isn't
+    // mistaken for jitter, longer windows wouldn't make that any flatter.
+    // Quiet sensors get short windows (faster warmup, cooldown and breath edges), noisy ones long enough that their
+    // windows still come out stable. One step per window, shrinking only with room to spare so it doesn't flap.
+    void WelfordAnalyzer::AdaptWindow(const WindowResult& window, const WelfordStats& stats)
+    {
+        // A breath or the heater settling isn't noise, only windows that aren't moving much update the estimates.
+        const bool bQuiet = !std::isfinite(window.mean_prev) || window.drift_per_sec <= 4.0 * cfg.drift_per_sec_max;
+        if (stats.num_samples < 2 || !bQuiet)
+        {
+            windows_at_len = 0; // Second differences only across quiet windows
+            return;
+        }
+
+        const double len_ratio = (double)window_len_us / (double)cfg.window_micro;
+        const double variance = stats.variance_sample();
+        noise_var = std::isfinite(noise_var) ? noise_var + (noise_alpha * (variance - noise_var)) : variance;
+
+        // Variance of one window's mean (m0 - 2 m1 + m2 has 6x it), scaled to what a window_micro window would have
+        // (1/len, as for white noise).
+        if (windows_at_len >= 2)
+        {
+            const double second_diff = window.mean - (2.0 * quiet_means[0]) + quiet_means[1];
+            const double sem_var = second_diff * second_diff * len_ratio / 6.0;
+            mean_var = std::isfinite(mean_var) ? mean_var + (noise_alpha * (sem_var - mean_var)) : sem_var;
+        }
+        quiet_means[1] = quiet_means[0];
+        quiet_means[0] = window.mean;
+        ++windows_at_len;
+
+        const double window_s = (double)cfg.window_micro / us_to_sec;
+        const double sd_allowed = cfg.noise_target * cfg.stddev_max;
+        const double drift_allowed = cfg.noise_target * cfg.drift_per_sec_max;
+        double wanted_s = window_s * noise_var / (sd_allowed * sd_allowed);
+        if (std::isfinite(mean_var))
+        {
+            // sqrt(2 * mean_var * window_s / len) / len <= drift_allowed
+            wanted_s = std::max(wanted_s, std::cbrt(2.0 * mean_var * window_s / (drift_allowed * drift_allowed)));
+        }
+        const double wanted_us = wanted_s * us_to_sec;
+
+        const uint64_t old_len = window_len_us;
+        if (wanted_us > (double)window_len_us)
+        {
+            const uint64_t longer = window_len_us * 2;
+            if (longer <= cfg.max_window_micro && (window_start_micro_sec - window_origin_us) % longer == 0) {window_len_us = longer;}
+        }
+        else if (wanted_us * 2.5 <= (double)window_len_us)
+        {
+            const uint64_t shorter = window_len_us / 2;
+            if (shorter >= cfg.min_window_micro && window_len_us % 2 == 0) {window_len_us = shorter;}
+        }
+        if (window_len_us != old_len) {windows_at_len = 0;}
+    }
+
     bool BreathAnalyzer::AnalyzeBreath(const WindowResult& breathwindow,BreathResult& breathresult, BreathEvent& out_event)
     {
         out_event = {};
@@ -145,6 +251,12 @@ namespace DrunkAPI
 
         if (breathwindow.window_end_us == 0){return false;}
 
+        // Blowing while it warms up or cools down doesn't count, Ready only starts on exhales it sees itself.
+        if (breath_state != BreathAnalyzerState::Ready && breath_state != BreathAnalyzerState::Processing)
+        {
+            flow_exhales_seen = flow.exhales;
+        }
+
         if (!bWarmedup)
         {
             bFreezebaseline = false;
@@ -168,11 +280,15 @@ namespace DrunkAPI
             case BreathAnalyzerState::Processing:
                 bFreezebaseline = true;
                 out_event.State = BreathAnalyzerState::Processing;
+                if (bFlowGated) {return ProcessingFlow(breathwindow, breathresult, out_event);}
                 return Processing(breathwindow, breathresult, end_threshold,out_event);
             
             case DrunkAPI::BreathAnalyzerState::Analyzed:
                 out_event.State = BreathAnalyzerState::Analyzed;
                 out_event.peak_voltage = breathresult.peak_volts; // Set peak voltaga found
+                out_event.start_us = breath_start_us;
+                out_event.end_us = analyzed_end_us;
+                out_event.flow_volume_l = analyzed_volume_l;
                 breath_state = BreathAnalyzerState::Cooldown;
                 cooldown_stable_count = 0;
                 return false;
@@ -220,7 +336,7 @@ namespace DrunkAPI
             bWarmedup = true;
             breath_state = BreathAnalyzerState::Ready;
             baseline_stable_count = 0;
-            fmt::print("Warmup complete (baseline acquired)\n");
+            if (bcfg.bPrintStatus) {fmt::print("Warmup complete (baseline acquired)\n");}
             return false;
         }
 
@@ -230,10 +346,22 @@ namespace DrunkAPI
 
     bool BreathAnalyzer::Ready(const WindowResult& breathwindow, BreathResult& breathresult, double start_threshold)
     {
-        if(breathwindow.mean < start_threshold){return false;}
+        // With a flow sensor only an exhale starts a breath (one that already ended inside this window too), vapor
+        // drifting over the MQ-3 just moves the baseline.
+        if (bFlowGated)
+        {
+            if (!flow.bExhaling && flow.exhales == flow_exhales_seen){return false;}
+            breath_start_us = flow.start_us;
+        }
+        else
+        {
+            if(breathwindow.mean < start_threshold){return false;}
+            breath_start_us = (breathwindow.window_start_us != 0) ? breathwindow.window_start_us : breathwindow.window_end_us;
+            features.Begin(breathresult.baseline_mean);
+            features.Add(breathwindow.mean, breathwindow.mean_prev, breathwindow.window_start_us, breathwindow.window_end_us);
+        }
 
         breath_state = BreathAnalyzerState::Processing;
-        breath_start_us = (breathwindow.window_start_us != 0) ? breathwindow.window_start_us : breathwindow.window_end_us;
 
         cur_peak_voltage = breathwindow.mean;
         breathresult.peak_volts = cur_peak_voltage;
@@ -248,6 +376,7 @@ namespace DrunkAPI
     {
         cur_peak_voltage = std::max(cur_peak_voltage,breathwindow.mean);
         breathresult.peak_volts = cur_peak_voltage;
+        features.Add(breathwindow.mean, breathwindow.mean_prev, breathwindow.window_start_us, breathwindow.window_end_us);
 
         const uint64_t elapsed = breathwindow.window_end_us - breath_start_us;
         const bool falling_edge = (breathwindow.mean <= end_threshold);
@@ -265,12 +394,75 @@ namespace DrunkAPI
             cooldown_stable_count = 0;
             return false;
         }
-        
+
+        // Room vapor rather than a blow goes back to listening right away. The baseline is frozen from before the
+        // run, so it's moved up to where the air is now, otherwise the same vapor would trigger again next window.
+        ++candidates;
+        last_score = model.Score(features.Finish());
+        if (bcfg.bClassify && last_score < bcfg.classify_threshold)
+        {
+            ++rejected;
+            if (bcfg.bPrintStatus) {fmt::print("Not a breath (p={:.2f}), back to Ready\n", last_score);}
+            breathresult.baseline_mean = std::max(breathresult.baseline_mean, breathwindow.mean);
+            breath_state = BreathAnalyzerState::Ready;
+            cur_peak_voltage = 0.0;
+            breathresult.peak_volts = 0.0;
+            return false;
+        }
+
         out_event.start_us = breath_start_us;
         out_event.end_us = breathwindow.window_end_us;
         out_event.peak_voltage = cur_peak_voltage;
 
         analyzed_end_us = breathwindow.window_end_us;
+        analyzed_volume_l = 0.0;
+
+        breath_state = BreathAnalyzerState::Analyzed;
+
+        return true;
+    }
+
+    // The exhale sets start and end, the MQ-3 only gives the peak. It lags the air though (rise tau), so after the
+    // exhale it gets until its window mean turns over, or flow_tail_us, to finish climbing.
+    bool BreathAnalyzer::ProcessingFlow(const WindowResult& breathwindow, BreathResult& breathresult, BreathEvent& out_event)
+    {
+        cur_peak_voltage = std::max(cur_peak_voltage,breathwindow.mean);
+        breathresult.peak_volts = cur_peak_voltage;
+
+        const bool bExhaleDone = !flow.bExhaling && flow.exhales > flow_exhales_seen;
+        const bool blowtimeout = (breathwindow.window_end_us - breath_start_us >= bcfg.max_blow_time_us) && flow.bExhaling;
+
+        if (bExhaleDone)
+        {
+            const bool bPeakPassed = breathwindow.mean < cur_peak_voltage;
+            const bool bTailDone = breathwindow.window_end_us >= flow.end_us + bcfg.flow_tail_us;
+            if (!bPeakPassed && !bTailDone) {return false;}
+        }
+        else if (!blowtimeout)
+        {
+            return false;
+        }
+
+        flow_exhales_seen = flow.exhales;
+        breath_start_us = flow.start_us; // A second exhale inside the same breath replaces the first
+        const uint64_t end_us = bExhaleDone ? flow.end_us : breathwindow.window_end_us;
+
+        if (end_us - breath_start_us < bcfg.min_blow_time_us || flow.volume_l < bcfg.min_flow_volume_l)
+        {
+            if (bcfg.bPrintStatus) {fmt::print("Blow rejected: {:.2f}s, {:.2f}L\n", static_cast<double>(end_us - breath_start_us) / 1'000'000.0, flow.volume_l);}
+            breath_state = BreathAnalyzerState::Cooldown;
+            cooldown_start_us = breathwindow.window_end_us;
+            cooldown_stable_count = 0;
+            return false;
+        }
+
+        out_event.start_us = breath_start_us;
+        out_event.end_us = end_us;
+        out_event.peak_voltage = cur_peak_voltage;
+        out_event.flow_volume_l = flow.volume_l;
+
+        analyzed_end_us = end_us;
+        analyzed_volume_l = flow.volume_l;
 
         breath_state = BreathAnalyzerState::Analyzed;
 
@@ -284,7 +476,7 @@ namespace DrunkAPI
             cooldown_stable_count++;
             if (cooldown_stable_count >= bcfg.cooldown_stable_windows)
             {
-                fmt::print("Cooldown Completed!\n");
+                if (bcfg.bPrintStatus) {fmt::print("Cooldown Completed!\n");}
                 breath_state = BreathAnalyzerState::Ready;
                 cooldown_stable_count = 0;
                 cur_peak_voltage = 0.0;
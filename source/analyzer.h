@@ -4,7 +4,10 @@
 #include <cmath>
 #include <limits>
 #include <sys/types.h>
+#include "breath_classifier.h"
+#include "breath_classifier_model.h"
 #include "config_settings.h"
+#include "flow_gate.h"
 #include "process_runner.h"
 #include "sampler.h"
 
@@ -61,6 +64,23 @@ namespace DrunkAPI
             m2 += delta * delta2;
         }
 
+        // Chan et al. parallel combination, folds another partial window into this one as if its samples had been
+        // pushed here. Used by the offline tools to stitch windows split across chunks.
+        void merge(const WelfordStats& other)
+        {
+            if (other.num_samples == 0) {return;}
+            if (num_samples == 0) {*this = other; return;}
+
+            const double n_a = (double)num_samples;
+            const double n_b = (double)other.num_samples;
+            const double n = n_a + n_b;
+            const double delta = other.mean - mean;
+
+            mean += delta * (n_b / n);
+            m2 += other.m2 + (delta * delta) * (n_a * n_b / n);
+            num_samples += other.num_samples;
+        }
+
         double variance_sample() const {
             return (num_samples > 1) ? (m2 / (double)(num_samples- 1)) : 0.0;
         }
@@ -97,13 +117,41 @@ namespace DrunkAPI
             
             StepResult<WindowResult> AnalyzeBatch(const Sample* Samples, size_t n, double(*get_value)(const Sample&)); // I use a function pointer here because I'd like to pass a lambda function to extract out voltage from a sample.
             StepResult<WindowResult> AnalyzeSample(Microseconds t_micro, SampleValue sample);
+
+            // Like AnalyzeBatch, but every window the batch finalizes goes to on_window (oldest first) instead of only
+            // the last one, and it doesn't stop early on a stable window.
+            template<class OnWindow>
+            void AnalyzeEach(const Sample* Samples, size_t n, double(*get_value)(const Sample&), OnWindow&& on_window)
+            {
+                for (size_t i = 0; i < n; ++i)
+                {
+                    const StepResult<WindowResult> step = AnalyzeSample(Microseconds{Samples[i].t_us}, SampleValue{get_value(Samples[i])});
+                    if (step.result.window_end_us != 0) {on_window(step.result);}
+                }
+            }
             StepResult<WindowResult> FinalizeWindow();
 
+            // Finalizes a window whose stats were accumulated elsewhere (offline tools), same stability/drift
+            // bookkeeping as a live window.
+            StepResult<WindowResult> FinalizeStats(const WelfordStats& stats, std::uint64_t window_start_us);
+
             void reset();
 
             Analyzer_Config Get_AnalyzerConfg() const {return cfg;};
 
+            // Length of the window being filled, window_micro unless bAdaptiveWindow moved it.
+            uint64_t WindowLengthUs() const noexcept { return window_len_us; }
+
+            // Samples come in at hz from from_us on (RuntimeProcess moved the sampler's rate), the minimum sample rule
+            // follows. The sampler only switches a batch or so after it's asked, so the window starting at from_us
+            // (and anything before it) is held to the slower of the two rates.
+            void SetSampleRate(double hz, uint64_t from_us);
+            double SampleRateHz() const noexcept { return sample_hz; }
+
         private:
+            void AdaptWindow(const WindowResult& window, const WelfordStats& stats);
+            double WindowRateHz(uint64_t window_start_us) const noexcept;
+
             Analyzer_Config cfg;
             WelfordStats WfS; 
             
@@ -111,7 +159,21 @@ namespace DrunkAPI
             uint64_t window_start_micro_sec = 0;
             uint64_t window_end_micro_sec = 0;
 
+            // Adaptive windows are window_micro times a power of two, and a window only grows on a boundary that's a
+            // multiple of its new length from the first one, so every window is one block of a fixed grid.
+            uint64_t window_len_us = cfg.window_micro;
+            uint64_t prev_window_len_us = cfg.window_micro; // Of the window prev_window_mean came from
+            uint64_t window_origin_us = 0;
+            uint64_t windows_at_len = 0; // Quiet windows in a row at this length
+            double quiet_means[2] = {0.0, 0.0}; // Their means, newest first
+            double noise_var = std::numeric_limits<double>::quiet_NaN(); // Sample variance, smoothed over quiet windows
+            double mean_var = std::numeric_limits<double>::quiet_NaN(); // Variance of a window mean, scaled to window_micro
+
             double prev_window_mean = std::numeric_limits<double>::quiet_NaN();
+
+            double sample_hz = cfg.sample_rate_hz;
+            double switch_floor_hz = cfg.sample_rate_hz; // Slower side of the last switch
+            uint64_t rate_settled_us = 0; // Windows starting from here on are all at sample_hz
     };
 
     //enum class BreathAnalyzerState : uint8_t {Warmup, Ready, Processing, Cooldown, Analyzed};
@@ -123,6 +185,7 @@ namespace DrunkAPI
         uint64_t end_us = 0;
         double peak_voltage = 0.0;
         BreathAnalyzerState State = BreathAnalyzerState::Warmup;
+        double flow_volume_l = 0.0; // Blown volume with a flow sensor, start/end are then the exhale's. 0 = no flow sensor
     };
 
     // Current Breath Snapshot
@@ -146,6 +209,22 @@ namespace DrunkAPI
             // Consumes Finalized Welford Windows.
             bool AnalyzeBreath(const WindowResult& breathwindow, BreathResult& breathresult, BreathEvent& out_event);
 
+            // Latest flow sensor state (see flow_gate.h), from then on the exhale starts and ends Processing.
+            void SetFlow(const FlowStatus& status)
+            {
+                flow = status;
+                bFlowGated = true;
+            }
+
+            // Classifier weights, DefaultBreathModel unless drunk_train is trying out new ones.
+            void SetModel(const BreathModel& in_model) { model = in_model; }
+
+            // Features and score of the last candidate that got past min_blow_time_us (MQ-3 path), scored or not.
+            const BreathFeatures& LastFeatures() const noexcept { return features.Features(); }
+            double LastScore() const noexcept { return last_score; }
+            uint64_t Candidates() const noexcept { return candidates; }
+            uint64_t Rejected() const noexcept { return rejected; }
+
             void reset(BreathResult& breathresult)
             {
                 cur_peak_voltage = 0.0;
@@ -166,6 +245,17 @@ namespace DrunkAPI
 
             double cur_peak_voltage = 0.0;
 
+            FlowStatus flow{};
+            bool bFlowGated = false;
+            uint64_t flow_exhales_seen = 0; // Exhales that ended outside Ready don't start a breath later
+            double analyzed_volume_l = 0.0;
+
+            BreathModel model = DefaultBreathModel;
+            BreathFeatureTracker features;
+            double last_score = 1.0;
+            uint64_t candidates = 0;
+            uint64_t rejected = 0;
+
             bool bWarmedup = false;
             bool bFoundbaseline = false;
             bool bFreezebaseline = false;
@@ -175,6 +265,7 @@ namespace DrunkAPI
             void UpdateBaseline(const WindowResult& breathwindow, BreathResult& breathresult);
             bool Ready(const WindowResult& breathwindow, BreathResult& breathresult, double start_threshold);
             bool Processing(const WindowResult& breathwindow, BreathResult& breathresult, double end_threshold, BreathEvent& out_event);
+            bool ProcessingFlow(const WindowResult& breathwindow, BreathResult& breathresult, BreathEvent& out_event);
             bool Cooldown(const WindowResult& breathwindow, BreathResult& breathresult, double ready_threshold);
     };
 
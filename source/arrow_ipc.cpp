@@ -0,0 +1,402 @@
+#include "arrow_ipc.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <initializer_list>
+#include <string_view>
+#include <unistd.h>
+
+namespace DrunkAPI
+{
+    namespace
+    {
+        constexpr char FileMagic[8] = {'A','R','R','O','W','1','\0','\0'}; // 6 byte magic + 2 pad
+        constexpr std::uint32_t Continuation = 0xFFFFFFFFU;
+
+        // Schema.fbs / Message.fbs enum values
+        constexpr std::uint16_t MetadataV5 = 4;
+        constexpr std::uint8_t HeaderSchema = 1;
+        constexpr std::uint8_t HeaderRecordBatch = 3;
+        constexpr std::uint8_t TypeInt = 2;
+        constexpr std::uint8_t TypeFloatingPoint = 3;
+        constexpr std::uint16_t PrecisionSingle = 1;
+        constexpr std::uint16_t PrecisionDouble = 2;
+
+        constexpr std::size_t AlignUp(std::size_t value, std::size_t align) { return (value + align - 1) & ~(align - 1); }
+
+        // One table field. If `slot` is set the field is a uoffset (table/vector/string) and the position of the
+        // placeholder is handed back so it can be patched once the child has been written.
+        struct FbField
+        {
+            std::uint16_t id = 0;
+            std::uint8_t size = 0;
+            std::uint64_t bits = 0;
+            std::size_t* slot = nullptr;
+        };
+
+        // Front to back flatbuffer builder. The official builder writes back to front, here every child is appended
+        // after its parent so all uoffsets point forward like the format requires. Each vtable sits right in front of
+        // its table, and every scalar lands on its natural alignment so the reader's verifier is happy.
+        class FlatBuilder
+        {
+            public:
+                FlatBuilder() { buf.resize(sizeof(std::uint32_t)); } // Root offset
+
+                std::size_t Table(std::initializer_list<FbField> fields)
+                {
+                    std::uint16_t entries = 0;
+                    std::uint16_t offsets[16]{};
+                    std::size_t cursor = sizeof(std::int32_t); // soffset to the vtable
+                    for (const FbField& field : fields)
+                    {
+                        cursor = AlignUp(cursor, field.size);
+                        offsets[field.id] = static_cast<std::uint16_t>(cursor);
+                        cursor += field.size;
+                        entries = std::max<std::uint16_t>(entries, static_cast<std::uint16_t>(field.id + 1));
+                    }
+                    const std::size_t table_bytes = cursor;
+                    const std::size_t vtable_bytes = sizeof(std::uint16_t) * (2U + entries);
+
+                    // Table starts 8 byte aligned so 8 byte fields can be laid out relative to it.
+                    Pad(2);
+                    while ((buf.size() + vtable_bytes) % 8 != 0) {Append<std::uint16_t>(0);}
+
+                    const std::size_t vtable_pos = buf.size();
+                    Append<std::uint16_t>(static_cast<std::uint16_t>(vtable_bytes));
+                    Append<std::uint16_t>(static_cast<std::uint16_t>(table_bytes));
+                    for (std::uint16_t i = 0; i < entries; ++i) {Append<std::uint16_t>(offsets[i]);}
+
+                    const std::size_t table_pos = buf.size();
+                    buf.resize(table_pos + table_bytes, 0);
+                    Put<std::int32_t>(table_pos, static_cast<std::int32_t>(table_pos - vtable_pos));
+
+                    for (const FbField& field : fields)
+                    {
+                        const std::size_t pos = table_pos + offsets[field.id];
+                        if (field.slot != nullptr) {*field.slot = pos; continue;}
+                        std::memcpy(buf.data() + pos, &field.bits, field.size); // Little endian host
+                    }
+                    return table_pos;
+                }
+
+                // [len | uoffset...], the placeholders are appended to `slots`.
+                std::size_t OffsetVector(std::size_t count, std::vector<std::size_t>& slots)
+                {
+                    Pad(4);
+                    const std::size_t pos = buf.size();
+                    Append<std::uint32_t>(static_cast<std::uint32_t>(count));
+                    for (std::size_t i = 0; i < count; ++i)
+                    {
+                        slots.push_back(buf.size());
+                        Append<std::uint32_t>(0);
+                    }
+                    return pos;
+                }
+
+                // [len | structs], elements 8 byte aligned (all the structs we write are made of longs).
+                std::size_t StructVector(const void* data, std::size_t count, std::size_t struct_bytes)
+                {
+                    while ((buf.size() + sizeof(std::uint32_t)) % 8 != 0) {buf.push_back(0);}
+                    const std::size_t pos = buf.size();
+                    Append<std::uint32_t>(static_cast<std::uint32_t>(count));
+                    const auto* bytes = static_cast<const std::uint8_t*>(data);
+                    buf.insert(buf.end(), bytes, bytes + count * struct_bytes);
+                    return pos;
+                }
+
+                std::size_t String(std::string_view text)
+                {
+                    Pad(4);
+                    const std::size_t pos = buf.size();
+                    Append<std::uint32_t>(static_cast<std::uint32_t>(text.size()));
+                    buf.insert(buf.end(), text.begin(), text.end());
+                    buf.push_back(0);
+                    return pos;
+                }
+
+                void Patch(std::size_t slot, std::size_t target) { Put<std::uint32_t>(slot, static_cast<std::uint32_t>(target - slot)); }
+                void SetRoot(std::size_t table) { Patch(0, table); }
+
+                // Message metadata must be a multiple of 8 so the body that follows stays aligned.
+                std::vector<std::uint8_t> Finish()
+                {
+                    Pad(8);
+                    return std::move(buf);
+                }
+
+            private:
+                template<class T>
+                void Append(T value)
+                {
+                    const std::size_t pos = buf.size();
+                    buf.resize(pos + sizeof(T));
+                    Put<T>(pos, value);
+                }
+
+                template<class T>
+                void Put(std::size_t pos, T value) { std::memcpy(buf.data() + pos, &value, sizeof(T)); }
+
+                void Pad(std::size_t align) { buf.resize(AlignUp(buf.size(), align), 0); }
+
+                std::vector<std::uint8_t> buf;
+        };
+
+        // Field { name, nullable, type_type, type, dictionary, children }
+        void AppendField(FlatBuilder& fb, std::size_t slot, const ArrowField& field)
+        {
+            const bool is_float = (field.type == ArrowType::Float32 || field.type == ArrowType::Float64);
+
+            std::size_t name_slot = 0;
+            std::size_t type_slot = 0;
+            std::size_t children_slot = 0;
+            fb.Patch(slot, fb.Table({
+                {.id = 0, .size = 4, .slot = &name_slot},
+                {.id = 1, .size = 1, .bits = 0}, // nullable = false, no validity bitmaps
+                {.id = 2, .size = 1, .bits = is_float ? TypeFloatingPoint : TypeInt},
+                {.id = 3, .size = 4, .slot = &type_slot},
+                {.id = 5, .size = 4, .slot = &children_slot},
+            }));
+
+            fb.Patch(name_slot, fb.String(field.name));
+
+            if (is_float)
+            {
+                const std::uint16_t precision = (field.type == ArrowType::Float32) ? PrecisionSingle : PrecisionDouble;
+                fb.Patch(type_slot, fb.Table({{.id = 0, .size = 2, .bits = precision}}));
+            }
+            else
+            {
+                const auto bit_width = static_cast<std::uint32_t>(ArrowTypeWidth(field.type) * 8U);
+                const bool is_signed = (field.type == ArrowType::Int16);
+                fb.Patch(type_slot, fb.Table({{.id = 0, .size = 4, .bits = bit_width}, {.id = 1, .size = 1, .bits = is_signed ? 1U : 0U}}));
+            }
+
+            // Readers insist on a children vector even for primitive types.
+            std::vector<std::size_t> unused;
+            fb.Patch(children_slot, fb.OffsetVector(0, unused));
+        }
+
+        // Schema { endianness, fields, custom_metadata }
+        void AppendSchema(FlatBuilder& fb, std::size_t slot, const std::vector<ArrowField>& fields, const ArrowMetadata& metadata)
+        {
+            std::size_t fields_slot = 0;
+            std::size_t metadata_slot = 0;
+            fb.Patch(slot, fb.Table({{.id = 1, .size = 4, .slot = &fields_slot}, {.id = 2, .size = 4, .slot = &metadata_slot}}));
+
+            std::vector<std::size_t> field_slots;
+            fb.Patch(fields_slot, fb.OffsetVector(fields.size(), field_slots));
+            for (std::size_t i = 0; i < fields.size(); ++i)
+            {
+                AppendField(fb, field_slots[i], fields[i]);
+            }
+
+            std::vector<std::size_t> kv_slots;
+            fb.Patch(metadata_slot, fb.OffsetVector(metadata.size(), kv_slots));
+            for (std::size_t i = 0; i < metadata.size(); ++i)
+            {
+                std::size_t key_slot = 0;
+                std::size_t value_slot = 0;
+                fb.Patch(kv_slots[i], fb.Table({{.id = 0, .size = 4, .slot = &key_slot}, {.id = 1, .size = 4, .slot = &value_slot}}));
+                fb.Patch(key_slot, fb.String(metadata[i].first));
+                fb.Patch(value_slot, fb.String(metadata[i].second));
+            }
+        }
+
+        // Message { version, header_type, header, bodyLength }, returns the header slot.
+        std::size_t AppendMessage(FlatBuilder& fb, std::uint8_t header_type, std::int64_t body_bytes)
+        {
+            std::size_t header_slot = 0;
+            fb.SetRoot(fb.Table({
+                {.id = 0, .size = 2, .bits = MetadataV5},
+                {.id = 1, .size = 1, .bits = header_type},
+                {.id = 2, .size = 4, .slot = &header_slot},
+                {.id = 3, .size = 8, .bits = static_cast<std::uint64_t>(body_bytes)},
+            }));
+            return header_slot;
+        }
+
+        struct FbBuffer
+        {
+            std::int64_t offset;
+            std::int64_t length;
+        };
+
+        struct FbFieldNode
+        {
+            std::int64_t length;
+            std::int64_t null_count;
+        };
+
+        struct FbBlock
+        {
+            std::int64_t offset;
+            std::int32_t metadata_bytes;
+            std::int32_t pad;
+            std::int64_t body_bytes;
+        };
+        static_assert(sizeof(FbBlock) == 24, "Block struct layout from File.fbs");
+    }
+
+    bool ArrowFileWriter::Open(const std::string& in_path, std::vector<ArrowField> in_fields, const ArrowMetadata& metadata)
+    {
+        Close();
+
+        path = in_path;
+        fields = std::move(in_fields);
+        schema_metadata = metadata;
+        batches.clear();
+        total_rows = 0;
+        file_offset = 0;
+
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            fmt::print(stderr, "Error: Unable to create arrow file '{}': {}\n", path, std::strerror(errno));
+            return false;
+        }
+
+        FlatBuilder fb;
+        AppendSchema(fb, AppendMessage(fb, HeaderSchema, 0), fields, schema_metadata);
+
+        if (!WriteAll(FileMagic, sizeof(FileMagic)) || !WriteMessage(fb.Finish(), {}, 0, 0, nullptr))
+        {
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        return true;
+    }
+
+    bool ArrowFileWriter::WriteBatch(std::size_t rows, std::span<const void* const> columns)
+    {
+        if (fd < 0 || rows == 0) {return fd >= 0;}
+        if (columns.size() != fields.size())
+        {
+            fmt::print(stderr, "Error: Arrow batch has {} columns, schema has {}\n", columns.size(), fields.size());
+            return false;
+        }
+
+        // Each column is a zero length validity buffer followed by its values, padded to 8 bytes.
+        std::vector<FbFieldNode> nodes(fields.size(), FbFieldNode{static_cast<std::int64_t>(rows), 0});
+        std::vector<FbBuffer> buffers;
+        buffers.reserve(fields.size() * 2);
+
+        std::int64_t body_bytes = 0;
+        for (const ArrowField& field : fields)
+        {
+            const auto data_bytes = static_cast<std::int64_t>(rows * ArrowTypeWidth(field.type));
+            buffers.push_back({body_bytes, 0});
+            buffers.push_back({body_bytes, data_bytes});
+            body_bytes += static_cast<std::int64_t>(AlignUp(static_cast<std::size_t>(data_bytes), 8));
+        }
+
+        // RecordBatch { length, nodes, buffers }
+        FlatBuilder fb;
+        const std::size_t header_slot = AppendMessage(fb, HeaderRecordBatch, body_bytes);
+        std::size_t nodes_slot = 0;
+        std::size_t buffers_slot = 0;
+        fb.Patch(header_slot, fb.Table({
+            {.id = 0, .size = 8, .bits = static_cast<std::uint64_t>(rows)},
+            {.id = 1, .size = 4, .slot = &nodes_slot},
+            {.id = 2, .size = 4, .slot = &buffers_slot},
+        }));
+        fb.Patch(nodes_slot, fb.StructVector(nodes.data(), nodes.size(), sizeof(FbFieldNode)));
+        fb.Patch(buffers_slot, fb.StructVector(buffers.data(), buffers.size(), sizeof(FbBuffer)));
+
+        Block block{};
+        if (!WriteMessage(fb.Finish(), columns, rows, body_bytes, &block)) {return false;}
+
+        batches.push_back(block);
+        total_rows += rows;
+        return true;
+    }
+
+    bool ArrowFileWriter::Close()
+    {
+        if (fd < 0) {return true;}
+
+        // EOS, then the footer repeats the schema and indexes every batch for random access.
+        const std::uint32_t eos[2] = {Continuation, 0};
+        bool bOk = WriteAll(eos, sizeof(eos));
+
+        std::vector<FbBlock> blocks;
+        blocks.reserve(batches.size());
+        for (const Block& batch : batches)
+        {
+            blocks.push_back({batch.offset, batch.metadata_bytes, 0, batch.body_bytes});
+        }
+
+        // Footer { version, schema, dictionaries, recordBatches }
+        FlatBuilder fb;
+        std::size_t schema_slot = 0;
+        std::size_t dictionaries_slot = 0;
+        std::size_t batches_slot = 0;
+        fb.SetRoot(fb.Table({
+            {.id = 0, .size = 2, .bits = MetadataV5},
+            {.id = 1, .size = 4, .slot = &schema_slot},
+            {.id = 2, .size = 4, .slot = &dictionaries_slot},
+            {.id = 3, .size = 4, .slot = &batches_slot},
+        }));
+        AppendSchema(fb, schema_slot, fields, schema_metadata);
+        fb.Patch(dictionaries_slot, fb.StructVector(nullptr, 0, sizeof(FbBlock)));
+        fb.Patch(batches_slot, fb.StructVector(blocks.data(), blocks.size(), sizeof(FbBlock)));
+
+        const std::vector<std::uint8_t> footer = fb.Finish();
+        const auto footer_bytes = static_cast<std::int32_t>(footer.size());
+        bOk = bOk && WriteAll(footer.data(), footer.size()) && WriteAll(&footer_bytes, sizeof(footer_bytes)) && WriteAll(FileMagic, 6);
+
+        if (!bOk)
+        {
+            fmt::print(stderr, "Error: Unable to finish arrow file '{}'\n", path);
+        }
+
+        ::close(fd);
+        fd = -1;
+        return bOk;
+    }
+
+    bool ArrowFileWriter::WriteMessage(const std::vector<std::uint8_t>& metadata, std::span<const void* const> columns, std::size_t rows, std::int64_t body_bytes, Block* block)
+    {
+        const std::int64_t start = file_offset;
+        const std::uint32_t prefix[2] = {Continuation, static_cast<std::uint32_t>(metadata.size())};
+
+        if (!WriteAll(prefix, sizeof(prefix)) || !WriteAll(metadata.data(), metadata.size())) {return false;}
+
+        // Body goes straight from the caller's column arrays.
+        static constexpr std::uint8_t Zeros[8] = {};
+        for (std::size_t i = 0; i < columns.size(); ++i)
+        {
+            const std::size_t data_bytes = rows * ArrowTypeWidth(fields[i].type);
+            if (!WriteAll(columns[i], data_bytes) || !WriteAll(Zeros, AlignUp(data_bytes, 8) - data_bytes)) {return false;}
+        }
+
+        if (block != nullptr)
+        {
+            block->offset = start;
+            block->metadata_bytes = static_cast<std::int32_t>(sizeof(prefix) + metadata.size());
+            block->body_bytes = body_bytes;
+        }
+        return true;
+    }
+
+    bool ArrowFileWriter::WriteAll(const void* data, std::size_t len)
+    {
+        const auto* bytes = static_cast<const std::uint8_t*>(data);
+        while (len > 0)
+        {
+            const ssize_t written = ::write(fd, bytes, len);
+            if (written < 0)
+            {
+                if (errno == EINTR) {continue;}
+                fmt::print(stderr, "Error: Write to '{}' failed: {}\n", path, std::strerror(errno));
+                return false;
+            }
+            bytes += written;
+            len -= static_cast<std::size_t>(written);
+            file_offset += written;
+        }
+        return true;
+    }
+}
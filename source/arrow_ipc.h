@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal Apache Arrow IPC file writer (Feather v2), so recordings open straight in pandas/polars/duckdb.
+//
+// Only what we need is supported: flat tables of non-nullable fixed width columns. Batches are written straight from
+// caller owned column arrays, there's no row type and no copy besides the write() itself.
+//
+// File layout:
+//   "ARROW1\0\0" | Schema message | RecordBatch message... | EOS | Footer | int32 footer size | "ARROW1"
+//
+// A message is [0xFFFFFFFF | int32 metadata size | flatbuffer metadata (8 byte padded) | body]. The flatbuffers are
+// built by hand (see FlatBuilder in arrow_ipc.cpp) so we don't pull the flatbuffers or arrow libraries onto the Pi.
+namespace DrunkAPI
+{
+    enum class ArrowType : std::uint8_t
+    {
+        UInt8,
+        Int16,
+        UInt64,
+        Float32,
+        Float64,
+    };
+
+    constexpr std::size_t ArrowTypeWidth(ArrowType type)
+    {
+        switch (type)
+        {
+            case ArrowType::UInt8: return 1;
+            case ArrowType::Int16: return 2;
+            case ArrowType::Float32: return 4;
+            case ArrowType::UInt64:
+            case ArrowType::Float64:
+            default: return 8;
+        }
+    }
+
+    struct ArrowField
+    {
+        std::string name;
+        ArrowType type = ArrowType::Float64;
+    };
+
+    using ArrowMetadata = std::vector<std::pair<std::string, std::string>>; // Schema key/value metadata
+
+    class ArrowFileWriter final
+    {
+        public:
+            ArrowFileWriter() = default;
+            ArrowFileWriter(const ArrowFileWriter&) = delete;
+            ArrowFileWriter& operator=(const ArrowFileWriter&) = delete;
+            ArrowFileWriter(ArrowFileWriter&&) = delete;
+            ArrowFileWriter& operator=(ArrowFileWriter&&) = delete;
+            ~ArrowFileWriter() { Close(); }
+
+            // Creates the file and writes the schema message.
+            bool Open(const std::string& in_path, std::vector<ArrowField> in_fields, const ArrowMetadata& metadata = {});
+
+            // columns[i] points at `rows` packed values of fields[i].
+            bool WriteBatch(std::size_t rows, std::span<const void* const> columns);
+
+            // Writes the EOS marker and footer. Without it the file is still a valid Arrow stream, just not a Feather file.
+            bool Close();
+
+            bool IsOpen() const noexcept { return fd >= 0; }
+            std::uint64_t Rows() const noexcept { return total_rows; }
+
+        private:
+            struct Block
+            {
+                std::int64_t offset = 0;
+                std::int32_t metadata_bytes = 0;
+                std::int64_t body_bytes = 0;
+            };
+
+            bool WriteMessage(const std::vector<std::uint8_t>& metadata, std::span<const void* const> columns, std::size_t rows, std::int64_t body_bytes, Block* block);
+            bool WriteAll(const void* data, std::size_t len);
+
+            std::string path;
+            std::vector<ArrowField> fields;
+            ArrowMetadata schema_metadata; // Kept for the footer, it repeats the schema
+            std::vector<Block> batches;
+            std::uint64_t total_rows = 0;
+            std::int64_t file_offset = 0;
+            int fd = -1;
+    };
+}
@@ -0,0 +1,156 @@
+#include "arrow_sink.h"
+#include <filesystem>
+#include <fmt/core.h>
+#include <system_error>
+
+namespace DrunkAPI
+{
+    namespace
+    {
+        template<class... Columns>
+        void ReserveAll(std::size_t rows, Columns&... columns) { (columns.reserve(rows), ...); }
+
+        template<class... Columns>
+        void ClearAll(Columns&... columns) { (columns.clear(), ...); }
+    }
+
+    bool ArrowSessionSink::Open(const std::string& base_path, std::uint32_t sample_rate_hz, std::int64_t wall_minus_mono_us, std::size_t in_batch_rows)
+    {
+        Close();
+        batch_rows = (in_batch_rows == 0) ? 1 : in_batch_rows;
+
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(base_path).parent_path(), ec);
+
+        const ArrowMetadata metadata = {
+            {"source", "drunk_app"},
+            {"wall_minus_mono_us", fmt::format("{}", wall_minus_mono_us)},
+            {"sample_rate_hz", (sample_rate_hz == 0) ? std::string("variable") : fmt::format("{}", sample_rate_hz)},
+        };
+
+        const bool bOpened =
+            samples_file.Open(base_path + ".samples.arrow", {
+                {"t_us", ArrowType::UInt64},
+                {"raw", ArrowType::Int16},
+                {"volts", ArrowType::Float32},
+            }, metadata) &&
+            windows_file.Open(base_path + ".windows.arrow", {
+                {"window_start_us", ArrowType::UInt64},
+                {"window_end_us", ArrowType::UInt64},
+                {"mean", ArrowType::Float64},
+                {"stddev", ArrowType::Float64},
+                {"mean_prev", ArrowType::Float64},
+                {"drift_per_sec", ArrowType::Float64},
+                {"stable", ArrowType::UInt8},
+            }, metadata) &&
+            events_file.Open(base_path + ".events.arrow", {
+                {"t_us", ArrowType::UInt64},
+                {"state", ArrowType::UInt8}, // BreathAnalyzerState
+                {"peak_volts", ArrowType::Float64},
+                {"baseline_mean", ArrowType::Float64},
+                {"baseline_std", ArrowType::Float64},
+                {"start_us", ArrowType::UInt64},
+                {"end_us", ArrowType::UInt64},
+            }, metadata);
+
+        if (!bOpened)
+        {
+            Close();
+            return false;
+        }
+
+        ReserveAll(batch_rows, sample_cols.t_us, sample_cols.raw, sample_cols.volts);
+        return true;
+    }
+
+    bool ArrowSessionSink::Close()
+    {
+        Flush();
+        const bool bSamples = samples_file.Close();
+        const bool bWindows = windows_file.Close();
+        const bool bEvents = events_file.Close();
+        return bSamples && bWindows && bEvents;
+    }
+
+    void ArrowSessionSink::OnSamples(const Sample* samples, std::size_t n)
+    {
+        if (!samples_file.IsOpen()) {return;}
+
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            sample_cols.t_us.push_back(samples[i].t_us);
+            sample_cols.raw.push_back(samples[i].raw);
+            sample_cols.volts.push_back(samples[i].volts);
+
+            if (sample_cols.t_us.size() == batch_rows) {FlushSamples();}
+        }
+    }
+
+    void ArrowSessionSink::OnWindow(const WindowResult& window)
+    {
+        if (!windows_file.IsOpen()) {return;}
+
+        window_cols.start_us.push_back(window.window_start_us);
+        window_cols.end_us.push_back(window.window_end_us);
+        window_cols.mean.push_back(window.mean);
+        window_cols.stddev.push_back(window.stddev);
+        window_cols.mean_prev.push_back(window.mean_prev);
+        window_cols.drift_per_sec.push_back(window.drift_per_sec);
+        window_cols.stable.push_back(window.stable ? 1U : 0U);
+
+        if (window_cols.end_us.size() == batch_rows) {FlushWindows();}
+    }
+
+    void ArrowSessionSink::OnState(std::uint64_t t_us, const BreathEvent& event, const BreathResult& snapshot)
+    {
+        if (!events_file.IsOpen()) {return;}
+
+        const bool bAnalyzed = (event.State == BreathAnalyzerState::Analyzed);
+        event_cols.t_us.push_back(t_us);
+        event_cols.state.push_back(static_cast<std::uint8_t>(event.State));
+        event_cols.peak_volts.push_back(bAnalyzed ? event.peak_voltage : snapshot.peak_volts);
+        event_cols.baseline_mean.push_back(snapshot.baseline_mean);
+        event_cols.baseline_std.push_back(snapshot.baseline_std);
+        event_cols.start_us.push_back(bAnalyzed ? event.start_us : 0);
+        event_cols.end_us.push_back(bAnalyzed ? event.end_us : 0);
+
+        if (event_cols.t_us.size() == batch_rows) {FlushEvents();}
+    }
+
+    void ArrowSessionSink::Flush()
+    {
+        FlushSamples();
+        FlushWindows();
+        FlushEvents();
+    }
+
+    void ArrowSessionSink::FlushSamples()
+    {
+        SampleColumns& c = sample_cols;
+        if (c.t_us.empty()) {return;}
+
+        const void* columns[] = {c.t_us.data(), c.raw.data(), c.volts.data()};
+        samples_file.WriteBatch(c.t_us.size(), columns);
+        ClearAll(c.t_us, c.raw, c.volts);
+    }
+
+    void ArrowSessionSink::FlushWindows()
+    {
+        WindowColumns& c = window_cols;
+        if (c.end_us.empty()) {return;}
+
+        const void* columns[] = {c.start_us.data(), c.end_us.data(), c.mean.data(), c.stddev.data(), c.mean_prev.data(), c.drift_per_sec.data(), c.stable.data()};
+        windows_file.WriteBatch(c.end_us.size(), columns);
+        ClearAll(c.start_us, c.end_us, c.mean, c.stddev, c.mean_prev, c.drift_per_sec, c.stable);
+    }
+
+    void ArrowSessionSink::FlushEvents()
+    {
+        EventColumns& c = event_cols;
+        if (c.t_us.empty()) {return;}
+
+        const void* columns[] = {c.t_us.data(), c.state.data(), c.peak_volts.data(), c.baseline_mean.data(), c.baseline_std.data(), c.start_us.data(), c.end_us.data()};
+        events_file.WriteBatch(c.t_us.size(), columns);
+        ClearAll(c.t_us, c.state, c.peak_volts, c.baseline_mean, c.baseline_std, c.start_us, c.end_us);
+    }
+}
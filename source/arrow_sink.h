@@ -0,0 +1,91 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "arrow_ipc.h"
+#include "config_settings.h"
+#include "pipeline_sink.h"
+
+// Writes a session as three Arrow IPC (Feather v2) tables:
+//   <base>.samples.arrow  t_us, raw, volts
+//   <base>.windows.arrow  window_start_us, window_end_us, mean, stddev, mean_prev, drift_per_sec, stable
+//   <base>.events.arrow   t_us, state, peak_volts, baseline_mean, baseline_std, start_us, end_us
+//
+// Values go straight into per column arrays and a full set of arrays is one record batch, no row objects in between.
+// Timestamps are steady_clock like the rest of the pipeline, the schema metadata carries `wall_minus_mono_us`.
+//
+//   pl.read_ipc("session.samples.arrow")  /  pd.read_feather("session.windows.arrow")
+namespace DrunkAPI
+{
+    class ArrowSessionSink final : public PipelineSink
+    {
+        public:
+            ArrowSessionSink() = default;
+            ArrowSessionSink(const ArrowSessionSink&) = delete;
+            ArrowSessionSink& operator=(const ArrowSessionSink&) = delete;
+            ArrowSessionSink(ArrowSessionSink&&) = delete;
+            ArrowSessionSink& operator=(ArrowSessionSink&&) = delete;
+            ~ArrowSessionSink() override { Close(); }
+
+            // sample_rate_hz 0 = variable, the metadata says so rather than a number.
+            bool Open(const std::string& base_path, std::uint32_t sample_rate_hz, std::int64_t wall_minus_mono_us, std::size_t in_batch_rows = Config::ArrowBatchRows);
+            bool Close();
+            bool IsOpen() const noexcept { return samples_file.IsOpen(); }
+
+            void OnSamples(const Sample* samples, std::size_t n) override;
+            void OnWindow(const WindowResult& window) override;
+            void OnState(std::uint64_t t_us, const BreathEvent& event, const BreathResult& snapshot) override;
+
+            // Pushes out whatever is buffered as (short) batches.
+            void Flush() override;
+
+            std::uint64_t SampleRows() const noexcept { return samples_file.Rows() + sample_cols.t_us.size(); }
+            std::uint64_t WindowRows() const noexcept { return windows_file.Rows() + window_cols.end_us.size(); }
+            std::uint64_t EventRows() const noexcept { return events_file.Rows() + event_cols.t_us.size(); }
+
+        private:
+            struct SampleColumns
+            {
+                std::vector<std::uint64_t> t_us;
+                std::vector<std::int16_t> raw;
+                std::vector<float> volts;
+            };
+
+            struct WindowColumns
+            {
+                std::vector<std::uint64_t> start_us;
+                std::vector<std::uint64_t> end_us;
+                std::vector<double> mean;
+                std::vector<double> stddev;
+                std::vector<double> mean_prev;
+                std::vector<double> drift_per_sec;
+                std::vector<std::uint8_t> stable;
+            };
+
+            struct EventColumns
+            {
+                std::vector<std::uint64_t> t_us;
+                std::vector<std::uint8_t> state;
+                std::vector<double> peak_volts;
+                std::vector<double> baseline_mean;
+                std::vector<double> baseline_std;
+                std::vector<std::uint64_t> start_us;
+                std::vector<std::uint64_t> end_us;
+            };
+
+            void FlushSamples();
+            void FlushWindows();
+            void FlushEvents();
+
+            std::size_t batch_rows = Config::ArrowBatchRows;
+
+            ArrowFileWriter samples_file;
+            ArrowFileWriter windows_file;
+            ArrowFileWriter events_file;
+
+            SampleColumns sample_cols;
+            WindowColumns window_cols;
+            EventColumns event_cols;
+    };
+}
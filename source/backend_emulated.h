@@ -0,0 +1,221 @@
+#pragma once
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fmt/core.h>
+#include "ads1115.h"
+#include "ads1115_emu.h"
+#include "flow_gate.h"
+#include "gpio_emu.h"
+#include "reference_comp.h"
+#include "signal_gen.h"
+#include "spi_adc.h"
+#include "spi_adc_emu.h"
+#include "station.h"
+
+namespace DrunkAPI
+{
+    struct EmulatedBackend_Config
+    {
+        Ads1115Emu_Config adc{};
+        Signal_Config signal{};
+        std::vector<BreathSpec> script{}; // Session time blows, see MakeBreathScript
+        bool bEchoLeds = true;
+
+        Signal_Config reference{}; // Reference sensor on adc.reference_channel, never blown into
+    };
+
+    // Host mode: the same Ads1115_Source / LedController code against the ADS1115 emulator and in-memory GPIO.
+    struct EmulatedBackend
+    {
+        using Settings = EmulatedBackend_Config;
+        using Source = FlowMuxSource<ReferencePairSource<Ads1115_Source<Ads1115Emu>>, Ads1115_Source<Ads1115Emu>>;
+
+        EmuGpio gpio;
+        Ads1115Emu ads1115;
+        Source source;
+        ADS1115::i2c_device::SlaveAddress addr;
+        int flow_channel; // Set up in Init(), once the bus speed is known
+        ADS1115::DataRate main_rate;
+
+        // Reference and flow reads per tick the same as Ads1115Backend, the flow budget at the emulated bus's speed.
+        explicit EmulatedBackend(const Settings& in_cfg)
+            : gpio(in_cfg.bEchoLeds)
+            , ads1115(in_cfg.adc, in_cfg.signal, in_cfg.script, in_cfg.reference)
+            , source(ads1115, in_cfg.adc.addr,
+                     ADS1115::Mux::AIN0_GND,
+                     ADS1115::Pga::FS_4_096V,
+                     MainReadRate(in_cfg.adc.reference_channel, in_cfg.adc.flow_channel))
+            , addr(in_cfg.adc.addr)
+            , flow_channel(in_cfg.adc.flow_channel)
+            , main_rate(MainReadRate(in_cfg.adc.reference_channel, in_cfg.adc.flow_channel))
+        {
+            if (in_cfg.adc.reference_channel >= 0)
+            {
+                source.reference.emplace(ads1115, in_cfg.adc.addr, ADS1115::SingleEndedMux(static_cast<std::uint8_t>(in_cfg.adc.reference_channel)),
+                    ADS1115::Pga::FS_4_096V, ADS1115::DataRate::SPS_475);
+            }
+
+        }
+
+        bool Init()
+        {
+            if (!gpio.Init())
+            {
+                std::perror("Critical Error: Failed to initialize LED GPIOs");
+                return false;
+            }
+
+            if (!ads1115.Init(1, addr))
+            {
+                std::perror("Critical Error: Failed to initialize ADC");
+                return false;
+            }
+            const bool bBusOk = VerifyI2cBus(ads1115, addr, Config::I2cBusHz);
+            if (flow_channel >= 0) {AttachFlow(ads1115, source, addr, flow_channel, main_rate, bBusOk);} // cfg.adc.bus_hz slows it down like a stock Pi's
+            return true;
+        }
+
+        GpioLines& Lines() { return gpio; }
+    };
+
+    struct EmulatedSpiBackend_Config
+    {
+        SpiAdcEmu_Config adc{};
+        std::uint32_t speed_hz = Config::SpiClockHz;
+        std::size_t burst_depth = Config::SpiBurstDepth;
+        Signal_Config signal{};
+        std::vector<BreathSpec> script{};
+        bool bEchoLeds = true;
+
+        Signal_Config reference{};
+    };
+
+    // Host mode for the SPI ADC path: SpiAdcSource against the frame level emulator. The whole burst is one
+    // Transfer() like the spidev ioctl, so the sampler, ring and lanes see exactly what they would on the Pi.
+    template<class Chip = Mcp3208>
+    struct EmulatedSpiBackend
+    {
+        using Settings = EmulatedSpiBackend_Config;
+        using Source = SpiAdcSource<Chip, SpiAdcEmu<Chip>>;
+
+        EmuGpio gpio;
+        SpiAdcEmu<Chip> bus;
+        Source source;
+        std::uint32_t speed_hz;
+
+        explicit EmulatedSpiBackend(const Settings& in_cfg)
+            : gpio(in_cfg.bEchoLeds)
+            , bus(in_cfg.adc, in_cfg.signal, in_cfg.script, in_cfg.reference)
+            , source(bus, SpiAdc_Config{0, in_cfg.adc.reference_channel, in_cfg.adc.flow_channel, in_cfg.burst_depth})
+            , speed_hz(in_cfg.speed_hz) {}
+
+        bool Init()
+        {
+            if (!gpio.Init())
+            {
+                std::perror("Critical Error: Failed to initialize LED GPIOs");
+                return false;
+            }
+
+            if (speed_hz > Chip::MaxClockHz)
+            {
+                fmt::print(stderr, "Warning: {} Hz is past the {}'s {} Hz\n", speed_hz, Chip::Name, Chip::MaxClockHz);
+            }
+
+            if (!bus.Init(Config::SpiDevice, speed_hz) || !source.Setup())
+            {
+                fmt::print(stderr, "Critical Error: Failed to initialize {}\n", Chip::Name);
+                return false;
+            }
+            return true;
+        }
+
+        GpioLines& Lines() { return gpio; }
+    };
+
+    struct EmulatedStationBackend_Config
+    {
+        std::size_t sensors = 3;
+        std::size_t buses = 2; // Sensors are dealt round robin onto buses
+
+        Signal_Config signal{}; // Seed is bumped per sensor so they don't all read the same air
+        std::vector<std::vector<BreathSpec>> scripts{}; // One per sensor, missing ones get no blows
+        bool bRealTime = true;
+        bool bEchoLeds = true;
+
+        // Pull one sensor's board off the bus for a while to watch the others carry on. -1 = none.
+        int unplug_sensor = -1;
+        double unplug_at_s = 0.0;
+        double unplug_for_s = 0.0;
+    };
+
+    // Station mode in host mode: one ADS1115 emulator + in-memory LED row per sensor.
+    struct EmulatedStationBackend
+    {
+        using Settings = EmulatedStationBackend_Config;
+        using Source = Ads1115_Source<Ads1115Emu>;
+
+        struct Slot
+        {
+            Sensor_Config sensor;
+            std::unique_ptr<EmuGpio> gpio;
+            std::unique_ptr<Ads1115Emu> ads1115;
+            std::unique_ptr<Source> source;
+        };
+
+        std::vector<Slot> slots;
+
+        explicit EmulatedStationBackend(const Settings& in_cfg)
+        {
+            const std::size_t buses = in_cfg.buses == 0 ? 1 : in_cfg.buses;
+            for (std::size_t i = 0; i < in_cfg.sensors; ++i)
+            {
+                Slot slot{};
+                slot.sensor.name = fmt::format("s{}", i);
+                slot.sensor.bus = i % buses;
+                slot.sensor.analyzer.bDebugPrint = false; // N sensors of DBG lines is unreadable
+
+                Ads1115Emu_Config adc{};
+                adc.bRealTime = in_cfg.bRealTime;
+                if (static_cast<int>(i) == in_cfg.unplug_sensor)
+                {
+                    adc.unplug_at_s = in_cfg.unplug_at_s;
+                    adc.unplug_for_s = in_cfg.unplug_for_s;
+                }
+
+                Signal_Config signal = in_cfg.signal;
+                signal.seed += i;
+
+                slot.gpio = std::make_unique<EmuGpio>(in_cfg.bEchoLeds, Default_LedArray, slot.sensor.name);
+                slot.ads1115 = std::make_unique<Ads1115Emu>(adc, signal, i < in_cfg.scripts.size() ? in_cfg.scripts[i] : std::vector<BreathSpec>{});
+
+                // 475 SPS like the real station, a bus fits a few conversions per sample period.
+                slot.source = std::make_unique<Source>(*slot.ads1115, adc.addr,
+                    ADS1115::Mux::AIN0_GND,
+                    ADS1115::Pga::FS_4_096V,
+                    ADS1115::DataRate::SPS_475);
+                slots.push_back(std::move(slot));
+            }
+        }
+
+        bool Init()
+        {
+            for (Slot& slot : slots)
+            {
+                if (!slot.gpio->Init("drunk_station") || !slot.ads1115->Init(1, ADS1115::i2c_device::SlaveAddress::ADDR_GND))
+                {
+                    fmt::print(stderr, "Critical Error: Failed to initialize emulated sensor {}\n", slot.sensor.name);
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::size_t Count() const noexcept { return slots.size(); }
+        const Sensor_Config& SensorAt(std::size_t index) const { return slots[index].sensor; }
+        Source& SourceAt(std::size_t index) { return *slots[index].source; }
+        GpioLines& LinesAt(std::size_t index) { return *slots[index].gpio; }
+    };
+}
@@ -0,0 +1,285 @@
+#pragma once
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include <fmt/core.h>
+#include "ads1115.h"
+#include "config_settings.h"
+#include "flow_gate.h"
+#include "gpio_bank.h"
+#include "reference_comp.h"
+#include "spi_adc.h"
+#include "station.h"
+
+namespace DrunkAPI
+{
+    // A RDY line that doesn't come up isn't fatal, the samples just get the estimated stamps.
+    inline bool AttachAdcReadyLine(ADS1115& ads1115, const char* gpio_chip, int ready_gpio, const std::vector<ADS1115::i2c_device::SlaveAddress>& addrs)
+    {
+        if (!ads1115.AttachReadyLine(gpio_chip, static_cast<unsigned int>(ready_gpio)))
+        {
+            fmt::print(stderr, "Warning: ALERT/RDY on gpio {} unusable, sample times will be estimated\n", ready_gpio);
+            return false;
+        }
+
+        for (const auto addr : addrs)
+        {
+            if (!EnableConversionReady(ads1115, addr))
+            {
+                fmt::print(stderr, "Warning: ADS1115 0x{:02x} won't take the conversion ready thresholds, sample times will be estimated\n", static_cast<int>(addr));
+                ads1115.DetachReadyLine();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // SCL clock out needs the bus's pins and adapter (config_settings.h), those are only given for one bus. The rest
+    // recover by reopening.
+    inline void AttachI2cRecovery(ADS1115& ads1115, int i2c_bus, const char* gpio_chip)
+    {
+        if (i2c_bus != Config::I2cRecoveryBus) {return;}
+        ads1115.AttachBusRecovery(gpio_chip, Config::I2cSclGpio, Config::I2cSdaGpio, Config::I2cAdapterDriver, Config::I2cAdapterDevice);
+    }
+
+    struct Ads1115Backend_Config
+    {
+        ADS1115::i2c_device::SlaveAddress addr = ADS1115::i2c_device::SlaveAddress::ADDR_GND;
+        int i2c_bus = 1; // /dev/i2c-1 on the Pi header
+        const char* gpio_chip = "/dev/gpiochip0";
+        int ready_gpio = Config::AdcReadyGpio; // ALERT/RDY, -1 = not wired
+
+        // Shielded reference MQ-3 (see reference_comp.h), same bus. -1 = none
+        int reference_channel = Config::ReferenceChannel;
+        ADS1115::i2c_device::SlaveAddress reference_addr = static_cast<ADS1115::i2c_device::SlaveAddress>(Config::ReferenceAddr);
+
+        // Mouthpiece pressure sensor (see flow_gate.h), same bus. -1 = none
+        int flow_channel = Config::FlowChannel;
+        ADS1115::i2c_device::SlaveAddress flow_addr = static_cast<ADS1115::i2c_device::SlaveAddress>(Config::FlowAddr);
+    };
+
+    // The Pi: LEDs through libgpiod, MQ-3 through the ADS1115 on /dev/i2c-N.
+    struct Ads1115Backend
+    {
+        using Settings = Ads1115Backend_Config;
+        using Source = FlowMuxSource<ReferencePairSource<Ads1115_Source<ADS1115>>, Ads1115_Source<ADS1115>>;
+
+        Settings cfg;
+        GPIOBank gpio_bank;
+        ADS1115 ads1115;
+        Source source;
+
+        // More than one conversion per tick with a reference or flow sensor, at 128 SPS one already takes the whole
+        // period. Flow gets whatever 860 SPS reads still fit after the MQ-3 ones, once Init() knows the bus speed.
+        explicit Ads1115Backend(const Settings& in_cfg)
+            : cfg(in_cfg)
+            , gpio_bank(in_cfg.gpio_chip)
+            , source(ads1115, in_cfg.addr,
+                     ADS1115::Mux::AIN0_GND,
+                     ADS1115::Pga::FS_4_096V,
+                     MainReadRate(in_cfg.reference_channel, in_cfg.flow_channel))
+        {
+            if (cfg.reference_channel >= 0)
+            {
+                source.reference.emplace(ads1115, cfg.reference_addr, ADS1115::SingleEndedMux(static_cast<std::uint8_t>(cfg.reference_channel)),
+                    ADS1115::Pga::FS_4_096V, ADS1115::DataRate::SPS_475);
+            }
+
+        }
+
+        bool Init()
+        {
+            if (!gpio_bank.Init())
+            {
+                std::perror("Critical Error: Failed to initialize LED GPIOs");
+                return false;
+            }
+
+            if (!ads1115.Init(cfg.i2c_bus, cfg.addr))
+            {
+                std::perror("Critical Error: Failed to initialize ADC");
+                return false;
+            }
+            AttachI2cRecovery(ads1115, cfg.i2c_bus, cfg.gpio_chip);
+            const bool bBusOk = VerifyI2cBus(ads1115, cfg.addr, Config::I2cBusHz);
+            if (cfg.flow_channel >= 0)
+            {
+                AttachFlow(ads1115, source, cfg.flow_addr, cfg.flow_channel, MainReadRate(cfg.reference_channel, cfg.flow_channel), bBusOk);
+            }
+
+            if (cfg.ready_gpio >= 0)
+            {
+                std::vector<ADS1115::i2c_device::SlaveAddress> addrs{cfg.addr};
+                if (source.reference && cfg.reference_addr != cfg.addr) {addrs.push_back(cfg.reference_addr);}
+                if (source.flow && std::find(addrs.begin(), addrs.end(), cfg.flow_addr) == addrs.end()) {addrs.push_back(cfg.flow_addr);}
+                AttachAdcReadyLine(ads1115, cfg.gpio_chip, cfg.ready_gpio, addrs);
+            }
+            return true;
+        }
+
+        GpioLines& Lines() { return gpio_bank; }
+    };
+
+    struct SpiBackend_Config
+    {
+        const char* spi_device = Config::SpiDevice;
+        std::uint32_t speed_hz = Config::SpiClockHz;
+        const char* gpio_chip = "/dev/gpiochip0";
+        SpiAdc_Config source{}; // MQ-3 on CH0, reference / flow on Config::ReferenceChannel / FlowChannel
+    };
+
+    // The Pi with an SPI ADC (spi_adc.h) in place of the ADS1115: every channel in one spidev ioctl per tick.
+    template<class Chip = Mcp3208>
+    struct SpiBackend
+    {
+        using Settings = SpiBackend_Config;
+        using Source = SpiAdcSource<Chip, SpiBus>;
+
+        Settings cfg;
+        GPIOBank gpio_bank;
+        SpiBus bus;
+        Source source;
+
+        explicit SpiBackend(const Settings& in_cfg)
+            : cfg(in_cfg)
+            , gpio_bank(in_cfg.gpio_chip)
+            , source(bus, in_cfg.source) {}
+
+        bool Init()
+        {
+            if (!gpio_bank.Init())
+            {
+                std::perror("Critical Error: Failed to initialize LED GPIOs");
+                return false;
+            }
+
+            if (cfg.speed_hz > Chip::MaxClockHz)
+            {
+                fmt::print(stderr, "Warning: {} Hz is past the {}'s {} Hz\n", cfg.speed_hz, Chip::Name, Chip::MaxClockHz);
+            }
+
+            if (!bus.Init(cfg.spi_device, cfg.speed_hz) || !source.Setup())
+            {
+                fmt::print(stderr, "Critical Error: Failed to initialize {}\n", Chip::Name);
+                return false;
+            }
+            return true;
+        }
+
+        GpioLines& Lines() { return gpio_bank; }
+    };
+
+    struct Ads1115StationBackend_Config
+    {
+        std::vector<Config::StationSensorLayout> sensors{Config::StationLayout.begin(), Config::StationLayout.end()};
+        const char* gpio_chip = "/dev/gpiochip0";
+
+        // A bus thread reads its sensors back to back inside one sample period, at 128 SPS a single conversion
+        // already takes the whole period. 475 SPS fits a few channels per bus.
+        ADS1115::DataRate rate = ADS1115::DataRate::SPS_475;
+    };
+
+    // Station mode on the Pi: one ADS1115 handle per I2C bus (the address goes with every transfer, so one handle
+    // serves every board on that bus) and one GPIOBank per sensor LED row.
+    struct Ads1115StationBackend
+    {
+        using Settings = Ads1115StationBackend_Config;
+        using Source = Ads1115_Source<ADS1115>;
+
+        struct Bus
+        {
+            int i2c_bus = 1;
+            ADS1115::i2c_device::SlaveAddress first_addr{};
+            std::unique_ptr<ADS1115> ads1115;
+            std::vector<ADS1115::i2c_device::SlaveAddress> addrs{}; // Every board on the bus
+            int ready_gpio = -1;
+        };
+
+        struct Slot
+        {
+            Sensor_Config sensor;
+            LedPins pins{};
+            std::unique_ptr<GPIOBank> gpio;
+            std::unique_ptr<Source> source;
+        };
+
+        std::vector<Bus> buses;
+        std::vector<Slot> slots;
+        const char* gpio_chip;
+
+        explicit Ads1115StationBackend(const Settings& in_cfg) : gpio_chip(in_cfg.gpio_chip)
+        {
+            for (const Config::StationSensorLayout& layout : in_cfg.sensors)
+            {
+                const auto addr = static_cast<ADS1115::i2c_device::SlaveAddress>(layout.addr);
+
+                std::size_t bus_index = 0;
+                while (bus_index < buses.size() && buses[bus_index].i2c_bus != layout.i2c_bus) {++bus_index;}
+                if (bus_index == buses.size()) {buses.push_back({layout.i2c_bus, addr, std::make_unique<ADS1115>()});}
+
+                Bus& bus = buses[bus_index];
+                if (std::find(bus.addrs.begin(), bus.addrs.end(), addr) == bus.addrs.end()) {bus.addrs.push_back(addr);}
+                if (layout.ready_gpio >= 0) {bus.ready_gpio = layout.ready_gpio;}
+
+                Slot slot{};
+                slot.sensor.name = layout.name;
+                slot.sensor.bus = bus_index;
+                slot.sensor.analyzer.bDebugPrint = false; // N sensors of DBG lines is unreadable
+
+                for (std::size_t i = 0; i < slot.pins.size(); ++i)
+                {
+                    slot.pins[i] = {layout.led_gpio[i], static_cast<LedType>(i)};
+                }
+
+                const auto mux = ADS1115::SingleEndedMux(layout.channel);
+                slot.gpio = std::make_unique<GPIOBank>(in_cfg.gpio_chip, slot.pins);
+                slot.source = std::make_unique<Source>(*buses[bus_index].ads1115, addr, mux, ADS1115::Pga::FS_4_096V, in_cfg.rate);
+                slots.push_back(std::move(slot));
+            }
+        }
+
+        bool Init()
+        {
+            for (Slot& slot : slots)
+            {
+                if (!slot.gpio->Init("drunk_station"))
+                {
+                    fmt::print(stderr, "Critical Error: Failed to initialize LED GPIOs for {}\n", slot.sensor.name);
+                    return false;
+                }
+            }
+
+            // A board that isn't answering only fails its own reads later, the station benches it.
+            for (Bus& bus : buses)
+            {
+                if (!bus.ads1115->Init(bus.i2c_bus, bus.first_addr))
+                {
+                    std::perror("Critical Error: Failed to initialize ADC");
+                    return false;
+                }
+
+                AttachI2cRecovery(*bus.ads1115, bus.i2c_bus, gpio_chip);
+                VerifyI2cBus(*bus.ads1115, bus.first_addr, Config::I2cBusHz);
+
+                // The speed is the adapter's, settled once above, but every board on the bus gets its own echo test.
+                for (const auto board : bus.addrs)
+                {
+                    if (board == bus.first_addr) {continue;}
+                    if (!BusSelfTest(*bus.ads1115, board, bus.ads1115->BusHz()).bEcho)
+                    {
+                        fmt::print(stderr, "Warning: I2C self test, 0x{:02x} on /dev/i2c-{} didn't read its config back at {} Hz\n",
+                            static_cast<int>(board), bus.i2c_bus, bus.ads1115->BusHz());
+                    }
+                }
+                if (bus.ready_gpio >= 0) {AttachAdcReadyLine(*bus.ads1115, gpio_chip, bus.ready_gpio, bus.addrs);}
+            }
+            return true;
+        }
+
+        std::size_t Count() const noexcept { return slots.size(); }
+        const Sensor_Config& SensorAt(std::size_t index) const { return slots[index].sensor; }
+        Source& SourceAt(std::size_t index) { return *slots[index].source; }
+        GpioLines& LinesAt(std::size_t index) { return *slots[index].gpio; }
+    };
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdio>
+#include <string>
+#include "gpio_emu.h"
+#include "recording_source.h"
+
+namespace DrunkAPI
+{
+    struct ReplayBackend_Config
+    {
+        std::string path; // .drec, flight recorder file or CSV
+        bool bLoop = false;
+        bool bEchoLeds = true;
+    };
+
+    // Host mode: a captured session played back in real time through the live pipeline, LEDs in memory.
+    struct ReplayBackend
+    {
+        using Settings = ReplayBackend_Config;
+        using Source = RecordingSource;
+
+        Settings cfg;
+        EmuGpio gpio;
+        Source source;
+
+        explicit ReplayBackend(const Settings& in_cfg) : cfg(in_cfg), gpio(in_cfg.bEchoLeds), source(in_cfg.bLoop) {}
+
+        bool Init()
+        {
+            if (!gpio.Init())
+            {
+                std::perror("Critical Error: Failed to initialize LED GPIOs");
+                return false;
+            }
+
+            if (!source.Load(cfg.path))
+            {
+                std::fprintf(stderr, "Critical Error: Failed to load replay %s\n", cfg.path.c_str());
+                return false;
+            }
+            return true;
+        }
+
+        GpioLines& Lines() { return gpio; }
+    };
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Second opinion on a Processing run before it becomes an Analyzed breath. A door opening or a spilled drink next to
+// the jug walks the MQ-3 over the start threshold just like a blow does, and every one of those used to cost a whole
+// Cooldown (25 stable windows) of not listening. The shape gives most of them away: a blow jumps (the sensor's rise tau
+// on a big step), tops out and starts decaying once the blow is over, room vapor creeps up and keeps going.
+//
+// Five features off the candidate's windows go through a logistic regression, the weights are trained offline by
+// drunk_train over labeled recordings and compiled in as a constexpr table (breath_classifier_model.h). One score is
+// a handful of multiply-adds, a few logs and one exp, well under a microsecond.
+namespace DrunkAPI
+{
+    inline constexpr std::size_t BreathFeatureCount = 5;
+
+    struct BreathFeatures
+    {
+        double rise_slope = 0.0; // Steepest window to window climb, V/s (including the window that started it)
+        double auc = 0.0; // Sum of (window mean - baseline) * window length, V*s
+        double duration_s = 0.0; // Start of the first window to the end of the last. Not a model input, see BreathModelInputs
+        double peak_height = 0.0; // Peak window mean over baseline, V
+        double peak_position = 0.0; // Where in the run the peak was, 0 = first window, 1 = last
+        double end_drop = 0.0; // How far the last window fell back from the peak, fraction of peak_height
+    };
+
+    // What the model actually sees. The magnitudes span a couple of decades (a whiff vs a 0.12 BAC blow) so they go in
+    // as logs, the shape fractions as they are. The duration is left out: the MQ-3 decays far slower than a blow, so
+    // Processing nearly always runs to max_blow_time_us and the duration is the same for blows and vapor alike.
+    inline constexpr const char* BreathFeatureNames[BreathFeatureCount] = {"log rise_slope", "log auc", "log peak_height", "peak_position", "end_drop"};
+
+    inline std::array<double, BreathFeatureCount> BreathModelInputs(const BreathFeatures& features)
+    {
+        constexpr double Floor = 1e-4;
+        return {
+            std::log(std::max(features.rise_slope, Floor)),
+            std::log(std::max(features.auc, Floor)),
+            std::log(std::max(features.peak_height, Floor)),
+            features.peak_position,
+            features.end_drop,
+        };
+    }
+
+    // p(breath) = 1 / (1 + exp(-(bias + sum weight * (input - mean) / scale)))
+    struct BreathModel
+    {
+        std::array<double, BreathFeatureCount> mean{};
+        std::array<double, BreathFeatureCount> scale{1.0, 1.0, 1.0, 1.0, 1.0};
+        std::array<double, BreathFeatureCount> weight{};
+        double bias = 0.0;
+
+        double Logit(const BreathFeatures& features) const
+        {
+            const std::array<double, BreathFeatureCount> inputs = BreathModelInputs(features);
+            double logit = bias;
+            for (std::size_t i = 0; i < BreathFeatureCount; ++i) {logit += weight[i] * ((inputs[i] - mean[i]) / scale[i]);}
+            return logit;
+        }
+
+        double Score(const BreathFeatures& features) const
+        {
+            return 1.0 / (1.0 + std::exp(-Logit(features)));
+        }
+    };
+
+    // Builds BreathFeatures one finalized window at a time, from the window that crossed the start threshold to the
+    // one Processing ended on. Baseline is the (frozen) one the start threshold was computed from.
+    class BreathFeatureTracker final
+    {
+        public:
+            void Begin(double baseline_volts)
+            {
+                baseline = baseline_volts;
+                features = {};
+                peak = -1e9;
+                peak_end_us = 0;
+                first_start_us = 0;
+                last_mean = 0.0;
+                windows = 0;
+            }
+
+            void Add(double mean, double mean_prev, std::uint64_t window_start_us, std::uint64_t window_end_us)
+            {
+                const double window_s = static_cast<double>(window_end_us - window_start_us) * 1e-6;
+                if (windows == 0) {first_start_us = window_start_us;}
+                ++windows;
+
+                if (std::isfinite(mean_prev) && window_s > 0.0) {features.rise_slope = std::max(features.rise_slope, (mean - mean_prev) / window_s);}
+                features.auc += std::max(0.0, mean - baseline) * window_s;
+                if (mean > peak)
+                {
+                    peak = mean;
+                    peak_end_us = window_end_us;
+                }
+                last_mean = mean;
+                last_end_us = window_end_us;
+            }
+
+            const BreathFeatures& Finish()
+            {
+                if (windows == 0) {return features;}
+
+                const auto span_us = static_cast<double>(last_end_us - first_start_us);
+                features.duration_s = span_us * 1e-6;
+                features.peak_height = std::max(0.0, peak - baseline);
+                // Window ends, so a single window run has its peak at 1 and a peak in the first of five sits at 0.2.
+                features.peak_position = span_us > 0.0 ? static_cast<double>(peak_end_us - first_start_us) / span_us : 1.0;
+                features.end_drop = features.peak_height > 0.0 ? std::clamp((peak - last_mean) / features.peak_height, 0.0, 1.0) : 0.0;
+                return features;
+            }
+
+            const BreathFeatures& Features() const noexcept { return features; }
+
+        private:
+            BreathFeatures features{};
+            double baseline = 0.0;
+            double peak = 0.0;
+            double last_mean = 0.0;
+            std::uint64_t peak_end_us = 0;
+            std::uint64_t first_start_us = 0;
+            std::uint64_t last_end_us = 0;
+            std::uint32_t windows = 0;
+    };
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include "breath_classifier.h"
+
+// Generated by drunk_train, don't edit. Regenerate with drunk_train --out source/breath_classifier_model.h <recording>...
+// (the recordings the shipped table came from are made by the drunk_siggen loop under Breath Classifier in README.md)
+// 875 candidates from 8 recordings. Inputs: log rise_slope, log auc, log peak_height, peak_position, end_drop
+namespace DrunkAPI
+{
+    inline constexpr BreathModel DefaultBreathModel{
+        {-0.798579628, 1.32424961, -0.0816503222, 0.914742857, 0.00293792097},
+        {1.41747518, 1.02532394, 0.950630794, 0.136903792, 0.0106167234},
+        {4.99563933, 3.22255907, 1.88225806, -1.86901668, 0.423326684},
+        -4.28683778,
+    };
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+// Clocks the consumer loop can run on. Anything with now() / sleep_for() works, ProcessRunner takes it as a template
+// parameter so the live build still compiles down to plain steady_clock calls.
+namespace DrunkAPI
+{
+    // Live clock, monotonic. Same time base the sampler stamps samples with.
+    struct SteadyClock
+    {
+        static std::chrono::microseconds now()
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch());
+        }
+
+        static void sleep_for(std::chrono::microseconds duration) { std::this_thread::sleep_for(duration); }
+    };
+
+    // Virtual clock for replay. Sleeping just moves time forward, so an hour of recording runs as fast as the
+    // analyzers can chew through it while the consumer still sees the same batch cuts it would live.
+    // Handle type, copies share the same time so the runner and the replay feed agree on "now".
+    class ManualClock
+    {
+        public:
+            explicit ManualClock(std::uint64_t& in_now_us) : now_us(&in_now_us) {}
+
+            std::chrono::microseconds now() const { return std::chrono::microseconds(*now_us); }
+            void sleep_for(std::chrono::microseconds duration) const { *now_us += static_cast<std::uint64_t>(duration.count()); }
+            void set(std::uint64_t t_us) const { *now_us = t_us; }
+
+        private:
+            std::uint64_t* now_us;
+    };
+}
@@ -0,0 +1,93 @@
+#include "clock_sync.h"
+#include <algorithm>
+
+namespace DrunkAPI
+{
+    bool ClockSync::Add(const ClockExchange& exchange)
+    {
+        // Pong from before a clock step or just garbage, either way nothing to learn from it.
+        if (exchange.t4_us < exchange.t1_us || exchange.t3_us < exchange.t2_us) {return false;}
+        ++exchanges;
+
+        const auto round_trip = static_cast<std::int64_t>(exchange.t4_us - exchange.t1_us);
+        const auto held = static_cast<std::int64_t>(exchange.t3_us - exchange.t2_us);
+        const auto there = static_cast<std::int64_t>(exchange.t2_us - exchange.t1_us);
+        const auto back = static_cast<std::int64_t>(exchange.t3_us - exchange.t4_us);
+
+        Point point{};
+        point.mono_us = exchange.t1_us + (exchange.t4_us - exchange.t1_us) / 2;
+        point.offset_us = there / 2 + back / 2 + (there % 2 + back % 2) / 2;
+        point.delay_us = static_cast<std::uint32_t>(std::clamp<std::int64_t>(round_trip - held, 0, UINT32_MAX));
+        block.push_back(point);
+
+        if (block.size() < std::max<std::size_t>(cfg.filter, 1)) {return false;}
+
+        const auto best = std::min_element(block.begin(), block.end(), [](const Point& lhs, const Point& rhs){ return lhs.delay_us < rhs.delay_us; });
+        points.push_back(*best);
+        block.clear();
+        if (points.size() > cfg.history) {points.erase(points.begin());}
+
+        Fit();
+        return true;
+    }
+
+    void ClockSync::Reset()
+    {
+        block.clear();
+        points.clear();
+        map = ClockMap{};
+        exchanges = 0;
+    }
+
+    void ClockSync::Fit()
+    {
+        std::uint32_t best_delay = UINT32_MAX;
+        for (const Point& point : points) {best_delay = std::min(best_delay, point.delay_us);}
+        const std::uint64_t max_delay = 2ULL * best_delay + cfg.delay_slack_us;
+
+        // Line through the good points, relative to the newest one so the doubles stay small.
+        const Point& newest = points.back();
+        double n = 0.0;
+        double sum_x = 0.0;
+        double sum_y = 0.0;
+        double sum_xx = 0.0;
+        double sum_xy = 0.0;
+        for (const Point& point : points)
+        {
+            if (point.delay_us > max_delay) {continue;}
+            const double x = static_cast<double>(static_cast<std::int64_t>(point.mono_us - newest.mono_us));
+            const double y = static_cast<double>(point.offset_us - newest.offset_us);
+            n += 1.0;
+            sum_x += x;
+            sum_y += y;
+            sum_xx += x * x;
+            sum_xy += x * y;
+        }
+
+        // Three points minimum before a slope means anything, until then it's the best recent offset.
+        double slope = 0.0; // us per us
+        double intercept = sum_y / std::max(n, 1.0);
+        const double denom = n * sum_xx - sum_x * sum_x;
+        if (n >= 3.0 && denom > 0.0)
+        {
+            slope = std::clamp((n * sum_xy - sum_x * sum_y) / denom, -cfg.max_drift_ppm * 1e-6, cfg.max_drift_ppm * 1e-6);
+            intercept = (sum_y - slope * sum_x) / n;
+        }
+
+        double residual = 0.0;
+        for (const Point& point : points)
+        {
+            if (point.delay_us > max_delay) {continue;}
+            const double x = static_cast<double>(static_cast<std::int64_t>(point.mono_us - newest.mono_us));
+            const double error = static_cast<double>(point.offset_us - newest.offset_us) - (intercept + slope * x);
+            residual += error * error;
+        }
+        residual = std::sqrt(residual / std::max(n, 1.0));
+
+        map.ref_mono_us = newest.mono_us;
+        map.offset_us = newest.offset_us + std::llround(intercept);
+        map.drift_ppm = slope * 1e6;
+        map.uncertainty_us = static_cast<std::uint32_t>(best_delay / 2 + static_cast<std::uint32_t>(std::lround(residual)));
+        map.points = static_cast<std::uint32_t>(n);
+    }
+}
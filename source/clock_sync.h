@@ -0,0 +1,89 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "config_settings.h"
+
+// Unit steady_clock -> fleet shared time, estimated NTP style over the collector connection.
+//
+// Each exchange is a ping stamped t1 on the unit's steady clock, stamped t2 / t3 by the collector on receive / reply
+// (shared time = the collector's steady clock + a unix offset fixed when it started), and t4 back on the unit:
+//
+//   offset = ((t2 - t1) + (t3 - t4)) / 2        delay = (t4 - t1) - (t3 - t2)
+//
+// A queued ping only ever reads as too much delay and a skewed offset, never too little, so out of every `filter`
+// exchanges only the fastest one is kept (min RTT filter). The kept points from the last minute or so then get a least
+// squares line, offset against unit time, whose slope is the crystal drift between the two clocks (tens of ppm on a Pi,
+// ~1ms a minute, too much to treat the offset as constant). Points well above the best delay seen are left out of the fit.
+//
+// The result is a ClockMap that rides along with every sample block, so the collector maps a block with one multiply
+// add per sample and the wire format stays plain Samples. Path asymmetry (slow uplink, fast downlink) is invisible to
+// any ping scheme and ends up in the offset, on a LAN that's tens of microseconds.
+namespace DrunkAPI
+{
+    // On the wire (NetFrameType::ClockSamples), so fixed layout.
+    struct ClockMap
+    {
+        std::uint64_t ref_mono_us; // Unit steady time the offset is for
+        std::int64_t offset_us; // shared = mono + offset + drift_ppm * (mono - ref) / 1e6
+        double drift_ppm;
+        std::uint32_t uncertainty_us; // Half the best RTT + fit residual
+        std::uint32_t points; // 0 = no estimate yet
+    };
+    static_assert(sizeof(ClockMap) == 32, "ClockMap is a wire format");
+
+    inline std::uint64_t MapToShared(const ClockMap& map, std::uint64_t mono_us)
+    {
+        const auto since_ref = static_cast<double>(static_cast<std::int64_t>(mono_us - map.ref_mono_us));
+        return mono_us + static_cast<std::uint64_t>(map.offset_us + std::llround(map.drift_ppm * since_ref * 1e-6));
+    }
+
+    struct ClockExchange
+    {
+        std::uint64_t t1_us; // Unit, ping sent
+        std::uint64_t t2_us; // Collector, ping received
+        std::uint64_t t3_us; // Collector, pong sent
+        std::uint64_t t4_us; // Unit, pong received
+    };
+
+    struct ClockSync_Config
+    {
+        std::size_t filter = Config::ClockFilterExchanges; // Exchanges per kept point
+        std::size_t history = Config::ClockHistoryPoints;
+        std::uint32_t delay_slack_us = 200; // Points slower than 2x best delay + this stay out of the fit
+        double max_drift_ppm = 500.0; // Anything more is a bad fit, not a crystal
+    };
+
+    class ClockSync final
+    {
+        public:
+            explicit ClockSync(ClockSync_Config in_cfg = {}) : cfg(in_cfg) {}
+
+            // Returns true when it produced a new point (and so a new Map()).
+            bool Add(const ClockExchange& exchange);
+
+            // Fresh connection to a possibly different collector, start over.
+            void Reset();
+
+            bool Valid() const noexcept { return map.points > 0; }
+            const ClockMap& Map() const noexcept { return map; }
+            std::size_t Exchanges() const noexcept { return exchanges; }
+
+        private:
+            struct Point
+            {
+                std::uint64_t mono_us; // Midpoint of t1..t4
+                std::int64_t offset_us;
+                std::uint32_t delay_us;
+            };
+
+            void Fit();
+
+            ClockSync_Config cfg;
+            std::vector<Point> block; // Current filter window
+            std::vector<Point> points; // Kept, oldest first
+            ClockMap map{};
+            std::size_t exchanges = 0;
+    };
+}
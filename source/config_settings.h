@@ -1,5 +1,7 @@
 // constants.h
 #pragma once
+#include <array>
+#include <bit>
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
@@ -15,6 +17,43 @@ namespace DrunkAPI::Config
     // If you want rounding instead of truncation uncomment this.
     // inline constexpr auto SamplePeriod = std::chrono::microseconds((1'000'000 + SampleRate_Hz/2) / SampleRate_Hz);
 
+    // State driven sample rate (RuntimeProcess asks the Sampler on every breath state change), off = SampleRate_Hz
+    // the whole session. Warmup and Cooldown stay at SampleRate_Hz, only single channel sources can change rate.
+    inline constexpr bool DynamicSampleRate = false;
+    inline constexpr std::uint32_t ReadySampleHz = 32; // Waiting on a blow
+    inline constexpr std::uint32_t ProcessingSampleHz = 860; // During one, capped at back to back 860 SPS reads (~660Hz at 400kHz)
+
+    // ADS1115 ALERT/RDY -> GPIO line (BCM numbering). Samples are then stamped with the kernel's edge timestamp,
+    // -1 = not wired, the conversion end is estimated from the OS bit polls instead.
+    inline constexpr int AdcReadyGpio = -1;
+
+    // I2C fault recovery (see i2c_recovery.h). Retries stay inside the read, reopening the fd and clocking the bus
+    // free go by failed reads in a row on the same bus.
+    inline constexpr std::uint8_t I2cRetries = 2; // Per read, NACKs / bus errors only (a timed out conversion isn't retried)
+    inline constexpr std::uint32_t I2cReopenAfter = 4;
+    inline constexpr std::uint32_t I2cBusRecoverAfter = 16;
+    inline constexpr std::uint32_t I2cRecoverEveryMs = 1000; // Still out after that, try the bus recovery again this often
+    inline constexpr double I2cAvailabilitySlo = 0.999; // Bus up this fraction of the session, warned about when an outage breaks it
+    inline constexpr std::uint32_t I2cSloMinSessionS = 600; // Not judged before this, a bus that's down at boot would read 0% otherwise
+
+    // SCL clock out (9 pulses + STOP) for a slave holding SDA low. The adapter driver is unbound to get the pins as
+    // GPIOs and bound again to hand them back, empty device = no bus recovery, only the fd is reopened.
+    inline constexpr int I2cRecoveryBus = 1; // /dev/i2c-N the pins below belong to
+    inline constexpr int I2cSclGpio = 3;
+    inline constexpr int I2cSdaGpio = 2;
+    inline constexpr const char* I2cAdapterDriver = "/sys/bus/platform/drivers/i2c-bcm2835";
+    inline constexpr const char* I2cAdapterDevice = ""; // "fe804000.i2c" on a Pi 4 (ls the driver dir)
+
+    // I2C bus speed. The ADS1115 does 100kHz standard, 400kHz fast and 3.4MHz high speed mode. This is what's asked
+    // for, the adapter's clock-frequency is what we get, and the self test at startup checks the chip keeps up.
+    // High speed needs the HS master code ahead of every transaction: HS capable controllers send it themselves
+    // (the Pi's bcm2835 isn't one, it tops out in fast mode), the software one is for controllers that don't.
+    inline constexpr std::uint32_t I2cBusHz = 400'000; // dtparam=i2c_arm_baudrate, flow reads only fit between MQ-3 samples at fast mode or better
+    inline constexpr std::uint8_t I2cHsMasterCode = 0x08; // 0000 1xxx, xxx tells masters apart on a multi master bus
+    // A NACKed zero length write ahead of each transaction, needs I2C_FUNC_PROTOCOL_MANGLING. It goes out at the
+    // adapter's clock rather than the <= 400kHz the spec wants, so it stays off unless a controller needs it.
+    inline constexpr bool I2cHsSoftwareMasterCode = false;
+
     // Default Ring Buffer 
     inline constexpr std::size_t RingSize = 4096; // Note, must be valid power of 2
 
@@ -23,11 +62,18 @@ namespace DrunkAPI::Config
     inline constexpr std::chrono::milliseconds ConsumerTickSleep(50);
     inline constexpr std::chrono::minutes ConsumerTimeout(1); // 15 min
     inline constexpr std::size_t ConsumerMaxBatch(256); // Default 256
+    inline constexpr std::size_t PendingWindows = 16; // Finalized windows RuntimeProcess holds for the callback, a full batch closes 4 at 0.5s
 
     // Default Welford Analyzer Settings
     inline constexpr std::uint32_t WindowUs = 1'000'000; // 1 Second per Window default
     inline constexpr std::size_t   MinWindowSamples = 80; // 80 per second
 
+    // Adaptive window length (WelfordAnalyzer), off = every window is WindowUs
+    inline constexpr bool AdaptiveWindow = false;
+    inline constexpr std::uint32_t MinWindowUs = 500'000; // Lengths are WindowUs times a power of two within these. Shorter and one railed read moves a window past the start threshold
+    inline constexpr std::uint32_t MaxWindowUs = 4'000'000;
+    inline constexpr double WindowNoiseTarget = 0.5; // Window noise aimed at this fraction of what the stability test allows
+
     // Statistical Stability Tuneables
     inline constexpr double Max_Sd_Threshold = 0.002; // default 0.003
     inline constexpr double Max_Drift_Rate_Per_Sec = 0.001; // default 0.001
@@ -58,6 +104,109 @@ namespace DrunkAPI::Config
     inline constexpr const double Rise_Noise_Factor = 3.0;
     inline constexpr const double Fall_Noise_Factor = 2.0;
     inline constexpr const double Ready_Noise_Factor = 2.0;
+
+    // Breath classifier (breath_classifier.h), vets a Processing run before it's reported. The shipped table is
+    // drunk_train's output over the synthetic set in the README, retrain on jug recordings when there are some.
+    inline constexpr bool ClassifyBreaths = true;
+    inline constexpr double ClassifyThreshold = 0.5; // p(breath) below this goes straight back to Ready, no Cooldown
+
+    // Reference MQ-3 (shielded from the breath, ambient compensation), off unless a channel is set
+    // -----------------------------
+    inline constexpr int ReferenceChannel = -1; // AINn of the reference sensor, -1 = no reference
+    inline constexpr std::uint8_t ReferenceAddr = 0x48; // Its ADS1115, the main sensor's board by default
+    inline constexpr double ReferenceAirVolts = 0.0; // Reference reading in clean air, 0 = lowest it has settled at
+    inline constexpr std::size_t ReferenceMaxLag = 32; // Cross-correlation span each way (250ms), also the added latency
+
+    // Mouthpiece flow (differential pressure sensor across an orifice, see flow_gate.h), off unless a channel is set
+    // -----------------------------
+    inline constexpr int FlowChannel = -1; // AINn of the pressure sensor, -1 = MQ-3 voltage alone starts/ends a breath
+    inline constexpr std::uint8_t FlowAddr = 0x48; // Its ADS1115, the main sensor's board by default
+    inline constexpr std::size_t FlowMaxReadsPerTick = 4; // Flow conversions per MQ-3 sample, fewer if the bus can't fit them
+    inline constexpr double FlowVoltsPerKpa = 1.0; // MPXV7002DP at 5V, 2.5V at 0 Pa
+    inline constexpr double FlowOrificeK = 0.035; // L/s per sqrt(Pa), 0.5 L/s at ~200 Pa through the mouthpiece
+    inline constexpr double FlowStartLps = 0.15; // Exhale starts above this...
+    inline constexpr double FlowEndLps = 0.08; // ...and ends below this
+    inline constexpr double FlowMinVolumeL = 1.0; // Less than this blown and the MQ-3 never saw deep lung air
+    inline constexpr double FlowDeadSpaceL = 0.15; // Mouth/airway/mouthpiece air that leaves first, no alcohol in it
+    inline constexpr std::uint64_t FlowTailUs = 4'000'000; // After the exhale the MQ-3 gets this long to reach its peak
+    inline constexpr double Mq3RiseTau_s = 1.5; // MQ-3 response to a step in alcohol (first order)
+
+    // SPI ADC (MCP3208 / ADS8688 class, see spi_adc.h), the --spi backend. Main sensor on CH0, the reference and
+    // flow sensor on ReferenceChannel / FlowChannel of the same chip, every channel read in one burst per tick.
+    // -----------------------------
+    inline constexpr const char* SpiDevice = "/dev/spidev0.0";
+    inline constexpr std::uint32_t SpiClockHz = 1'000'000; // MCP3208 is good to 2MHz at 5V, 1MHz at 2.7V
+    inline constexpr std::size_t SpiBurstDepth = 1; // Conversions per channel per sampler tick, 8 = 1024 Hz a channel
+    inline constexpr std::size_t SpiMaxBurstDepth = 32;
+
+    // Flight Recorder (mmap black box, survives a crash)
+    // -----------------------------
+    inline constexpr const char* FlightRecorderPath = "/var/tmp/drunk_app.flight"; // Previous run is kept as .prev
+    inline constexpr std::size_t FlightRecorderMinutes = 10; // Minutes of raw samples to keep
+    inline constexpr std::size_t FlightSampleSlots = std::bit_ceil(static_cast<std::size_t>(SampleRate_Hz) * 60U * FlightRecorderMinutes);
+    inline constexpr std::size_t FlightEventSlots = 8192; // Windows + state transitions
+
+    // Window/Breath History (compressed time-series store)
+    // -----------------------------
+    inline constexpr const char* HistoryPath = "/var/lib/drunk_app/history";
+    inline constexpr std::uint32_t HistoryRawDays = 14; // 1s windows
+    inline constexpr std::uint32_t HistoryMinuteDays = 180; // 1min rollups
+    inline constexpr std::uint32_t HistoryHourDays = 3650; // 1h rollups
+
+    // Result Journal (audit trail, group committed)
+    // -----------------------------
+    inline constexpr const char* JournalPath = "/var/lib/drunk_app/results.wal";
+    inline constexpr std::chrono::microseconds JournalCommitBudget(20'000); // Max wait before a record is synced
+    inline constexpr std::size_t JournalMaxBytes = 4U * 1024U * 1024U; // Compact past this
+    inline constexpr std::size_t JournalKeepRecords = 20'000;
+
+    // Session capture (off by default, empty dir disables)
+    // -----------------------------
+    inline constexpr const char* RecordingDir = ""; // Raw .drec sample recordings, eg "/var/lib/drunk_app/recordings"
+    inline constexpr const char* ArrowExportDir = ""; // Arrow IPC samples/windows/events tables for pandas/polars
+    inline constexpr std::size_t ArrowBatchRows = 65'536; // Rows per record batch (~8.5 min of samples)
+
+    // Fleet streaming (unit -> drunk_collector, off unless a host is set)
+    // -----------------------------
+    inline constexpr const char* CollectorHost = ""; // eg "10.0.0.2" or "collector.lan"
+    inline constexpr std::uint16_t CollectorPort = 9130;
+    inline constexpr std::uint64_t UnitId = 0; // 0 = hash of the hostname
+    inline constexpr std::size_t NetMaxBuffered = 5 * 60 * SampleRate_Hz; // 5 min of samples while the collector is away
+    inline constexpr std::chrono::milliseconds NetFlushEvery(250);
+    inline constexpr std::chrono::milliseconds NetReconnectEvery(2'000);
+    inline constexpr std::chrono::milliseconds ClockPingEvery(250); // Clock sync exchange with the collector
+    inline constexpr std::chrono::milliseconds ClockPingTimeout(100); // Pong later than this is dropped
+    inline constexpr std::size_t ClockFilterExchanges = 4; // Fastest of every 4 pings is kept (1 point a second)
+    inline constexpr std::size_t ClockHistoryPoints = 64; // ~1 min of points in the drift fit
+
+    // Collector side (drunk_collector)
+    inline constexpr const char* CollectorArchiveDir = "/var/lib/drunk_collector";
+    inline constexpr std::chrono::seconds ArchiveBucket(60); // One archive segment per minute of wall time
+    inline constexpr std::chrono::milliseconds ArchiveLateness(2'000); // Out of order allowance before a sample is late
+    inline constexpr std::chrono::seconds ArchiveStallAfter(10); // Silent unit stops holding the merge back
+    inline constexpr std::size_t ArchiveMaxBuffered = 4'000'000; // Samples (64MB) waiting to merge, past this we force it
+
+    // Station mode (--station, several mouthpieces in one process)
+    // -----------------------------
+    struct StationSensorLayout
+    {
+        const char* name; // Console tag + history/journal suffix
+        int i2c_bus; // /dev/i2c-N, sensors on the same bus share a sampler thread
+        std::uint8_t addr; // ADS1115 address, 0x48 (ADDR->GND) .. 0x4B (ADDR->SCL)
+        std::uint8_t channel; // AIN0..AIN3 single ended
+        std::array<unsigned int, 5> led_gpio; // Blue Green Yellow Orange Red
+        int ready_gpio = -1; // ALERT/RDY, boards on one bus can share a line (open drain). -1 = not wired
+    };
+
+    // Two MQ-3s on one ADS1115 (AIN0, AIN1), second LED row on the free header pins.
+    inline constexpr std::array<StationSensorLayout, 2> StationLayout = {{
+        {"left", 1, 0x48, 0, {26, 17, 27, 22, 16}},
+        {"right", 1, 0x48, 1, {5, 6, 13, 19, 20}},
+    }};
+    inline constexpr std::size_t StationAnalyzerThreads = 2;
+    inline constexpr std::uint32_t StationFaultReads = 64; // Consecutive failed reads (~0.5s) before a sensor is benched
+    inline constexpr std::uint32_t StationRailReads = 3 * SampleRate_Hz; // 3s pinned to a rail = unplugged/shorted
+    inline constexpr std::chrono::seconds StationRetry(5); // Benched sensor gets one probe read this often
 }
 // Used for Welford Analysis 
 struct Analyzer_Config
@@ -65,6 +214,14 @@ struct Analyzer_Config
     // Windowing
     uint32_t window_micro = DrunkAPI::Config::WindowUs;
     size_t min_window_sample_size = DrunkAPI::Config::MinWindowSamples;
+    double sample_rate_hz = DrunkAPI::Config::SampleRate_Hz; // Rate min_window_sample_size is for, WelfordAnalyzer::SetSampleRate scales it
+
+    // Adaptive mode, the length follows the sensor's noise (see WelfordAnalyzer::AdaptWindow). Window counts elsewhere
+    // (warmup, cooldown, stable_consecutive_windows_req) stay counts of windows, whatever length they end up.
+    bool bAdaptiveWindow = DrunkAPI::Config::AdaptiveWindow;
+    uint32_t min_window_micro = DrunkAPI::Config::MinWindowUs;
+    uint32_t max_window_micro = DrunkAPI::Config::MaxWindowUs;
+    double noise_target = DrunkAPI::Config::WindowNoiseTarget;
 
     // Stability Thresholds
     double stddev_max = DrunkAPI::Config::Max_Sd_Threshold; // volts (or Rs, or ratio)
@@ -76,6 +233,9 @@ struct Analyzer_Config
     double R1_3_3v = DrunkAPI::Config::R1_3_3v;
     float Rs_Ro_Div = DrunkAPI::Config::Rs_Ro_Ratio_Datasheet; // Pulled from y-intercept Air on MQ3 datasheet. Rs/RO = 60
     double Ro_Air = DrunkAPI::Config::Ro_Air;
+
+    // Prints a DBG line per finalized window. Offline tools turn this off.
+    bool bDebugPrint = true;
     
 };
 
@@ -102,6 +262,17 @@ struct BreathAnalyzer_Config
     double ready_delta_v = DrunkAPI::Config::Ready_Hysteresis;
     double ready_k_sigma = DrunkAPI::Config::Ready_Noise_Factor;
 
+    // Flow gating, only once the analyzer is fed a flow sensor (BreathAnalyzer::SetFlow)
+    uint64_t flow_tail_us = DrunkAPI::Config::FlowTailUs;
+    double min_flow_volume_l = DrunkAPI::Config::FlowMinVolumeL;
+
+    // Candidate breaths scored by the classifier, only on the MQ-3 path (a flow sensor already gates on the exhale)
+    bool bClassify = DrunkAPI::Config::ClassifyBreaths;
+    double classify_threshold = DrunkAPI::Config::ClassifyThreshold;
+
+    // Warmup/Cooldown console messages. Offline tools turn this off.
+    bool bPrintStatus = true;
+
     /*Slope Voltage Velocity Gating (Idea not implemented)
     double min_rise_volts_sec = 0.15; 
     uint32_t slope_stable_windows = 2;
@@ -0,0 +1,42 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32 (IEEE 802.3, reflected 0xEDB88320), same one zlib/gzip use so records can be checked with off the shelf tools.
+// The table is built at compile time.
+namespace DrunkAPI
+{
+    namespace Detail
+    {
+        consteval std::array<std::uint32_t, 256> MakeCrc32Table()
+        {
+            constexpr std::uint32_t Polynomial = 0xEDB88320U;
+            std::array<std::uint32_t, 256> table{};
+            for (std::uint32_t i = 0; i < 256; ++i)
+            {
+                std::uint32_t crc = i;
+                for (int bit = 0; bit < 8; ++bit)
+                {
+                    crc = ((crc & 1U) != 0U) ? (crc >> 1U) ^ Polynomial : crc >> 1U;
+                }
+                table[i] = crc;
+            }
+            return table;
+        }
+
+        inline constexpr std::array<std::uint32_t, 256> Crc32Table = MakeCrc32Table();
+    }
+
+    // Pass the previous return value as `crc` to checksum data in pieces.
+    inline std::uint32_t Crc32(const void* data, std::size_t len, std::uint32_t crc = 0)
+    {
+        const auto* bytes = static_cast<const std::uint8_t*>(data);
+        crc = ~crc;
+        for (std::size_t i = 0; i < len; ++i)
+        {
+            crc = Detail::Crc32Table[(crc ^ bytes[i]) & 0xFFU] ^ (crc >> 8U);
+        }
+        return ~crc;
+    }
+}
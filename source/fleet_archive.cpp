@@ -0,0 +1,428 @@
+#include "fleet_archive.h"
+#include "clock.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fmt/core.h>
+#include <queue>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace DrunkAPI
+{
+    namespace
+    {
+        bool WriteAll(int fd, const void* data, std::size_t len)
+        {
+            const auto* bytes = static_cast<const std::uint8_t*>(data);
+            while (len > 0)
+            {
+                const ssize_t written = ::write(fd, bytes, len);
+                if (written < 0)
+                {
+                    if (errno == EINTR) {continue;}
+                    return false;
+                }
+                bytes += written;
+                len -= static_cast<std::size_t>(written);
+            }
+            return true;
+        }
+
+        std::uint64_t WallNowUs()
+        {
+            return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+        }
+
+        bool ByTime(const Sample& lhs, const Sample& rhs) { return lhs.t_us < rhs.t_us; }
+    }
+
+    bool FleetArchive::Open(const FleetArchive_Config& in_cfg)
+    {
+        Close();
+        cfg = in_cfg;
+        if (cfg.bucket.count() <= 0)
+        {
+            fmt::print(stderr, "Error: Archive bucket must be positive\n");
+            return false;
+        }
+
+        std::error_code ec;
+        std::filesystem::create_directories(cfg.dir, ec);
+        if (ec)
+        {
+            fmt::print(stderr, "Error: Unable to create archive '{}': {}\n", cfg.dir, ec.message());
+            return false;
+        }
+
+        units.clear();
+        segment.clear();
+        buffered = 0;
+        late_buffered = 0;
+        segment_records = 0;
+        bSegmentOpen = false;
+        merged_until = 0;
+        stats = FleetArchiveStats{};
+        lag_count = 0;
+        opened_wall_us = WallNowUs();
+        bOpen = true;
+        return true;
+    }
+
+    void FleetArchive::Close()
+    {
+        if (!bOpen) {return;}
+        Merge(0, true);
+        if (bSegmentOpen) {SealSegment();}
+        FlushLate();
+        bOpen = false;
+    }
+
+    void FleetArchive::Connect(std::uint64_t unit_id)
+    {
+        Unit& unit = units[unit_id];
+        ++unit.connections;
+        unit.last_heard = SteadyClock::now();
+    }
+
+    void FleetArchive::Disconnect(std::uint64_t unit_id)
+    {
+        const auto found = units.find(unit_id);
+        if (found != units.end() && found->second.connections > 0) {--found->second.connections;}
+    }
+
+    void FleetArchive::Append(std::uint64_t unit_id, std::span<const Sample> samples)
+    {
+        Unit& unit = units[unit_id];
+        unit.last_heard = SteadyClock::now();
+        stats.received += samples.size();
+
+        for (const Sample& sample : samples)
+        {
+            if (sample.t_us < merged_until)
+            {
+                unit.late.push_back(sample);
+                ++late_buffered;
+                ++stats.late;
+                continue;
+            }
+
+            if (unit.pending.size() > unit.head && sample.t_us < unit.pending.back().t_us) {unit.bSorted = false;}
+            unit.pending.push_back(sample);
+            unit.newest_us = std::max(unit.newest_us, sample.t_us);
+            ++buffered;
+        }
+
+        if (late_buffered >= cfg.late_flush) {FlushLate();}
+    }
+
+    void FleetArchive::Heartbeat(std::uint64_t unit_id, std::uint64_t wall_us)
+    {
+        Unit& unit = units[unit_id];
+        unit.last_heard = SteadyClock::now();
+        unit.newest_us = std::max(unit.newest_us, wall_us);
+    }
+
+    std::uint64_t FleetArchive::Watermark(std::chrono::microseconds now) const
+    {
+        std::uint64_t live_oldest = UINT64_MAX;
+        std::uint64_t newest = 0;
+        for (const auto& [unit_id, unit] : units)
+        {
+            newest = std::max(newest, unit.newest_us);
+            if (IsLive(unit, now)) {live_oldest = std::min(live_oldest, unit.newest_us);}
+        }
+
+        // Nobody live, nothing can still be on its way: merge whatever the departed left behind.
+        if (live_oldest == UINT64_MAX) {return newest;}
+
+        const auto lateness = static_cast<std::uint64_t>(cfg.lateness.count());
+        return live_oldest > lateness ? live_oldest - lateness : 0;
+    }
+
+    void FleetArchive::Advance()
+    {
+        if (!bOpen) {return;}
+
+        const std::uint64_t watermark = Watermark(SteadyClock::now());
+        stats.watermark_us = std::max(stats.watermark_us, watermark);
+        Merge(watermark, false);
+
+        const auto bucket_us = static_cast<std::uint64_t>(cfg.bucket.count());
+        if (bSegmentOpen && watermark >= (segment_bucket + 1) * bucket_us) {SealSegment();}
+    }
+
+    void FleetArchive::Merge(std::uint64_t watermark_us, bool bDrain)
+    {
+        struct Head
+        {
+            std::uint64_t t_us;
+            std::uint64_t unit_id;
+            Unit* unit;
+            bool operator>(const Head& other) const noexcept { return t_us > other.t_us; }
+        };
+
+        std::priority_queue<Head, std::vector<Head>, std::greater<>> heads;
+        for (auto& [unit_id, unit] : units)
+        {
+            if (unit.head == unit.pending.size()) {continue;}
+            if (!unit.bSorted)
+            {
+                std::stable_sort(unit.pending.begin() + static_cast<std::ptrdiff_t>(unit.head), unit.pending.end(), ByTime);
+                unit.bSorted = true;
+            }
+            heads.push(Head{unit.pending[unit.head].t_us, unit_id, &unit});
+        }
+
+        // Over budget: merge ahead of the watermark until we're back to 3/4 of it.
+        const std::size_t keep = buffered > cfg.max_buffered ? cfg.max_buffered / 4 * 3 : buffered;
+        const std::uint64_t wall_now = WallNowUs();
+
+        while (!heads.empty())
+        {
+            const Head top = heads.top();
+            const bool bForced = !bDrain && top.t_us > watermark_us;
+            if (bForced && buffered <= keep) {break;}
+            heads.pop();
+
+            // Runs of one unit that stay ahead of everyone else go out without touching the heap.
+            Unit& unit = *top.unit;
+            do
+            {
+                Emit(top.unit_id, unit.pending[unit.head++], wall_now);
+                --buffered;
+                if (bForced) {++stats.forced;}
+            } while (unit.head < unit.pending.size() && (bDrain || unit.pending[unit.head].t_us <= watermark_us)
+                && (heads.empty() || unit.pending[unit.head].t_us <= heads.top().t_us));
+
+            if (unit.head < unit.pending.size()) {heads.push(Head{unit.pending[unit.head].t_us, top.unit_id, &unit});}
+        }
+
+        // Drop the merged prefixes once they're worth the memmove.
+        for (auto& [unit_id, unit] : units)
+        {
+            if (unit.head == unit.pending.size())
+            {
+                unit.pending.clear();
+                unit.head = 0;
+            }
+            else if (unit.head >= 4096 && unit.head * 2 >= unit.pending.size())
+            {
+                unit.pending.erase(unit.pending.begin(), unit.pending.begin() + static_cast<std::ptrdiff_t>(unit.head));
+                unit.head = 0;
+            }
+        }
+    }
+
+    void FleetArchive::Emit(std::uint64_t unit_id, const Sample& sample, std::uint64_t wall_now_us)
+    {
+        const auto bucket_us = static_cast<std::uint64_t>(cfg.bucket.count());
+        const std::uint64_t bucket = sample.t_us / bucket_us;
+        if (bSegmentOpen && bucket != segment_bucket) {SealSegment();}
+        if (!bSegmentOpen)
+        {
+            segment_bucket = bucket;
+            bSegmentOpen = true;
+        }
+
+        segment[unit_id].push_back(sample);
+        ++segment_records;
+        ++stats.merged;
+        merged_until = std::max(merged_until, sample.t_us);
+
+        const std::uint64_t lag = wall_now_us > sample.t_us ? wall_now_us - sample.t_us : 0;
+        lag_us[lag_count++ % LagSamples] = static_cast<std::uint32_t>(std::min<std::uint64_t>(lag, UINT32_MAX));
+    }
+
+    void FleetArchive::SealSegment()
+    {
+        const auto bucket_us = static_cast<std::uint64_t>(cfg.bucket.count());
+        const std::uint64_t start_us = segment_bucket * bucket_us;
+
+        // A restart inside the same bucket gets a second file rather than clobbering the first.
+        std::string path = fmt::format("{}/seg-{:020}.darc", cfg.dir, start_us);
+        for (int n = 1; std::filesystem::exists(path); ++n)
+        {
+            path = fmt::format("{}/seg-{:020}.{}.darc", cfg.dir, start_us, n);
+        }
+
+        if (WriteFile(path, start_us, bucket_us, segment, segment_records)) {++stats.segments;}
+
+        merged_until = std::max(merged_until, start_us + bucket_us);
+        segment.clear();
+        segment_records = 0;
+        bSegmentOpen = false;
+        FlushLate();
+    }
+
+    void FleetArchive::FlushLate()
+    {
+        if (late_buffered == 0) {return;}
+
+        std::map<std::uint64_t, std::vector<Sample>> parts;
+        std::uint64_t oldest = UINT64_MAX;
+        for (auto& [unit_id, unit] : units)
+        {
+            if (unit.late.empty()) {continue;}
+            std::stable_sort(unit.late.begin(), unit.late.end(), ByTime);
+            oldest = std::min(oldest, unit.late.front().t_us);
+            parts[unit_id].swap(unit.late);
+        }
+
+        const std::string path = fmt::format("{}/late-{:020}-{:06}.darc", cfg.dir, opened_wall_us, stats.late_files);
+        if (WriteFile(path, oldest, 0, parts, late_buffered)) {++stats.late_files;}
+        late_buffered = 0;
+    }
+
+    bool FleetArchive::WriteFile(const std::string& path, std::uint64_t bucket_start_us, std::uint64_t bucket_us,
+        const std::map<std::uint64_t, std::vector<Sample>>& parts, std::uint64_t records)
+    {
+        ArchiveHeader header{};
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.version = Version;
+        header.record_size = sizeof(Sample);
+        header.partitions = static_cast<std::uint32_t>(parts.size());
+        header.bucket_start_wall_us = bucket_start_us;
+        header.bucket_us = bucket_us;
+        header.records = records;
+
+        std::vector<ArchivePartition> table;
+        table.reserve(parts.size());
+        std::uint64_t first = 0;
+        for (const auto& [unit_id, samples] : parts)
+        {
+            table.push_back(ArchivePartition{unit_id, first, samples.size(), 0});
+            first += samples.size();
+        }
+
+        const std::string tmp_path = path + ".tmp";
+        const int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            fmt::print(stderr, "Error: Unable to create archive segment '{}': {}\n", tmp_path, std::strerror(errno));
+            return false;
+        }
+
+        bool bOk = WriteAll(fd, &header, sizeof(header)) && WriteAll(fd, table.data(), table.size() * sizeof(ArchivePartition));
+        for (const auto& [unit_id, samples] : parts)
+        {
+            if (!bOk) {break;}
+            bOk = WriteAll(fd, samples.data(), samples.size() * sizeof(Sample));
+        }
+        bOk = bOk && ::fdatasync(fd) == 0;
+        ::close(fd);
+
+        if (!bOk || ::rename(tmp_path.c_str(), path.c_str()) != 0)
+        {
+            fmt::print(stderr, "Error: Archive segment '{}' write failed: {}\n", path, std::strerror(errno));
+            ::unlink(tmp_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    FleetArchiveStats FleetArchive::Stats() const
+    {
+        FleetArchiveStats out = stats;
+        out.units = units.size();
+        out.buffered = buffered;
+
+        const auto now = SteadyClock::now();
+        for (const auto& [unit_id, unit] : units)
+        {
+            if (IsLive(unit, now)) {++out.live;}
+        }
+
+        std::vector<std::uint32_t> lags(lag_us.begin(), lag_us.begin() + static_cast<std::ptrdiff_t>(std::min<std::uint64_t>(lag_count, LagSamples)));
+        if (!lags.empty())
+        {
+            std::sort(lags.begin(), lags.end());
+            out.lag_p50_ms = lags[lags.size() / 2] / 1000.0;
+            out.lag_p99_ms = lags[static_cast<std::size_t>(0.99 * static_cast<double>(lags.size() - 1))] / 1000.0;
+        }
+        return out;
+    }
+
+    bool ArchiveSegment::Open(const std::string& path)
+    {
+        Close();
+
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            fmt::print(stderr, "Error: Unable to open archive segment '{}': {}\n", path, std::strerror(errno));
+            return false;
+        }
+
+        struct stat file_stat{};
+        if (::fstat(fd, &file_stat) != 0 || static_cast<std::size_t>(file_stat.st_size) < sizeof(ArchiveHeader))
+        {
+            fmt::print(stderr, "Error: '{}' is not an archive segment\n", path);
+            ::close(fd);
+            return false;
+        }
+
+        const auto total = static_cast<std::size_t>(file_stat.st_size);
+        void* map = ::mmap(nullptr, total, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+
+        if (map == MAP_FAILED)
+        {
+            fmt::print(stderr, "Error: Unable to mmap '{}': {}\n", path, std::strerror(errno));
+            return false;
+        }
+
+        base = static_cast<const unsigned char*>(map);
+        mapped_bytes = total;
+
+        // Segments are written whole, so the sizes have to add up exactly.
+        const ArchiveHeader& header = Header();
+        const std::size_t expected = sizeof(ArchiveHeader) + header.partitions * sizeof(ArchivePartition) + header.records * sizeof(Sample);
+        if (std::memcmp(header.magic, FleetArchive::Magic, sizeof(header.magic)) != 0 || header.version != FleetArchive::Version
+            || header.record_size != sizeof(Sample) || expected != total)
+        {
+            fmt::print(stderr, "Error: '{}' has a bad archive header\n", path);
+            Close();
+            return false;
+        }
+
+        for (const ArchivePartition& partition : Partitions())
+        {
+            if (partition.first + partition.count > header.records)
+            {
+                fmt::print(stderr, "Error: '{}' has a bad partition table\n", path);
+                Close();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void ArchiveSegment::Close()
+    {
+        if (base == nullptr) {return;}
+        ::munmap(const_cast<unsigned char*>(base), mapped_bytes);
+        base = nullptr;
+        mapped_bytes = 0;
+    }
+
+    std::vector<std::string> ListArchive(const std::string& dir, bool bLate)
+    {
+        std::vector<std::string> out;
+        const std::string prefix = bLate ? "late-" : "seg-";
+
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(dir, ec))
+        {
+            const std::string name = entry.path().filename().string();
+            if (name.rfind(prefix, 0) == 0 && entry.path().extension() == ".darc") {out.push_back(entry.path().string());}
+        }
+
+        // Zero padded stamps, so name order is time order.
+        std::sort(out.begin(), out.end());
+        return out;
+    }
+}
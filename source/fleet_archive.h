@@ -0,0 +1,190 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "config_settings.h"
+#include "sampler.h"
+
+// drunk_collector's archive: every unit's stream merged by timestamp and cut into wall time segments.
+//
+//   <dir>/seg-<bucket start wall us>.darc    ArchiveHeader (64) + ArchivePartition[partitions] (32 each) + Samples
+//   <dir>/late-<open wall us>-<n>.darc       Same layout, samples that arrived after their bucket was sealed
+//
+// Records are the 16 byte Sample with t_us in unix microseconds, one partition per unit (sorted by unit id), each in
+// time order. A segment is written once, to a temp file that's renamed in place, so readers only ever see whole files.
+//
+// Units stream mostly in order but not quite (a reconnect flushes a backlog, a sampler hiccup...), so nothing is
+// merged until every live unit has moved past it: the watermark is the oldest "newest sample" among live units minus
+// the lateness allowance. Below it a k-way merge over the units' sorted buffers emits samples in global time order,
+// and a bucket is sealed once the watermark passes its end. A sample older than what's already merged is late. A unit
+// that goes quiet stops counting as live after stall_after, and if the buffers still outgrow max_buffered we merge
+// past the watermark anyway (stragglers for that stretch then come in late), so memory stays bounded either way.
+namespace DrunkAPI
+{
+    struct ArchiveHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t record_size;
+        std::uint32_t partitions;
+        std::uint32_t reserved0;
+        std::uint64_t bucket_start_wall_us;
+        std::uint64_t bucket_us; // 0 for late files
+        std::uint64_t records;
+        std::uint8_t reserved[16];
+    };
+    static_assert(sizeof(ArchiveHeader) == 64, "ArchiveHeader is an on disk format");
+
+    struct ArchivePartition
+    {
+        std::uint64_t unit_id;
+        std::uint64_t first; // Record index
+        std::uint64_t count;
+        std::uint64_t reserved;
+    };
+    static_assert(sizeof(ArchivePartition) == 32, "ArchivePartition is an on disk format");
+
+    struct FleetArchive_Config
+    {
+        std::string dir = Config::CollectorArchiveDir;
+        std::chrono::microseconds bucket{Config::ArchiveBucket};
+        std::chrono::microseconds lateness{Config::ArchiveLateness};
+        std::chrono::microseconds stall_after{Config::ArchiveStallAfter};
+        std::size_t max_buffered = Config::ArchiveMaxBuffered;
+        std::size_t late_flush = 65'536; // Late samples held before they're written out
+    };
+
+    struct FleetArchiveStats
+    {
+        std::size_t units = 0;
+        std::size_t live = 0; // Connected and heard from within stall_after
+        std::uint64_t received = 0;
+        std::uint64_t merged = 0;
+        std::uint64_t late = 0;
+        std::uint64_t forced = 0; // Merged ahead of the watermark because the buffers were full
+        std::uint64_t segments = 0;
+        std::uint64_t late_files = 0;
+        std::size_t buffered = 0;
+        std::uint64_t watermark_us = 0;
+        double lag_p50_ms = 0.0; // Wall clock at merge - sample time
+        double lag_p99_ms = 0.0;
+    };
+
+    // Single threaded, the collector's event loop owns it.
+    class FleetArchive final
+    {
+        public:
+            static constexpr char Magic[8] = {'D','R','N','K','A','R','C','1'};
+            static constexpr std::uint32_t Version = 1;
+
+            FleetArchive() = default;
+            FleetArchive(const FleetArchive&) = delete;
+            FleetArchive& operator=(const FleetArchive&) = delete;
+            FleetArchive(FleetArchive&&) = delete;
+            FleetArchive& operator=(FleetArchive&&) = delete;
+            ~FleetArchive() { Close(); }
+
+            bool Open(const FleetArchive_Config& in_cfg);
+
+            // Merges everything still buffered and seals the open segment.
+            void Close();
+            bool IsOpen() const noexcept { return bOpen; }
+
+            // A unit can hold several connections (reconnect racing the old socket's close), it's live while any is up.
+            void Connect(std::uint64_t unit_id);
+            void Disconnect(std::uint64_t unit_id);
+
+            // Samples with t_us already in wall time, any order.
+            void Append(std::uint64_t unit_id, std::span<const Sample> samples);
+            void Heartbeat(std::uint64_t unit_id, std::uint64_t wall_us);
+
+            // Merges up to the watermark and seals finished segments, call it every ~100ms.
+            void Advance();
+
+            FleetArchiveStats Stats() const;
+
+        private:
+            static constexpr std::size_t LagSamples = 4096;
+
+            struct Unit
+            {
+                std::vector<Sample> pending; // [head, end) waiting to merge
+                std::size_t head = 0;
+                bool bSorted = true;
+                std::uint64_t newest_us = 0;
+                int connections = 0;
+                std::chrono::microseconds last_heard{0};
+                std::vector<Sample> late;
+            };
+
+            bool IsLive(const Unit& unit, std::chrono::microseconds now) const
+            {
+                return unit.connections > 0 && unit.newest_us > 0 && now - unit.last_heard < cfg.stall_after;
+            }
+
+            std::uint64_t Watermark(std::chrono::microseconds now) const;
+            void Merge(std::uint64_t watermark_us, bool bDrain);
+            void Emit(std::uint64_t unit_id, const Sample& sample, std::uint64_t wall_now_us);
+            void SealSegment();
+            void FlushLate();
+            bool WriteFile(const std::string& path, std::uint64_t bucket_start_us, std::uint64_t bucket_us,
+                const std::map<std::uint64_t, std::vector<Sample>>& parts, std::uint64_t records);
+
+            FleetArchive_Config cfg;
+            bool bOpen = false;
+            std::uint64_t opened_wall_us = 0;
+
+            std::unordered_map<std::uint64_t, Unit> units;
+            std::size_t buffered = 0;
+            std::size_t late_buffered = 0;
+
+            std::map<std::uint64_t, std::vector<Sample>> segment; // Open bucket, unit id -> samples
+            std::uint64_t segment_bucket = 0;
+            std::uint64_t segment_records = 0;
+            bool bSegmentOpen = false;
+            std::uint64_t merged_until = 0; // Anything older arriving now is late
+
+            FleetArchiveStats stats;
+            std::array<std::uint32_t, LagSamples> lag_us{};
+            std::uint64_t lag_count = 0;
+    };
+
+    // Read only mmap of a .darc segment (or late file).
+    class ArchiveSegment final
+    {
+        public:
+            ArchiveSegment() = default;
+            ArchiveSegment(const ArchiveSegment&) = delete;
+            ArchiveSegment& operator=(const ArchiveSegment&) = delete;
+            ArchiveSegment(ArchiveSegment&&) = delete;
+            ArchiveSegment& operator=(ArchiveSegment&&) = delete;
+            ~ArchiveSegment() { Close(); }
+
+            bool Open(const std::string& path);
+            void Close();
+
+            const ArchiveHeader& Header() const noexcept { return *reinterpret_cast<const ArchiveHeader*>(base); }
+            std::span<const ArchivePartition> Partitions() const noexcept
+            {
+                return {reinterpret_cast<const ArchivePartition*>(base + sizeof(ArchiveHeader)), Header().partitions};
+            }
+            std::span<const Sample> Samples(const ArchivePartition& partition) const noexcept
+            {
+                const auto* records = reinterpret_cast<const Sample*>(base + sizeof(ArchiveHeader) + Header().partitions * sizeof(ArchivePartition));
+                return {records + partition.first, partition.count};
+            }
+
+        private:
+            const unsigned char* base = nullptr;
+            std::size_t mapped_bytes = 0;
+    };
+
+    // Segment (or late) files in an archive directory, oldest first.
+    std::vector<std::string> ListArchive(const std::string& dir, bool bLate = false);
+}
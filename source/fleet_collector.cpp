@@ -0,0 +1,339 @@
+#include "fleet_collector.h"
+#include "clock.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fmt/core.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace DrunkAPI
+{
+    namespace
+    {
+        constexpr std::size_t ReadChunk = 64 * 1024;
+        constexpr int MaxEvents = 256;
+    }
+
+    bool FleetCollector::Open(const FleetCollector_Config& in_cfg)
+    {
+        Close();
+        cfg = in_cfg;
+
+        listen_fd = ::socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0)
+        {
+            std::perror("Critical Error: Collector socket");
+            return false;
+        }
+
+        // Dual stack, v4 units show up as ::ffff:a.b.c.d
+        const int off = 0;
+        const int on = 1;
+        ::setsockopt(listen_fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        sockaddr_in6 address{};
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(cfg.port);
+        if (::bind(listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listen_fd, SOMAXCONN) != 0)
+        {
+            fmt::print(stderr, "Critical Error: Unable to listen on port {}: {}\n", cfg.port, std::strerror(errno));
+            Close();
+            return false;
+        }
+
+        socklen_t address_len = sizeof(address);
+        ::getsockname(listen_fd, reinterpret_cast<sockaddr*>(&address), &address_len);
+        bound_port = ntohs(address.sin6_port);
+
+        epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = listen_fd;
+        if (epoll_fd < 0 || ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) != 0)
+        {
+            std::perror("Critical Error: Collector epoll");
+            Close();
+            return false;
+        }
+
+        if (!archive.Open(cfg.archive))
+        {
+            Close();
+            return false;
+        }
+
+        shared_offset_us = static_cast<std::int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch() - std::chrono::steady_clock::now().time_since_epoch()).count());
+        counters = FleetCollectorStats{};
+        Publish();
+        return true;
+    }
+
+    std::uint64_t FleetCollector::SharedNowUs() const
+    {
+        return static_cast<std::uint64_t>(SteadyClock::now().count() + shared_offset_us);
+    }
+
+    void FleetCollector::Close()
+    {
+        while (!connections.empty()) {Drop(connections.begin()->first);}
+        archive.Close();
+        if (epoll_fd >= 0) {::close(epoll_fd);}
+        if (listen_fd >= 0) {::close(listen_fd);}
+        epoll_fd = -1;
+        listen_fd = -1;
+    }
+
+    void FleetCollector::Run(const std::atomic<bool>& bStop)
+    {
+        if (epoll_fd < 0) {return;}
+
+        std::vector<epoll_event> events(MaxEvents);
+        auto next_advance = SteadyClock::now();
+        const auto advance_every = std::chrono::duration_cast<std::chrono::microseconds>(cfg.advance_every);
+
+        while (!bStop.load(std::memory_order_relaxed))
+        {
+            const auto wait_ms = std::max<std::int64_t>(0, (next_advance - SteadyClock::now()).count() / 1000);
+            const int ready = ::epoll_wait(epoll_fd, events.data(), MaxEvents, static_cast<int>(std::min<std::int64_t>(wait_ms, cfg.advance_every.count())));
+            if (ready < 0 && errno != EINTR)
+            {
+                std::perror("Critical Error: epoll_wait");
+                break;
+            }
+
+            for (int i = 0; i < ready; ++i)
+            {
+                const int fd = events[static_cast<std::size_t>(i)].data.fd;
+                if (fd == listen_fd)
+                {
+                    Accept();
+                    continue;
+                }
+
+                const auto found = connections.find(fd);
+                if (found == connections.end()) {continue;}
+                if (!Read(*found->second) || !Parse(*found->second)) {Drop(fd);}
+            }
+
+            if (SteadyClock::now() >= next_advance)
+            {
+                archive.Advance();
+                Publish();
+                next_advance = SteadyClock::now() + advance_every;
+            }
+        }
+
+        while (!connections.empty()) {Drop(connections.begin()->first);}
+        archive.Close();
+        Publish();
+    }
+
+    void FleetCollector::Accept()
+    {
+        while (true)
+        {
+            const int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED)
+                {
+                    std::perror("Error: accept");
+                }
+                if (errno == EINTR || errno == ECONNABORTED) {continue;}
+                return;
+            }
+
+            if (connections.size() >= cfg.max_connections)
+            {
+                ++counters.rejected;
+                ::close(fd);
+                continue;
+            }
+
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLRDHUP;
+            event.data.fd = fd;
+            if (::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+            {
+                std::perror("Error: epoll_ctl");
+                ::close(fd);
+                continue;
+            }
+
+            // Pongs go out the moment they're written, see NetStreamSink::Connect().
+            const int on = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            EnableRxTimestamps(fd);
+            auto conn = std::make_unique<Connection>();
+            conn->fd = fd;
+            connections.emplace(fd, std::move(conn));
+            ++counters.accepted;
+        }
+    }
+
+    bool FleetCollector::Read(Connection& conn)
+    {
+        // Level triggered, so one chunk per wakeup is enough and a chatty unit can't hog the loop.
+        if (conn.read_pos > 0 && conn.read_pos * 2 >= conn.in.size())
+        {
+            conn.in.erase(conn.in.begin(), conn.in.begin() + static_cast<std::ptrdiff_t>(conn.read_pos));
+            conn.read_pos = 0;
+        }
+
+        const std::size_t used = conn.in.size();
+        conn.in.resize(used + ReadChunk);
+        std::int64_t age_us = 0;
+        const ssize_t got = RecvStamped(conn.fd, conn.in.data() + used, ReadChunk, 0, age_us);
+        conn.read_at_us = SharedNowUs() - static_cast<std::uint64_t>(age_us);
+        if (got <= 0)
+        {
+            const int read_errno = errno;
+            conn.in.resize(used);
+            return got < 0 && (read_errno == EAGAIN || read_errno == EWOULDBLOCK || read_errno == EINTR);
+        }
+
+        conn.in.resize(used + static_cast<std::size_t>(got));
+        counters.bytes += static_cast<std::uint64_t>(got);
+        return true;
+    }
+
+    bool FleetCollector::Parse(Connection& conn)
+    {
+        while (true)
+        {
+            const std::uint8_t* cursor = conn.in.data() + conn.read_pos;
+            const std::size_t available = conn.in.size() - conn.read_pos;
+
+            if (!conn.bHello)
+            {
+                if (available < sizeof(NetHello)) {return true;}
+                std::memcpy(&conn.hello, cursor, sizeof(NetHello));
+                if (std::memcmp(conn.hello.magic, NetMagic, sizeof(NetMagic)) != 0 || conn.hello.version < 1 || conn.hello.version > NetVersion)
+                {
+                    ++counters.protocol_errors;
+                    return false;
+                }
+
+                conn.bHello = true;
+                conn.read_pos += sizeof(NetHello);
+                archive.Connect(conn.hello.unit_id);
+                continue;
+            }
+
+            if (available < sizeof(NetFrameHeader)) {return true;}
+            NetFrameHeader header{};
+            std::memcpy(&header, cursor, sizeof(header));
+            const auto type = static_cast<NetFrameType>(header.type);
+            const bool bKnown = type == NetFrameType::Samples || type == NetFrameType::Heartbeat || type == NetFrameType::Ping
+                || type == NetFrameType::ClockSamples;
+            if (header.count > NetMaxFrameRecords || !bKnown)
+            {
+                ++counters.protocol_errors;
+                return false;
+            }
+
+            const std::size_t map_bytes = type == NetFrameType::ClockSamples ? sizeof(ClockMap) : 0;
+            const std::size_t frame_bytes = sizeof(header) + map_bytes + header.count * sizeof(Sample);
+            if (available < frame_bytes) {return true;}
+
+            if (type == NetFrameType::ClockSamples)
+            {
+                std::memcpy(&conn.map, cursor + sizeof(header), sizeof(ClockMap));
+                conn.bMapped = conn.map.points > 0;
+            }
+            else if (type == NetFrameType::Samples)
+            {
+                conn.bMapped = false;
+            }
+
+            // Unit steady -> shared: the block's clock map, or the unit's own idea of wall time.
+            auto to_shared = [&conn](std::uint64_t mono_us)
+            {
+                return conn.bMapped ? MapToShared(conn.map, mono_us) : mono_us + static_cast<std::uint64_t>(conn.hello.wall_minus_mono_us);
+            };
+
+            if (type == NetFrameType::Ping)
+            {
+                if (!Pong(conn, header.t_us)) {return false;}
+            }
+            else if (type == NetFrameType::Heartbeat)
+            {
+                archive.Heartbeat(conn.hello.unit_id, to_shared(header.t_us));
+            }
+            else
+            {
+                // Records may sit at any alignment in the read buffer, copy them out while moving to shared time.
+                conn.scratch.resize(header.count);
+                std::memcpy(conn.scratch.data(), cursor + sizeof(header) + map_bytes, header.count * sizeof(Sample));
+                if (conn.bMapped)
+                {
+                    for (Sample& sample : conn.scratch) {sample.t_us = MapToShared(conn.map, sample.t_us);}
+                }
+                else
+                {
+                    const auto offset = static_cast<std::uint64_t>(conn.hello.wall_minus_mono_us);
+                    for (Sample& sample : conn.scratch) {sample.t_us += offset;}
+                }
+                archive.Append(conn.hello.unit_id, conn.scratch);
+            }
+
+            conn.read_pos += frame_bytes;
+            ++counters.frames;
+        }
+    }
+
+    bool FleetCollector::Pong(Connection& conn, std::uint64_t t1_us)
+    {
+        struct
+        {
+            NetFrameHeader header;
+            NetPong pong;
+        } reply{};
+        reply.header = NetFrameHeader{static_cast<std::uint32_t>(NetFrameType::Pong), 0, t1_us};
+        reply.pong.t2_us = conn.read_at_us;
+        reply.pong.t3_us = SharedNowUs();
+
+        // Full socket buffer means the unit isn't reading, skip this one. A torn pong would desync the stream though.
+        const ssize_t sent = ::send(conn.fd, &reply, sizeof(reply), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {return errno == EAGAIN || errno == EWOULDBLOCK;}
+        return static_cast<std::size_t>(sent) == sizeof(reply);
+    }
+
+    void FleetCollector::Drop(int fd)
+    {
+        const auto found = connections.find(fd);
+        if (found == connections.end()) {return;}
+
+        if (found->second->bHello) {archive.Disconnect(found->second->hello.unit_id);}
+        ::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        connections.erase(found);
+    }
+
+    void FleetCollector::Publish()
+    {
+        counters.connections = connections.size();
+        counters.synced = 0;
+        for (const auto& [fd, conn] : connections)
+        {
+            if (conn->bMapped) {++counters.synced;}
+        }
+        counters.archive = archive.Stats();
+
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        published = counters;
+    }
+
+    FleetCollectorStats FleetCollector::Stats() const
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        return published;
+    }
+}
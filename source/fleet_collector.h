@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "fleet_archive.h"
+#include "net_stream.h"
+
+// drunk_collector's network side: one thread, one epoll set, every unit's socket non blocking. Reads are parsed in
+// place out of a per connection buffer, whole frames go to the FleetArchive, a partial frame waits for the rest.
+// The same loop ticks FleetArchive::Advance(), so the archive never needs a lock.
+//
+// It's also the fleet's time reference: pings are answered straight from the loop with shared time stamps (our steady
+// clock + a unix offset fixed at Open(), so it never steps), and sample blocks that carry a ClockMap are mapped into
+// it. Older units, or a unit still syncing, are placed with the hello's wall_minus_mono_us instead.
+namespace DrunkAPI
+{
+    struct FleetCollector_Config
+    {
+        std::uint16_t port = Config::CollectorPort; // 0 = any free port (load test), Port() tells which
+        FleetArchive_Config archive{};
+        std::chrono::milliseconds advance_every{100};
+        std::size_t max_connections = 4096;
+    };
+
+    struct FleetCollectorStats
+    {
+        std::size_t connections = 0;
+        std::size_t synced = 0; // Connections whose last block came with a clock map
+        std::uint64_t accepted = 0;
+        std::uint64_t rejected = 0; // Over max_connections
+        std::uint64_t protocol_errors = 0; // Bad hello / frame, connection dropped
+        std::uint64_t bytes = 0;
+        std::uint64_t frames = 0;
+        FleetArchiveStats archive{};
+    };
+
+    class FleetCollector final
+    {
+        public:
+            FleetCollector() = default;
+            FleetCollector(const FleetCollector&) = delete;
+            FleetCollector& operator=(const FleetCollector&) = delete;
+            FleetCollector(FleetCollector&&) = delete;
+            FleetCollector& operator=(FleetCollector&&) = delete;
+            ~FleetCollector() { Close(); }
+
+            // Binds, listens and opens the archive.
+            bool Open(const FleetCollector_Config& in_cfg);
+
+            // Event loop until bStop, then drops every connection and closes the archive (flushing it).
+            void Run(const std::atomic<bool>& bStop);
+
+            void Close();
+            std::uint16_t Port() const noexcept { return bound_port; }
+
+            // shared time = collector steady_clock + this
+            std::int64_t SharedOffsetUs() const noexcept { return shared_offset_us; }
+
+            // Snapshot taken once per Advance(), safe from any thread.
+            FleetCollectorStats Stats() const;
+
+        private:
+            struct Connection
+            {
+                int fd = -1;
+                bool bHello = false;
+                NetHello hello{};
+                std::vector<std::uint8_t> in; // [read_pos, in.size()) unparsed
+                std::size_t read_pos = 0;
+                std::vector<Sample> scratch;
+                std::uint64_t read_at_us = 0; // Shared time the last read's data arrived (kernel stamp), a ping's t2
+                ClockMap map{};
+                bool bMapped = false;
+            };
+
+            void Accept();
+            bool Read(Connection& conn);
+            bool Parse(Connection& conn);
+            bool Pong(Connection& conn, std::uint64_t t1_us);
+            std::uint64_t SharedNowUs() const;
+            void Drop(int fd);
+            void Publish();
+
+            FleetCollector_Config cfg;
+            int listen_fd = -1;
+            int epoll_fd = -1;
+            std::uint16_t bound_port = 0;
+            std::int64_t shared_offset_us = 0;
+
+            FleetArchive archive;
+            std::unordered_map<int, std::unique_ptr<Connection>> connections;
+            FleetCollectorStats counters; // Event loop only
+
+            mutable std::mutex stats_mutex;
+            FleetCollectorStats published; // Guarded by stats_mutex
+    };
+}
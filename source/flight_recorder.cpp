@@ -0,0 +1,371 @@
+#include "flight_recorder.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace DrunkAPI
+{
+    namespace
+    {
+        constexpr std::size_t LaneCount = 2;
+
+        // Mirrors BreathAnalyzerState ordering in analyzer.h so the dump doesn't need the analyzer headers.
+        constexpr std::array<const char*, 6> StateNames = {"None", "Warmup", "Ready", "Processing", "Cooldown", "Analyzed"};
+
+        bool IsPowerOfTwo(std::size_t n) { return n != 0 && (n & (n - 1)) == 0; }
+
+        std::int64_t WallMinusMonoUs()
+        {
+            using namespace std::chrono;
+            const auto wall = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+            const auto mono = duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+            return static_cast<std::int64_t>(wall - mono);
+        }
+    }
+
+    FlightRecorder::~FlightRecorder()
+    {
+        StopSignalDumper();
+        Close();
+    }
+
+    void FlightRecorder::Close()
+    {
+        if (base != nullptr)
+        {
+            if (bWritable) {::msync(base, mapped_bytes, MS_ASYNC);}
+            ::munmap(base, mapped_bytes);
+        }
+        base = nullptr;
+        mapped_bytes = 0;
+    }
+
+    bool FlightRecorder::Open(const char* path, std::size_t sample_slots, std::size_t event_slots)
+    {
+        if (!IsPowerOfTwo(sample_slots) || !IsPowerOfTwo(event_slots))
+        {
+            fmt::print(stderr, "Error: Flight recorder slots must be a power of 2\n");
+            return false;
+        }
+
+        Close();
+        file_path = path;
+
+        // Keep the last run around, that's the one we care about after a crash.
+        const std::string prev_path = file_path + ".prev";
+        if (::access(path, F_OK) == 0 && ::rename(path, prev_path.c_str()) != 0)
+        {
+            fmt::print(stderr, "Warning: Unable to rotate flight recorder '{}': {}\n", path, std::strerror(errno));
+        }
+
+        const std::size_t sample_bytes = sample_slots * sizeof(FlightRecord);
+        const std::size_t event_bytes = event_slots * sizeof(FlightRecord);
+        const std::size_t total = HeaderBytes + sample_bytes + event_bytes;
+
+        const int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            fmt::print(stderr, "Error: Unable to open flight recorder '{}': {}\n", path, std::strerror(errno));
+            return false;
+        }
+
+        // Reserve the blocks up front so a full disk fails here and not with a SIGBUS in the sampler thread.
+        if (::posix_fallocate(fd, 0, static_cast<off_t>(total)) != 0 && ::ftruncate(fd, static_cast<off_t>(total)) != 0)
+        {
+            fmt::print(stderr, "Error: Unable to size flight recorder '{}': {}\n", path, std::strerror(errno));
+            ::close(fd);
+            return false;
+        }
+
+        void* map = ::mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd); // The mapping holds its own reference to the file.
+
+        if (map == MAP_FAILED)
+        {
+            fmt::print(stderr, "Error: Unable to mmap flight recorder '{}': {}\n", path, std::strerror(errno));
+            return false;
+        }
+
+        base = static_cast<unsigned char*>(map);
+        mapped_bytes = total;
+        bWritable = true;
+
+        FlightHeader* header = Header();
+        std::memset(header, 0, HeaderBytes);
+        header->version = Version;
+        header->record_size = sizeof(FlightRecord);
+        header->wall_minus_mono_us = WallMinusMonoUs();
+        header->pid = static_cast<std::uint64_t>(::getpid());
+
+        header->lanes[0].capacity = sample_slots;
+        header->lanes[0].offset = HeaderBytes;
+        header->lanes[1].capacity = event_slots;
+        header->lanes[1].offset = HeaderBytes + sample_bytes;
+
+        // Magic goes in last, a half initialized file is never mistaken for a valid one.
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(header->magic, Magic, sizeof(Magic));
+
+        fmt::print("Flight recorder: {} ({} sample slots, {} event slots)\n", path, sample_slots, event_slots);
+        return true;
+    }
+
+    bool FlightRecorder::OpenReadOnly(const char* path)
+    {
+        Close();
+        file_path = path;
+
+        const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            fmt::print(stderr, "Error: Unable to open flight recorder '{}': {}\n", path, std::strerror(errno));
+            return false;
+        }
+
+        struct stat file_stat{};
+        if (::fstat(fd, &file_stat) != 0 || static_cast<std::size_t>(file_stat.st_size) < HeaderBytes)
+        {
+            fmt::print(stderr, "Error: '{}' is not a flight recorder file\n", path);
+            ::close(fd);
+            return false;
+        }
+
+        const auto total = static_cast<std::size_t>(file_stat.st_size);
+        void* map = ::mmap(nullptr, total, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if (map == MAP_FAILED)
+        {
+            fmt::print(stderr, "Error: Unable to mmap '{}': {}\n", path, std::strerror(errno));
+            return false;
+        }
+
+        base = static_cast<unsigned char*>(map);
+        mapped_bytes = total;
+        bWritable = false;
+
+        const FlightHeader* header = Header();
+        bool valid = std::memcmp(header->magic, Magic, sizeof(Magic)) == 0 && header->version == Version && header->record_size == sizeof(FlightRecord);
+
+        for (std::size_t lane = 0; valid && lane < LaneCount; ++lane)
+        {
+            const auto& lane_header = header->lanes[lane];
+            valid = IsPowerOfTwo(lane_header.capacity) && lane_header.offset + (lane_header.capacity * sizeof(FlightRecord)) <= total;
+        }
+
+        if (!valid)
+        {
+            fmt::print(stderr, "Error: '{}' has a bad flight recorder header\n", path);
+            Close();
+            return false;
+        }
+
+        return true;
+    }
+
+    FlightRecord* FlightRecorder::LaneRecords(FlightLane lane) const noexcept
+    {
+        return reinterpret_cast<FlightRecord*>(base + Header()->lanes[static_cast<std::size_t>(lane)].offset);
+    }
+
+    void FlightRecorder::Write(FlightLane lane, const FlightRecord& record) noexcept
+    {
+        if (base == nullptr || !bWritable) {return;}
+
+        FlightLaneHeader& lane_header = Header()->lanes[static_cast<std::size_t>(lane)];
+
+        // Single writer per lane, so a relaxed read of our own counter is fine.
+        std::atomic_ref<std::uint64_t> next_seq(lane_header.next_seq);
+        const std::uint64_t seq = next_seq.load(std::memory_order_relaxed) + 1;
+
+        FlightRecord& slot = LaneRecords(lane)[(seq - 1) & (lane_header.capacity - 1)];
+        std::atomic_ref<std::uint64_t> slot_seq(slot.seq);
+
+        // Invalidate first so a crash in the middle of the copy leaves a slot the reader skips.
+        slot_seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot.t_us = record.t_us;
+        slot.f0 = record.f0;
+        slot.f1 = record.f1;
+        slot.f2 = record.f2;
+        slot.raw = record.raw;
+        slot.type = record.type;
+        slot.flags = record.flags;
+
+        slot_seq.store(seq, std::memory_order_release);
+        next_seq.store(seq, std::memory_order_release);
+    }
+
+    void FlightRecorder::RecordSample(std::uint64_t t_us, std::int16_t raw, float volts) noexcept
+    {
+        FlightRecord record{};
+        record.t_us = t_us;
+        record.f0 = volts;
+        record.raw = raw;
+        record.type = static_cast<std::uint8_t>(FlightRecordType::Sample);
+        Write(FlightLane::Sampler, record);
+    }
+
+    void FlightRecorder::RecordWindow(std::uint64_t t_us, double mean, double stddev, double drift_per_sec, bool stable) noexcept
+    {
+        FlightRecord record{};
+        record.t_us = t_us;
+        record.f0 = static_cast<float>(mean);
+        record.f1 = static_cast<float>(stddev);
+        record.f2 = static_cast<float>(drift_per_sec);
+        record.type = static_cast<std::uint8_t>(FlightRecordType::Window);
+        record.flags = stable ? 1U : 0U;
+        Write(FlightLane::Consumer, record);
+    }
+
+    void FlightRecorder::RecordState(std::uint64_t t_us, std::uint8_t state, double peak_volts) noexcept
+    {
+        FlightRecord record{};
+        record.t_us = t_us;
+        record.f0 = static_cast<float>(peak_volts);
+        record.type = static_cast<std::uint8_t>(FlightRecordType::State);
+        record.flags = state;
+        Write(FlightLane::Consumer, record);
+    }
+
+    std::vector<FlightRecord> FlightRecorder::Snapshot() const
+    {
+        std::vector<FlightRecord> out;
+        if (base == nullptr) {return out;}
+
+        for (std::size_t lane = 0; lane < LaneCount; ++lane)
+        {
+            const FlightLaneHeader& lane_header = Header()->lanes[lane];
+            const std::uint64_t newest = std::atomic_ref<std::uint64_t>(const_cast<std::uint64_t&>(lane_header.next_seq)).load(std::memory_order_acquire);
+            const std::uint64_t oldest = (newest > lane_header.capacity) ? newest - lane_header.capacity + 1 : 1;
+
+            const FlightRecord* records = LaneRecords(static_cast<FlightLane>(lane));
+            for (std::uint64_t idx = 0; idx < lane_header.capacity; ++idx)
+            {
+                // Seqlock read, the writer may be lapping the ring under a live dump (SIGUSR1). The copy only counts
+                // if the slot's seq was set before it and is still the same after it, otherwise it could be half
+                // the old record and half the new one under the old seq.
+                std::atomic_ref<std::uint64_t> slot_seq(const_cast<std::uint64_t&>(records[idx].seq));
+                const std::uint64_t seq = slot_seq.load(std::memory_order_acquire);
+                if (seq == 0) {continue;}
+
+                FlightRecord copy = records[idx];
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot_seq.load(std::memory_order_relaxed) != seq) {continue;}
+                copy.seq = seq;
+
+                // A slot is only trusted if its sequence number is inside the live window of the ring.
+                if (seq < oldest || seq > newest) {continue;}
+                out.push_back(copy);
+            }
+        }
+
+        std::sort(out.begin(), out.end(), [](const FlightRecord& lhs, const FlightRecord& rhs)
+        {
+            return (lhs.t_us != rhs.t_us) ? lhs.t_us < rhs.t_us : lhs.type < rhs.type;
+        });
+
+        return out;
+    }
+
+    void FlightRecorder::DumpText(std::FILE* out) const
+    {
+        if (base == nullptr) {return;}
+
+        const FlightHeader* header = Header();
+        const std::vector<FlightRecord> records = Snapshot();
+
+        fmt::print(out, "# flight recorder '{}' pid={} records={}\n", file_path, header->pid, records.size());
+        fmt::print(out, "# mono_us,wall_us,type,raw,volts|mean|peak,stddev,drift,flags\n");
+
+        for (const FlightRecord& rec : records)
+        {
+            const auto wall_us = static_cast<std::int64_t>(rec.t_us) + header->wall_minus_mono_us;
+
+            switch (static_cast<FlightRecordType>(rec.type))
+            {
+                case FlightRecordType::Sample:
+                    fmt::print(out, "{},{},sample,{},{:.6f},,,\n", rec.t_us, wall_us, rec.raw, rec.f0);
+                    break;
+                case FlightRecordType::Window:
+                    fmt::print(out, "{},{},window,,{:.6f},{:.6f},{:.6f},{}\n", rec.t_us, wall_us, rec.f0, rec.f1, rec.f2, rec.flags != 0 ? "stable" : "unstable");
+                    break;
+                case FlightRecordType::State:
+                {
+                    const char* name = rec.flags < StateNames.size() ? StateNames[rec.flags] : "Unknown";
+                    fmt::print(out, "{},{},state,,{:.6f},,,{}\n", rec.t_us, wall_us, rec.f0, name);
+                    break;
+                }
+                case FlightRecordType::Empty:
+                default:
+                    break;
+            }
+        }
+    }
+
+    void FlightRecorder::BlockDumpSignal()
+    {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGUSR1);
+        ::pthread_sigmask(SIG_BLOCK, &set, nullptr);
+    }
+
+    bool FlightRecorder::StartSignalDumper()
+    {
+        if (base == nullptr || dump_thread.joinable()) {return false;}
+
+        dump_stop.store(false);
+        dump_thread = std::thread([this]
+        {
+            sigset_t set;
+            sigemptyset(&set);
+            sigaddset(&set, SIGUSR1);
+            ::pthread_sigmask(SIG_BLOCK, &set, nullptr); // Never let the default action kill us from this thread
+
+            while (true)
+            {
+                int signal_num = 0;
+                if (::sigwait(&set, &signal_num) != 0) {continue;}
+                if (dump_stop.load()) {break;}
+
+                // Push dirty pages out and write a readable copy next to the ring.
+                ::msync(base, mapped_bytes, MS_SYNC);
+
+                const std::string dump_path = file_path + ".txt";
+                std::FILE* out = std::fopen(dump_path.c_str(), "w");
+                if (out == nullptr)
+                {
+                    fmt::print(stderr, "Error: Unable to write flight dump '{}': {}\n", dump_path, std::strerror(errno));
+                    continue;
+                }
+
+                DumpText(out);
+                std::fclose(out);
+                fmt::print(stderr, "Flight recorder dumped to {}\n", dump_path);
+            }
+        });
+
+        return true;
+    }
+
+    void FlightRecorder::StopSignalDumper()
+    {
+        if (!dump_thread.joinable()) {return;}
+
+        dump_stop.store(true);
+        ::pthread_kill(dump_thread.native_handle(), SIGUSR1); // Wake the sigwait
+        dump_thread.join();
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Flight recorder: a crash surviving black box of the last N minutes of samples, windows and state transitions.
+// The ring lives inside a MAP_SHARED file mapping, so every store lands straight in the page cache. If the process
+// dies the kernel still owns those pages and flushes them to the file, no syscall is needed on the write path.
+//
+// Layout (one page header followed by two lanes):
+//   [FlightHeader | Lane 0 records (sampler thread) | Lane 1 records (consumer thread)]
+//
+// Each lane has exactly one writer so it's the same single producer idea as the SpscRing. Readers (the dump tool)
+// can look at the file while the app is running, or after it crashed.
+namespace DrunkAPI
+{
+    enum class FlightLane : std::uint8_t
+    {
+        Sampler = 0, // Raw samples, written by the sampler thread
+        Consumer = 1, // Windows + state transitions, written by the consumer thread
+    };
+
+    enum class FlightRecordType : std::uint8_t
+    {
+        Empty = 0,
+        Sample = 1,
+        Window = 2,
+        State = 3,
+    };
+
+    // 32 bytes so two records share a cache line on Arm.
+    struct FlightRecord
+    {
+        std::uint64_t seq = 0; // 0 means never written or torn (writer crashed mid store)
+        std::uint64_t t_us = 0; // Monotonic timestamp
+        float f0 = 0.0F; // Sample: volts, Window: mean, State: peak volts
+        float f1 = 0.0F; // Window: stddev
+        float f2 = 0.0F; // Window: drift per sec
+        std::int16_t raw = 0; // Sample: raw adc code
+        std::uint8_t type = 0; // FlightRecordType
+        std::uint8_t flags = 0; // Window: stable, State: BreathAnalyzerState
+    };
+    static_assert(sizeof(FlightRecord) == 32, "FlightRecord must stay 32 bytes, it's an on disk format");
+
+    struct FlightLaneHeader
+    {
+        alignas(64) std::uint64_t next_seq; // Last published sequence number
+        std::uint64_t capacity; // Must be power of 2
+        std::uint64_t offset; // Byte offset of the first record from the start of the file
+    };
+
+    struct FlightHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t record_size;
+        std::int64_t wall_minus_mono_us; // Used by the dump to print wall clock times next to steady_clock stamps
+        std::uint64_t pid;
+        FlightLaneHeader lanes[2];
+    };
+
+    class FlightRecorder final
+    {
+        public:
+            static constexpr char Magic[8] = {'D','R','N','K','F','L','T','1'};
+            static constexpr std::uint32_t Version = 1;
+            static constexpr std::size_t HeaderBytes = 4096;
+
+            FlightRecorder() = default;
+            FlightRecorder(const FlightRecorder&) = delete;
+            FlightRecorder& operator=(const FlightRecorder&) = delete;
+            FlightRecorder(FlightRecorder&&) = delete;
+            FlightRecorder& operator=(FlightRecorder&&) = delete;
+            ~FlightRecorder();
+
+            // Creates (or recreates) the backing file. A previous recording is kept as <path>.prev so a crash isn't
+            // wiped by the restart that follows it.
+            bool Open(const char* path, std::size_t sample_slots, std::size_t event_slots);
+
+            // Maps an existing recording read-only (used by the dump tool).
+            bool OpenReadOnly(const char* path);
+
+            bool IsOpen() const noexcept { return base != nullptr; }
+
+            // Hot path writers, no syscalls and no allocations.
+            void RecordSample(std::uint64_t t_us, std::int16_t raw, float volts) noexcept;
+            void RecordWindow(std::uint64_t t_us, double mean, double stddev, double drift_per_sec, bool stable) noexcept;
+            void RecordState(std::uint64_t t_us, std::uint8_t state, double peak_volts) noexcept;
+
+            // Copy out every valid record ordered by time.
+            std::vector<FlightRecord> Snapshot() const;
+            void DumpText(std::FILE* out) const;
+
+            // SIGUSR1 dump support. BlockDumpSignal() must be called in main before any thread is created so the
+            // signal is only ever consumed by the dumper thread via sigwait().
+            static void BlockDumpSignal();
+            bool StartSignalDumper();
+            void StopSignalDumper();
+
+            const std::string& Path() const noexcept { return file_path; }
+            std::int64_t WallOffsetUs() const noexcept { return (base != nullptr) ? Header()->wall_minus_mono_us : 0; }
+
+        private:
+            void Write(FlightLane lane, const FlightRecord& record) noexcept;
+            FlightHeader* Header() const noexcept { return reinterpret_cast<FlightHeader*>(base); }
+            FlightRecord* LaneRecords(FlightLane lane) const noexcept;
+            void Close();
+
+            unsigned char* base = nullptr;
+            std::size_t mapped_bytes = 0;
+            bool bWritable = false;
+            std::string file_path;
+
+            std::thread dump_thread;
+            std::atomic<bool> dump_stop{false};
+    };
+}
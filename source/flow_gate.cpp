@@ -0,0 +1,85 @@
+#include "flow_gate.h"
+#include <cmath>
+
+namespace DrunkAPI
+{
+    double FlowDetector::FlowLps(double adc_volts) const
+    {
+        const double dp_pa = ((adc_volts * cfg.divider) - zero_volts) / cfg.volts_per_kpa * 1000.0;
+        return dp_pa > 0.0 ? cfg.orifice_k * std::sqrt(dp_pa) : 0.0;
+    }
+
+    void FlowDetector::Process(const Sample* samples, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const Sample& sample = samples[i];
+            const double sensor_volts = static_cast<double>(sample.volts) * cfg.divider;
+            ++processed;
+
+            // First read is taken as no flow, the app starts before anyone blows.
+            if (!bZeroed)
+            {
+                zero_volts = sensor_volts;
+                last_t_us = sample.t_us;
+                bZeroed = true;
+                continue;
+            }
+
+            if (sample.t_us <= last_t_us) {continue;}
+            const double dt_s = static_cast<double>(sample.t_us - last_t_us) * 1e-6;
+            last_t_us = sample.t_us;
+
+            const double lps = FlowLps(sample.volts);
+            smooth_lps += (lps - smooth_lps) * (dt_s / (cfg.smooth_tau_s + dt_s));
+            status.flow_lps = smooth_lps;
+
+            // Trapezoid over the gap, unless reads went missing for long enough that it would be a guess.
+            const double blown_l = dt_s <= cfg.max_gap_s ? 0.5 * (lps + last_lps) * dt_s : 0.0;
+            last_lps = lps;
+
+            if (!status.bExhaling)
+            {
+                if (smooth_lps < cfg.start_lps)
+                {
+                    above_since_us = 0;
+                    pending_volume_l = 0.0;
+
+                    // Only quiet air moves the zero, not the run up to an exhale.
+                    if (smooth_lps < cfg.end_lps) {zero_volts += (sensor_volts - zero_volts) * (dt_s / (cfg.zero_tau_s + dt_s));}
+                    continue;
+                }
+
+                if (above_since_us == 0) {above_since_us = sample.t_us;}
+                pending_volume_l += blown_l;
+                if (sample.t_us - above_since_us < cfg.min_on_us) {continue;}
+
+                status.bExhaling = true;
+                status.start_us = above_since_us;
+                status.end_us = 0;
+                status.volume_l = pending_volume_l;
+                status.peak_lps = smooth_lps;
+                below_since_us = 0;
+                continue;
+            }
+
+            status.volume_l += blown_l;
+            status.peak_lps = std::max(status.peak_lps, smooth_lps);
+
+            if (smooth_lps >= cfg.end_lps)
+            {
+                below_since_us = 0;
+                continue;
+            }
+
+            if (below_since_us == 0) {below_since_us = sample.t_us;}
+            if (sample.t_us - below_since_us < cfg.min_off_us) {continue;}
+
+            status.bExhaling = false;
+            status.end_us = below_since_us;
+            ++status.exhales;
+            above_since_us = 0;
+            pending_volume_l = 0.0;
+        }
+    }
+}
@@ -0,0 +1,168 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <fmt/core.h>
+#include "ads1115.h"
+#include "config_settings.h"
+#include "mq3_helper.h"
+#include "sampler.h"
+#include "spsc.h"
+
+// Breath flow from a differential pressure sensor (MPXV7002DP style) across the mouthpiece's orifice, read on its own
+// ADS1115 channel a few times per MQ-3 sample. Room vapor drifting over the MQ-3 moves the voltage without any air
+// going through the mouthpiece, so BreathAnalyzer::SetFlow() lets the exhale itself start and end Processing instead
+// of the voltage, and the blown volume goes along with the result.
+//
+//   flow (L/s) = orifice_k * sqrt(dp), dp = (sensor volts - zero) / volts_per_kpa * 1000
+//
+// Inhaling (dp < 0) reads as no flow. The zero is tracked while nobody is blowing, the sensor's offset drifts with
+// temperature more than the 0.15 L/s start threshold is worth.
+namespace DrunkAPI
+{
+    struct Flow_Config
+    {
+        double divider = MQ3::Voltage_Factor; // ADC volts -> sensor volts, same 5V -> 3.3V divider as the MQ-3
+        double volts_per_kpa = Config::FlowVoltsPerKpa;
+        double orifice_k = Config::FlowOrificeK;
+        double start_lps = Config::FlowStartLps;
+        double end_lps = Config::FlowEndLps;
+        double smooth_tau_s = 0.02; // Detection only, the volume integrates the raw flow
+        double zero_tau_s = 5.0;
+        std::uint64_t min_on_us = 50'000; // Above start this long before it's an exhale (a knock on the mouthpiece isn't)
+        std::uint64_t min_off_us = 150'000; // Below end this long before it's over (catching a breath mid blow isn't)
+        double max_gap_s = 0.1; // Longer between samples (failed reads) isn't integrated across
+    };
+
+    // Current exhale if one is going, otherwise the last one.
+    struct FlowStatus
+    {
+        bool bExhaling = false;
+        std::uint64_t start_us = 0;
+        std::uint64_t end_us = 0; // 0 while exhaling
+        double volume_l = 0.0; // So far
+        double peak_lps = 0.0;
+        double flow_lps = 0.0; // Latest, smoothed
+        std::uint64_t exhales = 0; // Completed ones
+    };
+
+    class FlowDetector final
+    {
+        public:
+            explicit FlowDetector(Flow_Config in_cfg = {}) : cfg(in_cfg) {}
+
+            // Flow channel samples, oldest first. No allocations.
+            void Process(const Sample* samples, std::size_t n);
+
+            const FlowStatus& Status() const noexcept { return status; }
+            double ZeroVolts() const noexcept { return zero_volts; }
+            std::uint64_t Samples() const noexcept { return processed; }
+
+        private:
+            double FlowLps(double adc_volts) const;
+
+            Flow_Config cfg;
+            FlowStatus status{};
+            bool bZeroed = false;
+            double zero_volts = 0.0;
+            double smooth_lps = 0.0;
+            double last_lps = 0.0;
+            std::uint64_t last_t_us = 0;
+            std::uint64_t above_since_us = 0; // Candidate start, 0 = below start
+            std::uint64_t below_since_us = 0; // Candidate end, 0 = still blowing
+            double pending_volume_l = 0.0; // Blown while the start was being confirmed
+            std::uint64_t processed = 0;
+    };
+
+    // Inverse of FlowDetector's model, what the ADC reads for a flow (emulator and tests).
+    inline double FlowToAdcVolts(const Flow_Config& cfg, double zero_sensor_volts, double flow_lps)
+    {
+        const double ratio = std::max(0.0, flow_lps) / cfg.orifice_k;
+        const double dp_kpa = (ratio * ratio) / 1000.0;
+        return (zero_sensor_volts + (dp_kpa * cfg.volts_per_kpa)) / cfg.divider;
+    }
+
+    // Flow conversions that still fit in a sample period after busy_us of other reads on the bus, with a tenth of it
+    // left for scheduling. 0 = none fit, flow reads would push the MQ-3 off its rate.
+    constexpr std::size_t FlowReadsPerTick(std::uint64_t busy_us, std::uint64_t flow_read_us)
+    {
+        const auto period_us = static_cast<std::uint64_t>(Config::SamplePeriod.count());
+        const std::uint64_t budget_us = period_us - (period_us / 10);
+        if (busy_us >= budget_us || flow_read_us == 0) {return 0;}
+        return std::min<std::size_t>(Config::FlowMaxReadsPerTick, (budget_us - busy_us) / flow_read_us);
+    }
+
+    // The MQ-3's data rate. At 128 SPS one conversion takes the whole period, sharing the chip with a reference or
+    // flow channel it goes to 475.
+    constexpr ADS1115::DataRate MainReadRate(int reference_channel, int flow_channel)
+    {
+        const bool bShared = reference_channel >= 0 || flow_channel >= 0;
+        return bShared ? ADS1115::DataRate::SPS_475 : ADS1115::DataRate::SPS_128;
+    }
+
+    // Backend Init, after VerifyI2cBus: as many 860 SPS flow reads as fit after the MQ-3 (and reference) ones at the
+    // speed the bus was negotiated at, a stock Pi's 100kHz fits far fewer than 400kHz. Device is ADS1115 or
+    // Ads1115Emu, Source a FlowMuxSource over their Ads1115_Source. Nothing is attached when the self test failed or
+    // nothing fits, breaths are then gated on the MQ-3 alone.
+    template<class Device, class Source>
+    void AttachFlow(Device& device, Source& source, ADS1115::i2c_device::SlaveAddress addr, int flow_channel, ADS1115::DataRate main_rate, bool bBusOk)
+    {
+        if (!bBusOk)
+        {
+            fmt::print(stderr, "Warning: I2C self test failed, flow reads are off and breaths are gated on the MQ-3 alone\n");
+            return;
+        }
+
+        const std::uint32_t bus_hz = device.BusHz();
+        const std::uint64_t busy_us = ADS1115::ReadTimeUs(main_rate, bus_hz)
+            + (source.reference ? ADS1115::ReadTimeUs(ADS1115::DataRate::SPS_475, bus_hz) : 0);
+        source.flow_reads = FlowReadsPerTick(busy_us, ADS1115::ReadTimeUs(ADS1115::DataRate::SPS_860, bus_hz));
+        if (source.flow_reads == 0)
+        {
+            fmt::print(stderr, "Warning: No room on the bus for flow reads at {}Hz, breaths are gated on the MQ-3 alone\n", bus_hz);
+            return;
+        }
+        source.flow.emplace(device, addr, ADS1115::SingleEndedMux(static_cast<std::uint8_t>(flow_channel)),
+            ADS1115::Pga::FS_4_096V, ADS1115::DataRate::SPS_860);
+    }
+
+    // The flow channel rides along on the MQ-3's sampler tick: after the main read (and the reference, Inner is a
+    // ReferencePairSource) come flow_reads more conversions, straight into flow_lane for RuntimeProcess. The MQ-3
+    // keeps its rate, the flow samples just come in bursts of flow_reads per period.
+    template<class Inner, class FlowSource, std::size_t RingN = Config::RingSize>
+    struct FlowMuxSource : Inner
+    {
+        std::optional<FlowSource> flow; // Empty = no flow sensor, the lane stays empty
+        std::size_t flow_reads = 0;
+        mutable SpscRing<Sample, RingN> flow_lane;
+        mutable std::uint64_t flow_failed = 0;
+
+        template<class... Args>
+        explicit FlowMuxSource(Args&&... args) : Inner(std::forward<Args>(args)...) {}
+
+        bool sample_value(Sample& out) const
+        {
+            if (!Inner::sample_value(out)) {return false;}
+
+            if (flow)
+            {
+                for (std::size_t i = 0; i < flow_reads; ++i)
+                {
+                    Sample sample{};
+                    if (flow->sample_value(sample)) {flow_lane.push_overwrite(sample);}
+                    else {++flow_failed;}
+                }
+            }
+            return true;
+        }
+
+        // Same for flow, flow_reads was budgeted against the MQ-3 tick it was set up with.
+        void set_rate_hz(std::uint32_t hz)
+        {
+            if (!flow) {Inner::set_rate_hz(hz);}
+        }
+        std::uint32_t max_rate_hz() const { return flow ? 0 : Inner::max_rate_hz(); }
+    };
+}
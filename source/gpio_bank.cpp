@@ -1,4 +1,5 @@
 #include <gpiod.h>
+#include <thread>
 #include "gpio_bank.h"
 
 namespace DrunkAPI 
@@ -63,6 +64,12 @@ namespace DrunkAPI
         return true;
     }
 
+    bool GPIOBank::SetLine(unsigned int offset, bool active)
+    {
+        if (!request_interface) {return false;}
+        return gpiod_line_request_set_value(request_interface.get(), offset, active ? GPIOD_LINE_VALUE_ACTIVE : GPIOD_LINE_VALUE_INACTIVE) == 0;
+    }
+
     std::array<unsigned int, Default_LedArray.size()> 
     GPIOBank::MakeOffset(const LedPins& leds)
     {
@@ -75,5 +82,132 @@ namespace DrunkAPI
 
         return offsets;
     }
-}
 
+    bool GpioEdgeLine::Init(const char* consumer)
+    {
+        chip_interface = Chip{gpiod_chip_open(chipdevice)};
+        if (!chip_interface)
+        {
+            fmt::print(stderr, "Error: gpiod_chip_open failed: {}\n", std::strerror(errno));
+            return false;
+        }
+
+        LineSettings settings{gpiod_line_settings_new()};
+        LineConfig config{gpiod_line_config_new()};
+        RequestConfig request{gpiod_request_config_new()};
+        events = EdgeEventBuffer{gpiod_edge_event_buffer_new(EventCapacity)};
+        if (!settings || !config || !request || !events)
+        {
+            fmt::print(stderr, "Error: gpiod_*_new failed: {}\n", std::strerror(errno));
+            return false;
+        }
+
+        gpiod_line_settings_set_direction(settings.get(), GPIOD_LINE_DIRECTION_INPUT);
+        gpiod_line_settings_set_edge_detection(settings.get(), GPIOD_LINE_EDGE_FALLING);
+        gpiod_line_settings_set_bias(settings.get(), GPIOD_LINE_BIAS_PULL_UP);
+        gpiod_line_settings_set_event_clock(settings.get(), GPIOD_LINE_CLOCK_MONOTONIC);
+        gpiod_line_config_add_line_settings(config.get(), &offset, 1, settings.get());
+        gpiod_request_config_set_consumer(request.get(), consumer);
+
+        request_interface = LineRequest(gpiod_chip_request_lines(chip_interface.get(), request.get(), config.get()));
+        if (!request_interface)
+        {
+            fmt::print(stderr, "Error: Failed to request edge events on gpio {}: {}\n", offset, std::strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    void GpioEdgeLine::Drain()
+    {
+        if (!request_interface) {return;}
+        while (gpiod_line_request_wait_edge_events(request_interface.get(), 0) > 0)
+        {
+            if (gpiod_line_request_read_edge_events(request_interface.get(), events.get(), EventCapacity) <= 0) {return;}
+        }
+    }
+
+    bool GpioEdgeLine::Wait(std::chrono::microseconds timeout, std::uint64_t& out_t_us)
+    {
+        if (!request_interface) {return false;}
+
+        const std::int64_t timeout_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+        if (gpiod_line_request_wait_edge_events(request_interface.get(), timeout_ns) <= 0) {return false;}
+
+        const int count = gpiod_line_request_read_edge_events(request_interface.get(), events.get(), EventCapacity);
+        if (count <= 0) {return false;}
+
+        gpiod_edge_event* event = gpiod_edge_event_buffer_get_event(events.get(), static_cast<unsigned long>(count - 1));
+        out_t_us = gpiod_edge_event_get_timestamp_ns(event) / 1000U;
+        return true;
+    }
+
+    bool ClockOutI2cBus(const char* chipPath, unsigned int scl, unsigned int sda, const char* consumer)
+    {
+        constexpr int MaxPulses = 9; // A byte and its ACK, the most a slave can be part way through
+        constexpr auto HalfClock = std::chrono::microseconds(5); // 100kHz
+
+        Chip chip{gpiod_chip_open(chipPath)};
+        if (!chip)
+        {
+            fmt::print(stderr, "Error: gpiod_chip_open failed: {}\n", std::strerror(errno));
+            return false;
+        }
+
+        // Open drain with the pull ups on like the bus, ACTIVE lets a line float high. SDA is only driven for the STOP.
+        auto request_lines = [&](bool bSdaOutput) -> LineRequest
+        {
+            LineSettings scl_settings{gpiod_line_settings_new()};
+            LineSettings sda_settings{gpiod_line_settings_new()};
+            LineConfig config{gpiod_line_config_new()};
+            RequestConfig request{gpiod_request_config_new()};
+            if (!scl_settings || !sda_settings || !config || !request) {return nullptr;}
+
+            gpiod_line_settings_set_direction(scl_settings.get(), GPIOD_LINE_DIRECTION_OUTPUT);
+            gpiod_line_settings_set_drive(scl_settings.get(), GPIOD_LINE_DRIVE_OPEN_DRAIN);
+            gpiod_line_settings_set_bias(scl_settings.get(), GPIOD_LINE_BIAS_PULL_UP);
+            gpiod_line_settings_set_output_value(scl_settings.get(), bSdaOutput ? GPIOD_LINE_VALUE_INACTIVE : GPIOD_LINE_VALUE_ACTIVE);
+
+            gpiod_line_settings_set_direction(sda_settings.get(), bSdaOutput ? GPIOD_LINE_DIRECTION_OUTPUT : GPIOD_LINE_DIRECTION_INPUT);
+            gpiod_line_settings_set_bias(sda_settings.get(), GPIOD_LINE_BIAS_PULL_UP);
+            if (bSdaOutput)
+            {
+                gpiod_line_settings_set_drive(sda_settings.get(), GPIOD_LINE_DRIVE_OPEN_DRAIN);
+                gpiod_line_settings_set_output_value(sda_settings.get(), GPIOD_LINE_VALUE_INACTIVE);
+            }
+
+            gpiod_line_config_add_line_settings(config.get(), &scl, 1, scl_settings.get());
+            gpiod_line_config_add_line_settings(config.get(), &sda, 1, sda_settings.get());
+            gpiod_request_config_set_consumer(request.get(), consumer);
+            return LineRequest(gpiod_chip_request_lines(chip.get(), request.get(), config.get()));
+        };
+
+        LineRequest lines = request_lines(false);
+        if (!lines)
+        {
+            fmt::print(stderr, "Error: Failed to request I2C pins {} / {}: {}\n", scl, sda, std::strerror(errno));
+            return false;
+        }
+
+        auto sda_high = [&]{ return gpiod_line_request_get_value(lines.get(), sda) == GPIOD_LINE_VALUE_ACTIVE; };
+        for (int pulse = 0; pulse < MaxPulses && !sda_high(); ++pulse)
+        {
+            gpiod_line_request_set_value(lines.get(), scl, GPIOD_LINE_VALUE_INACTIVE);
+            std::this_thread::sleep_for(HalfClock);
+            gpiod_line_request_set_value(lines.get(), scl, GPIOD_LINE_VALUE_ACTIVE);
+            std::this_thread::sleep_for(HalfClock);
+        }
+        const bool bFreed = sda_high();
+        lines.reset();
+
+        // STOP: SDA goes high while SCL is high, every slave resets its state machine on it.
+        lines = request_lines(true);
+        if (!lines) {return bFreed;}
+        std::this_thread::sleep_for(HalfClock);
+        gpiod_line_request_set_value(lines.get(), scl, GPIOD_LINE_VALUE_ACTIVE);
+        std::this_thread::sleep_for(HalfClock);
+        gpiod_line_request_set_value(lines.get(), sda, GPIOD_LINE_VALUE_ACTIVE);
+        std::this_thread::sleep_for(HalfClock);
+        return bFreed;
+    }
+}
@@ -1,6 +1,8 @@
 #pragma once
+#include "gpio_lines.h"
 #include "gpiod.h"
 #include <array>
+#include <chrono>
 #include <cstdint>
 #include <memory.h>
 #include <cstdio>
@@ -44,44 +46,27 @@ struct LineRequestDeleter {
     }
 };
 
-enum class LedType : uint8_t
-{
-    Blue = 0, // Ready
-    Green = 1, // Sober
-    Yellow = 2, // Light
-    Orange = 3, // Tipsy
-    Red = 4, // Drunk
-};
-
-struct Led_Info
-{
-    unsigned int gpio_pin;
-    LedType Type;
+struct EdgeEventBufferDeleter {
+    void operator()(gpiod_edge_event_buffer* ptr) const noexcept 
+    {
+        if (ptr != nullptr) {gpiod_edge_event_buffer_free(ptr);}
+    }
 };
 
-constexpr uint8_t NUM_PINS = 5; 
 using LineSettings = std::unique_ptr<gpiod_line_settings, LineSettingsDeleter>;
 using LineConfig  = std::unique_ptr<gpiod_line_config,   LineConfigDeleter>;
 using RequestConfig = std::unique_ptr<gpiod_request_config,  RequestConfigDeleter>;
 using Chip        = std::unique_ptr<gpiod_chip,          ChipDeleter>;
 using LineRequest  = std::unique_ptr<gpiod_line_request,  LineRequestDeleter>;
-using LedPins = std::array<Led_Info, NUM_PINS>;
-
-inline constexpr LedPins Default_LedArray = {{
-    { 26, LedType::Blue}, // white wire  -> gpio26 BLUE (1)
-    { 17, LedType::Green}, // orange wire -> gpio17 GREEN (2)
-    { 27, LedType::Yellow}, // orange wire -> gpio27 ORANGE (3)
-    { 22, LedType::Orange}, // yellow wire -> gpio22 ORANGE (4)
-    { 16, LedType::Red}, // yellow wire -> gpio16 RED (5)
-}};
+using EdgeEventBuffer = std::unique_ptr<gpiod_edge_event_buffer, EdgeEventBufferDeleter>;
 
 namespace DrunkAPI
 {
-    class GPIOBank final
+    class GPIOBank final : public GpioLines
     {
         public:
-            // Make sure you find your chip path
-            GPIOBank(const char* chipPath = "/dev/gpiochip0") : chipdevice(chipPath), Leds(Default_LedArray){}
+            // Make sure you find your chip path. Station mode hands each sensor its own group of pins.
+            GPIOBank(const char* chipPath = "/dev/gpiochip0", const LedPins& pins = Default_LedArray) : chipdevice(chipPath), Leds(pins){}
             // Non Copyable
             GPIOBank(const GPIOBank&) = delete;
             // No Assignment
@@ -98,7 +83,9 @@ namespace DrunkAPI
                 return request_interface;
             }
 
-            const LedPins& GetLedInfo() const noexcept
+            bool SetLine(unsigned int offset, bool active) override;
+
+            const LedPins& GetLedInfo() const noexcept override
             {
                 return Leds;
             }
@@ -116,4 +103,37 @@ namespace DrunkAPI
             LineRequest request_interface = nullptr;
     };
 
+
+    // One input line with falling edge events, stamped by the kernel on CLOCK_MONOTONIC (the steady clock samples use).
+    // Pulled up since the ADS1115's ALERT/RDY is open drain.
+    class GpioEdgeLine final
+    {
+        public:
+            GpioEdgeLine(const char* chipPath, unsigned int in_offset) : chipdevice(chipPath), offset(in_offset){}
+            GpioEdgeLine(const GpioEdgeLine&) = delete;
+            GpioEdgeLine& operator=(const GpioEdgeLine&) = delete;
+            GpioEdgeLine(GpioEdgeLine&&) = delete;
+            GpioEdgeLine& operator=(GpioEdgeLine&&) = delete;
+
+            [[nodiscard]] bool Init(const char* consumer = "drunk_app");
+
+            // Throw away edges that already happened.
+            void Drain();
+
+            // Next falling edge within timeout, out_t_us = kernel timestamp. Several queued = the newest wins.
+            bool Wait(std::chrono::microseconds timeout, std::uint64_t& out_t_us);
+
+        private:
+            static constexpr std::size_t EventCapacity = 16;
+
+            const char* chipdevice;
+            unsigned int offset;
+            Chip chip_interface = nullptr;
+            LineRequest request_interface = nullptr;
+            EdgeEventBuffer events = nullptr;
+    };
+
+    // I2C bus recovery (the spec's 9 clock pulses): SCL clocked until a slave stuck mid byte lets go of SDA, then a
+    // STOP. The pins have to be free, ADS1115::RecoverBus unbinds the adapter first. True when SDA came back high.
+    bool ClockOutI2cBus(const char* chipPath, unsigned int scl, unsigned int sda, const char* consumer = "drunk_i2c_recovery");
 };
\ No newline at end of file
@@ -0,0 +1,39 @@
+#include "gpio_emu.h"
+#include <cstddef>
+#include <fmt/core.h>
+
+namespace DrunkAPI
+{
+    bool EmuGpio::Init([[maybe_unused]] const char* consumer)
+    {
+        lines.fill(false);
+        bInit = true;
+        fmt::print("Hardware Init: GPIO Emulator Ready!\n");
+        return true;
+    }
+
+    bool EmuGpio::SetLine(unsigned int offset, bool active)
+    {
+        if (!bInit || offset >= MaxLines) {return false;}
+
+        ++writes;
+        const bool bChanged = lines[offset] != active;
+        lines[offset] = active;
+        if (bEcho && bChanged) {Echo();}
+        return true;
+    }
+
+    void EmuGpio::Echo() const
+    {
+        // Indexed by LedType: Blue Green Yellow Orange Red
+        constexpr char Names[NUM_PINS] = {'B', 'G', 'Y', 'O', 'R'};
+        char row[NUM_PINS * 2] = {};
+        for (std::size_t i = 0; i < Leds.size(); ++i)
+        {
+            row[i * 2] = lines[Leds[i].gpio_pin] ? Names[static_cast<std::size_t>(Leds[i].Type)] : '.';
+            row[(i * 2) + 1] = ' ';
+        }
+        row[(NUM_PINS * 2) - 1] = '\0';
+        fmt::print(stderr, "[{}] {}\n", label, row);
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "gpio_lines.h"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+namespace DrunkAPI
+{
+    // In-memory LED lines for host mode. Every write lands in an array, with bEcho the LED row is printed to
+    // stderr whenever it changes so you can watch the state machine without a breadboard.
+    class EmuGpio final : public GpioLines
+    {
+        public:
+            // label prefixes the echoed row, station mode runs one EmuGpio per sensor.
+            explicit EmuGpio(bool in_echo = false, const LedPins& pins = Default_LedArray, std::string in_label = "leds")
+                : bEcho(in_echo), label(std::move(in_label)), Leds(pins) {}
+
+            EmuGpio(const EmuGpio&) = delete;
+            EmuGpio& operator=(const EmuGpio&) = delete;
+            EmuGpio(EmuGpio&&) = delete;
+            EmuGpio& operator=(EmuGpio&&) = delete;
+
+            [[nodiscard]] bool Init(const char* consumer = "drunk_app");
+
+            bool SetLine(unsigned int offset, bool active) override;
+            const LedPins& GetLedInfo() const noexcept override { return Leds; }
+
+            bool LineValue(unsigned int offset) const noexcept { return offset < MaxLines && lines[offset]; }
+            std::uint64_t Writes() const noexcept { return writes; }
+
+        private:
+            static constexpr unsigned int MaxLines = 64;
+
+            void Echo() const;
+
+            bool bEcho;
+            std::string label;
+            bool bInit = false;
+            LedPins Leds;
+            std::array<bool, MaxLines> lines{};
+            std::uint64_t writes = 0;
+    };
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+// Hardware agnostic side of the LED GPIOs. LedController only talks to GpioLines, GPIOBank (libgpiod) is the
+// real one and EmuGpio (gpio_emu.h) is the host mode stand in.
+enum class LedType : uint8_t
+{
+    Blue = 0, // Ready
+    Green = 1, // Sober
+    Yellow = 2, // Light
+    Orange = 3, // Tipsy
+    Red = 4, // Drunk
+};
+
+struct Led_Info
+{
+    unsigned int gpio_pin;
+    LedType Type;
+};
+
+constexpr uint8_t NUM_PINS = 5;
+using LedPins = std::array<Led_Info, NUM_PINS>;
+
+inline constexpr LedPins Default_LedArray = {{
+    { 26, LedType::Blue}, // white wire  -> gpio26 BLUE (1)
+    { 17, LedType::Green}, // orange wire -> gpio17 GREEN (2)
+    { 27, LedType::Yellow}, // orange wire -> gpio27 ORANGE (3)
+    { 22, LedType::Orange}, // yellow wire -> gpio22 ORANGE (4)
+    { 16, LedType::Red}, // yellow wire -> gpio16 RED (5)
+}};
+
+namespace DrunkAPI
+{
+    class GpioLines
+    {
+        public:
+            virtual ~GpioLines() = default;
+
+            // Drive one output line, false if the line request isn't up.
+            virtual bool SetLine(unsigned int offset, bool active) = 0;
+            virtual const LedPins& GetLedInfo() const noexcept = 0;
+    };
+}
@@ -0,0 +1,130 @@
+#include "i2c_recovery.h"
+#include <algorithm>
+
+namespace DrunkAPI
+{
+    const char* I2cFaultName(I2cFault fault)
+    {
+        switch (fault)
+        {
+            case I2cFault::Nack: return "nack";
+            case I2cFault::BusTimeout: return "bus timeout";
+            case I2cFault::ConversionTimeout: return "conversion timeout";
+            case I2cFault::Io: return "io";
+            default: return "?";
+        }
+    }
+
+    void I2cRecovery::StartSession(std::uint64_t now_us)
+    {
+        std::uint64_t unset = 0;
+        session_start_us.compare_exchange_strong(unset, now_us, std::memory_order_relaxed);
+    }
+
+    I2cAction I2cRecovery::OnFault(I2cFault fault, std::uint8_t attempt)
+    {
+        faults[static_cast<std::size_t>(fault)].fetch_add(1, std::memory_order_relaxed);
+
+        // A timed out conversion already cost a whole conversion time, going again would eat the next tick too.
+        if (fault == I2cFault::ConversionTimeout || attempt >= cfg.retries) {return I2cAction::None;}
+        return I2cAction::Retry;
+    }
+
+    I2cAction I2cRecovery::OnReadFailed(std::uint64_t now_us)
+    {
+        failed_reads.fetch_add(1, std::memory_order_relaxed);
+        StartSession(now_us);
+
+        if (failed_run == 0)
+        {
+            outage_start_us.store(now_us, std::memory_order_relaxed);
+            actions_this_outage = 0;
+        }
+        ++failed_run;
+
+        // Reopen once, then clock the bus free, then keep at it every recover_every_us.
+        I2cAction action = I2cAction::None;
+        if (failed_run >= cfg.bus_recover_after)
+        {
+            if (failed_run == cfg.bus_recover_after || now_us - last_action_us >= cfg.recover_every_us) {action = I2cAction::RecoverBus;}
+        }
+        else if (failed_run == cfg.reopen_after)
+        {
+            action = I2cAction::Reopen;
+        }
+
+        if (action != I2cAction::None)
+        {
+            last_action_us = now_us;
+            ++actions_this_outage;
+        }
+        return action;
+    }
+
+    std::optional<I2cOutage> I2cRecovery::OnRead(std::uint64_t now_us, bool bRetried)
+    {
+        reads.fetch_add(1, std::memory_order_relaxed);
+        if (bRetried) {retried_ok.fetch_add(1, std::memory_order_relaxed);}
+        StartSession(now_us);
+        if (failed_run == 0) {return std::nullopt;}
+
+        const std::uint64_t start_us = outage_start_us.load(std::memory_order_relaxed);
+        I2cOutage outage{};
+        outage.duration_us = now_us > start_us ? now_us - start_us : 0;
+        outage.failed_reads = failed_run;
+        outage.actions = actions_this_outage;
+
+        outages.fetch_add(1, std::memory_order_relaxed);
+        outage_us.fetch_add(outage.duration_us, std::memory_order_relaxed);
+        if (outage.duration_us > longest_outage_us.load(std::memory_order_relaxed)) {longest_outage_us.store(outage.duration_us, std::memory_order_relaxed);}
+        outage_start_us.store(0, std::memory_order_relaxed);
+        failed_run = 0;
+        return outage;
+    }
+
+    void I2cRecovery::OnRecovery(I2cAction action, bool bOk)
+    {
+        if (action == I2cAction::Reopen) {reopens.fetch_add(1, std::memory_order_relaxed);}
+        if (action == I2cAction::RecoverBus) {bus_recoveries.fetch_add(1, std::memory_order_relaxed);}
+        if (!bOk) {recovery_failures.fetch_add(1, std::memory_order_relaxed);}
+    }
+
+    void I2cRecovery::Remember(std::uint8_t addr, std::uint8_t reg, std::uint16_t value)
+    {
+        auto it = std::find_if(programmed.begin(), programmed.end(), [&](const Persistent& write) { return write.addr == addr && write.reg == reg; });
+        if (it != programmed.end()) {it->value = value;}
+        else {programmed.push_back(Persistent{addr, reg, value});}
+    }
+
+    I2cHealth I2cRecovery::Health(std::uint64_t now_us) const
+    {
+        I2cHealth health{};
+        for (std::size_t i = 0; i < faults.size(); ++i) {health.faults[i] = faults[i].load(std::memory_order_relaxed);}
+        health.reads = reads.load(std::memory_order_relaxed);
+        health.failed_reads = failed_reads.load(std::memory_order_relaxed);
+        health.retried_ok = retried_ok.load(std::memory_order_relaxed);
+        health.reopens = reopens.load(std::memory_order_relaxed);
+        health.bus_recoveries = bus_recoveries.load(std::memory_order_relaxed);
+        health.recovery_failures = recovery_failures.load(std::memory_order_relaxed);
+        health.reprograms = reprograms.load(std::memory_order_relaxed);
+        health.outages = outages.load(std::memory_order_relaxed);
+        health.outage_us = outage_us.load(std::memory_order_relaxed);
+        health.longest_outage_us = longest_outage_us.load(std::memory_order_relaxed);
+
+        const std::uint64_t start_us = outage_start_us.load(std::memory_order_relaxed);
+        health.current_outage_us = start_us != 0 && now_us > start_us ? now_us - start_us : 0;
+        health.longest_outage_us = std::max(health.longest_outage_us, health.current_outage_us);
+
+        const std::uint64_t session_start = session_start_us.load(std::memory_order_relaxed);
+        health.session_us = session_start != 0 && now_us > session_start ? now_us - session_start : 0;
+        if (health.session_us > 0)
+        {
+            const double down = static_cast<double>(health.outage_us + health.current_outage_us) / static_cast<double>(health.session_us);
+            health.availability = std::clamp(1.0 - down, 0.0, 1.0);
+        }
+        // A minute long outage five seconds after boot says nothing about the bus yet, the SLO is for long sessions.
+        health.bSloJudged = health.session_us >= cfg.slo_min_session_us;
+        health.bSloMet = !health.bSloJudged || health.availability >= cfg.availability_slo;
+        return health;
+    }
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "config_settings.h"
+
+// Keeps an I2C bus going through glitches. A failed read used to be a skipped sample, and a wedged bus (a slave
+// holding SDA low after a reset mid byte) or a dead fd stayed that way for the rest of the session. This is the
+// bookkeeping and the escalation policy, the device does the actual work (ADS1115::Reopen / RecoverBus and the
+// emulator's stand ins), Ads1115_Source drives it:
+//   - a NACK or bus error is retried right away, up to retries per read
+//   - reopen_after failed reads in a row reopens the fd, bus_recover_after clocks SCL to free the bus, and that
+//     repeats every recover_every_ms for as long as it stays out
+//   - once reads come back the persistent registers (the conversion ready thresholds) are written again, the chip
+//     may have browned out and lost them
+// Every run of failed reads is an outage, timed from the first failure to the next good read.
+namespace DrunkAPI
+{
+    enum class I2cFault : std::uint8_t
+    {
+        Nack, // ENXIO / EREMOTEIO, nobody answered (unplugged, browned out)
+        BusTimeout, // ETIMEDOUT / EAGAIN, the controller gave up (SCL stretched or SDA stuck)
+        ConversionTimeout, // Transactions went through but OS never came back set
+        Io, // Anything else, including a closed fd
+        Count
+    };
+
+    const char* I2cFaultName(I2cFault fault);
+
+    enum class I2cAction : std::uint8_t
+    {
+        None,
+        Retry,
+        Reopen,
+        RecoverBus,
+    };
+
+    struct I2cRecovery_Config
+    {
+        std::uint8_t retries = Config::I2cRetries;
+        std::uint32_t reopen_after = Config::I2cReopenAfter;
+        std::uint32_t bus_recover_after = Config::I2cBusRecoverAfter;
+        std::uint64_t recover_every_us = std::uint64_t{Config::I2cRecoverEveryMs} * 1000;
+        double availability_slo = Config::I2cAvailabilitySlo;
+        std::uint64_t slo_min_session_us = std::uint64_t{Config::I2cSloMinSessionS} * 1'000'000;
+    };
+
+    struct I2cHealth
+    {
+        std::array<std::uint64_t, static_cast<std::size_t>(I2cFault::Count)> faults{}; // Per failed transaction, retries included
+        std::uint64_t reads = 0; // Good ones
+        std::uint64_t failed_reads = 0; // Gave up after the retries
+        std::uint64_t retried_ok = 0; // Good after at least one retry
+        std::uint64_t reopens = 0;
+        std::uint64_t bus_recoveries = 0;
+        std::uint64_t recovery_failures = 0; // Reopen / bus recovery that didn't come back up
+        std::uint64_t reprograms = 0;
+        std::uint64_t outages = 0; // Finished ones
+        std::uint64_t outage_us = 0; // Total, finished ones
+        std::uint64_t longest_outage_us = 0;
+        std::uint64_t current_outage_us = 0; // 0 = up
+        std::uint64_t session_us = 0; // Since StartSession (the device's Init)
+        double availability = 1.0; // 1 - (outage_us + current_outage_us) / session_us
+        bool bSloJudged = false; // session_us is past slo_min_session_us, before that bSloMet stays true
+        bool bSloMet = true;
+    };
+
+    // A finished outage, for the caller's warning.
+    struct I2cOutage
+    {
+        std::uint64_t duration_us = 0;
+        std::uint32_t failed_reads = 0;
+        std::uint32_t actions = 0; // Reopens + bus recoveries it took
+    };
+
+    // One per bus (device handle). Sampler thread only apart from Health(), which any thread can call.
+    class I2cRecovery
+    {
+        public:
+            // A register write that has to survive a chip reset, replayed after an outage.
+            struct Persistent
+            {
+                std::uint8_t addr = 0;
+                std::uint8_t reg = 0;
+                std::uint16_t value = 0;
+            };
+
+            explicit I2cRecovery(I2cRecovery_Config in_cfg = {}) : cfg(in_cfg) {}
+
+            // The device came up (Init), availability counts from here. A read before it starts the clock instead.
+            void StartSession(std::uint64_t now_us);
+
+            // A transaction in the attempt'th try of a read failed. Retry, or None to give up on the read.
+            I2cAction OnFault(I2cFault fault, std::uint8_t attempt);
+
+            // The read gave up, what to do about the bus before the next one.
+            I2cAction OnReadFailed(std::uint64_t now_us);
+
+            // The read came back. Set when it ended an outage, the caller then replays Programmed().
+            std::optional<I2cOutage> OnRead(std::uint64_t now_us, bool bRetried);
+
+            void OnRecovery(I2cAction action, bool bOk);
+            void OnReprogram() { reprograms.fetch_add(1, std::memory_order_relaxed); }
+
+            void Remember(std::uint8_t addr, std::uint8_t reg, std::uint16_t value);
+            const std::vector<Persistent>& Programmed() const noexcept { return programmed; }
+
+            I2cHealth Health(std::uint64_t now_us) const;
+            const I2cRecovery_Config& GetConfig() const noexcept { return cfg; }
+
+        private:
+            I2cRecovery_Config cfg;
+            std::vector<Persistent> programmed;
+
+            // Sampler thread
+            std::uint32_t failed_run = 0;
+            std::uint64_t last_action_us = 0;
+            std::uint32_t actions_this_outage = 0;
+
+            std::array<std::atomic<std::uint64_t>, static_cast<std::size_t>(I2cFault::Count)> faults{};
+            std::atomic<std::uint64_t> reads{0};
+            std::atomic<std::uint64_t> failed_reads{0};
+            std::atomic<std::uint64_t> retried_ok{0};
+            std::atomic<std::uint64_t> reopens{0};
+            std::atomic<std::uint64_t> bus_recoveries{0};
+            std::atomic<std::uint64_t> recovery_failures{0};
+            std::atomic<std::uint64_t> reprograms{0};
+            std::atomic<std::uint64_t> outages{0};
+            std::atomic<std::uint64_t> outage_us{0};
+            std::atomic<std::uint64_t> longest_outage_us{0};
+            std::atomic<std::uint64_t> session_start_us{0}; // 0 = not started
+            std::atomic<std::uint64_t> outage_start_us{0}; // 0 = up
+    };
+}
@@ -1,34 +1,27 @@
 #include "led_controller.h"
-#include "gpio_bank.h"
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
-#include <gpiod.h>
 #include <algorithm>
 #include <thread>
 
 namespace DrunkAPI
 {
-    void LedController::SetLed(LedType type, gpiod_line_value state)
+    void LedController::SetLed(LedType type, bool state)
     {
-        const LineRequest& Linereq = LedBank.GetLineRequest();
         const LedPins& led_info = LedBank.GetLedInfo();
-
-        if(!Linereq){std::perror("Error: Line Request Invalid Set Failed"); return;}
         if(led_info.empty()){std::perror("Error: Led Array Empty"); return;}
 
         size_t idx = LedToIndex(type);
-        if(idx > led_info.size()){return;}
-        auto* req = Linereq.get();
-        gpiod_line_request_set_value(req, led_info[idx].gpio_pin, state);
-      
+        if(idx >= led_info.size()){return;}
+        if(!LedBank.SetLine(led_info[idx].gpio_pin, state)){std::perror("Error: Line Request Invalid Set Failed");}
     }
 
     void LedController::Clear()
     {
         for(Led_Info led: LedBank.GetLedInfo())
         {
-            SetLed(led.Type,GPIOD_LINE_VALUE_INACTIVE);
+            SetLed(led.Type,false);
         }
     }
     
@@ -36,7 +29,7 @@ namespace DrunkAPI
     {
         for(Led_Info led: LedBank.GetLedInfo())
         {
-            SetLed(led.Type,GPIOD_LINE_VALUE_ACTIVE);
+            SetLed(led.Type,true);
         }
     }
 
@@ -46,7 +39,7 @@ namespace DrunkAPI
         {
             auto led = static_cast<LedType>(i);
             bool enable = (mask & (1U << i)) != 0;
-            SetLed(led, enable ? GPIOD_LINE_VALUE_ACTIVE : GPIOD_LINE_VALUE_INACTIVE);
+            SetLed(led, enable);
         }
     }
 
@@ -56,14 +49,14 @@ namespace DrunkAPI
         // 0 -> n leds ON
         for (size_t i = 0; i < static_cast<size_t>(LedBank.GetLedInfo().size()); ++i)
         {
-            SetLed(LedBank.GetLedInfo()[i].Type, GPIOD_LINE_VALUE_ACTIVE);
+            SetLed(LedBank.GetLedInfo()[i].Type, true);
             std::this_thread::sleep_for(step);
         }
 
         // n -> 0 leds OFF
         for (size_t i = static_cast<size_t>(LedBank.GetLedInfo().size()) - 1; i-->0;)
         {
-            SetLed(LedBank.GetLedInfo()[static_cast<std::size_t>(i)].Type, GPIOD_LINE_VALUE_INACTIVE);
+            SetLed(LedBank.GetLedInfo()[static_cast<std::size_t>(i)].Type, false);
             std::this_thread::sleep_for(step);
         }
     }
@@ -71,14 +64,14 @@ namespace DrunkAPI
     void LedController::Blink(LedType led, uint32_t count, std::chrono::milliseconds on_time,std::chrono::milliseconds off_time)
     {
         // Start from a known state
-        SetLed(led, GPIOD_LINE_VALUE_INACTIVE);
+        SetLed(led, false);
 
         for (uint32_t i = 0; i < count; ++i)
         {
-            SetLed(led, GPIOD_LINE_VALUE_ACTIVE);
+            SetLed(led, true);
             std::this_thread::sleep_for(on_time);
 
-            SetLed(led, GPIOD_LINE_VALUE_INACTIVE);
+            SetLed(led, false);
             std::this_thread::sleep_for(off_time);
         }
     }
@@ -88,7 +81,7 @@ namespace DrunkAPI
         const auto& leds = LedBank.GetLedInfo();
         if (leds.empty()){return;}
 
-        auto set_all = [&](gpiod_line_value line_value)
+        auto set_all = [&](bool line_value)
         {
             for (const auto& led : leds)
             {
@@ -98,10 +91,10 @@ namespace DrunkAPI
 
         for (std::uint32_t i = 0; i < count; ++i)
         {
-            set_all(GPIOD_LINE_VALUE_ACTIVE);
+            set_all(true);
             std::this_thread::sleep_for(on_time);
 
-            set_all(GPIOD_LINE_VALUE_INACTIVE);
+            set_all(false);
             std::this_thread::sleep_for(off_time);
         }
     }
@@ -1,11 +1,11 @@
 #pragma once
-#include "gpio_bank.h"
+#include "gpio_lines.h"
 #include <chrono>
 #include <condition_variable>
 #include <cstddef>
 #include <cstdint>
-#include <gpiod.h>
 #include <mutex>
+#include <thread>
 
 namespace DrunkAPI
 {
@@ -74,9 +74,9 @@ namespace DrunkAPI
         LedController& operator=(LedController&&) = delete;
         LedController(LedController&&) = delete;
         
-        explicit LedController(GPIOBank& bank) : LedBank(bank){}
+        explicit LedController(GpioLines& bank) : LedBank(bank){}
 
-        void SetLed(LedType type, gpiod_line_value state);
+        void SetLed(LedType type, bool state);
 
         void Clear();
         void EnableAll();
@@ -91,7 +91,7 @@ namespace DrunkAPI
         
         private:
 
-        GPIOBank& LedBank;
+        GpioLines& LedBank;
     };
 
 
@@ -171,11 +171,11 @@ namespace DrunkAPI
                     for (std::uint32_t i = 0; i < cmd.count; ++i)
                     {
                         if (Cancel_Command()){return;}
-                        led_ctrl.SetLed(cmd.led, GPIOD_LINE_VALUE_ACTIVE);
+                        led_ctrl.SetLed(cmd.led, true);
                         std::this_thread::sleep_for(cmd.on);
 
                         if (Cancel_Command()){return;}
-                        led_ctrl.SetLed(cmd.led, GPIOD_LINE_VALUE_INACTIVE);
+                        led_ctrl.SetLed(cmd.led, false);
                         std::this_thread::sleep_for(cmd.off);
                     }
                     break;
@@ -1,9 +1,11 @@
-#include "ads1115.h"
+#include "flight_recorder.h"
 #include "processor_traits.h"
 #include "processor_types.h"
+#include "station.h"
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fmt/core.h>
-#include <gpiod.h>
 #include <csignal>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -16,24 +18,203 @@ static std::atomic<bool> g_exit_requested{false};
 static void on_sigint(int result)  { g_sigint_count.fetch_add(1); }
 static void on_sigterm(int result) { g_exit_requested.store(true); g_sigint_count.store(2); } */
 
+// Backend is picked at build time: drunk_app (Pi), drunk_app_emulated, drunk_app_replay. See CMakeLists.txt.
+#if defined(DRUNK_BACKEND_EMULATED)
+#include "backend_emulated.h"
+using Backend = DrunkAPI::EmulatedBackend;
+using StationBackend = DrunkAPI::EmulatedStationBackend;
+template<class Chip> using SpiBackend = DrunkAPI::EmulatedSpiBackend<Chip>;
+#elif defined(DRUNK_BACKEND_REPLAY)
+#include "backend_replay.h"
+using Backend = DrunkAPI::ReplayBackend;
+#else
+#include "backend_real.h"
+using Backend = DrunkAPI::Ads1115Backend;
+using StationBackend = DrunkAPI::Ads1115StationBackend;
+template<class Chip> using SpiBackend = DrunkAPI::SpiBackend<Chip>;
+#endif
+
 using CalibrationProcess = DrunkAPI::CalibrationProcess;
 using RuntimeProcess = DrunkAPI::RuntimeProcess;
 
-int main()
+static void PrintUsage(const char* argv0)
+{
+#if defined(DRUNK_BACKEND_EMULATED)
+    fmt::print("usage: {} [--runtime | --station] [--seed n] [--every s] [--bac b] [--fast] [--quiet-leds]\n", argv0);
+    fmt::print("       [--reference] [--ambient mg_l[,swing_mg_l,period_s]] [--flow] [--i2c-hz hz] [--wedge at_s] [--lose-fd at_s]\n");
+    fmt::print("       [--spi mcp3208|ads8688] [--spi-depth n]\n");
+    fmt::print("       station: [--sensors n] [--buses n] [--unplug sensor,at_s,for_s]\n");
+#elif defined(DRUNK_BACKEND_REPLAY)
+    fmt::print("usage: {} <capture> [--runtime] [--loop] [--quiet-leds]\n", argv0);
+#else
+    fmt::print("usage: {} [--runtime | --station] [--spi mcp3208|ads8688] [--spi-depth n]\n", argv0);
+#endif
+}
+
+#if !defined(DRUNK_BACKEND_REPLAY)
+// SPI ADC in place of the ADS1115, the chip is a template argument so both get built.
+template<class SpiBackendT>
+static int RunSpiSession(const typename SpiBackendT::Settings& settings, bool bRuntime)
+{
+    return bRuntime ? DrunkAPI::RunSession<RuntimeProcess, SpiBackendT>(settings) : DrunkAPI::RunSession<CalibrationProcess, SpiBackendT>(settings);
+}
+#endif
+
+int main(int argc, char** argv)
 {
     std::setvbuf(stdout,nullptr,_IOFBF,0);
+
+    // SIGUSR1 dumps the flight recorder, block it before any thread spawns so only the dumper thread sees it.
+    DrunkAPI::FlightRecorder::BlockDumpSignal();
+
     // OS Callbacks for Kill
     //std::signal(SIGINT,  on_sigint);
     //std::signal(SIGTERM, on_sigterm);
 
+    // Calibration until the sensor is calibrated, then --runtime
+    bool bRuntime = false;
+    bool bStation = false; // Config::StationLayout on the Pi, --sensors emulated ones in host mode
+    Backend::Settings settings{};
+
+#if defined(DRUNK_BACKEND_EMULATED)
+    // A day of blows every couple of minutes, past the heater warmup.
+    double every_s = 120.0;
+    std::vector<double> bacs{0.02, 0.05, 0.08, 0.12};
+    StationBackend::Settings station_settings{};
+#endif
+#if !defined(DRUNK_BACKEND_REPLAY)
+    const char* spi_chip = nullptr; // --spi, unset = the ADS1115
+    std::size_t spi_depth = DrunkAPI::Config::SpiBurstDepth;
+#endif
+
+    for (int i = 1; i < argc; ++i)
+    {
+        [[maybe_unused]] const bool has_value = (i + 1 < argc);
+        if (std::strcmp(argv[i], "--runtime") == 0) {bRuntime = true;}
+        else if (std::strcmp(argv[i], "--calibrate") == 0) {bRuntime = false;}
+        else if (std::strcmp(argv[i], "--station") == 0) {bStation = true;}
+#if !defined(DRUNK_BACKEND_REPLAY)
+        else if (std::strcmp(argv[i], "--spi") == 0 && has_value) {spi_chip = argv[++i];}
+        else if (std::strcmp(argv[i], "--spi-depth") == 0 && has_value) {spi_depth = std::strtoull(argv[++i], nullptr, 10);}
+#endif
+#if defined(DRUNK_BACKEND_EMULATED)
+        else if (std::strcmp(argv[i], "--sensors") == 0 && has_value) {station_settings.sensors = std::strtoull(argv[++i], nullptr, 10);}
+        else if (std::strcmp(argv[i], "--buses") == 0 && has_value) {station_settings.buses = std::strtoull(argv[++i], nullptr, 10);}
+        else if (std::strcmp(argv[i], "--unplug") == 0 && has_value)
+        {
+            if (std::sscanf(argv[++i], "%d,%lf,%lf", &station_settings.unplug_sensor, &station_settings.unplug_at_s, &station_settings.unplug_for_s) != 3)
+            {
+                PrintUsage(argv[0]);
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--seed") == 0 && has_value) {settings.signal.seed = std::strtoull(argv[++i], nullptr, 10);}
+        else if (std::strcmp(argv[i], "--every") == 0 && has_value) {every_s = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--bac") == 0 && has_value) {bacs.assign(1, std::strtod(argv[++i], nullptr));}
+        else if (std::strcmp(argv[i], "--fast") == 0) {settings.adc.bRealTime = false;}
+        else if (std::strcmp(argv[i], "--quiet-leds") == 0) {settings.bEchoLeds = false;}
+        else if (std::strcmp(argv[i], "--reference") == 0) {settings.adc.reference_channel = 1;}
+        else if (std::strcmp(argv[i], "--flow") == 0)
+        {
+            // Pressure sensor on AIN2, and the blows then carry their airway dead space like a real one.
+            settings.adc.flow_channel = 2;
+            settings.signal.dead_space_l = DrunkAPI::Config::FlowDeadSpaceL;
+        }
+        else if (std::strcmp(argv[i], "--i2c-hz") == 0 && has_value) {settings.adc.bus_hz = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));} // 100000 = a stock Pi
+        else if (std::strcmp(argv[i], "--wedge") == 0 && has_value) {settings.adc.wedge_at_s = std::strtod(argv[++i], nullptr);} // Until the bus recovery clocks it free
+        else if (std::strcmp(argv[i], "--lose-fd") == 0 && has_value) {settings.adc.lose_fd_at_s = std::strtod(argv[++i], nullptr);} // Until a reopen
+        else if (std::strcmp(argv[i], "--ambient") == 0 && has_value)
+        {
+            if (std::sscanf(argv[++i], "%lf,%lf,%lf", &settings.signal.ambient_mg_l, &settings.signal.ambient_swing_mg_l, &settings.signal.ambient_period_s) < 1)
+            {
+                PrintUsage(argv[0]);
+                return 1;
+            }
+        }
+#elif defined(DRUNK_BACKEND_REPLAY)
+        else if (std::strcmp(argv[i], "--loop") == 0) {settings.bLoop = true;}
+        else if (std::strcmp(argv[i], "--quiet-leds") == 0) {settings.bEchoLeds = false;}
+        else if (argv[i][0] != '-' && settings.path.empty()) {settings.path = argv[i];}
+#endif
+        else
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+#if defined(DRUNK_BACKEND_EMULATED)
+    settings.script = DrunkAPI::MakeBreathScript(24.0 * 3600.0, every_s, bacs, 3.0, 240.0);
+
+    // Reference on AIN1: same room, its own noise, and the shield slows the air getting to it.
+    settings.reference = settings.signal;
+    settings.reference.seed += 1;
+    settings.reference.ambient_lag_s = 0.1;
+
+    if (bStation)
+    {
+        // Same schedule per sensor, staggered so the blows don't all land on the same tick.
+        station_settings.signal = settings.signal;
+        station_settings.bRealTime = settings.adc.bRealTime;
+        station_settings.bEchoLeds = settings.bEchoLeds;
+        for (std::size_t sensor = 0; sensor < station_settings.sensors; ++sensor)
+        {
+            const double offset_s = every_s * static_cast<double>(sensor) / static_cast<double>(station_settings.sensors);
+            station_settings.scripts.push_back(DrunkAPI::MakeBreathScript(24.0 * 3600.0, every_s, bacs, 3.0, 240.0 + offset_s));
+        }
+        return DrunkAPI::RunStation<StationBackend>(station_settings);
+    }
+
+    // Same session on the SPI ADC emulator, the reference / flow channels follow --reference / --flow.
+    if (spi_chip != nullptr)
+    {
+        DrunkAPI::EmulatedSpiBackend_Config spi_settings{};
+        spi_settings.adc.bRealTime = settings.adc.bRealTime;
+        spi_settings.adc.reference_channel = settings.adc.reference_channel;
+        spi_settings.adc.flow_channel = settings.adc.flow_channel;
+        spi_settings.burst_depth = spi_depth;
+        spi_settings.signal = settings.signal;
+        spi_settings.script = settings.script;
+        spi_settings.bEchoLeds = settings.bEchoLeds;
+        spi_settings.reference = settings.reference;
+
+        if (std::strcmp(spi_chip, "mcp3208") == 0) {return RunSpiSession<SpiBackend<DrunkAPI::Mcp3208>>(spi_settings, bRuntime);}
+        if (std::strcmp(spi_chip, "ads8688") == 0) {return RunSpiSession<SpiBackend<DrunkAPI::Ads8688>>(spi_settings, bRuntime);}
+        PrintUsage(argv[0]);
+        return 1;
+    }
+#elif defined(DRUNK_BACKEND_REPLAY)
+    if (bStation)
+    {
+        fmt::print(stderr, "Error: --station needs live or emulated sensors, replay one capture at a time\n");
+        return 1;
+    }
+
+    if (settings.path.empty())
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+#else
     // Set your Ads1115 slave Address
-    auto s_address = DrunkAPI::ADS1115::i2c_device::SlaveAddress::ADDR_GND;
+    settings.addr = DrunkAPI::ADS1115::i2c_device::SlaveAddress::ADDR_GND;
+
+    // Sensor layout lives in config_settings.h (Config::StationLayout).
+    if (bStation) {return DrunkAPI::RunStation<StationBackend>(StationBackend::Settings{});}
+
+    if (spi_chip != nullptr)
+    {
+        DrunkAPI::SpiBackend_Config spi_settings{};
+        spi_settings.source.burst_depth = spi_depth;
 
-    // Uncomment if Calibrating
-    int status = DrunkAPI::RunSession<CalibrationProcess>(s_address);
+        if (std::strcmp(spi_chip, "mcp3208") == 0) {return RunSpiSession<SpiBackend<DrunkAPI::Mcp3208>>(spi_settings, bRuntime);}
+        if (std::strcmp(spi_chip, "ads8688") == 0) {return RunSpiSession<SpiBackend<DrunkAPI::Ads8688>>(spi_settings, bRuntime);}
+        PrintUsage(argv[0]);
+        return 1;
+    }
+#endif
 
-    // Uncomment After Calibrated.
-    //int status = DrunkAPI::RunSession<RuntimeProcess>(s_address);
+    int status = bRuntime ? DrunkAPI::RunSession<RuntimeProcess, Backend>(settings) : DrunkAPI::RunSession<CalibrationProcess, Backend>(settings);
 
     /*  TCP_config host_config;
         DrunkAPI::CSVNet CsvSink{host_config};
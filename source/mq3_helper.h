@@ -80,5 +80,42 @@ namespace DrunkAPI::MQ3
         double BAC = ppm * PPM_BAC_Conversion;
         return BAC;
     }
-    
+
+    // Whole chain, peak ADC volts -> BAC (the Analyzed path in StartRuntime).
+    inline double adc3v3_to_bac(double vadc_3v3, double RLoad, double r0_air)
+    {
+        return calculate_bac(calculate_ppm(calculate_concentration_exp(adc3v3_to_ratio(vadc_3v3, RLoad, r0_air))));
+    }
+
+    // Inverses of the chain above, used by the signal generator to go from a scripted BAC to ADC volts.
+    inline double bac_to_concentration(double bac)
+    {
+        return (bac / PPM_BAC_Conversion) / Ethanol_Conversion;
+    }
+
+    // ln(Rs/R0) = E_Slope * ln(C) - E_Intercept
+    inline double concentration_to_ratio_exp(double concentration)
+    {
+        return std::exp((E_Slope * std::log(concentration)) - E_Intercept);
+    }
+
+    inline double ratio_to_adc3v3(double rs_ro, double RLoad, double r0_air, double Vcc = VCC_5v)
+    {
+        const double rs = rs_ro * r0_air;
+        return (Vcc * RLoad / (rs + RLoad)) / Voltage_Factor;
+    }
+
+    // Breath through the mouthpiece is plug flow: the first dead_space_l is mouth/airway air with no alcohol in it, so
+    // a first order sensor (rise_tau_s) at the end of the blow only rose on alcohol for the rest of it. Scales the
+    // conductance (R0/Rs) the alcohol added over clean air back up to what the whole blow would have given.
+    inline double dead_space_corrected_ratio(double rs_ro, double air_rs_ro, double volume_l, double blow_s, double dead_space_l, double rise_tau_s)
+    {
+        if (volume_l <= dead_space_l || blow_s <= 0.0 || rs_ro >= air_rs_ro) {return rs_ro;}
+
+        const double live_s = blow_s * (1.0 - (dead_space_l / volume_l));
+        const double scale = (1.0 - std::exp(-blow_s / rise_tau_s)) / (1.0 - std::exp(-live_s / rise_tau_s));
+        const double air = 1.0 / air_rs_ro;
+        return 1.0 / (air + (((1.0 / rs_ro) - air) * scale));
+    }
+
 }
@@ -0,0 +1,384 @@
+#include "net_stream.h"
+#include "clock.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fmt/core.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace DrunkAPI
+{
+    std::uint64_t DefaultUnitId()
+    {
+        char host[256]{};
+        if (::gethostname(host, sizeof(host) - 1) != 0) {return 1;}
+
+        std::uint64_t hash = 14695981039346656037ULL;
+        for (const char* cursor = host; *cursor != '\0'; ++cursor)
+        {
+            hash ^= static_cast<unsigned char>(*cursor);
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    bool EnableRxTimestamps(int fd)
+    {
+        const int on = 1;
+        return ::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0;
+    }
+
+    ssize_t RecvStamped(int fd, void* buffer, std::size_t len, int flags, std::int64_t& age_us)
+    {
+        iovec io{buffer, len};
+        alignas(cmsghdr) std::uint8_t control[CMSG_SPACE(sizeof(timespec))];
+        msghdr message{};
+        message.msg_iov = &io;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        age_us = 0;
+        const ssize_t got = ::recvmsg(fd, &message, flags);
+        if (got <= 0) {return got;}
+
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg))
+        {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_TIMESTAMPNS) {continue;}
+
+            // The stamp is CLOCK_REALTIME, only its distance to now is used so a wall clock step can't leak in.
+            timespec arrived{};
+            timespec now{};
+            std::memcpy(&arrived, CMSG_DATA(cmsg), sizeof(arrived));
+            ::clock_gettime(CLOCK_REALTIME, &now);
+            const std::int64_t age_ns = (now.tv_sec - arrived.tv_sec) * 1'000'000'000LL + (now.tv_nsec - arrived.tv_nsec);
+            age_us = std::max<std::int64_t>(0, age_ns / 1000);
+        }
+        return got;
+    }
+
+    bool NetStreamSink::Open(const NetStream_Config& in_cfg, std::uint64_t unit_id, std::uint32_t sample_rate_hz, std::int64_t wall_minus_mono_us)
+    {
+        Close();
+        if (in_cfg.host.empty())
+        {
+            fmt::print(stderr, "Error: No collector host configured\n");
+            return false;
+        }
+
+        cfg = in_cfg;
+        clock_sync = ClockSync(cfg.clock);
+        hello = NetHello{};
+        std::memcpy(hello.magic, NetMagic, sizeof(NetMagic));
+        hello.version = NetVersion;
+        hello.sample_rate_hz = sample_rate_hz;
+        hello.unit_id = unit_id;
+        hello.wall_minus_mono_us = wall_minus_mono_us;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.clear();
+            pending.reserve(std::min<std::size_t>(cfg.max_buffered, 4096));
+            bFlush = false;
+            bStop = false;
+            stats = NetStreamStats{};
+        }
+
+        sender = std::thread([this]{ SenderLoop(); });
+        if (!cfg.bQuiet) {fmt::print("Streaming samples to {}:{} as unit {:016x}\n", cfg.host, cfg.port, unit_id);}
+        return true;
+    }
+
+    void NetStreamSink::Close()
+    {
+        if (!sender.joinable()) {return;}
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            bStop = true;
+        }
+        cv.notify_one();
+        sender.join();
+    }
+
+    void NetStreamSink::OnSamples(const Sample* samples, std::size_t n)
+    {
+        if (n == 0) {return;}
+
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.insert(pending.end(), samples, samples + n);
+
+        // Collector away for a while, keep the newest.
+        if (pending.size() > cfg.max_buffered)
+        {
+            const std::size_t excess = pending.size() - cfg.max_buffered;
+            pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(excess));
+            stats.dropped += excess;
+        }
+    }
+
+    void NetStreamSink::Flush()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            bFlush = true;
+        }
+        cv.notify_one();
+    }
+
+    NetStreamStats NetStreamSink::Stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+    bool NetStreamSink::Connect()
+    {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* found = nullptr;
+        const std::string port = std::to_string(cfg.port);
+        if (const int rc = ::getaddrinfo(cfg.host.c_str(), port.c_str(), &hints, &found); rc != 0)
+        {
+            if (!cfg.bQuiet) {fmt::print(stderr, "Error: Unable to resolve collector '{}': {}\n", cfg.host, ::gai_strerror(rc));}
+            return false;
+        }
+
+        for (const addrinfo* addr = found; addr != nullptr && fd < 0; addr = addr->ai_next)
+        {
+            fd = ::socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC, addr->ai_protocol);
+            if (fd < 0) {continue;}
+            if (::connect(fd, addr->ai_addr, addr->ai_addrlen) != 0)
+            {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        const int connect_errno = errno;
+        ::freeaddrinfo(found);
+
+        if (fd < 0)
+        {
+            if (!cfg.bQuiet) {fmt::print(stderr, "Error: Unable to reach collector {}:{}: {}\n", cfg.host, cfg.port, std::strerror(connect_errno));}
+            return false;
+        }
+
+        if (::send(fd, &hello, sizeof(hello), MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(hello)))
+        {
+            Disconnect();
+            return false;
+        }
+
+        // Could be a different (or restarted) collector, its shared time starts over.
+        clock_sync.Reset();
+        EnableRxTimestamps(fd);
+
+        // A ping stuck behind Nagle waits for the collector's delayed ACK (~40ms) and wrecks the exchange. Frames
+        // coalesce with MSG_MORE instead.
+        const int on = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        if (!cfg.bQuiet) {fmt::print("Connected to collector {}:{}\n", cfg.host, cfg.port);}
+        return true;
+    }
+
+    std::uint64_t NetStreamSink::MonoNow() const
+    {
+        return cfg.mono_now ? cfg.mono_now() : static_cast<std::uint64_t>(SteadyClock::now().count());
+    }
+
+    bool NetStreamSink::Exchange()
+    {
+        const std::uint64_t t1 = MonoNow();
+        const NetFrameHeader ping{static_cast<std::uint32_t>(NetFrameType::Ping), 0, t1};
+        if (::send(fd, &ping, sizeof(ping), MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(ping))) {return false;}
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++stats.pings;
+        }
+
+        // The collector only ever talks back in pongs, so it's always header + NetPong.
+        std::uint8_t reply[sizeof(NetFrameHeader) + sizeof(NetPong)];
+        std::size_t got = 0;
+        std::uint64_t t4 = 0;
+        const auto deadline = SteadyClock::now() + std::chrono::duration_cast<std::chrono::microseconds>(cfg.ping_timeout);
+        while (true)
+        {
+            const auto left_ms = (deadline - SteadyClock::now()).count() / 1000;
+            if (left_ms <= 0) {return true;} // Lost or slow, a late pong is skipped by the next exchange
+
+            pollfd readable{fd, POLLIN, 0};
+            const int ready = ::poll(&readable, 1, static_cast<int>(left_ms));
+            if (ready < 0 && errno != EINTR) {return false;}
+            if (ready <= 0) {continue;}
+
+            std::int64_t age_us = 0;
+            const ssize_t n = RecvStamped(fd, reply + got, sizeof(reply) - got, MSG_DONTWAIT, age_us);
+            if (got == 0) {t4 = MonoNow() - static_cast<std::uint64_t>(age_us);}
+            if (n == 0) {return false;}
+            if (n < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {continue;}
+                return false;
+            }
+
+            got += static_cast<std::size_t>(n);
+            if (got < sizeof(reply)) {continue;}
+            got = 0;
+
+            NetFrameHeader header{};
+            NetPong pong{};
+            std::memcpy(&header, reply, sizeof(header));
+            std::memcpy(&pong, reply + sizeof(header), sizeof(pong));
+            if (header.type != static_cast<std::uint32_t>(NetFrameType::Pong)) {return false;}
+            if (header.t_us != t1) {continue;} // Answer to an earlier ping that timed out
+
+            clock_sync.Add(ClockExchange{t1, pong.t2_us, pong.t3_us, t4});
+            std::lock_guard<std::mutex> lock(mutex);
+            ++stats.pongs;
+            stats.clock = clock_sync.Map();
+            return true;
+        }
+    }
+
+    void NetStreamSink::Disconnect()
+    {
+        if (fd < 0) {return;}
+        ::close(fd);
+        fd = -1;
+    }
+
+    bool NetStreamSink::SendBatch(const std::vector<Sample>& batch)
+    {
+        auto send_all = [this](const void* data, std::size_t len, int more = 0)
+        {
+            const auto* bytes = static_cast<const std::uint8_t*>(data);
+            while (len > 0)
+            {
+                const ssize_t sent = ::send(fd, bytes, len, MSG_NOSIGNAL | more);
+                if (sent < 0)
+                {
+                    if (errno == EINTR) {continue;}
+                    return false;
+                }
+                bytes += sent;
+                len -= static_cast<std::size_t>(sent);
+            }
+            return true;
+        };
+
+        if (batch.empty())
+        {
+            const NetFrameHeader beat{static_cast<std::uint32_t>(NetFrameType::Heartbeat), 0, MonoNow()};
+            return send_all(&beat, sizeof(beat));
+        }
+
+        // Once synced every block carries the current map, the collector never has to guess which one applies.
+        const bool bMapped = clock_sync.Valid();
+        const auto type = static_cast<std::uint32_t>(bMapped ? NetFrameType::ClockSamples : NetFrameType::Samples);
+        for (std::size_t offset = 0; offset < batch.size(); offset += NetMaxFrameRecords)
+        {
+            const auto count = static_cast<std::uint32_t>(std::min<std::size_t>(batch.size() - offset, NetMaxFrameRecords));
+            const NetFrameHeader header{type, count, batch[offset].t_us};
+            if (!send_all(&header, sizeof(header), MSG_MORE)) {return false;}
+            if (bMapped && !send_all(&clock_sync.Map(), sizeof(ClockMap), MSG_MORE)) {return false;}
+            if (!send_all(batch.data() + offset, count * sizeof(Sample))) {return false;}
+        }
+        return true;
+    }
+
+    void NetStreamSink::SenderLoop()
+    {
+        std::vector<Sample> batch;
+        batch.reserve(pending.capacity());
+        auto next_connect = SteadyClock::now();
+        auto next_ping = SteadyClock::now();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            cv.wait_for(lock, cfg.flush_every, [this]{ return bStop || bFlush; });
+            const bool bLast = bStop;
+            bFlush = false;
+            batch.swap(pending);
+            lock.unlock();
+
+            if (fd < 0 && SteadyClock::now() >= next_connect)
+            {
+                if (Connect())
+                {
+                    std::lock_guard<std::mutex> stats_lock(mutex);
+                    ++stats.connects;
+                }
+                else
+                {
+                    next_connect = SteadyClock::now() + std::chrono::duration_cast<std::chrono::microseconds>(cfg.reconnect_every);
+                }
+            }
+
+            bool bSent = false;
+            bool bLost = false;
+            if (fd >= 0)
+            {
+                bSent = SendBatch(batch);
+                if (!bSent)
+                {
+                    if (!cfg.bQuiet) {fmt::print(stderr, "Error: Lost collector connection: {}\n", std::strerror(errno));}
+                    Disconnect();
+                    next_connect = SteadyClock::now() + std::chrono::duration_cast<std::chrono::microseconds>(cfg.reconnect_every);
+                    bLost = true;
+                }
+            }
+
+            if (fd >= 0 && !bLast && SteadyClock::now() >= next_ping)
+            {
+                if (!Exchange())
+                {
+                    if (!cfg.bQuiet) {fmt::print(stderr, "Error: Lost collector connection during clock sync\n");}
+                    Disconnect();
+                    next_connect = SteadyClock::now() + std::chrono::duration_cast<std::chrono::microseconds>(cfg.reconnect_every);
+                }
+                next_ping = SteadyClock::now() + std::chrono::duration_cast<std::chrono::microseconds>(cfg.ping_every);
+            }
+
+            lock.lock();
+            if (bSent)
+            {
+                stats.sent += batch.size();
+            }
+            else if (bLost)
+            {
+                stats.dropped += batch.size();
+            }
+            else if (!batch.empty())
+            {
+                // Never got out, goes back in front of whatever arrived meanwhile (still bounded).
+                batch.insert(batch.end(), pending.begin(), pending.end());
+                batch.swap(pending);
+                if (pending.size() > cfg.max_buffered)
+                {
+                    const std::size_t excess = pending.size() - cfg.max_buffered;
+                    pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(excess));
+                    stats.dropped += excess;
+                }
+            }
+            batch.clear();
+
+            if (bLast)
+            {
+                if (fd >= 0 && !pending.empty()) {continue;} // Whatever raced in with the stop
+                stats.dropped += pending.size();
+                pending.clear();
+                break;
+            }
+        }
+        lock.unlock();
+        Disconnect();
+    }
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <sys/types.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "clock_sync.h"
+#include "config_settings.h"
+#include "pipeline_sink.h"
+#include "sampler.h"
+
+// Unit -> collector sample stream over TCP (drunk_collector on the other end).
+//
+//   NetHello (64 bytes) once per connection, then frames: NetFrameHeader (16 bytes) + count records.
+//
+// Same idea as .drec, raw host order structs (every unit and the collector are little endian Linux) so a batch goes
+// out with one send() and the collector copies records straight out of its read buffer. Sample frames carry the ring's
+// Sample records as is, t_us stays on the unit's steady clock. Heartbeats carry the unit's steady now, so a unit with
+// nothing to say still moves the collector's merge forward.
+//
+// Steady clocks have an arbitrary epoch per unit, so the unit pings the collector (Ping / Pong, see clock_sync.h) and
+// once it has an estimate every block goes out as ClockSamples: the ClockMap, then the records. Until then (and from
+// version 1 units) the collector falls back to the hello's wall_minus_mono_us, which is only as good as the unit's NTP.
+namespace DrunkAPI
+{
+    struct NetHello
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t sample_rate_hz; // Same as RecordingHeader's, 0 = variable
+        std::uint64_t unit_id;
+        std::int64_t wall_minus_mono_us;
+        std::uint8_t reserved[32];
+    };
+    static_assert(sizeof(NetHello) == 64, "NetHello is a wire format");
+
+    enum class NetFrameType : std::uint32_t
+    {
+        Samples = 1, // count Sample records
+        Heartbeat = 2, // No records, t_us = unit steady now
+        Ping = 3, // No records, t_us = unit steady send time (t1)
+        Pong = 4, // Collector -> unit, t_us = the ping's t1, then a NetPong
+        ClockSamples = 5, // ClockMap, then count Sample records
+    };
+
+    struct NetFrameHeader
+    {
+        std::uint32_t type;
+        std::uint32_t count;
+        std::uint64_t t_us;
+    };
+    static_assert(sizeof(NetFrameHeader) == 16, "NetFrameHeader is a wire format");
+
+    struct NetPong
+    {
+        std::uint64_t t2_us; // Shared time the ping was read
+        std::uint64_t t3_us; // Shared time the pong went out
+    };
+    static_assert(sizeof(NetPong) == 16, "NetPong is a wire format");
+
+    inline constexpr char NetMagic[8] = {'D','R','N','K','N','E','T','1'};
+    inline constexpr std::uint32_t NetVersion = 2; // 2 added Ping/Pong/ClockSamples, the collector still takes 1
+    inline constexpr std::uint32_t NetMaxFrameRecords = 65'536; // 1MB, anything bigger is a broken peer
+
+    // FNV-1a of the hostname, used when Config::UnitId is 0.
+    std::uint64_t DefaultUnitId();
+
+    // Clock sync wants arrival times, not "when a busy thread got round to reading", so both ends turn on kernel receive
+    // stamps (SO_TIMESTAMPNS) and read with this. age_us = how long the data sat in the socket (0 without a stamp),
+    // subtract it from a clock read taken right after the call.
+    bool EnableRxTimestamps(int fd);
+    ssize_t RecvStamped(int fd, void* buffer, std::size_t len, int flags, std::int64_t& age_us);
+
+    struct NetStream_Config
+    {
+        std::string host = Config::CollectorHost;
+        std::uint16_t port = Config::CollectorPort;
+        std::size_t max_buffered = Config::NetMaxBuffered; // Samples held while the collector is away, oldest go first
+        std::chrono::milliseconds flush_every{Config::NetFlushEvery};
+        std::chrono::milliseconds reconnect_every{Config::NetReconnectEvery};
+        std::chrono::milliseconds ping_every{Config::ClockPingEvery};
+        std::chrono::milliseconds ping_timeout{Config::ClockPingTimeout};
+        ClockSync_Config clock{};
+        std::function<std::uint64_t()> mono_now; // Clock the samples are stamped with, steady_clock when empty (load test skews it)
+        bool bQuiet = false; // No connect/disconnect chatter (load test runs hundreds of these)
+    };
+
+    struct NetStreamStats
+    {
+        std::uint64_t sent = 0; // Samples handed to the kernel
+        std::uint64_t dropped = 0; // Buffer overflow while disconnected + batches lost with a broken connection
+        std::uint64_t connects = 0;
+        std::uint64_t pings = 0;
+        std::uint64_t pongs = 0; // Answered in time
+        ClockMap clock{}; // Latest estimate, points == 0 until the first one
+    };
+
+    // Streams the pipeline's samples to a collector. OnSamples() only copies into a buffer, a sender thread does the
+    // network side so a slow or missing collector never holds up the consumer. Delivery is at most once: a batch that
+    // fails half way is counted as dropped rather than resent, the collector would store the resent half twice.
+    // The clock exchange runs on the same thread between flushes: ping, wait for the pong (ping_timeout at most), so
+    // t4 is stamped the moment it's read and not whenever the sender next looks.
+    class NetStreamSink final : public PipelineSink
+    {
+        public:
+            NetStreamSink() = default;
+            NetStreamSink(const NetStreamSink&) = delete;
+            NetStreamSink& operator=(const NetStreamSink&) = delete;
+            NetStreamSink(NetStreamSink&&) = delete;
+            NetStreamSink& operator=(NetStreamSink&&) = delete;
+            ~NetStreamSink() override { Close(); }
+
+            // Starts the sender, the collector doesn't have to be up yet.
+            bool Open(const NetStream_Config& in_cfg, std::uint64_t unit_id, std::uint32_t sample_rate_hz, std::int64_t wall_minus_mono_us);
+
+            // Last flush attempt, then disconnects.
+            void Close();
+            bool IsOpen() const noexcept { return sender.joinable(); }
+
+            void OnSamples(const Sample* samples, std::size_t n) override;
+            void OnWindow(const WindowResult&) override {}
+            void OnState(std::uint64_t, const BreathEvent&, const BreathResult&) override {}
+            void Flush() override;
+
+            NetStreamStats Stats() const;
+
+        private:
+            void SenderLoop();
+            bool Connect();
+            void Disconnect();
+            bool SendBatch(const std::vector<Sample>& batch);
+            bool Exchange(); // One ping / pong into clock_sync, false when the connection broke
+            std::uint64_t MonoNow() const;
+
+            NetStream_Config cfg;
+            NetHello hello{};
+
+            mutable std::mutex mutex;
+            std::condition_variable cv;
+            std::vector<Sample> pending; // Guarded by mutex
+            bool bFlush = false;
+            bool bStop = false;
+            NetStreamStats stats; // Guarded by mutex
+
+            int fd = -1; // Sender thread only
+            ClockSync clock_sync; // Sender thread only, published through stats.clock
+            std::thread sender;
+    };
+}
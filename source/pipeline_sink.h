@@ -0,0 +1,66 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "analyzer.h"
+#include "sampler.h"
+
+// Optional taps on the consumer side of the pipeline (recording, Arrow export...).
+// Sinks are called on the consumer thread right after the processor has looked at the batch, so they see exactly
+// what the analyzers saw. They're off the sampler thread, a slow sink only delays the next batch.
+namespace DrunkAPI
+{
+    class PipelineSink
+    {
+        public:
+            virtual ~PipelineSink() = default;
+
+            virtual void OnSamples(const Sample* samples, std::size_t n) = 0;
+            virtual void OnWindow(const WindowResult& window) = 0;
+
+            // Breath state transitions, `event` carries start/end/peak once the state is Analyzed.
+            virtual void OnState(std::uint64_t t_us, const BreathEvent& event, const BreathResult& snapshot) = 0;
+
+            virtual void Flush() {}
+    };
+
+    // Fixed fan out so the processors don't allocate, attach before the runner starts.
+    class SinkFanout final
+    {
+        public:
+            static constexpr std::size_t MaxSinks = 4;
+
+            bool Attach(PipelineSink* sink)
+            {
+                if (sink == nullptr || count == MaxSinks) {return false;}
+                sinks[count++] = sink;
+                return true;
+            }
+
+            bool Empty() const noexcept { return count == 0; }
+
+            void OnSamples(const Sample* samples, std::size_t n) const
+            {
+                for (std::size_t i = 0; i < count; ++i) {sinks[i]->OnSamples(samples, n);}
+            }
+
+            void OnWindow(const WindowResult& window) const
+            {
+                for (std::size_t i = 0; i < count; ++i) {sinks[i]->OnWindow(window);}
+            }
+
+            void OnState(std::uint64_t t_us, const BreathEvent& event, const BreathResult& snapshot) const
+            {
+                for (std::size_t i = 0; i < count; ++i) {sinks[i]->OnState(t_us, event, snapshot);}
+            }
+
+            void Flush() const
+            {
+                for (std::size_t i = 0; i < count; ++i) {sinks[i]->Flush();}
+            }
+
+        private:
+            std::array<PipelineSink*, MaxSinks> sinks{};
+            std::size_t count = 0;
+    };
+}
@@ -5,6 +5,7 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include <vector>
+#include "clock.h"
 #include "config_settings.h"
 #include "sampler.h"
 #include "data_sink.h"
@@ -33,12 +34,21 @@ namespace DrunkAPI
 {
     static std::atomic<bool> g_running{true};
 
-    template<class Sampler, class Processor>
+    // What one pass of a stream task did, see StreamExecutor (stream_executor.h).
+    enum class StreamStatus : std::uint8_t
+    {
+        Idle, // Drained what was there, park until more arrives
+        Backlog, // Stopped at the batch limit, more is waiting
+        Done // Finished, never schedule again
+    };
+
+    // Clock is SteadyClock live, replay swaps in a ManualClock so sleeps and timeouts run on recorded time.
+    template<class Sampler, class Processor, class Clock = SteadyClock>
     class ProcessRunner
     {
         public:
-            ProcessRunner(Sampler& in_sampler, Consumer_Config in_consumer_config, Processor& in_processor)
-            :   sampler(in_sampler), consumer_config(in_consumer_config), processor(in_processor), batch(DrunkAPI::Config::ConsumerMaxBatch){}
+            ProcessRunner(Sampler& in_sampler, Consumer_Config in_consumer_config, Processor& in_processor, Clock in_clock = Clock{})
+            :   sampler(in_sampler), consumer_config(in_consumer_config), processor(in_processor), clock(in_clock), batch(DrunkAPI::Config::ConsumerMaxBatch){}
             
             ProcessRunner(const ProcessRunner&) = delete;
             ProcessRunner& operator=(const ProcessRunner&) = delete;
@@ -56,7 +66,7 @@ namespace DrunkAPI
                     batch.resize(consumer_config.max_batch);
                 }
 
-                auto start = std::chrono::steady_clock::now();
+                const auto start = clock.now();
 
                 while (g_running.load(std::memory_order_relaxed)) 
                 {
@@ -64,12 +74,12 @@ namespace DrunkAPI
 
                     if (num_of_samples == 0) 
                     {
-                        std::this_thread::sleep_for(consumer_config.consumer_idle_sleep);
+                        clock.sleep_for(consumer_config.consumer_idle_sleep);
 
                         // idle 
                         if constexpr (bEnableTimeout<Processor>())
                         {
-                            if (std::chrono::steady_clock::now() - start >= consumer_config.Timeout)
+                            if (clock.now() - start >= consumer_config.Timeout)
                             {
                                 return processor.result();
                             }
@@ -97,12 +107,12 @@ namespace DrunkAPI
                             return processor.result();
                     }
 
-                    std::this_thread::sleep_for(consumer_config.consumer_tick_sleep);
+                    clock.sleep_for(consumer_config.consumer_tick_sleep);
 
                     // Slapping a type check here so calibration uses a timeout.
                     if constexpr (bEnableTimeout<Processor>())
                     {
-                        if (std::chrono::steady_clock::now() - start >= consumer_config.Timeout) 
+                        if (clock.now() - start >= consumer_config.Timeout) 
                         {
                             fmt::print("Timeout.\n");
                             return processor.result(); // timed out; return best info so far
@@ -121,6 +131,38 @@ namespace DrunkAPI
                 return run([](Processor&){});
             }
 
+            // Task mode: a StreamExecutor calls step() when the ring has data instead of run() owning a thread and its
+            // sleeps, the executor's poll period plays the tick sleep. start() once first. Same batch, event and
+            // timeout handling as run(), the timeout is only checked when the stream gets scheduled.
+            void start()
+            {
+                sampler.start_sampler();
+                if (batch.size() < consumer_config.max_batch) {batch.resize(consumer_config.max_batch);}
+                task_start = clock.now();
+            }
+
+            bool has_data() { return sampler.buffer().size_approx() != 0; }
+
+            template<class ProcessCallback>
+            StreamStatus step(ProcessCallback&& on_process_event)
+            {
+                const size_t num_of_samples = sampler.buffer().pop_batch(batch.data(), consumer_config.max_batch);
+                if (num_of_samples != 0)
+                {
+                    auto cur_step = processor.on_batch(batch.data(), num_of_samples);
+                    if (cur_step.event != StateEvent::None) {on_process_event(processor);}
+                    if (cur_step.action != StateAction::Continue) {return StreamStatus::Done;}
+                }
+
+                if constexpr (bEnableTimeout<Processor>())
+                {
+                    if (clock.now() - task_start >= consumer_config.Timeout) {return StreamStatus::Done;}
+                }
+                return (num_of_samples == consumer_config.max_batch) ? StreamStatus::Backlog : StreamStatus::Idle;
+            }
+
+            auto result() const { return processor.result(); }
+
             template<class ProcessorT>
             static consteval bool bEnableTimeout()
             {
@@ -139,7 +181,9 @@ namespace DrunkAPI
             Sampler& sampler;
             Consumer_Config consumer_config;
             Processor& processor;
+            Clock clock;
             std::vector<DrunkAPI::Sample> batch;
+            std::chrono::microseconds task_start{0};
     };
 
     // Helper if you want to Export Values to CSV file via NCat to your main machine if desired. Allows the ability to collect row sample data, could be useful for creating test data.
@@ -1,8 +1,11 @@
 #pragma once
+#include <chrono>
 #include <fmt/core.h>
 #include <type_traits>
 #include <cstdint>
-#include "ads1115.h"
+#include "arrow_sink.h"
+#include "net_stream.h"
+#include "recording.h"
 #include "processor_types.h"
 #include "sampler.h"
 
@@ -26,61 +29,160 @@ namespace DrunkAPI
     template<class ProcessorT>
     inline constexpr ProcessorMode ProcessorMode_T = ProcessorTraits<ProcessorT>::mode;
 
-    template<class ProcessorT>
+    // Everything a session needs. Backend supplies the GPIO lines and the sample source: Ads1115Backend
+    // (backend_real.h) on the Pi, EmulatedBackend / ReplayBackend (backend_emulated.h / backend_replay.h) anywhere else.
+    template<class ProcessorT, class Backend>
     struct HardwareContext
     {
-        GPIOBank gpio_bank;
-        ADS1115 ads1115;
+        using Source = typename Backend::Source;
+
+        Backend hw;
         LedController led_ctrl;
+        FlightRecorder flight_recorder; // Declared before the sampler so it outlives the sampler thread
+        RecordingWriter recording; // Optional session capture (Config::RecordingDir / ArrowExportDir)
+        ArrowSessionSink arrow_export;
+        NetStreamSink net_stream; // Optional fleet streaming (Config::CollectorHost)
 
-        Ads1115_Source source;
-        Sampler<Ads1115_Source> sampler;
+        Sampler<Source> sampler;
 
         Consumer_Config consumer_cfg{};
         Analyzer_Config analyzer_cfg{};
         BreathAnalyzer_Config breath_cfg{};
         ProcessorT processor;
-        DrunkAPI::ProcessRunner<Sampler<Ads1115_Source>, ProcessorT> runner;
-
-        HardwareContext(ADS1115::i2c_device::SlaveAddress addr)
-            : led_ctrl(gpio_bank)
-            , source(ads1115, addr,
-                     ADS1115::Mux::AIN0_GND,
-                     ADS1115::Pga::FS_4_096V,
-                     ADS1115::DataRate::SPS_128)
-            , sampler(source)
+        DrunkAPI::ProcessRunner<Sampler<Source>, ProcessorT> runner;
+
+        explicit HardwareContext(const typename Backend::Settings& settings)
+            : hw(settings)
+            , led_ctrl(hw.Lines())
+            , sampler(hw.source)
             , processor(ProcessorTraits<ProcessorT>::make(analyzer_cfg, breath_cfg))
             , runner(sampler, consumer_cfg, processor){}
 
     };
 
-    template<class ProcessorT>
-    static int SystemInit(HardwareContext<ProcessorT>& context, ADS1115::i2c_device::SlaveAddress addr)
+    template<class ProcessorT, class Backend>
+    static int SystemInit(HardwareContext<ProcessorT, Backend>& context)
     {
+        // GPIO + ADC (or their host mode stand ins)
+        if (!context.hw.Init()) {return 1;}
+        context.sampler.refresh_rate_limit();
+
+        // Black box is best effort, a read-only /var/tmp shouldn't stop a session.
+        if (context.flight_recorder.Open(Config::FlightRecorderPath, Config::FlightSampleSlots, Config::FlightEventSlots))
+        {
+            context.sampler.attach_recorder(&context.flight_recorder);
+            context.processor.AttachRecorder(&context.flight_recorder);
+            context.flight_recorder.StartSignalDumper();
+        }
+        else
+        {
+            fmt::print(stderr, "Warning: Flight recorder disabled\n");
+        }
+
+        // Ambient compensation when the backend reads a reference MQ-3 next to the main one.
+        if constexpr (requires { context.hw.source.reference; context.processor.AttachReference(&context.hw.source.reference_lane); })
+        {
+            if (context.hw.source.reference)
+            {
+                // Burst sources read the reference burst_depth times a tick, the pairing is per conversion.
+                ReferenceComp_Config reference_cfg{};
+                if constexpr (requires { context.hw.source.burst_depth; })
+                {
+                    reference_cfg.sample_rate_hz *= static_cast<double>(context.hw.source.burst_depth);
+                    reference_cfg.pair_tolerance_us /= context.hw.source.burst_depth;
+                }
+                context.processor.AttachReference(&context.hw.source.reference_lane, reference_cfg);
+                fmt::print("Reference MQ-3 attached, analysis runs {} samples behind for the lag search\n", reference_cfg.max_lag);
+            }
+        }
+
+        // Exhale gating when the backend reads a mouthpiece flow sensor between MQ-3 samples.
+        if constexpr (requires { context.hw.source.flow; context.processor.AttachFlow(&context.hw.source.flow_lane); })
+        {
+            if (context.hw.source.flow)
+            {
+                context.processor.AttachFlow(&context.hw.source.flow_lane);
+                if constexpr (requires { context.hw.source.burst_depth; })
+                {
+                    fmt::print("Flow sensor attached, read alongside every MQ-3 sample ({} Hz)\n", context.hw.source.flow_reads * Config::SampleRate_Hz);
+                }
+                else
+                {
+                    fmt::print("Flow sensor attached, {} reads per MQ-3 sample ({} Hz)\n", context.hw.source.flow_reads,
+                        context.hw.source.flow_reads * Config::SampleRate_Hz);
+                }
+            }
+        }
+
+        // What the session headers say it was sampled at. Burst sources put burst_depth conversions in the ring per tick.
+        std::uint32_t session_rate_hz = Config::SampleRate_Hz;
+        if constexpr (requires { context.hw.source.burst_depth; })
+        {
+            session_rate_hz *= static_cast<std::uint32_t>(context.hw.source.burst_depth);
+        }
+
+        // State driven sample rate, only single channel sources take it (the reference lag search and the flow read
+        // budget are counted in MQ-3 ticks).
+        if constexpr (requires { context.processor.AttachRateControl(&context.sampler.rate_control()); })
+        {
+            if (Config::DynamicSampleRate)
+            {
+                SampleRateControl& rate = context.sampler.rate_control();
+                if (rate.Supported())
+                {
+                    context.processor.AttachRateControl(&rate);
+                    session_rate_hz = 0; // Changes with the breath state, readers go by t_us
+                    fmt::print("Dynamic sample rate: {} Hz ready, {} Hz processing\n", rate.Achievable(Config::ReadySampleHz), rate.Achievable(Config::ProcessingSampleHz));
+                }
+                else
+                {
+                    fmt::print(stderr, "Warning: Sample source can't change rate, staying at {} Hz\n", Config::SampleRate_Hz);
+                }
+            }
+        }
+
+        // Session capture, both off unless a directory is configured.
+        const auto wall_minus_mono = std::chrono::system_clock::now().time_since_epoch() - std::chrono::steady_clock::now().time_since_epoch();
+        const auto wall_offset_us = static_cast<std::int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(wall_minus_mono).count());
+        const auto session_name = fmt::format("session-{}", std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+
+        if (Config::RecordingDir[0] != '\0')
+        {
+            if (context.recording.Open(fmt::format("{}/{}.drec", Config::RecordingDir, session_name), session_rate_hz, wall_offset_us))
+            {
+                context.processor.AttachSink(&context.recording);
+            }
+        }
 
-        if (!context.gpio_bank.Init())
+        if (Config::ArrowExportDir[0] != '\0')
         {
-            std::perror("Critical Error: Failed to initialize LED GPIOs");
-            return 1;
+            if (context.arrow_export.Open(fmt::format("{}/{}", Config::ArrowExportDir, session_name), session_rate_hz, wall_offset_us))
+            {
+                context.processor.AttachSink(&context.arrow_export);
+            }
         }
 
-        if (!context.ads1115.Init(1, addr))
+        // Fleet streaming, the sink buffers until the collector answers so it doesn't have to be up yet.
+        if (Config::CollectorHost[0] != '\0')
         {
-            std::perror("Critical Error: Failed to initialize ADC");
-            return 1;
+            const std::uint64_t unit_id = Config::UnitId != 0 ? Config::UnitId : DefaultUnitId();
+            if (context.net_stream.Open(NetStream_Config{}, unit_id, session_rate_hz, wall_offset_us))
+            {
+                context.processor.AttachSink(&context.net_stream);
+            }
         }
 
         return 0;
     }
 
-    template <class ProcessorT>
-    static int RunSession(DrunkAPI::ADS1115::i2c_device::SlaveAddress addr)
+    template <class ProcessorT, class Backend>
+    static int RunSession(const typename Backend::Settings& settings)
     {
         // Setup Configurations
-        HardwareContext<ProcessorT> SessionContext(addr);
+        HardwareContext<ProcessorT, Backend> SessionContext(settings);
         
         // Intialize GPIO and ADS1115
-        if(int init = SystemInit(SessionContext,addr) !=0)
+        if(int init = SystemInit(SessionContext) !=0)
         {
             return init;
         }
@@ -1,19 +1,32 @@
 #pragma once
 #include "config_settings.h"
+#include "flight_recorder.h"
+#include "pipeline_sink.h"
+#include "result_journal.h"
+#include "ts_store.h"
 #include "led_controller.h"
 #include "mq3_helper.h"
 #include "process_runner.h"
 #include "analyzer.h"
+#include "flow_gate.h"
+#include "i2c_recovery.h"
+#include "reference_comp.h"
 #include "sampler.h"
+#include "spsc.h"
+#include <algorithm>
+#include <array>
 #include <chrono>
 #include <cstdint>
 #include <cstdio>
 #include <fmt/core.h>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <thread>
 
 namespace DrunkAPI 
 { 
-    template<class ProcessorT>
+    template<class ProcessorT, class Backend>
     struct HardwareContext;
 
     auto get_volts = +[](const Sample& sample)->double { return sample.volts; };
@@ -33,6 +46,7 @@ namespace DrunkAPI
         {
         
             StepResult<WindowResult> step = analyzer_.AnalyzeBatch(sample, n, get_volts);
+            sinks.OnSamples(sample, n);
         
             if (step.result.window_end_us != 0) 
             {
@@ -41,6 +55,13 @@ namespace DrunkAPI
                     step.result.stddev, 
                     step.result.drift_per_sec, 
                     step.result.stable);
+
+                if (recorder != nullptr)
+                {
+                    recorder->RecordWindow(step.result.window_end_us, step.result.mean, step.result.stddev, step.result.drift_per_sec, step.result.stable);
+                }
+
+                sinks.OnWindow(step.result);
                     
                 last_ = step.result;
             }
@@ -56,10 +77,14 @@ namespace DrunkAPI
         }
 
         WindowResult result() const { return last_; }
+        void AttachRecorder(FlightRecorder* in_recorder) { recorder = in_recorder; }
+        bool AttachSink(PipelineSink* sink) { return sinks.Attach(sink); }
         WelfordAnalyzer analyzer_;
 
         private:
         WindowResult last_{};
+        FlightRecorder* recorder = nullptr;
+        SinkFanout sinks;
     };
 
     class RuntimeProcess final
@@ -82,52 +107,336 @@ namespace DrunkAPI
             out.event = StateEvent::None;
             out.result = snapshot_;
 
-            StepResult<WindowResult> step = W_analyzer_.AnalyzeBatch(sample ,n , get_volts);
-            
-            // Window Finalized so the breath analyzer can consume a new window.
-            if(step.result.window_end_us != 0)
-            {
-                out.result.last_window = step.result;
-                BreathEvent breath_event{};
-
-                B_analyzer_.AnalyzeBreath(out.result.last_window, out.result, breath_event);
-                
-                out.event = static_cast<ProcessState::Event>(breath_event.State); // Pass through the state up to the Event Callback
-
-                last_event = breath_event;
-                bHasEvent = true;
+            sinks.OnSamples(sample, n);
 
-                //fmt::print("Breath Event State: {}\n",static_cast<int>(breath_event.State));
+            // Flow samples are pushed before their MQ-3 sample is returned, so the detector is never behind this batch.
+            if (flow)
+            {
+                size_t got = 0;
+                while (flow_lane != nullptr && (got = flow_lane->pop_batch(flow_batch.data(), flow_batch.size())) > 0)
+                {
+                    flow->Process(flow_batch.data(), got);
+                }
+                B_analyzer_.SetFlow(flow->Status());
             }
 
+            // Every window the batch closes goes through the breath analyzer, short adaptive windows (or a backlog
+            // batch) close several. With a reference sensor the analyzers see the ambient compensated copy, sinks and
+            // the recorder keep the raw main channel.
+            auto on_window = [&](const WindowResult& window) { OnWindow(window, out); };
+            if (reference) {AnalyzeCompensated(sample, n, on_window);}
+            else {W_analyzer_.AnalyzeEach(sample, n, get_volts, on_window);}
+
             snapshot_ = out.result;
             return out;
         }
 
-        bool pop_breath_event(BreathEvent& out)
+        // Windows finalized since the last call with the breath analyzer's event for each, oldest first.
+        bool pop_window(WindowResult& window, BreathEvent& event)
         {
-            if(!bHasEvent){return false;}
+            if (pending_count == 0) {return false;}
 
-            out = last_event;
-            bHasEvent = false;
+            const PendingWindow& pending = pending_windows[pending_head];
+            window = pending.window;
+            event = pending.event;
+            pending_head = (pending_head + 1) % pending_windows.size();
+            --pending_count;
 
             return true;
         }
 
          BreathResult result() const { return snapshot_; }
+         void AttachRecorder(FlightRecorder* in_recorder) { recorder = in_recorder; }
+         bool AttachSink(PipelineSink* sink) { return sinks.Attach(sink); }
+
+         // Reference MQ-3 lane filled by ReferencePairSource, paired up with the main samples on every batch.
+         void AttachReference(SpscRing<Sample, Config::RingSize>* ring, ReferenceComp_Config cfg = {})
+         {
+             reference_lane = ring;
+             reference.emplace(cfg);
+         }
+         const ReferenceCompensator* Reference() const { return reference ? &*reference : nullptr; }
+
+         // Mouthpiece flow lane filled by FlowMuxSource, from then on exhales start and end a breath.
+         void AttachFlow(SpscRing<Sample, Config::RingSize>* ring, Flow_Config cfg = {})
+         {
+             flow_lane = ring;
+             flow.emplace(cfg);
+         }
+         const FlowDetector* Flow() const { return flow ? &*flow : nullptr; }
+
+         // Sampler's rate control, from then on every breath state change asks for that state's rate and the Welford
+         // analyzer's minimum sample rule follows what the sampler can give.
+         void AttachRateControl(SampleRateControl* control, SampleRate_Config cfg = {})
+         {
+             rate_control = control;
+             rate_cfg = cfg;
+         }
 
     private:
+       struct PendingWindow
+       {
+           WindowResult window{};
+           BreathEvent event{};
+       };
+
+       void OnWindow(const WindowResult& window, StepResult<BreathResult>& out)
+       {
+           out.result.last_window = window;
+           BreathEvent breath_event{};
+
+           B_analyzer_.AnalyzeBreath(out.result.last_window, out.result, breath_event);
+
+           out.event = static_cast<ProcessState::Event>(breath_event.State); // Pass through the state up to the Event Callback
+
+           const bool bTransition = (breath_event.State != last_state);
+           last_state = breath_event.State;
+
+           if (recorder != nullptr)
+           {
+               recorder->RecordWindow(window.window_end_us, window.mean, window.stddev, window.drift_per_sec, window.stable);
+
+               // Only transitions go in the black box, the window lane already shows the steady state.
+               if (bTransition)
+               {
+                   recorder->RecordState(window.window_end_us, static_cast<uint8_t>(breath_event.State), out.result.peak_volts);
+               }
+           }
+
+           sinks.OnWindow(window);
+           if (bTransition)
+           {
+               sinks.OnState(window.window_end_us, breath_event, out.result);
+               if (rate_control != nullptr) {RequestRate(breath_event.State, window.window_end_us);}
+           }
+
+           // A callback that never drains loses the oldest, not an Analyzed that just happened.
+           if (pending_count == pending_windows.size())
+           {
+               pending_head = (pending_head + 1) % pending_windows.size();
+               --pending_count;
+           }
+           pending_windows[(pending_head + pending_count) % pending_windows.size()] = {window, breath_event};
+           ++pending_count;
+       }
+
+       // The window that started a blow is at the idle rate, the rest of the blow gets full resolution.
+       void RequestRate(BreathAnalyzerState state, uint64_t from_us)
+       {
+           uint32_t hz = rate_cfg.warmup_hz;
+           switch (state)
+           {
+               case BreathAnalyzerState::Ready: hz = rate_cfg.ready_hz; break;
+               case BreathAnalyzerState::Processing: hz = rate_cfg.processing_hz; break;
+               case BreathAnalyzerState::Analyzed:
+               case BreathAnalyzerState::Cooldown: hz = rate_cfg.cooldown_hz; break;
+               default: break;
+           }
+           W_analyzer_.SetSampleRate(rate_control->Request(hz), from_us);
+       }
+
+       template<class OnWindowFn>
+       void AnalyzeCompensated(const Sample* sample, size_t n, OnWindowFn&& on_window)
+       {
+           // Only as much as the compensator can hold, the rest belongs to main samples still in the sampler's ring.
+           size_t got = 0;
+           while (reference_lane != nullptr && reference->PendingRoom() > 0
+               && (got = reference_lane->pop_batch(reference_batch.data(), std::min(reference_batch.size(), reference->PendingRoom()))) > 0)
+           {
+               reference->PushReference(reference_batch.data(), got);
+           }
+
+           // Fixed scratch, a bigger batch than the runner ever hands over just goes through in pieces.
+           for (size_t offset = 0; offset < n; offset += compensated.size())
+           {
+               const size_t chunk = std::min(compensated.size(), n - offset);
+               const size_t produced = reference->Process(sample + offset, chunk, compensated.data());
+               if (produced == 0) {continue;}
+
+               W_analyzer_.AnalyzeEach(compensated.data(), produced, get_volts, on_window);
+           }
+       }
+
        WelfordAnalyzer W_analyzer_;
        BreathAnalyzer  B_analyzer_;
        BreathResult snapshot_{};
 
-       bool bHasEvent = false;
-       BreathEvent last_event{};
+       std::optional<ReferenceCompensator> reference;
+       SpscRing<Sample, Config::RingSize>* reference_lane = nullptr;
+       std::array<Sample, Config::ConsumerMaxBatch> reference_batch{};
+       std::array<Sample, Config::ConsumerMaxBatch> compensated{};
+
+       std::optional<FlowDetector> flow;
+       SpscRing<Sample, Config::RingSize>* flow_lane = nullptr;
+       std::array<Sample, Config::ConsumerMaxBatch> flow_batch{};
+
+       std::array<PendingWindow, Config::PendingWindows> pending_windows{};
+       size_t pending_head = 0;
+       size_t pending_count = 0;
+
+       SampleRateControl* rate_control = nullptr;
+       SampleRate_Config rate_cfg{};
+
+       FlightRecorder* recorder = nullptr;
+       SinkFanout sinks;
+       BreathAnalyzerState last_state = BreathAnalyzerState::None;
        
     }; 
 
-    template<class ProcessorT>
-    static int StartCalibration(HardwareContext<ProcessorT>& SessionContext)
+    static Journal_Config MakeJournalConfig()
+    {
+        Journal_Config cfg{};
+        cfg.group_commit_budget = Config::JournalCommitBudget;
+        cfg.max_bytes = Config::JournalMaxBytes;
+        cfg.keep_records = Config::JournalKeepRecords;
+        return cfg;
+    }
+
+    static uint64_t WallClockUs()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    static TsRetention MakeHistoryRetention()
+    {
+        TsRetention retention{};
+        retention.raw_days = Config::HistoryRawDays;
+        retention.minute_days = Config::HistoryMinuteDays;
+        retention.hour_days = Config::HistoryHourDays;
+        return retention;
+    }
+
+    // Samples are stamped with steady_clock, history and the journal want wall time.
+    static int64_t WallOffsetUs()
+    {
+        const auto wall_minus_mono = std::chrono::system_clock::now().time_since_epoch() - std::chrono::steady_clock::now().time_since_epoch();
+        return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(wall_minus_mono).count());
+    }
+
+    // One breath state change: console, LEDs and for a result the BAC into history + journal.
+    // Station mode passes the sensor name as tag so the console lines say which mouthpiece it was.
+    static void ReportBreathEvent(const BreathEvent& event, LedWorker& led_worker, TimeSeriesStore& history, ResultJournal& journal, int64_t wall_offset_us, std::string_view tag = {})
+    {
+        const std::string prefix = tag.empty() ? std::string{} : fmt::format("[{}] ", tag);
+        auto to_wall_us = [wall_offset_us](uint64_t mono_us) { return static_cast<uint64_t>(static_cast<int64_t>(mono_us) + wall_offset_us); };
+
+        // Map breath state
+        switch (event.State)
+        {
+            case BreathAnalyzerState::Warmup:
+            {
+                fmt::print("{}Warming up... (Finding baseline)\n", prefix);
+                std::chrono::milliseconds in_on(500);
+                std::chrono::milliseconds in_off(500);
+                led_worker.SetState(LedState::Warmup);
+                led_worker.Apply_Command({.type = LedCommandType::BlinkOne,.count=2,.on=in_on,.off=in_off});
+                break;
+            }
+            case BreathAnalyzerState::Ready:
+                fmt::print("{}MQ3 Ready for analysis...\n", prefix);
+                led_worker.SetState(LedState::Ready);
+                led_worker.Apply_Command({ .type = LedCommandType::Mask, .led_mask = LedMask::M_Blue });
+                break;
+
+            case BreathAnalyzerState::Processing:
+            {
+                fmt::print("{}Processed...\n", prefix);
+                std::chrono::milliseconds in_on(200);
+                std::chrono::milliseconds in_off(200);
+                led_worker.SetState(LedState::Processing);
+                led_worker.Apply_Command({.type = LedCommandType::BlinkAll,.count=3,.on=in_on,.off=in_off});
+                break;
+            }
+
+            case BreathAnalyzerState::Cooldown:
+            {
+                fmt::print("{}Cooling Down...\n", prefix);
+                std::chrono::milliseconds in_on(500);
+                std::chrono::milliseconds in_off(500);
+                led_worker.SetState(LedState::Cooldown);
+                led_worker.Apply_Command({.type = LedCommandType::BlinkOne,.count=2,.on=in_on,.off=in_off,});
+                break;
+            }
+
+            case BreathAnalyzerState::Analyzed:
+            {
+                fmt::print("{}Breath Alcohol Detected: Peak = {:.6f}V\n", prefix, event.peak_voltage);
+
+                const auto Rs_Peak = MQ3::adc3v3_to_rs(event.peak_voltage, Config::RLoad);
+                const auto ratio   = MQ3::rs_to_ratio(Rs_Peak, Config::Ro_Air);
+
+                double conc = MQ3::calculate_concentration_exp(ratio);
+
+                // The MQ-3 only rose on lung air for the part of the blow after the dead space went by.
+                if (event.flow_volume_l > 0.0)
+                {
+                    const double blow_s = static_cast<double>(event.end_us - event.start_us) / 1'000'000.0;
+                    conc = MQ3::calculate_concentration_exp(MQ3::dead_space_corrected_ratio(ratio, Config::Rs_Ro_Ratio_Datasheet,
+                        event.flow_volume_l, blow_s, Config::FlowDeadSpaceL, Config::Mq3RiseTau_s));
+                    fmt::print("{}Exhaled: {:.2f}L in {:.1f}s\n", prefix, event.flow_volume_l, blow_s);
+                }
+
+                const double ppm   = MQ3::calculate_ppm(conc);
+                const double bac   = MQ3::calculate_bac(ppm);
+                fmt::print("{}Concentration: {:.6f}mg/l\n", prefix, ppm);
+                fmt::print("{}PPM Ethanol: {:.6f}\n", prefix, ppm);
+                fmt::print("{}BAC: {:.6f}\n", prefix, bac);
+
+                const double blow_seconds = static_cast<double>(event.end_us - event.start_us) / 1'000'000.0;
+                history.AppendBreath(to_wall_us(event.end_us), event.peak_voltage, bac, blow_seconds);
+
+                // Queued only, the journal's writer thread does the group commit.
+                JournalBreath record{};
+                record.wall_us = WallClockUs();
+                record.start_us = event.start_us;
+                record.end_us = event.end_us;
+                record.peak_volts = event.peak_voltage;
+                record.ppm = ppm;
+                record.bac = bac;
+                journal.AppendBreath(record);
+
+                // BAC holds LED result so user can see the result.
+                led_worker.Apply_Command({
+                    .type = LedCommandType::DriveBac,
+                    .bac = bac,
+                    .bac_holdtime = std::chrono::seconds(10)
+                });
+
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    static void PrintJournalLatency(const ResultJournal& journal, std::string_view tag = {})
+    {
+        const JournalLatency latency = journal.Latency();
+        if (latency.records > 0)
+        {
+            fmt::print("{}Journal durable commit: p50={:.0f}us p99={:.0f}us p999={:.0f}us max={:.0f}us ({} records / {} syncs)\n",
+                tag.empty() ? std::string{} : fmt::format("[{}] ", tag), latency.p50_us, latency.p99_us, latency.p999_us, latency.max_us, latency.records, latency.commits);
+        }
+        if (latency.failed_records > 0)
+        {
+            fmt::print(stderr, "{}Warning: Journal lost {} records in {} failed commits\n",
+                tag.empty() ? std::string{} : fmt::format("[{}] ", tag), latency.failed_records, latency.failed_commits);
+        }
+    }
+
+    static void PrintI2cHealth(const I2cHealth& health)
+    {
+        constexpr auto Fault = [](I2cFault fault) { return static_cast<std::size_t>(fault); };
+        fmt::print("I2C: availability {:.3f}%{} over {:.0f}s, {} outages (longest {:.2f}s), faults nack={} bus_timeout={} conversion_timeout={} io={}, "
+            "{} retried ok, {} reopens, {} bus recoveries\n",
+            health.availability * 100.0, !health.bSloJudged ? " (too early for the SLO)" : health.bSloMet ? "" : " (below SLO)", static_cast<double>(health.session_us) / 1e6, health.outages,
+            static_cast<double>(health.longest_outage_us) / 1e6, health.faults[Fault(I2cFault::Nack)], health.faults[Fault(I2cFault::BusTimeout)],
+            health.faults[Fault(I2cFault::ConversionTimeout)], health.faults[Fault(I2cFault::Io)], health.retried_ok, health.reopens, health.bus_recoveries);
+    }
+
+    template<class ProcessorT, class Backend>
+    static int StartCalibration(HardwareContext<ProcessorT, Backend>& SessionContext)
     {   
         std::setvbuf(stdout,nullptr,_IOFBF,0);
 
@@ -146,6 +455,20 @@ namespace DrunkAPI
 
             fmt::print("RS Stable found = {:.6f} Ohms\n", Rs_stable);
             fmt::print("Rs/Ro: {:.6f}\n",Rs_Ro_ratio);
+
+            // Calibration points go in the audit trail, wait for the sync since we exit right after.
+            ResultJournal journal;
+            if (journal.Open(Config::JournalPath, MakeJournalConfig()))
+            {
+                JournalCalibration calibration{};
+                calibration.wall_us = WallClockUs();
+                calibration.mean_volts = result.mean;
+                calibration.stddev = result.stddev;
+                calibration.rs_ohms = Rs_stable;
+                calibration.rs_ro_ratio = Rs_Ro_ratio;
+                calibration.stable = 1;
+                journal.WaitDurable(journal.AppendCalibration(calibration), std::chrono::seconds(1));
+            }
             constexpr uint8_t result_timeout = 5;
             std::this_thread::sleep_for(std::chrono::seconds(result_timeout)); // sleep for 5 seconds after result is found and return.
         }
@@ -153,88 +476,60 @@ namespace DrunkAPI
         return 0;
     }
 
-    template <class ProcessorT>
-    static int StartRuntime(HardwareContext<ProcessorT>& SessionContext)
+    template <class ProcessorT, class Backend>
+    static int StartRuntime(HardwareContext<ProcessorT, Backend>& SessionContext)
     {
         std::setvbuf(stdout,nullptr,_IOFBF,0);
 
         auto& Led_indicator = SessionContext.led_ctrl;
         LedWorker led_worker(Led_indicator);
 
+        // Long term window/breath history.
+        TimeSeriesStore history;
+        if (!history.Open(Config::HistoryPath, MakeHistoryRetention()))
+        {
+            fmt::print(stderr, "Warning: Window history disabled\n");
+        }
+
+        ResultJournal journal;
+        if (!journal.Open(Config::JournalPath, MakeJournalConfig()))
+        {
+            fmt::print(stderr, "Warning: Result journal disabled\n");
+        }
+
+        const int64_t wall_offset_us = WallOffsetUs();
+
         auto on_breath = [&](ProcessorT& processor)
         {
+            // Every window finalized since the last callback, in order.
+            WindowResult window{};
             BreathEvent event{};
-            while (processor.pop_breath_event(event))
+            while (processor.pop_window(window, event))
             {
-                // Map breath state
-                switch (event.State)
+                history.AppendWindow(static_cast<uint64_t>(static_cast<int64_t>(window.window_end_us) + wall_offset_us), window.mean, window.stddev,
+                    static_cast<double>(window.window_end_us - window.window_start_us) / 1'000'000.0);
+                ReportBreathEvent(event, led_worker, history, journal, wall_offset_us);
+
+                // Bus health with every result, only once the bus has had trouble.
+                if constexpr (requires { SessionContext.hw.ads1115.Recovery(); })
                 {
-                    case BreathAnalyzerState::Warmup:
-                    {
-                        fmt::print("Warming up... (Finding baseline)\n");
-                        std::chrono::milliseconds in_on(500);
-                        std::chrono::milliseconds in_off(500);
-                        led_worker.SetState(LedState::Warmup);
-                        led_worker.Apply_Command({.type = LedCommandType::BlinkOne,.count=2,.on=in_on,.off=in_off});
-                        break;
-                    }
-                    case BreathAnalyzerState::Ready:
-                        fmt::print("MQ3 Ready for analysis...\n");
-                        led_worker.SetState(LedState::Ready);
-                        led_worker.Apply_Command({ .type = LedCommandType::Mask, .led_mask = LedMask::M_Blue });
-                        break;
-
-                    case BreathAnalyzerState::Processing:
-                    {
-                        fmt::print("Processed...\n");
-                        std::chrono::milliseconds in_on(200);
-                        std::chrono::milliseconds in_off(200);
-                        led_worker.SetState(LedState::Processing);
-                        led_worker.Apply_Command({.type = LedCommandType::BlinkAll,.count=3,.on=in_on,.off=in_off});
-                        break;
-                    }
-
-                    case BreathAnalyzerState::Cooldown:
-                    {
-                        fmt::print("Cooling Down...\n");
-                        std::chrono::milliseconds in_on(500);
-                        std::chrono::milliseconds in_off(500);
-                        led_worker.SetState(LedState::Cooldown);
-                        led_worker.Apply_Command({.type = LedCommandType::BlinkOne,.count=2,.on=in_on,.off=in_off,});
-                        break;
-                    }
-
-                    case BreathAnalyzerState::Analyzed:
-                    {
-                        fmt::print("Breath Alcohol Detected: Peak = {:.6f}V\n", event.peak_voltage);
-
-                        const auto Rs_Peak = MQ3::adc3v3_to_rs(event.peak_voltage, Config::RLoad);
-                        const auto ratio   = MQ3::rs_to_ratio(Rs_Peak, Config::Ro_Air);
-
-                        const double conc  = MQ3::calculate_concentration_exp(ratio);
-                        const double ppm   = MQ3::calculate_ppm(conc);
-                        const double bac   = MQ3::calculate_bac(ppm);
-                        fmt::print("Concentration: {:.6f}mg/l\n", ppm);
-                        fmt::print("PPM Ethanol: {:.6f}\n", ppm);
-                        fmt::print("BAC: {:.6f}\n", bac);
-
-                        // BAC holds LED result so user can see the result.
-                        led_worker.Apply_Command({
-                            .type = LedCommandType::DriveBac,
-                            .bac = bac,
-                            .bac_holdtime = std::chrono::seconds(10)
-                        });
-
-                        break;
-                    }
-
-                    default:
-                        break;
+                    const I2cHealth health = SessionContext.hw.ads1115.Recovery().Health(static_cast<std::uint64_t>(SteadyClock::now().count()));
+                    if (event.State == BreathAnalyzerState::Analyzed && (health.failed_reads > 0 || health.retried_ok > 0)) {PrintI2cHealth(health);}
+                }
+
+                const ReferenceCompensator* reference = processor.Reference();
+                if (reference != nullptr && event.State == BreathAnalyzerState::Analyzed)
+                {
+                    const ReferenceCompStats stats = reference->Stats();
+                    fmt::print("Reference: room {:.4f}V on the main sensor, gain={:.3f} lag={} corr={:.2f} ({} held, {} fits)\n",
+                        stats.correction_volts, stats.gain, stats.lag_samples, stats.corr, stats.held, stats.fits);
                 }
             }
         };
 
         SessionContext.runner.run(on_breath);
+
+        PrintJournalLatency(journal);
         return 0;
     }
 }
\ No newline at end of file
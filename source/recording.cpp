@@ -0,0 +1,263 @@
+#include "recording.h"
+#include "flight_recorder.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fmt/core.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace DrunkAPI
+{
+    namespace
+    {
+        bool WriteAll(int fd, const void* data, std::size_t len)
+        {
+            const auto* bytes = static_cast<const std::uint8_t*>(data);
+            while (len > 0)
+            {
+                const ssize_t written = ::write(fd, bytes, len);
+                if (written < 0)
+                {
+                    if (errno == EINTR) {continue;}
+                    return false;
+                }
+                bytes += written;
+                len -= static_cast<std::size_t>(written);
+            }
+            return true;
+        }
+
+        bool HasMagic(const std::string& path, const char (&magic)[8])
+        {
+            char head[8]{};
+            std::FILE* file = std::fopen(path.c_str(), "rb");
+            if (file == nullptr) {return false;}
+            const bool bMatch = std::fread(head, 1, sizeof(head), file) == sizeof(head) && std::memcmp(head, magic, sizeof(head)) == 0;
+            std::fclose(file);
+            return bMatch;
+        }
+
+        // Splits "a,b,c" in place, returns the number of fields found.
+        std::size_t SplitCsv(char* line, char** fields, std::size_t max_fields)
+        {
+            std::size_t count = 0;
+            char* cursor = line;
+            while (count < max_fields)
+            {
+                fields[count++] = cursor;
+                char* comma = std::strchr(cursor, ',');
+                if (comma == nullptr) {break;}
+                *comma = '\0';
+                cursor = comma + 1;
+            }
+            return count;
+        }
+
+        bool LoadCsv(const std::string& path, std::vector<Sample>& out)
+        {
+            std::FILE* file = std::fopen(path.c_str(), "r");
+            if (file == nullptr)
+            {
+                fmt::print(stderr, "Error: Unable to open '{}': {}\n", path, std::strerror(errno));
+                return false;
+            }
+
+            char line[256];
+            char* fields[8]{};
+            while (std::fgets(line, sizeof(line), file) != nullptr)
+            {
+                if (line[0] < '0' || line[0] > '9') {continue;} // Header, comment
+
+                const std::size_t count = SplitCsv(line, fields, 8);
+                Sample sample{};
+
+                // drunk_flightdump: mono_us,wall_us,type,raw,volts,...  Plain capture: t_us,raw,volts
+                if (count >= 5 && std::strcmp(fields[2], "sample") == 0)
+                {
+                    sample.t_us = std::strtoull(fields[0], nullptr, 10);
+                    sample.raw = static_cast<std::int16_t>(std::strtol(fields[3], nullptr, 10));
+                    sample.volts = std::strtof(fields[4], nullptr);
+                }
+                else if (count == 3)
+                {
+                    sample.t_us = std::strtoull(fields[0], nullptr, 10);
+                    sample.raw = static_cast<std::int16_t>(std::strtol(fields[1], nullptr, 10));
+                    sample.volts = std::strtof(fields[2], nullptr);
+                }
+                else
+                {
+                    continue;
+                }
+                out.push_back(sample);
+            }
+
+            std::fclose(file);
+            return true;
+        }
+    }
+
+    bool RecordingWriter::Open(const std::string& in_path, std::uint32_t sample_rate_hz, std::int64_t wall_minus_mono_us)
+    {
+        Close();
+        path = in_path;
+
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            fmt::print(stderr, "Error: Unable to create recording '{}': {}\n", path, std::strerror(errno));
+            return false;
+        }
+
+        RecordingHeader header{};
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.version = Version;
+        header.record_size = sizeof(Sample);
+        header.sample_rate_hz = sample_rate_hz;
+        header.wall_minus_mono_us = wall_minus_mono_us;
+        header.created_wall_us = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+
+        if (!WriteAll(fd, &header, sizeof(header)))
+        {
+            fmt::print(stderr, "Error: Unable to write recording header '{}': {}\n", path, std::strerror(errno));
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+
+        buffer.clear();
+        buffer.reserve(BufferSamples);
+        fmt::print("Recording samples to {}\n", path);
+        return true;
+    }
+
+    void RecordingWriter::Close()
+    {
+        if (fd < 0) {return;}
+        Flush();
+        ::close(fd);
+        fd = -1;
+    }
+
+    void RecordingWriter::OnSamples(const Sample* samples, std::size_t n)
+    {
+        if (fd < 0) {return;}
+
+        buffer.insert(buffer.end(), samples, samples + n);
+        if (buffer.size() >= BufferSamples) {Flush();}
+    }
+
+    void RecordingWriter::Flush()
+    {
+        if (fd < 0 || buffer.empty()) {return;}
+
+        if (!WriteAll(fd, buffer.data(), buffer.size() * sizeof(Sample)))
+        {
+            fmt::print(stderr, "Error: Recording write to '{}' failed: {}\n", path, std::strerror(errno));
+        }
+        buffer.clear();
+    }
+
+    bool RecordingReader::Open(const std::string& path)
+    {
+        Close();
+
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            fmt::print(stderr, "Error: Unable to open recording '{}': {}\n", path, std::strerror(errno));
+            return false;
+        }
+
+        struct stat file_stat{};
+        if (::fstat(fd, &file_stat) != 0 || static_cast<std::size_t>(file_stat.st_size) < sizeof(RecordingHeader))
+        {
+            fmt::print(stderr, "Error: '{}' is not a recording\n", path);
+            ::close(fd);
+            return false;
+        }
+
+        const auto total = static_cast<std::size_t>(file_stat.st_size);
+        void* map = ::mmap(nullptr, total, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+
+        if (map == MAP_FAILED)
+        {
+            fmt::print(stderr, "Error: Unable to mmap '{}': {}\n", path, std::strerror(errno));
+            return false;
+        }
+
+        base = static_cast<const unsigned char*>(map);
+        mapped_bytes = total;
+
+        const RecordingHeader& header = Header();
+        if (std::memcmp(header.magic, RecordingWriter::Magic, sizeof(header.magic)) != 0 || header.version != RecordingWriter::Version || header.record_size != sizeof(Sample))
+        {
+            fmt::print(stderr, "Error: '{}' has a bad recording header\n", path);
+            Close();
+            return false;
+        }
+
+        // A torn last record (power cut mid write) is just ignored.
+        count = (total - sizeof(RecordingHeader)) / sizeof(Sample);
+        ::madvise(const_cast<unsigned char*>(base), total, MADV_SEQUENTIAL);
+        return true;
+    }
+
+    void RecordingReader::Close()
+    {
+        if (base == nullptr) {return;}
+        ::munmap(const_cast<unsigned char*>(base), mapped_bytes);
+        base = nullptr;
+        mapped_bytes = 0;
+        count = 0;
+    }
+
+    bool LoadRecording(const std::string& path, std::vector<Sample>& out, std::int64_t& wall_minus_mono_us, std::uint32_t* sample_rate_hz)
+    {
+        out.clear();
+        wall_minus_mono_us = 0;
+        if (sample_rate_hz != nullptr) {*sample_rate_hz = 0;}
+
+        if (HasMagic(path, RecordingWriter::Magic))
+        {
+            RecordingReader reader;
+            if (!reader.Open(path)) {return false;}
+            const std::span<const Sample> samples = reader.Samples();
+            out.assign(samples.begin(), samples.end());
+            wall_minus_mono_us = reader.Header().wall_minus_mono_us;
+            if (sample_rate_hz != nullptr) {*sample_rate_hz = reader.Header().sample_rate_hz;}
+        }
+        else if (HasMagic(path, FlightRecorder::Magic))
+        {
+            FlightRecorder recorder;
+            if (!recorder.OpenReadOnly(path.c_str())) {return false;}
+            for (const FlightRecord& record : recorder.Snapshot())
+            {
+                if (record.type != static_cast<std::uint8_t>(FlightRecordType::Sample)) {continue;}
+                out.push_back(Sample{record.t_us, record.raw, record.f0});
+            }
+            wall_minus_mono_us = recorder.WallOffsetUs();
+        }
+        else if (!LoadCsv(path, out))
+        {
+            return false;
+        }
+
+        // The analyzers want monotonic time, captures pasted together out of order would wreck the windows.
+        if (!std::is_sorted(out.begin(), out.end(), [](const Sample& lhs, const Sample& rhs) { return lhs.t_us < rhs.t_us; }))
+        {
+            std::stable_sort(out.begin(), out.end(), [](const Sample& lhs, const Sample& rhs) { return lhs.t_us < rhs.t_us; });
+        }
+        return true;
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+#include "pipeline_sink.h"
+#include "sampler.h"
+
+// Session recordings (.drec): a 64 byte header followed by packed Sample records, exactly what came out of the ring.
+// It's raw so the consumer can append a batch with one write(), and readers can mmap a segment and walk the samples
+// in place without parsing anything.
+namespace DrunkAPI
+{
+    static_assert(sizeof(Sample) == 16, "Sample is the .drec record format");
+
+    struct RecordingHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t record_size;
+        std::uint32_t sample_rate_hz; // What the session was sampled at, 0 = it changed (dynamic sample rate), go by t_us
+        std::uint32_t reserved0;
+        std::int64_t wall_minus_mono_us; // Sample t_us is steady_clock, add this to get unix time
+        std::uint64_t created_wall_us;
+        std::uint8_t reserved[24];
+    };
+    static_assert(sizeof(RecordingHeader) == 64, "RecordingHeader is an on disk format");
+
+    // Records the live pipeline, only the sample stream is stored (windows/events can always be recomputed).
+    class RecordingWriter final : public PipelineSink
+    {
+        public:
+            static constexpr char Magic[8] = {'D','R','N','K','R','E','C','1'};
+            static constexpr std::uint32_t Version = 1;
+
+            RecordingWriter() = default;
+            RecordingWriter(const RecordingWriter&) = delete;
+            RecordingWriter& operator=(const RecordingWriter&) = delete;
+            RecordingWriter(RecordingWriter&&) = delete;
+            RecordingWriter& operator=(RecordingWriter&&) = delete;
+            ~RecordingWriter() override { Close(); }
+
+            bool Open(const std::string& in_path, std::uint32_t sample_rate_hz, std::int64_t wall_minus_mono_us);
+            void Close();
+            bool IsOpen() const noexcept { return fd >= 0; }
+
+            void OnSamples(const Sample* samples, std::size_t n) override;
+            void OnWindow(const WindowResult&) override {}
+            void OnState(std::uint64_t, const BreathEvent&, const BreathResult&) override {}
+            void Flush() override;
+
+        private:
+            static constexpr std::size_t BufferSamples = 1024; // ~8s at 128 SPS per write()
+
+            std::string path;
+            std::vector<Sample> buffer;
+            int fd = -1;
+    };
+
+    // Read only mmap of a .drec segment.
+    class RecordingReader final
+    {
+        public:
+            RecordingReader() = default;
+            RecordingReader(const RecordingReader&) = delete;
+            RecordingReader& operator=(const RecordingReader&) = delete;
+            RecordingReader(RecordingReader&&) = delete;
+            RecordingReader& operator=(RecordingReader&&) = delete;
+            ~RecordingReader() { Close(); }
+
+            bool Open(const std::string& path);
+            void Close();
+
+            const RecordingHeader& Header() const noexcept { return *reinterpret_cast<const RecordingHeader*>(base); }
+            std::span<const Sample> Samples() const noexcept { return {reinterpret_cast<const Sample*>(base + sizeof(RecordingHeader)), count}; }
+
+        private:
+            const unsigned char* base = nullptr;
+            std::size_t mapped_bytes = 0;
+            std::size_t count = 0;
+    };
+
+    // Loads the samples of any capture we have lying around: .drec segments, flight recorder files, or CSV
+    // (t_us,raw,volts or a drunk_flightdump export). Samples come back in time order. sample_rate_hz gets the .drec
+    // header's rate, 0 (go by t_us) for a variable rate session and for the other formats, which don't say.
+    bool LoadRecording(const std::string& path, std::vector<Sample>& out, std::int64_t& wall_minus_mono_us, std::uint32_t* sample_rate_hz = nullptr);
+}
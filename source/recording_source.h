@@ -0,0 +1,90 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fmt/core.h>
+#include "clock.h"
+#include "config_settings.h"
+#include "process_runner.h"
+#include "recording.h"
+#include "sampler.h"
+
+namespace DrunkAPI
+{
+    // Plays a capture (.drec, flight recorder dump or CSV) through Sampler<Source> in place of the ADC, in real time.
+    // Each read advances the recording by one capture period, a hole in the capture comes back as a failed read so
+    // the analyzers see the same gaps they saw live. Samples are restamped with the steady clock like Ads1115_Source.
+    // At the end it either loops or drops g_running so the session returns.
+    class RecordingSource
+    {
+        public:
+            explicit RecordingSource(bool in_loop = false) : bLoop(in_loop) {}
+
+            bool Load(const std::string& path)
+            {
+                std::int64_t wall_minus_mono_us = 0;
+                if (!LoadRecording(path, samples, wall_minus_mono_us)) {return false;}
+                if (samples.empty())
+                {
+                    fmt::print(stderr, "Error: {} has no samples\n", path);
+                    return false;
+                }
+
+                // Median spacing is the capture's sample period, the mean would count the gaps.
+                std::vector<std::uint64_t> deltas;
+                for (std::size_t i = 1; i < samples.size() && deltas.size() < 4096; ++i) {deltas.push_back(samples[i].t_us - samples[i - 1].t_us);}
+                if (!deltas.empty())
+                {
+                    std::nth_element(deltas.begin(), deltas.begin() + static_cast<std::ptrdiff_t>(deltas.size() / 2), deltas.end());
+                    period_us = std::max<std::uint64_t>(1, deltas[deltas.size() / 2]);
+                }
+
+                Rewind();
+                fmt::print("Replay: {} samples from {}\n", samples.size(), path);
+                return true;
+            }
+
+            bool sample_value(Sample& out) const
+            {
+                if (cursor >= samples.size())
+                {
+                    if (!bLoop)
+                    {
+                        g_running.store(false, std::memory_order_relaxed);
+                        return false;
+                    }
+                    Rewind();
+                }
+
+                const std::uint64_t due_us = replay_us;
+                replay_us += period_us;
+
+                // Anything that crowded into the slot we already played is skipped.
+                while (cursor < samples.size() && samples[cursor].t_us + (period_us / 2) < due_us) {++cursor;}
+                if (cursor >= samples.size() || samples[cursor].t_us > due_us + (period_us / 2)) {return false;}
+
+                // Re-anchor on the sample so the capture's own jitter / rate error doesn't pile up into fake gaps.
+                replay_us = samples[cursor].t_us + period_us;
+                out = samples[cursor++];
+                out.t_us = static_cast<std::uint64_t>(SteadyClock::now().count());
+                return true;
+            }
+
+            bool Finished() const noexcept { return !bLoop && cursor >= samples.size(); }
+
+        private:
+            void Rewind() const
+            {
+                cursor = 0;
+                replay_us = samples.empty() ? 0 : samples.front().t_us;
+            }
+
+            std::vector<Sample> samples;
+            bool bLoop;
+            mutable std::size_t cursor = 0;
+            std::uint64_t period_us = static_cast<std::uint64_t>(Config::SamplePeriod.count());
+            mutable std::uint64_t replay_us = 0; // Recording time of the next read
+    };
+}
@@ -0,0 +1,255 @@
+#include "reference_comp.h"
+#include "mq3_helper.h"
+#include <algorithm>
+#include <cmath>
+
+namespace DrunkAPI
+{
+    namespace
+    {
+        constexpr double AirSettleTau_s = 10.0; // Smoothing before the reference's clean air minimum is taken
+
+        constexpr float MinAmbientVolts = 0.0005F; // A few LSB of room vapor isn't worth the logs
+        constexpr float LagMargin = 0.02F;
+        constexpr double MaxAdcVolts = (MQ3::VCC_5v / MQ3::Voltage_Factor) - 0.001; // Rs hits 0 at the divider's top
+
+        // A reference code pinned to a rail is an I2C glitch (see SignalGenerator), not ambient.
+        bool Railed(const Sample& sample) { return sample.raw <= 0 || sample.raw == 32767; }
+    }
+
+    double ReferenceCompensator::Concentration(double volts) const
+    {
+        const double clamped = std::clamp(volts, 0.001, MaxAdcVolts);
+        return MQ3::calculate_concentration_exp(MQ3::adc3v3_to_ratio(clamped, cfg.RL, cfg.Ro_Air));
+    }
+
+    // The MQ-3 is a power law, room vapor and breath add up in mg/L not in volts. Near clean air that's the same
+    // thing, so the baseline just gets the volts taken off (noise and all) without any logs. Up on a breath the same
+    // vapor is worth far fewer volts, there it comes off in mg/L.
+    float ReferenceCompensator::RemoveAmbient(float main_volts, float ambient_volts) const
+    {
+        if (ambient_volts <= MinAmbientVolts) {return main_volts;}
+        if (main_volts - ambient_volts <= main_air + breath_gate) {return main_volts - ambient_volts;}
+
+        const double breath = Concentration(main_volts) - Concentration(main_air + ambient_volts);
+        if (breath <= Concentration(main_air)) {return main_volts - ambient_volts;}
+
+        const double volts = MQ3::ratio_to_adc3v3(MQ3::concentration_to_ratio_exp(breath), cfg.RL, cfg.Ro_Air);
+        return std::max(main_volts - ambient_volts, static_cast<float>(volts));
+    }
+
+    ReferenceCompensator::ReferenceCompensator(ReferenceComp_Config in_cfg) : cfg(in_cfg)
+    {
+        lag_span = std::min(cfg.max_lag, MaxLag);
+        window = 2 * lag_span + 1;
+
+        const double rate = cfg.sample_rate_hz > 0.0 ? cfg.sample_rate_hz : Config::SampleRate_Hz;
+        detrend_alpha = static_cast<float>(1.0 / std::max(1.0, cfg.detrend_tau_s * rate));
+        corr_alpha = static_cast<float>(1.0 / std::max(1.0, cfg.corr_tau_s * rate));
+        air_alpha = static_cast<float>(1.0 / std::max(1.0, AirSettleTau_s * rate));
+        breath_gate = static_cast<float>(cfg.breath_gate_volts);
+        max_breath_steps = static_cast<std::uint32_t>(std::max(1.0, cfg.max_breath_s * rate));
+        Reset();
+    }
+
+    void ReferenceCompensator::Reset()
+    {
+        pending_head = 0;
+        pending_count = 0;
+        bHaveRef = false;
+        last_ref = 0.0F;
+        ref_hist.fill(0.0F);
+        dref_hist.fill(0.0F);
+        pos = 0;
+        delay_pos = 0;
+        steps = 0;
+        breath_run = 0;
+        breath_delay.fill(false);
+        corr.fill(0.0F);
+        var_main = 0.0F;
+        var_ref = 0.0F;
+        air = static_cast<float>(cfg.air_volts);
+        gain = static_cast<float>(cfg.gain);
+        lag_index = lag_span;
+        stats = ReferenceCompStats{};
+        stats.gain = cfg.gain;
+        stats.air_volts = cfg.air_volts;
+    }
+
+    void ReferenceCompensator::PushReference(const Sample* ref, std::size_t m)
+    {
+        for (std::size_t i = 0; i < m; ++i)
+        {
+            if (Railed(ref[i])) {continue;}
+
+            if (pending_count == MaxPending)
+            {
+                pending_head = (pending_head + 1) % MaxPending;
+                --pending_count;
+            }
+            pending[(pending_head + pending_count) % MaxPending] = ref[i];
+            ++pending_count;
+        }
+    }
+
+    bool ReferenceCompensator::NextReference(std::uint64_t t_us, float& out_volts)
+    {
+        while (pending_count > 0)
+        {
+            const Sample& front = pending[pending_head];
+
+            // Older than this main sample and unclaimed, its main read failed.
+            if (front.t_us + cfg.pair_tolerance_us < t_us)
+            {
+                pending_head = (pending_head + 1) % MaxPending;
+                --pending_count;
+                continue;
+            }
+
+            // Newer ones belong to a later main sample.
+            if (front.t_us > t_us + cfg.pair_tolerance_us) {break;}
+
+            last_ref = front.volts;
+            bHaveRef = true;
+            pending_head = (pending_head + 1) % MaxPending;
+            --pending_count;
+            ++stats.paired;
+            out_volts = last_ref;
+            return true;
+        }
+
+        if (!bHaveRef) {return false;}
+        ++stats.held;
+        out_volts = last_ref;
+        return true;
+    }
+
+    std::size_t ReferenceCompensator::Process(const Sample* main, std::size_t n, Sample* out)
+    {
+        std::size_t produced = 0;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            float ref_volts = 0.0F;
+
+            // Nothing to compensate with until the reference shows up, those go straight through.
+            if (!NextReference(main[i].t_us, ref_volts))
+            {
+                out[produced++] = main[i];
+                continue;
+            }
+            Step(main[i], ref_volts, out, produced);
+        }
+
+        Fit();
+        return produced;
+    }
+
+    void ReferenceCompensator::Step(const Sample& main, float ref_volts, Sample* out, std::size_t& produced)
+    {
+        const float main_volts = main.volts;
+        if (steps == 0)
+        {
+            main_mean = main_volts;
+            ref_mean = ref_volts;
+            ref_smooth = ref_volts;
+            main_smooth = main_volts;
+            main_air = main_volts;
+            if (cfg.air_volts <= 0.0) {air = ref_volts;}
+        }
+
+        // A breath is the main sensor moving without the reference. Those samples stay out of the fit and the main
+        // baseline holds, otherwise the high pass rings for the whole decay after. Not forever though, a main sensor
+        // that moved on its own for that long has a new baseline.
+        const float residual = (main_volts - main_mean) - (gain * (ref_volts - ref_mean));
+        const bool bBreath = std::abs(residual) > breath_gate && breath_run < max_breath_steps;
+        breath_run = bBreath ? breath_run + 1 : 0;
+
+        if (!bBreath) {main_mean += detrend_alpha * (main_volts - main_mean);}
+        ref_mean += detrend_alpha * (ref_volts - ref_mean);
+        const float dmain = main_volts - main_mean;
+        const float dref = ref_volts - ref_mean;
+
+        // Alcohol only ever pushes an MQ-3 up, so clean air is the lowest the reference has settled at.
+        ref_smooth += air_alpha * (ref_volts - ref_smooth);
+        if (cfg.air_volts <= 0.0 && ref_smooth < air) {air = ref_smooth;}
+        main_smooth += air_alpha * (main_volts - main_smooth);
+        main_air = std::min(main_air, main_smooth);
+
+        ref_hist[pos] = ref_volts;
+        ref_hist[pos + window] = ref_volts;
+        dref_hist[pos] = dref;
+        dref_hist[pos + window] = dref;
+        if (++pos == window) {pos = 0;}
+
+        main_delay[delay_pos] = main;
+        dmain_delay[delay_pos] = dmain;
+        breath_delay[delay_pos] = bBreath;
+        if (++delay_pos == lag_span + 1) {delay_pos = 0;}
+        ++steps;
+
+        // The delayed main sample is D behind. Until the window has filled the older half of it is still zeros, those
+        // lags just don't pick anything up yet.
+        if (steps <= lag_span) {return;}
+
+        // n - D sits where n + 1 will go.
+        const std::size_t center = delay_pos;
+        const float dmain_c = dmain_delay[center];
+        const float* dref_window = dref_hist.data() + pos; // [n - 2D, n], oldest first
+        const float* ref_window = ref_hist.data() + pos;
+        float* corr_lag = corr.data();
+        const float alpha = corr_alpha;
+
+        if (!breath_delay[center])
+        {
+            for (std::size_t j = 0; j < window; ++j)
+            {
+                corr_lag[j] += alpha * ((dmain_c * dref_window[j]) - corr_lag[j]);
+            }
+            var_main += alpha * ((dmain_c * dmain_c) - var_main);
+            var_ref += alpha * ((dref_window[lag_span] * dref_window[lag_span]) - var_ref);
+        }
+        else
+        {
+            ++stats.gated;
+        }
+
+        // What the room alone puts on the main sensor, in main sensor volts above its clean air.
+        const float ambient = gain * (ref_window[lag_index] - air);
+        Sample& compensated = out[produced++];
+        compensated = main_delay[center];
+        compensated.volts = RemoveAmbient(main_delay[center].volts, ambient); // raw stays the main channel's code
+        stats.correction_volts = main_delay[center].volts - compensated.volts;
+    }
+
+    void ReferenceCompensator::Fit()
+    {
+        if (steps < window) {return;}
+
+        std::size_t best = lag_span;
+        for (std::size_t j = 0; j < window; ++j)
+        {
+            if (corr[j] > corr[best]) {best = j;}
+        }
+
+        // Slow ambient correlates about the same at every lag, the peak has to stand out before it moves off zero.
+        if (corr[best] < corr[lag_span] + (LagMargin * std::abs(corr[lag_span]))) {best = lag_span;}
+
+        const float denom = std::sqrt(var_main * var_ref);
+        const float rho = denom > 0.0F ? corr[best] / denom : 0.0F;
+        const auto min_var = static_cast<float>(cfg.min_swing_volts * cfg.min_swing_volts);
+
+        // Only refit while the room is actually moving both sensors, a breath on the main one alone drags rho down.
+        if (rho >= static_cast<float>(cfg.min_corr) && var_ref >= min_var)
+        {
+            gain = std::clamp(corr[best] / var_ref, 0.0F, static_cast<float>(cfg.max_gain));
+            lag_index = best;
+            ++stats.fits;
+        }
+
+        stats.gain = gain;
+        stats.lag_samples = static_cast<int>(lag_index) - static_cast<int>(lag_span);
+        stats.corr = rho;
+        stats.air_volts = air;
+        stats.main_air_volts = main_air;
+    }
+}
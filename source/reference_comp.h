@@ -0,0 +1,166 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include "config_settings.h"
+#include "sampler.h"
+#include "spsc.h"
+
+// Ambient compensation with a second, shielded reference MQ-3. Alcohol vapor in the room reaches both sensors, a
+// breath only reaches the main one, so gain * (reference - reference clean air) is what the room puts on the main
+// sensor and taking that off leaves the breath (in mg/L once the main sensor is up its curve, see RemoveAmbient).
+//
+// Gain and lag come from a streaming cross-correlation of the two channels (both high passed) over +-max_lag
+// samples: the peak gives the lag, peak / reference variance the gain. Only updated while the channels actually move
+// together, otherwise the last fit (or the configured gain) stays. The compensated stream runs max_lag samples behind
+// so the reference is available on both sides of every main sample.
+//
+// Everything is fixed size and the per lag loop runs over contiguous floats (mirrored history windows) so the
+// compiler vectorizes it. No allocations after construction.
+namespace DrunkAPI
+{
+    struct ReferenceComp_Config
+    {
+        std::size_t max_lag = Config::ReferenceMaxLag; // Samples each way, capped at ReferenceCompensator::MaxLag
+        double sample_rate_hz = Config::SampleRate_Hz;
+        std::uint64_t pair_tolerance_us = 1'000'000 / (2 * Config::SampleRate_Hz); // Main/reference stamps this close pair up
+        double detrend_tau_s = 20.0; // High pass before correlating, slower than this is baseline not ambient
+        double corr_tau_s = 60.0; // Cross-correlation memory
+        double min_corr = 0.6; // Channels have to agree at least this well before the gain moves
+        double min_swing_volts = 0.002; // Reference sd below this is noise (and shared ADC hum), not ambient
+        double breath_gate_volts = 0.05; // Main off what the reference explains by this much = a breath, the fit sits it out
+        double max_breath_s = 90.0; // Blow + decay, longer than this and the main sensor's baseline moved
+        double gain = 1.0; // Main volts per reference volt until a fit says otherwise (matched sensors = 1)
+        double max_gain = 4.0;
+        double air_volts = Config::ReferenceAirVolts; // Reference clean air reading, 0 = lowest it has settled at
+
+        // Main sensor's curve, for taking the room off in mg/L (same constants as the BAC path)
+        double RL = Config::RLoad;
+        double Ro_Air = Config::Ro_Air;
+    };
+
+    struct ReferenceCompStats
+    {
+        double gain = 0.0;
+        int lag_samples = 0; // > 0 = the reference sees the room later than the main sensor
+        double corr = 0.0; // Normalized cross-correlation at that lag
+        double air_volts = 0.0;
+        double main_air_volts = 0.0;
+        double correction_volts = 0.0; // Last amount taken off the main channel
+        std::uint64_t paired = 0;
+        std::uint64_t held = 0; // Main samples without a fresh reference (failed read), the last one was reused
+        std::uint64_t fits = 0; // Batches the gain/lag were refit on
+        std::uint64_t gated = 0; // Samples left out of the fit as breath
+    };
+
+    class ReferenceCompensator final
+    {
+        public:
+            static constexpr std::size_t MaxLag = 64;
+            static constexpr std::size_t MaxPending = 2 * Config::ConsumerMaxBatch;
+
+            explicit ReferenceCompensator(ReferenceComp_Config in_cfg = {});
+
+            void Reset();
+
+            // Reference samples in arrival order. Past MaxPending the oldest go, no main sample claimed them.
+            void PushReference(const Sample* ref, std::size_t m);
+
+            // Main samples in, the same samples with compensated volts out (max_lag behind). out needs room for n, it
+            // can't alias main. Returns how many came out.
+            std::size_t Process(const Sample* main, std::size_t n, Sample* out);
+
+            std::size_t PendingRoom() const noexcept { return MaxPending - pending_count; }
+            ReferenceCompStats Stats() const noexcept { return stats; }
+
+        private:
+            static constexpr std::size_t MaxWindow = 2 * MaxLag + 1;
+
+            bool NextReference(std::uint64_t t_us, float& out_volts);
+            void Step(const Sample& main, float ref_volts, Sample* out, std::size_t& produced);
+            void Fit();
+            double Concentration(double volts) const;
+            float RemoveAmbient(float main_volts, float ambient_volts) const;
+
+            ReferenceComp_Config cfg;
+            std::size_t lag_span = 0; // D, the window is [n - 2D, n] around the delayed sample n - D
+            std::size_t window = 0; // 2D + 1
+            float detrend_alpha = 0.0F;
+            float corr_alpha = 0.0F;
+            float air_alpha = 0.0F;
+            float breath_gate = 0.0F;
+            std::uint32_t max_breath_steps = 0;
+            std::uint32_t breath_run = 0;
+
+            // Unclaimed reference samples, FIFO
+            std::array<Sample, MaxPending> pending{};
+            std::size_t pending_head = 0;
+            std::size_t pending_count = 0;
+            bool bHaveRef = false;
+            float last_ref = 0.0F;
+
+            // History written twice (pos and pos + window) so the last `window` values are always contiguous at pos.
+            std::array<float, 2 * MaxWindow> ref_hist{};
+            std::array<float, 2 * MaxWindow> dref_hist{};
+            std::size_t pos = 0;
+
+            // Main samples waiting out the lag span
+            std::array<Sample, MaxLag + 1> main_delay{};
+            std::array<float, MaxLag + 1> dmain_delay{};
+            std::array<bool, MaxLag + 1> breath_delay{};
+            std::size_t delay_pos = 0; // Where sample n + 1 goes, = n - D's slot
+            std::uint64_t steps = 0;
+
+            float main_mean = 0.0F;
+            float ref_mean = 0.0F;
+            float ref_smooth = 0.0F;
+            float air = 0.0F;
+            float main_smooth = 0.0F;
+            float main_air = 0.0F; // Main sensor's clean air, tracked the same way
+            std::array<float, MaxWindow> corr{}; // corr[j] ~ E[dmain(n - D) * dref(n - 2D + j)]
+            float var_main = 0.0F;
+            float var_ref = 0.0F;
+
+            float gain = 1.0F;
+            std::size_t lag_index = 0; // Index into the window the correction reads the reference at
+
+            ReferenceCompStats stats{};
+    };
+
+    // Main + reference MQ-3 read back to back on every sampler tick, so a pair is one conversion time apart. Sampler
+    // only sees the main channel, the reference goes to its own lane for RuntimeProcess to pair up. It's pushed before
+    // the main sample is returned, so it's always there by the time its main sample is popped.
+    template<class Source, std::size_t RingN = Config::RingSize>
+    struct ReferencePairSource
+    {
+        Source main;
+        std::optional<Source> reference; // Empty = single channel, the lane stays empty
+        mutable SpscRing<Sample, RingN> reference_lane;
+        mutable std::uint64_t reference_failed = 0;
+
+        template<class... Args>
+        explicit ReferencePairSource(Args&&... args) : main(std::forward<Args>(args)...) {}
+
+        bool sample_value(Sample& out) const
+        {
+            if (!main.sample_value(out)) {return false;}
+
+            if (reference)
+            {
+                Sample ref{};
+                if (reference->sample_value(ref)) {reference_lane.push_overwrite(ref);}
+                else {++reference_failed;}
+            }
+            return true;
+        }
+
+        // Sample rate requests only go through without a reference, the lag search and pair tolerance count main ticks.
+        void set_rate_hz(std::uint32_t hz)
+        {
+            if (!reference) {main.set_rate_hz(hz);}
+        }
+        std::uint32_t max_rate_hz() const { return reference ? 0 : main.max_rate_hz(); }
+    };
+}
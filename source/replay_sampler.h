@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include "clock.h"
+#include "config_settings.h"
+#include "process_runner.h"
+#include "sampler.h"
+
+namespace DrunkAPI
+{
+    // Drop in for Sampler<Source> that plays a recording back against a ManualClock. A sample becomes visible to
+    // pop_batch once the clock passes its timestamp, so ProcessRunner cuts the same batches it would have live and
+    // a backlog bigger than the ring drops the oldest samples like push_overwrite does.
+    // When the recording runs dry g_running is dropped so run() returns, Reset() puts it back for the next trace.
+    class ReplaySampler
+    {
+        public:
+            ReplaySampler(std::span<const Sample> in_samples, ManualClock in_clock) : samples(in_samples), clock(in_clock) {}
+
+            ReplaySampler(const ReplaySampler&) = delete;
+            ReplaySampler& operator=(const ReplaySampler&) = delete;
+
+            void start_sampler()
+            {
+                next = 0;
+                dropped_ = 0;
+                if (!samples.empty()) {clock.set(samples.front().t_us);}
+            }
+
+            void stop_sampler() {}
+
+            // ProcessRunner only needs pop_batch off the buffer.
+            ReplaySampler& buffer() { return *this; }
+            uint64_t dropped() const { return dropped_; }
+
+            std::size_t pop_batch(Sample* out, std::size_t max)
+            {
+                if (next >= samples.size())
+                {
+                    g_running.store(false, std::memory_order_relaxed);
+                    return 0;
+                }
+
+                const auto now_us = static_cast<std::uint64_t>(clock.now().count());
+                std::size_t end = next;
+                while (end < samples.size() && samples[end].t_us <= now_us) {++end;}
+
+                // The ring holds RingSize - 1, anything older got stomped while the consumer slept.
+                constexpr std::size_t capacity = DrunkAPI::Config::RingSize - 1;
+                if (end - next > capacity)
+                {
+                    dropped_ += end - next - capacity;
+                    next = end - capacity;
+                }
+
+                std::size_t count = 0;
+                for (; count < max && next < end; ++count, ++next) {out[count] = samples[next];}
+                return count;
+            }
+
+            static void Reset() { g_running.store(true, std::memory_order_relaxed); }
+
+        private:
+            std::span<const Sample> samples;
+            ManualClock clock;
+            std::size_t next = 0;
+            uint64_t dropped_ = 0;
+    };
+}
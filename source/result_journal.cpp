@@ -0,0 +1,430 @@
+#include "result_journal.h"
+#include "crc32.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fmt/core.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace DrunkAPI
+{
+    namespace
+    {
+        // On disk frame header, followed by `payload_len` bytes. CRC covers seq, type and payload.
+        struct FrameHeader
+        {
+            std::uint32_t payload_len;
+            std::uint32_t crc;
+            std::uint64_t seq;
+            std::uint8_t type;
+            std::uint8_t reserved[7];
+        };
+        static_assert(sizeof(FrameHeader) == 24, "FrameHeader is an on disk format");
+
+        constexpr std::size_t MaxPayload = 256;
+
+        std::uint32_t FrameCrc(const FrameHeader& header, const void* payload)
+        {
+            std::uint32_t crc = Crc32(&header.seq, sizeof(header.seq));
+            crc = Crc32(&header.type, sizeof(header.type), crc);
+            return Crc32(payload, header.payload_len, crc);
+        }
+
+        // Whole frame at offset with a matching CRC.
+        bool ValidFrameAt(const std::vector<std::uint8_t>& data, std::size_t offset, FrameHeader& header)
+        {
+            std::memcpy(&header, data.data() + offset, sizeof(header));
+            if (header.payload_len > MaxPayload || offset + sizeof(header) + header.payload_len > data.size()) {return false;}
+            return FrameCrc(header, data.data() + offset + sizeof(header)) == header.crc;
+        }
+
+        void EncodeFrame(const JournalEntry& entry, std::vector<std::uint8_t>& out)
+        {
+            const void* payload = (entry.type == JournalRecordType::Breath) ? static_cast<const void*>(&entry.breath) : static_cast<const void*>(&entry.calibration);
+            const std::size_t payload_len = (entry.type == JournalRecordType::Breath) ? sizeof(JournalBreath) : sizeof(JournalCalibration);
+
+            FrameHeader header{};
+            header.payload_len = static_cast<std::uint32_t>(payload_len);
+            header.seq = entry.seq;
+            header.type = static_cast<std::uint8_t>(entry.type);
+            header.crc = FrameCrc(header, payload);
+
+            const auto* header_bytes = reinterpret_cast<const std::uint8_t*>(&header);
+            const auto* payload_bytes = static_cast<const std::uint8_t*>(payload);
+            out.insert(out.end(), header_bytes, header_bytes + sizeof(header));
+            out.insert(out.end(), payload_bytes, payload_bytes + payload_len);
+        }
+
+        bool WriteAll(int fd, const std::uint8_t* data, std::size_t len)
+        {
+            while (len > 0)
+            {
+                const ssize_t written = ::write(fd, data, len);
+                if (written < 0)
+                {
+                    if (errno == EINTR) {continue;}
+                    return false;
+                }
+                data += written;
+                len -= static_cast<std::size_t>(written);
+            }
+            return true;
+        }
+
+        // fsync the parent directory so a rename/create survives power loss too.
+        void SyncParentDir(const std::string& file)
+        {
+            const std::size_t slash = file.find_last_of('/');
+            const std::string parent = (slash == std::string::npos) ? "." : file.substr(0, slash == 0 ? 1 : slash);
+            const int dir_fd = ::open(parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dir_fd >= 0)
+            {
+                ::fsync(dir_fd);
+                ::close(dir_fd);
+            }
+        }
+    }
+
+    bool ResultJournal::ReadAll(const std::string& in_path, std::vector<JournalEntry>& out, std::uint64_t* good_bytes, std::uint64_t* skipped_bytes)
+    {
+        const int read_fd = ::open(in_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (read_fd < 0) {return errno == ENOENT;} // No journal yet is fine
+
+        std::vector<std::uint8_t> data;
+        std::uint8_t chunk[4096];
+        ssize_t got = 0;
+        while ((got = ::read(read_fd, chunk, sizeof(chunk))) > 0)
+        {
+            data.insert(data.end(), chunk, chunk + got);
+        }
+        ::close(read_fd);
+
+        std::size_t offset = 0;
+        std::size_t good_end = 0;
+        std::uint64_t skipped = 0;
+        std::uint64_t last_seq = 0;
+        while (offset + sizeof(FrameHeader) <= data.size())
+        {
+            FrameHeader header{};
+            if (!ValidFrameAt(data, offset, header))
+            {
+                // A flipped bit in the middle mustn't take every later record with it. Look for the next frame that
+                // checks out (and comes after the last good one), only when there's none is this a torn tail.
+                std::size_t next = offset + 1;
+                FrameHeader next_header{};
+                while (next + sizeof(FrameHeader) <= data.size() && !(ValidFrameAt(data, next, next_header) && next_header.seq > last_seq)) {++next;}
+                if (next + sizeof(FrameHeader) > data.size()) {break;}
+
+                skipped += next - offset;
+                offset = next;
+                header = next_header;
+            }
+
+            const std::size_t frame_end = offset + sizeof(header) + header.payload_len;
+            const std::uint8_t* payload = data.data() + offset + sizeof(header);
+            last_seq = header.seq;
+
+            JournalEntry entry{};
+            entry.seq = header.seq;
+            entry.type = static_cast<JournalRecordType>(header.type);
+
+            if (entry.type == JournalRecordType::Breath && header.payload_len == sizeof(JournalBreath))
+            {
+                std::memcpy(&entry.breath, payload, sizeof(JournalBreath));
+                out.push_back(entry);
+            }
+            else if (entry.type == JournalRecordType::Calibration && header.payload_len == sizeof(JournalCalibration))
+            {
+                std::memcpy(&entry.calibration, payload, sizeof(JournalCalibration));
+                out.push_back(entry);
+            }
+            // Unknown but CRC valid records (newer versions) are skipped, not treated as corruption.
+
+            offset = frame_end;
+            good_end = frame_end;
+        }
+
+        if (good_bytes != nullptr) {*good_bytes = good_end;}
+        if (skipped_bytes != nullptr) {*skipped_bytes = skipped;}
+        return true;
+    }
+
+    bool ResultJournal::Open(const std::string& in_path, Journal_Config in_cfg, std::vector<JournalEntry>* recovered)
+    {
+        Close();
+        path = in_path;
+        cfg = in_cfg;
+
+        // Recovery: every frame that checks out is kept, corrupt ones in the middle are stepped over (and left in the
+        // file), only a torn tail past the last good frame is cut.
+        std::vector<JournalEntry> entries;
+        std::uint64_t good_bytes = 0;
+        std::uint64_t skipped_bytes = 0;
+        if (!ReadAll(path, entries, &good_bytes, &skipped_bytes))
+        {
+            fmt::print(stderr, "Error: Unable to read journal '{}': {}\n", path, std::strerror(errno));
+            return false;
+        }
+
+        std::error_code dir_error;
+        const std::filesystem::path parent = std::filesystem::path(path).parent_path();
+        if (!parent.empty()) {std::filesystem::create_directories(parent, dir_error);}
+
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            fmt::print(stderr, "Error: Unable to open journal '{}': {}\n", path, std::strerror(errno));
+            return false;
+        }
+
+        if (skipped_bytes != 0)
+        {
+            fmt::print(stderr, "Warning: Journal '{}' has {} corrupt bytes between good records, skipped over them\n", path, skipped_bytes);
+        }
+
+        struct stat file_stat{};
+        ::fstat(fd, &file_stat);
+        if (static_cast<std::uint64_t>(file_stat.st_size) != good_bytes)
+        {
+            fmt::print(stderr, "Journal: truncating {} bytes of torn/corrupt tail\n", static_cast<std::uint64_t>(file_stat.st_size) - good_bytes);
+            if (::ftruncate(fd, static_cast<off_t>(good_bytes)) != 0 || ::fdatasync(fd) != 0)
+            {
+                fmt::print(stderr, "Error: Unable to truncate journal '{}': {}\n", path, std::strerror(errno));
+            }
+        }
+
+        ::lseek(fd, 0, SEEK_END);
+        file_bytes = good_bytes;
+        SyncParentDir(path);
+
+        {
+            std::lock_guard lock(queue_mutex);
+            next_seq = entries.empty() ? 1 : entries.back().seq + 1;
+            settled_seq = next_seq - 1;
+            lost_seqs.clear();
+            bStop = false;
+            pending.clear();
+        }
+
+        fmt::print("Journal: {} ({} records recovered)\n", path, entries.size());
+        if (recovered != nullptr) {*recovered = std::move(entries);}
+
+        writer = std::thread([this]{ WriterLoop(); });
+        return true;
+    }
+
+    void ResultJournal::Close()
+    {
+        {
+            std::lock_guard lock(queue_mutex);
+            bStop = true;
+        }
+        queue_cv.notify_all();
+        if (writer.joinable()) {writer.join();} // The writer flushes whatever is still queued before exiting
+
+        if (fd >= 0)
+        {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    std::uint64_t ResultJournal::Enqueue(JournalEntry entry)
+    {
+        if (fd < 0) {return 0;}
+
+        std::uint64_t seq = 0;
+        {
+            std::lock_guard lock(queue_mutex);
+            seq = next_seq++;
+            entry.seq = seq;
+            pending.push_back({entry, std::chrono::steady_clock::now()});
+        }
+        queue_cv.notify_one();
+        return seq;
+    }
+
+    std::uint64_t ResultJournal::AppendBreath(const JournalBreath& breath)
+    {
+        JournalEntry entry{};
+        entry.type = JournalRecordType::Breath;
+        entry.breath = breath;
+        return Enqueue(entry);
+    }
+
+    std::uint64_t ResultJournal::AppendCalibration(const JournalCalibration& calibration)
+    {
+        JournalEntry entry{};
+        entry.type = JournalRecordType::Calibration;
+        entry.calibration = calibration;
+        return Enqueue(entry);
+    }
+
+    bool ResultJournal::WaitDurable(std::uint64_t seq, std::chrono::milliseconds timeout)
+    {
+        std::unique_lock lock(queue_mutex);
+        if (!durable_cv.wait_for(lock, timeout, [&]{ return settled_seq >= seq; })) {return false;}
+        return std::none_of(lost_seqs.begin(), lost_seqs.end(), [seq](const auto& lost){ return seq >= lost.first && seq <= lost.second; });
+    }
+
+    void ResultJournal::WriterLoop()
+    {
+        std::vector<Pending> batch;
+        std::vector<std::uint8_t> buffer;
+
+        while (true)
+        {
+            {
+                std::unique_lock lock(queue_mutex);
+                queue_cv.wait(lock, [&]{ return bStop || !pending.empty(); });
+
+                if (pending.empty() && bStop) {break;}
+
+                // Group commit: hold the sync until the oldest record has used up its budget or the batch is full.
+                const auto deadline = pending.front().queued + cfg.group_commit_budget;
+                queue_cv.wait_until(lock, deadline, [&]{ return bStop || pending.size() >= cfg.max_batch; });
+
+                batch.swap(pending);
+            }
+
+            buffer.clear();
+            for (const Pending& item : batch) {EncodeFrame(item.entry, buffer);}
+
+            bool bDurable = false;
+            bool bCompact = false;
+            int commit_errno = 0;
+            {
+                std::lock_guard file_lock(file_mutex);
+                bDurable = WriteAll(fd, buffer.data(), buffer.size()) && ::fdatasync(fd) == 0;
+                if (bDurable)
+                {
+                    file_bytes += buffer.size();
+                }
+                else
+                {
+                    // A partial write (ENOSPC) leaves a torn frame. Open() would step over it, but the records in it were
+                    // never durable, so cut back to the last good commit rather than leave junk in the file.
+                    commit_errno = errno;
+                    if (::ftruncate(fd, static_cast<off_t>(file_bytes)) != 0 || ::lseek(fd, static_cast<off_t>(file_bytes), SEEK_SET) < 0)
+                    {
+                        fmt::print(stderr, "Error: Unable to cut journal '{}' back after a failed commit: {}\n", path, std::strerror(errno));
+                    }
+                }
+                bCompact = file_bytes > cfg.max_bytes;
+            }
+
+            const auto done = std::chrono::steady_clock::now();
+
+            if (!bDurable)
+            {
+                // Keep going, the records are lost but the LED result still shows and the next batch may succeed.
+                fmt::print(stderr, "Error: Journal commit of {} records failed: {}\n", batch.size(), std::strerror(commit_errno));
+                std::lock_guard lock(stats_mutex);
+                ++failed_commit_count;
+                failed_record_count += batch.size();
+            }
+            else
+            {
+                RecordLatency(done, batch);
+            }
+
+            {
+                std::lock_guard lock(queue_mutex);
+                if (!bDurable) {lost_seqs.emplace_back(batch.front().entry.seq, batch.back().entry.seq);}
+                settled_seq = std::max(settled_seq, batch.back().entry.seq);
+            }
+            durable_cv.notify_all();
+            batch.clear();
+
+            if (bCompact) {Compact(cfg.keep_records);}
+        }
+    }
+
+    void ResultJournal::RecordLatency(std::chrono::steady_clock::time_point done, const std::vector<Pending>& batch)
+    {
+        std::lock_guard lock(stats_mutex);
+        ++commit_count;
+        for (const Pending& item : batch)
+        {
+            const auto waited = std::chrono::duration_cast<std::chrono::microseconds>(done - item.queued).count();
+            latency_us[latency_count % LatencySamples] = static_cast<std::uint32_t>(std::min<long long>(waited, UINT32_MAX));
+            ++latency_count;
+        }
+    }
+
+    JournalLatency ResultJournal::Latency() const
+    {
+        JournalLatency out{};
+        std::vector<std::uint32_t> samples;
+        {
+            std::lock_guard lock(stats_mutex);
+            out.commits = commit_count;
+            out.records = latency_count;
+            out.failed_commits = failed_commit_count;
+            out.failed_records = failed_record_count;
+            samples.assign(latency_us.begin(), latency_us.begin() + static_cast<std::ptrdiff_t>(std::min(latency_count, LatencySamples)));
+        }
+
+        if (samples.empty()) {return out;}
+        std::sort(samples.begin(), samples.end());
+
+        auto percentile = [&](double pct)
+        {
+            const auto idx = static_cast<std::size_t>(pct * static_cast<double>(samples.size() - 1));
+            return static_cast<double>(samples[idx]);
+        };
+
+        out.p50_us = percentile(0.50);
+        out.p90_us = percentile(0.90);
+        out.p99_us = percentile(0.99);
+        out.p999_us = percentile(0.999);
+        out.max_us = static_cast<double>(samples.back());
+        return out;
+    }
+
+    bool ResultJournal::Compact(std::size_t keep_records)
+    {
+        std::lock_guard file_lock(file_mutex);
+
+        // ReadAll steps over corrupt frames, so everything that still validates makes it into the new file.
+        std::vector<JournalEntry> entries;
+        std::uint64_t skipped_bytes = 0;
+        if (!ReadAll(path, entries, nullptr, &skipped_bytes)) {return false;}
+
+        const std::size_t drop = (entries.size() > keep_records) ? entries.size() - keep_records : 0;
+
+        std::vector<std::uint8_t> buffer;
+        for (std::size_t i = drop; i < entries.size(); ++i) {EncodeFrame(entries[i], buffer);}
+
+        // Write the new file next to the old one, sync it, then swap it in with rename().
+        const std::string tmp_path = path + ".compact";
+        const int tmp_fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (tmp_fd < 0)
+        {
+            fmt::print(stderr, "Error: Journal compaction failed to open '{}': {}\n", tmp_path, std::strerror(errno));
+            return false;
+        }
+
+        if (!WriteAll(tmp_fd, buffer.data(), buffer.size()) || ::fdatasync(tmp_fd) != 0 || ::rename(tmp_path.c_str(), path.c_str()) != 0)
+        {
+            fmt::print(stderr, "Error: Journal compaction of '{}' failed: {}\n", path, std::strerror(errno));
+            ::close(tmp_fd);
+            ::unlink(tmp_path.c_str());
+            return false;
+        }
+
+        SyncParentDir(path);
+
+        ::close(fd);
+        fd = tmp_fd;
+        ::lseek(fd, 0, SEEK_END);
+        file_bytes = buffer.size();
+
+        fmt::print("Journal: compacted {} -> {} records{}\n", entries.size(), entries.size() - drop,
+            skipped_bytes != 0 ? fmt::format(", {} corrupt bytes dropped", skipped_bytes) : std::string());
+        return true;
+    }
+}
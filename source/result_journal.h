@@ -0,0 +1,150 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Write-ahead journal for breath results and calibration events (the audit trail).
+//
+// Each record is framed as [len | crc32 | seq | type | payload]. The consumer thread only queues a record,
+// a writer thread batches everything that arrives within the latency budget into one write() + fdatasync().
+// An SD card takes tens of ms per sync, so group commit turns N syncs into one without blocking the analyzer.
+//
+// On Open() the file is scanned and the good records are handed back. A corrupt frame between good ones is stepped
+// over (the scan resyncs on the next frame whose CRC checks out), only a torn tail after the last good frame is cut.
+// The file is compacted (atomic rewrite keeping the newest records) once it grows past max_bytes.
+namespace DrunkAPI
+{
+    enum class JournalRecordType : std::uint8_t
+    {
+        Breath = 1,
+        Calibration = 2,
+    };
+
+    struct JournalBreath
+    {
+        std::uint64_t wall_us = 0; // When the result was produced (system_clock)
+        std::uint64_t start_us = 0; // Breath window, steady_clock
+        std::uint64_t end_us = 0;
+        double peak_volts = 0.0;
+        double ppm = 0.0;
+        double bac = 0.0;
+    };
+
+    struct JournalCalibration
+    {
+        std::uint64_t wall_us = 0;
+        double mean_volts = 0.0;
+        double stddev = 0.0;
+        double rs_ohms = 0.0;
+        double rs_ro_ratio = 0.0;
+        std::uint64_t stable = 0;
+    };
+
+    struct JournalEntry
+    {
+        JournalRecordType type = JournalRecordType::Breath;
+        std::uint64_t seq = 0;
+        JournalBreath breath{};
+        JournalCalibration calibration{};
+    };
+
+    struct Journal_Config
+    {
+        std::chrono::microseconds group_commit_budget{20'000}; // Max time a record waits for company before a sync
+        std::size_t max_batch = 64; // Sync right away once this many records are queued
+        std::size_t max_bytes = 4U * 1024U * 1024U; // Compact past this size
+        std::size_t keep_records = 20'000; // Records kept by compaction
+    };
+
+    struct JournalLatency
+    {
+        std::uint64_t commits = 0; // fdatasync calls
+        std::uint64_t records = 0;
+        double p50_us = 0.0;
+        double p90_us = 0.0;
+        double p99_us = 0.0;
+        double p999_us = 0.0;
+        double max_us = 0.0;
+        std::uint64_t failed_commits = 0; // write() / fdatasync() that failed, their records never became durable
+        std::uint64_t failed_records = 0;
+    };
+
+    class ResultJournal final
+    {
+        public:
+            ResultJournal() = default;
+            ResultJournal(const ResultJournal&) = delete;
+            ResultJournal& operator=(const ResultJournal&) = delete;
+            ResultJournal(ResultJournal&&) = delete;
+            ResultJournal& operator=(ResultJournal&&) = delete;
+            ~ResultJournal() { Close(); }
+
+            // Recovers the journal at `path` (recovered may be null) and starts the group commit thread.
+            bool Open(const std::string& in_path, Journal_Config in_cfg = {}, std::vector<JournalEntry>* recovered = nullptr);
+            void Close();
+            bool IsOpen() const noexcept { return fd >= 0; }
+
+            // Non blocking, returns the record's sequence number (0 if the journal is closed).
+            std::uint64_t AppendBreath(const JournalBreath& breath);
+            std::uint64_t AppendCalibration(const JournalCalibration& calibration);
+
+            // Blocks until `seq` is on stable storage or the timeout expires. False right away once its commit failed.
+            bool WaitDurable(std::uint64_t seq, std::chrono::milliseconds timeout);
+
+            // Atomically rewrites the file keeping only the newest keep_records.
+            bool Compact(std::size_t keep_records);
+
+            // Durable commit latency: time from Append() until the record's fdatasync returned.
+            JournalLatency Latency() const;
+
+            // Reads a journal without opening it for writing (tools). good_bytes = end of the last good frame,
+            // skipped_bytes = corrupt bytes stepped over before it.
+            static bool ReadAll(const std::string& path, std::vector<JournalEntry>& out, std::uint64_t* good_bytes = nullptr, std::uint64_t* skipped_bytes = nullptr);
+
+        private:
+            struct Pending
+            {
+                JournalEntry entry;
+                std::chrono::steady_clock::time_point queued;
+            };
+
+            std::uint64_t Enqueue(JournalEntry entry);
+            void WriterLoop();
+            void RecordLatency(std::chrono::steady_clock::time_point done, const std::vector<Pending>& batch);
+
+            static constexpr std::size_t LatencySamples = 8192;
+
+            std::string path;
+            Journal_Config cfg;
+            int fd = -1;
+            std::size_t file_bytes = 0;
+
+            // Queue shared with the writer thread
+            std::mutex queue_mutex;
+            std::condition_variable queue_cv;
+            std::condition_variable durable_cv;
+            std::vector<Pending> pending;
+            std::uint64_t next_seq = 1;
+            std::uint64_t settled_seq = 0; // Commit attempted up to here, durable unless it's in a lost range
+            std::vector<std::pair<std::uint64_t, std::uint64_t>> lost_seqs; // [first, last] of each failed commit
+            bool bStop = false;
+
+            std::mutex file_mutex; // Held by the writer while writing and by Compact() while swapping files
+            std::thread writer;
+
+            mutable std::mutex stats_mutex;
+            std::array<std::uint32_t, LatencySamples> latency_us{};
+            std::size_t latency_count = 0;
+            std::uint64_t commit_count = 0;
+            std::uint64_t failed_commit_count = 0;
+            std::uint64_t failed_record_count = 0;
+    };
+}
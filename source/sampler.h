@@ -1,17 +1,23 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <thread>
+#include "clock.h"
 #include "config_settings.h"
 #include "spsc.h"
-#include "ads1115.h"
+#include "flight_recorder.h"
 
 namespace DrunkAPI
 {
     struct SamplerConfg
     {
-        std::chrono::microseconds sample_rate{DrunkAPI::Config::SamplePeriod};
+        // Sample period. Nanoseconds so a synthetic source can be driven past 1 MHz.
+        std::chrono::nanoseconds sample_rate{DrunkAPI::Config::SamplePeriod};
     };
 
     struct Sample
@@ -21,45 +27,47 @@ namespace DrunkAPI
         float    volts;
     };
 
-    struct Ads1115_Source
+    // Sample rate per breath state, see RuntimeProcess::AttachRateControl.
+    struct SampleRate_Config
     {
-        DrunkAPI::ADS1115& ads;
-
-        DrunkAPI::ADS1115::i2c_device::SlaveAddress addr;
-        DrunkAPI::ADS1115::Mux mux;
-        DrunkAPI::ADS1115::Pga pga;
-        DrunkAPI::ADS1115::DataRate rate;
-
-        Ads1115_Source(DrunkAPI::ADS1115& ads_in,
-                    DrunkAPI::ADS1115::i2c_device::SlaveAddress addr_in,
-                    DrunkAPI::ADS1115::Mux mux_in,
-                    DrunkAPI::ADS1115::Pga pga_in,
-                    DrunkAPI::ADS1115::DataRate rate_in): ads(ads_in), addr(addr_in), mux(mux_in), pga(pga_in), rate(rate_in){}
+        std::uint32_t warmup_hz = Config::SampleRate_Hz;
+        std::uint32_t ready_hz = Config::ReadySampleHz;
+        std::uint32_t processing_hz = Config::ProcessingSampleHz;
+        std::uint32_t cooldown_hz = Config::SampleRate_Hz;
+    };
 
-        bool sample_value(Sample& out) const
-        {
-            uint16_t out_val = 0;
-            if(!ads.ReadSingleShot(addr,mux,pga,rate,out_val)) {return false;}
+    // Rate requests from the consumer side. The sampler thread picks the latest one up right before its next
+    // conversion and switches the source's data rate and its own tick together, so no sample is read at one rate and
+    // paced at the other.
+    class SampleRateControl
+    {
+        public:
+            // Returns what a request for hz gets, RuntimeProcess tells its analyzer that rather than what it asked for.
+            std::uint32_t Request(std::uint32_t hz)
+            {
+                const std::uint32_t got = Achievable(hz);
+                requested_hz.store(got, std::memory_order_relaxed);
+                return got;
+            }
 
-            out.raw = static_cast<int16_t>(out_val);
-            out.volts = static_cast<float>(DrunkAPI::ADS1115::Convert_Volts_FS4_096(out_val));
+            std::uint32_t Achievable(std::uint32_t hz) const noexcept { return std::min(hz, max_hz); }
 
-            // Set Monotonic timestamp
-            auto duration = std::chrono::steady_clock::now().time_since_epoch();
-            
-            const uint64_t usec = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
-            out.t_us = usec;
+            bool Supported() const noexcept { return max_hz != 0; }
+            std::uint32_t Applied() const noexcept { return applied_hz.load(std::memory_order_relaxed); }
 
-            return true;
-        }
+        private:
+            template<class Source, std::size_t RingN> friend class Sampler;
 
+            std::uint32_t max_hz = 0; // Source's fastest, 0 = it can't change rate. Set before the sampler starts
+            std::atomic<std::uint32_t> requested_hz{0}; // 0 = nothing asked for yet
+            std::atomic<std::uint32_t> applied_hz{0};
     };
 
-    template<class Source>
+    template<class Source, std::size_t RingN = DrunkAPI::Config::RingSize>
     class Sampler 
     {
         public:
-            explicit Sampler(Source& src) : DataSource(src) {}
+            explicit Sampler(Source& src, SamplerConfg in_cfg = {}) : DataSource(src), cfg(in_cfg) { refresh_rate_limit(); }
 
             Sampler(const Sampler&) = delete;
             Sampler& operator=(const Sampler&) = delete;
@@ -79,32 +87,88 @@ namespace DrunkAPI
             }
 
             // expose buffer to main/exporter
-            SpscRing<Sample, DrunkAPI::Config::RingSize>& buffer() { return ring; }
+            SpscRing<Sample, RingN>& buffer() { return ring; }
             uint64_t dropped() const { return dropped_.load(); }
+            uint64_t failed() const { return failed_.load(); } // Ticks the source had no sample for
+
+            // Optional black box, must be attached before start_sampler().
+            void attach_recorder(FlightRecorder* in_recorder) { recorder = in_recorder; }
+
+            // State driven rate changes (RuntimeProcess::AttachRateControl), Supported() once the source can do them.
+            SampleRateControl& rate_control() { return rate; }
+
+            // Re-reads the source's fastest rate. The sampler is built before the backend's Init(), so anything that
+            // changes there (the I2C bus speed, a flow sensor turning up) is only picked up here. Before start_sampler().
+            void refresh_rate_limit()
+            {
+                if constexpr (requires { DataSource.set_rate_hz(std::uint32_t{}); DataSource.max_rate_hz(); })
+                {
+                    rate.max_hz = DataSource.max_rate_hz();
+                }
+            }
 
         private:
             void run_sampler() 
             {
                 using namespace std::chrono;
 
-                constexpr auto period = microseconds(DrunkAPI::Config::SamplePeriod);
+                auto period = cfg.sample_rate;
                 auto next = steady_clock::now(); // Using monotonic clock (Fixed timestep) similiar to game engine tick simulation to sample at a fixed rate. Wall clock is bad and can drift
+                std::uint32_t rate_hz = 0;
                 while (running.load(std::memory_order_relaxed)) 
                 {
+                    // New rate goes in between conversions. The timestep restarts from now, catching up on ticks of the
+                    // old period at the new one would be a burst.
+                    const std::uint32_t want_hz = rate.requested_hz.load(std::memory_order_relaxed);
+                    if (want_hz != 0 && want_hz != rate_hz)
+                    {
+                        if constexpr (requires { DataSource.set_rate_hz(want_hz); }) {DataSource.set_rate_hz(want_hz);}
+                        period = std::chrono::duration_cast<nanoseconds>(seconds(1)) / want_hz;
+                        next = steady_clock::now();
+                        rate_hz = want_hz;
+                        rate.applied_hz.store(want_hz, std::memory_order_relaxed);
+                    }
+
                     next += period; // Set next period to wait until
 
-                    Sample sample{};
-                    if (DataSource.sample_value(sample)) {
-                        if (!ring.push_overwrite(sample)) {dropped_.fetch_add(1, std::memory_order_relaxed);}
+                    if constexpr (requires (Sample* out) { DataSource.sample_block(out, std::size_t{}); })
+                    {
+                        // Burst sources (SpiAdcSource) hand back several stamped samples per tick, they go into the
+                        // ring as one block so the consumer never sees half a burst.
+                        std::array<Sample, Config::SpiMaxBurstDepth> block{};
+                        const std::size_t got = DataSource.sample_block(block.data(), block.size());
+                        if (got == 0) {failed_.fetch_add(1, std::memory_order_relaxed);}
+                        else
+                        {
+                            const std::size_t overwritten = ring.push_overwrite_batch(block.data(), got);
+                            if (overwritten != 0) {dropped_.fetch_add(overwritten, std::memory_order_relaxed);}
+                            if (recorder != nullptr)
+                            {
+                                for (std::size_t i = 0; i < got; ++i) {recorder->RecordSample(block[i].t_us, block[i].raw, block[i].volts);}
+                            }
+                        }
+                    }
+                    else
+                    {
+                        Sample sample{};
+                        if (DataSource.sample_value(sample)) {
+                            if (!ring.push_overwrite(sample)) {dropped_.fetch_add(1, std::memory_order_relaxed);}
+                            if (recorder != nullptr) {recorder->RecordSample(sample.t_us, sample.raw, sample.volts);}
+                        }
+                        else {failed_.fetch_add(1, std::memory_order_relaxed);}
                     }
                     std::this_thread::sleep_until(next);
                 }
             }
 
             Source& DataSource;
-            SpscRing<Sample, DrunkAPI::Config::RingSize> ring;
+            SamplerConfg cfg;
+            SpscRing<Sample, RingN> ring;
             std::atomic<bool> running{false};
             std::atomic<uint64_t> dropped_{0};
+            std::atomic<uint64_t> failed_{0};
             std::thread thread;
+            FlightRecorder* recorder = nullptr;
+            SampleRateControl rate;
     };
 }
\ No newline at end of file
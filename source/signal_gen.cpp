@@ -0,0 +1,286 @@
+#include "signal_gen.h"
+#include "clock.h"
+#include "mq3_helper.h"
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <utility>
+
+namespace DrunkAPI
+{
+    namespace
+    {
+        constexpr double AdcVoltsPerCode = 4.096 / 32768.0; // ADS1115 at PGA 4.096V
+
+        // 1/f from octave spaced first order poles with equal variance, 20 Hz down to ~1 mHz.
+        constexpr double PinkTopHz = 20.0;
+        constexpr double PinkPoleStep = 4.0;
+
+        double VaporEnd(const VaporSpec& vapor)
+        {
+            return vapor.start_s + vapor.rise_s + vapor.hold_s + vapor.fall_s;
+        }
+
+        std::uint64_t SplitMix64(std::uint64_t& x)
+        {
+            std::uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30U)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27U)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31U);
+        }
+
+        std::uint64_t Rotl(std::uint64_t x, int k)
+        {
+            return (x << static_cast<unsigned>(k)) | (x >> static_cast<unsigned>(64 - k));
+        }
+    }
+
+    std::vector<BreathSpec> MakeBreathScript(double session_s, double every_s, const std::vector<double>& bacs, double blow_s, double first_s)
+    {
+        std::vector<BreathSpec> script;
+        if (every_s <= 0.0 || bacs.empty()) {return script;}
+
+        std::size_t n = 0;
+        for (double t = first_s; t + blow_s < session_s; t += every_s, ++n)
+        {
+            script.push_back({t, blow_s, bacs[n % bacs.size()]});
+        }
+        return script;
+    }
+
+    std::vector<VaporSpec> MakeVaporScript(double session_s, double every_s, const std::vector<double>& mg_l, const std::vector<double>& rise_s, double first_s)
+    {
+        std::vector<VaporSpec> vapor;
+        if (every_s <= 0.0 || mg_l.empty() || rise_s.empty()) {return vapor;}
+
+        std::size_t n = 0;
+        for (double t = first_s; t < session_s; t += every_s, ++n)
+        {
+            VaporSpec spec{};
+            spec.start_s = t;
+            spec.mg_l = mg_l[n % mg_l.size()];
+            spec.rise_s = rise_s[n % rise_s.size()];
+            vapor.push_back(spec);
+        }
+        return vapor;
+    }
+
+    // xoshiro256**, fast and the same on every platform unlike <random>'s distributions.
+    std::uint64_t SignalGenerator::Rng::next()
+    {
+        const std::uint64_t result = Rotl(state[1] * 5, 7) * 9;
+        const std::uint64_t t = state[1] << 17U;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = Rotl(state[3], 45);
+        return result;
+    }
+
+    double SignalGenerator::Rng::uniform()
+    {
+        return static_cast<double>(next() >> 11U) * 0x1.0p-53;
+    }
+
+    SignalGenerator::SignalGenerator(Signal_Config in_cfg, std::vector<BreathSpec> in_script) : cfg(in_cfg), script(std::move(in_script))
+    {
+        std::uint64_t seed = cfg.seed;
+        for (std::uint64_t& word : rng.state) {word = SplitMix64(seed);}
+
+        std::sort(script.begin(), script.end(), [](const BreathSpec& a, const BreathSpec& b) { return a.start_s < b.start_s; });
+        std::sort(cfg.vapor.begin(), cfg.vapor.end(), [](const VaporSpec& a, const VaporSpec& b) { return a.start_s < b.start_s; });
+
+        air_conductance = 1.0 / MQ3::adc3v3_to_ratio(cfg.baseline_volts, cfg.RL, cfg.Ro_Air);
+        conductance = air_conductance;
+        pink_scale = cfg.pink_volts / std::sqrt(static_cast<double>(PinkPoles));
+        last_t_us = cfg.start_us;
+    }
+
+    double SignalGenerator::Gaussian()
+    {
+        if (bHaveSpare)
+        {
+            bHaveSpare = false;
+            return spare;
+        }
+
+        // Marsaglia polar method, two normals per accepted pair.
+        double u = 0.0;
+        double v = 0.0;
+        double s = 0.0;
+        do
+        {
+            u = (2.0 * rng.uniform()) - 1.0;
+            v = (2.0 * rng.uniform()) - 1.0;
+            s = (u * u) + (v * v);
+        } while (s >= 1.0 || s == 0.0);
+
+        const double scale = std::sqrt(-2.0 * std::log(s) / s);
+        spare = v * scale;
+        bHaveSpare = true;
+        return u * scale;
+    }
+
+    void SignalGenerator::UpdateCoefficients(double dt_s)
+    {
+        coef_dt_s = dt_s;
+        rise_k = 1.0 - std::exp(-dt_s / cfg.rise_tau_s);
+        decay_k = 1.0 - std::exp(-dt_s / cfg.decay_tau_s);
+        walk_sigma = cfg.random_walk_volts * std::sqrt(dt_s / 3600.0);
+
+        double pole_hz = PinkTopHz;
+        for (std::size_t k = 0; k < PinkPoles; ++k)
+        {
+            pink_a[k] = std::exp(-2.0 * std::numbers::pi * pole_hz * dt_s);
+            pink_b[k] = std::sqrt(1.0 - (pink_a[k] * pink_a[k])) * pink_scale;
+            pole_hz /= PinkPoleStep;
+        }
+    }
+
+    double SignalGenerator::TargetConductance(double t_s)
+    {
+        // Script is sorted, skip blows that are over.
+        while (script_cursor < script.size() && t_s >= script[script_cursor].start_s + script[script_cursor].duration_s) {++script_cursor;}
+        const bool bBlowing = script_cursor < script.size() && t_s >= script[script_cursor].start_s && script[script_cursor].bac > 0.0
+            && (cfg.dead_space_l <= 0.0 || t_s >= script[script_cursor].start_s + (cfg.dead_space_l / script[script_cursor].flow_lps));
+
+        double concentration = bBlowing ? MQ3::bac_to_concentration(script[script_cursor].bac) : 0.0;
+        if (cfg.ambient_mg_l > 0.0 || cfg.ambient_swing_mg_l > 0.0)
+        {
+            const double room_t_s = t_s - cfg.ambient_lag_s;
+            concentration += std::max(0.0, cfg.ambient_mg_l + (cfg.ambient_swing_mg_l * std::sin(2.0 * std::numbers::pi * room_t_s / cfg.ambient_period_s)));
+        }
+
+        // Vapor is sorted by start, the cursor moves past events that are over (they rarely overlap, and then only
+        // the later one's start holds the cursor back).
+        while (vapor_cursor < cfg.vapor.size() && t_s >= VaporEnd(cfg.vapor[vapor_cursor])) {++vapor_cursor;}
+        for (std::size_t v = vapor_cursor; v < cfg.vapor.size() && t_s >= cfg.vapor[v].start_s; ++v)
+        {
+            const VaporSpec& vapor = cfg.vapor[v];
+            const double since_s = t_s - vapor.start_s;
+            const double fall_at_s = vapor.rise_s + vapor.hold_s;
+            double level = 1.0;
+            if (since_s < vapor.rise_s) {level = since_s / vapor.rise_s;}
+            else if (since_s >= fall_at_s) {level = std::max(0.0, 1.0 - ((since_s - fall_at_s) / vapor.fall_s));}
+            concentration += vapor.mg_l * level;
+        }
+        if (concentration <= 0.0) {return air_conductance;}
+
+        // The fit keeps going up as C -> 0, the sensor doesn't read cleaner than clean air.
+        const double ratio = MQ3::concentration_to_ratio_exp(concentration);
+        return std::max(air_conductance, 1.0 / ratio);
+    }
+
+    bool SignalGenerator::Step(std::uint64_t t_us, Sample& out)
+    {
+        const double nominal_dt = 1.0 / cfg.sample_rate_hz;
+        const double dt_s = (index == 0 || t_us <= last_t_us) ? nominal_dt : static_cast<double>(t_us - last_t_us) * 1e-6;
+        last_t_us = std::max(last_t_us, t_us);
+        ++index;
+
+        // Jitter doesn't matter for the coefficients, only real gaps do.
+        if (std::abs(dt_s - coef_dt_s) > 0.05 * nominal_dt) {UpdateCoefficients(dt_s);}
+
+        const double t_s = static_cast<double>(t_us - std::min(t_us, cfg.start_us)) * 1e-6;
+
+        // Sensor
+        const double target = TargetConductance(t_s);
+        conductance += (target - conductance) * ((target > conductance) ? rise_k : decay_k);
+        clean_volts = MQ3::ratio_to_adc3v3(1.0 / conductance, cfg.RL, cfg.Ro_Air);
+
+        // Baseline wander + noise
+        walk += walk_sigma * Gaussian();
+        double pink_sum = 0.0;
+        for (std::size_t k = 0; k < PinkPoles; ++k)
+        {
+            pink[k] = (pink_a[k] * pink[k]) + (pink_b[k] * Gaussian());
+            pink_sum += pink[k];
+        }
+
+        const double volts = clean_volts
+            + (cfg.warmup_volts * std::exp(-t_s / cfg.warmup_tau_s))
+            + (cfg.drift_volts_per_hour * t_s / 3600.0) + walk
+            + pink_sum + (cfg.white_volts * Gaussian())
+            + (cfg.hum_volts * std::sin(2.0 * std::numbers::pi * cfg.hum_hz * t_s));
+
+        // ADS1115 conversion
+        auto raw = static_cast<std::int16_t>(std::clamp(std::lround(volts / AdcVoltsPerCode), -32768L, 32767L));
+
+        // I2C faults
+        const double fault = rng.uniform();
+        if (fault < cfg.drop_prob)
+        {
+            ++dropped;
+            return false;
+        }
+        if (fault < cfg.drop_prob + cfg.stale_prob) {raw = last_raw;}
+        else if (fault < cfg.drop_prob + cfg.stale_prob + cfg.rail_prob) {raw = ((rng.next() & 1U) != 0) ? std::int16_t{32767} : std::int16_t{0};}
+        last_raw = raw;
+
+        out.t_us = t_us;
+        out.raw = raw;
+        out.volts = static_cast<float>(static_cast<double>(raw) * AdcVoltsPerCode);
+        return true;
+    }
+
+    bool SignalGenerator::Next(Sample& out)
+    {
+        const double nominal_us = static_cast<double>(index) * 1e6 / cfg.sample_rate_hz;
+        const double jitter_us = (cfg.jitter_us > 0.0) ? cfg.jitter_us * Gaussian() : 0.0;
+        const auto t_us = cfg.start_us + static_cast<std::uint64_t>(std::max(0.0, nominal_us + jitter_us));
+        return Step(std::max(t_us, (index == 0) ? cfg.start_us : last_t_us + 1), out);
+    }
+
+    std::size_t SignalGenerator::Generate(std::vector<Sample>& out, std::size_t count)
+    {
+        const std::size_t before = out.size();
+        out.reserve(before + count);
+        Sample sample{};
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (Next(sample)) {out.push_back(sample);}
+        }
+        return out.size() - before;
+    }
+
+    bool SignalSource::sample_value(Sample& out) const
+    {
+        const auto now_us = static_cast<std::uint64_t>(SteadyClock::now().count());
+        if (t0_us == 0) {t0_us = now_us;}
+
+        // Model runs on session time, the sample carries the real stamp like Ads1115_Source.
+        if (!generator.Step(generator.GetConfig().start_us + (now_us - t0_us), out)) {return false;}
+        out.t_us = now_us;
+        ++produced;
+        return true;
+    }
+
+    double FlowSensorModel::Volts(const std::vector<BreathSpec>& script, double t_s)
+    {
+        constexpr double FlowRampS = 0.2; // Blows start and stop over this long, not as a step
+
+        double flow_lps = 0.0;
+        for (const BreathSpec& blow : script)
+        {
+            const double into = t_s - blow.start_s;
+            if (into < 0.0 || into > blow.duration_s) {continue;}
+            flow_lps = blow.flow_lps * std::min({1.0, into / FlowRampS, (blow.duration_s - into) / FlowRampS});
+            break;
+        }
+
+        // Sum of uniforms is gaussian enough for sensor noise.
+        double noise = -2.0;
+        for (int i = 0; i < 4; ++i)
+        {
+            noise_state ^= noise_state << 13;
+            noise_state ^= noise_state >> 7;
+            noise_state ^= noise_state << 17;
+            noise += static_cast<double>(noise_state >> 11) * 0x1.0p-53;
+        }
+
+        const Flow_Config flow{};
+        return FlowToAdcVolts(flow, zero_volts + (noise * std::sqrt(3.0) * noise_volts), flow_lps);
+    }
+}
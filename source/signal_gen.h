@@ -0,0 +1,184 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "config_settings.h"
+#include "flow_gate.h"
+#include "sampler.h"
+
+// Synthetic MQ-3 sessions so the analyzers can be exercised without someone blowing into the jug.
+//
+// Signal path per sample:
+//   scripted BAC -> mg/L (+ room ambient) -> Rs/R0 (inverse of calculate_concentration_exp, capped at clean air)
+//   -> sensor conductance through a first order rise/decay -> ADC volts through the RL / divider chain
+//   + heater warmup + baseline drift/random walk + 1/f + white noise + mains hum
+//   -> ADS1115 quantization (FS 4.096V) -> I2C glitches (dropped, stale or railed reads)
+// Everything is seeded so a session is reproducible, and a day at 128 Hz generates in a few seconds.
+namespace DrunkAPI
+{
+    // One scripted blow, times relative to the start of the session.
+    struct BreathSpec
+    {
+        double start_s = 0.0;
+        double duration_s = 3.0;
+        double bac = 0.05; // Ground truth BAC of the breath
+        double flow_lps = 0.5; // Through the mouthpiece (flow sensor emulation, dead_space_l)
+    };
+
+    // Alcohol vapor that reaches the sensor without anyone blowing (a door letting in a bar's air, a spilled drink next
+    // to the jug). Ramps up over rise_s, holds, then ramps back down over fall_s. Never labeled, these are the false
+    // triggers drunk_tune / drunk_train score against.
+    struct VaporSpec
+    {
+        double start_s = 0.0;
+        double mg_l = 3e-6; // Already ~0.6V over clean air on the power law fit
+        double rise_s = 8.0;
+        double hold_s = 10.0;
+        double fall_s = 30.0;
+    };
+
+    struct Signal_Config
+    {
+        std::uint64_t seed = 1;
+        std::uint64_t start_us = 1'000'000; // t_us of the first sample, steady_clock like
+        double sample_rate_hz = Config::SampleRate_Hz;
+        double jitter_us = 50.0; // Sampler wakeup jitter (gaussian sigma)
+
+        // Sensor
+        double baseline_volts = 1.1876; // Clean air ADC volts (what the 18.9L jug reads)
+        double rise_tau_s = Config::Mq3RiseTau_s; // Conductance time constants towards more / less alcohol
+        double decay_tau_s = 12.0;
+        double RL = Config::RLoad;
+        double Ro_Air = Config::Ro_Air;
+
+        // Heater warmup after power on, decays away exponentially
+        double warmup_volts = 0.25;
+        double warmup_tau_s = 90.0;
+
+        // Baseline wander
+        double drift_volts_per_hour = 0.005;
+        double random_walk_volts = 0.002; // sigma after one hour
+
+        // Noise
+        double white_volts = 0.0004; // sigma
+        double pink_volts = 0.0003; // sigma of the 1/f part
+        double hum_volts = 0.0002; // Mains pickup amplitude
+        double hum_hz = 50.0;
+
+        // Alcohol vapor in the room (hand sanitizer, an open drink), every sensor in it sees this on top of any blow.
+        // ambient + swing * sin(2 pi t / period), the lag is how much later this sensor gets the room's air.
+        double ambient_mg_l = 0.0;
+        double ambient_swing_mg_l = 0.0;
+        double ambient_period_s = 600.0;
+        double ambient_lag_s = 0.0;
+
+        // Vapor events on top of the ambient, any order
+        std::vector<VaporSpec> vapor{};
+
+        // Mouth/airway air that comes out ahead of the lung air in every blow, no alcohol in it. 0 = lung air from the start
+        double dead_space_l = 0.0;
+
+        // I2C faults, per sample probabilities
+        double drop_prob = 1e-4; // Read failed, no sample
+        double stale_prob = 1e-4; // Previous conversion returned again
+        double rail_prob = 2e-5; // Garbage read, code railed to 0 or full scale
+    };
+
+    // Evenly spaced blows, cycling through `bacs`.
+    std::vector<BreathSpec> MakeBreathScript(double session_s, double every_s, const std::vector<double>& bacs, double blow_s, double first_s);
+
+    // Evenly spaced vapor events, cycling through `mg_l` and `rise_s` independently.
+    std::vector<VaporSpec> MakeVaporScript(double session_s, double every_s, const std::vector<double>& mg_l, const std::vector<double>& rise_s, double first_s);
+
+    class SignalGenerator final
+    {
+        public:
+            explicit SignalGenerator(Signal_Config in_cfg = {}, std::vector<BreathSpec> in_script = {});
+
+            // Model at t_us (must not go backwards). False when an I2C glitch ate the read.
+            bool Step(std::uint64_t t_us, Sample& out);
+
+            // Next sample on the nominal schedule (+ jitter).
+            bool Next(Sample& out);
+
+            // Appends `count` scheduled reads worth of samples (fewer if some were dropped), returns how many.
+            std::size_t Generate(std::vector<Sample>& out, std::size_t count);
+
+            // Noise free sensor volts of the last step, handy for plots / labels.
+            double CleanVolts() const noexcept { return clean_volts; }
+            const std::vector<BreathSpec>& Script() const noexcept { return script; }
+            const Signal_Config& GetConfig() const noexcept { return cfg; }
+            std::uint64_t Dropped() const noexcept { return dropped; }
+
+        private:
+            static constexpr std::size_t PinkPoles = 8;
+
+            struct Rng
+            {
+                std::uint64_t state[4];
+                std::uint64_t next();
+                double uniform(); // [0, 1)
+            };
+
+            double Gaussian();
+            double TargetConductance(double t_s);
+            void UpdateCoefficients(double dt_s);
+
+            Signal_Config cfg;
+            std::vector<BreathSpec> script;
+            Rng rng{};
+
+            double air_conductance = 0.0; // 1 / (Rs/R0) in clean air
+            double conductance = 0.0;
+            double walk = 0.0;
+            std::array<double, PinkPoles> pink{};
+            double pink_scale = 0.0; // Per pole sigma
+            bool bHaveSpare = false;
+            double spare = 0.0;
+
+            // Per dt coefficients, recomputed only when dt changes
+            double coef_dt_s = -1.0;
+            double rise_k = 0.0;
+            double decay_k = 0.0;
+            double walk_sigma = 0.0;
+            std::array<double, PinkPoles> pink_a{}; // AR(1) pole
+            std::array<double, PinkPoles> pink_b{}; // Innovation gain keeping each pole at pink_scale
+
+            std::size_t script_cursor = 0;
+            std::size_t vapor_cursor = 0;
+            std::uint64_t last_t_us = 0;
+            std::uint64_t index = 0;
+            std::uint64_t dropped = 0;
+            std::int16_t last_raw = 0;
+            double clean_volts = 0.0;
+    };
+
+    // Mouthpiece pressure sensor for the ADC emulators, blowing along with a breath script (BreathSpec::flow_lps).
+    class FlowSensorModel final
+    {
+        public:
+            FlowSensorModel(double in_zero_volts, double in_noise_volts) : zero_volts(in_zero_volts), noise_volts(in_noise_volts) {}
+
+            // ADC pin volts at session time t_s.
+            double Volts(const std::vector<BreathSpec>& script, double t_s);
+
+        private:
+            double zero_volts; // Sensor output at 0 Pa
+            double noise_volts; // sigma, at the sensor
+            std::uint64_t noise_state = 0x9E3779B97F4A7C15ULL;
+    };
+
+    // Plugs a generator into Sampler<Source> in place of Ads1115_Source, stamped with the steady clock.
+    struct SignalSource
+    {
+        mutable SignalGenerator generator;
+        mutable std::uint64_t produced = 0;
+        mutable std::uint64_t t0_us = 0; // Steady clock at the first read = session time 0
+
+        explicit SignalSource(Signal_Config cfg = {}, std::vector<BreathSpec> script = {}) : generator(cfg, std::move(script)) {}
+
+        bool sample_value(Sample& out) const;
+    };
+}
@@ -0,0 +1,63 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <linux/spi/spidev.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include "spi_adc.h"
+
+namespace DrunkAPI {
+
+    SpiBus::~SpiBus()
+    {
+        if (fd >= 0) {close(fd);}
+    }
+
+    bool SpiBus::Init(const char* device, std::uint32_t speed_hz)
+    {
+        fd = open(device, O_RDWR);
+        if (fd < 0)
+        {
+            std::perror(fmt::format("Error: Unable to open {}", device).c_str());
+            return false;
+        }
+
+        std::uint8_t mode = SPI_MODE_0; // MCP3208 and ADS8688 both take mode 0 (and 3)
+        std::uint8_t bits = 8;
+        if (ioctl(fd, SPI_IOC_WR_MODE, &mode) < 0 || ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+            ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed_hz) < 0)
+        {
+            std::perror(fmt::format("Error: Unable to set up {}", device).c_str());
+            close(fd);
+            fd = -1;
+            return false;
+        }
+
+        // What the controller will actually do, the Pi divides its core clock down so it can come back lower.
+        std::uint32_t actual_hz = speed_hz;
+        if (ioctl(fd, SPI_IOC_RD_MAX_SPEED_HZ, &actual_hz) < 0) {actual_hz = speed_hz;}
+        speed = actual_hz;
+
+        fmt::print("Hardware Init: {} at {} Hz\n", device, speed);
+        return true;
+    }
+
+    bool SpiBus::Transfer(spi_ioc_transfer* xfers, std::size_t n) const
+    {
+        if (fd < 0 || n == 0) {return false;}
+
+        // SPI_IOC_MESSAGE(n) builds a char[] type out of n, spelled out here so n doesn't have to be a constant.
+        // speed_hz = 0 in the transfers, they run at the max speed Init set.
+        const auto request = _IOC(_IOC_WRITE, SPI_IOC_MAGIC, 0, SPI_MSGSIZE(n));
+
+        // No print here, this runs every tick. The source reports a run of failures once (SpiAdcSource::sample_block).
+        if (ioctl(fd, request, xfers) < 0)
+        {
+            last_error = errno;
+            return false;
+        }
+        return true;
+    }
+}
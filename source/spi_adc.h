@@ -0,0 +1,325 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <vector>
+#include <fmt/core.h>
+#include <linux/spi/spidev.h>
+#include "clock.h"
+#include "config_settings.h"
+#include "sampler.h"
+#include "spsc.h"
+
+// SPI ADCs for when the ADS1115 runs out: one conversion is a single full duplex frame instead of a config write,
+// OS polls and a register read, and nothing is muxed behind a data rate. Every channel of a tick (MQ-3, reference,
+// flow, burst_depth times over) goes out as one SPI_IOC_MESSAGE ioctl, so the whole burst costs one syscall and
+// one timestamp. Frames are placed back from that stamp by the bus clock, the host never sees them separately.
+//
+// Chip is the frame codec (Mcp3208, Ads8688 below), Bus is SpiBus on the Pi or SpiAdcEmu (spi_adc_emu.h) anywhere
+// else. Both take the same spi_ioc_transfer array.
+namespace DrunkAPI
+{
+    // 12 bit, 8 channels, VREF = the Pi's 3V3. Frame = 5 zeros, start, SGL, D2 | D1 D0, sample, null, B11..B8 |
+    // B7..B0. The result comes back in the frame that asked for it.
+    struct Mcp3208
+    {
+        static constexpr const char* Name = "MCP3208";
+        static constexpr std::uint8_t Channels = 8;
+        static constexpr std::size_t FrameBytes = 3;
+        static constexpr bool bPipelined = false;
+        static constexpr double SamplePoint = 0.3; // Sample and hold closes ~7 clocks into the 24
+        static constexpr std::uint16_t FrameGapUs = 0;
+        static constexpr std::uint32_t MaxClockHz = 2'000'000; // At 5V, 1MHz at 2.7V
+        static constexpr double FullScaleVolts = 3.3;
+        static constexpr std::uint32_t Codes = 4096;
+
+        static void Command(std::uint8_t channel, std::uint8_t* tx)
+        {
+            tx[0] = static_cast<std::uint8_t>(0x06U | ((channel >> 2) & 0x01U));
+            tx[1] = static_cast<std::uint8_t>((channel & 0x03U) << 6);
+            tx[2] = 0;
+        }
+
+        // Channel a frame converts, Channels when it isn't a conversion.
+        static std::uint8_t CommandChannel(const std::uint8_t* tx)
+        {
+            if ((tx[0] & 0x06U) != 0x06U) {return Channels;}
+            return static_cast<std::uint8_t>(((tx[0] & 0x01U) << 2) | (tx[1] >> 6));
+        }
+
+        static std::uint16_t Decode(const std::uint8_t* rx) { return static_cast<std::uint16_t>(((rx[1] & 0x0FU) << 8) | rx[2]); }
+
+        static void Encode(std::uint16_t code, std::uint8_t* rx)
+        {
+            rx[0] = 0;
+            rx[1] = static_cast<std::uint8_t>((code >> 8) & 0x0FU);
+            rx[2] = static_cast<std::uint8_t>(code & 0xFFU);
+        }
+
+        static std::int16_t Raw(std::uint16_t code) { return static_cast<std::int16_t>(code); }
+    };
+
+    // 16 bit, 8 channels, 500 kSPS. Frame = 16 bit command, then the previous frame's conversion in the last 16
+    // clocks, so a burst ends with one no-op frame to clock the last result out. Inputs are set to 0..1.25 x VREF
+    // (0..5.12V) by Setup, the power on range is +-10.24V.
+    struct Ads8688
+    {
+        static constexpr const char* Name = "ADS8688";
+        static constexpr std::uint8_t Channels = 8;
+        static constexpr std::size_t FrameBytes = 4;
+        static constexpr bool bPipelined = true;
+        static constexpr double SamplePoint = 1.0; // Conversion starts as CS goes up
+        static constexpr std::uint16_t FrameGapUs = 1; // Covers the 850ns conversion before the next frame
+        static constexpr std::uint32_t MaxClockHz = 17'000'000;
+        static constexpr double FullScaleVolts = 5.12;
+        static constexpr std::uint32_t Codes = 65536;
+
+        static constexpr std::uint8_t RangeRegister = 0x05; // Channel 0's, the other seven follow it
+        static constexpr std::uint8_t RangeUnipolar1_25 = 0x06;
+
+        // MAN_Ch_n = 0xC000 | n << 10
+        static void Command(std::uint8_t channel, std::uint8_t* tx)
+        {
+            tx[0] = static_cast<std::uint8_t>(0xC0U | ((channel & 0x07U) << 2));
+            tx[1] = tx[2] = tx[3] = 0;
+        }
+
+        static void NoOp(std::uint8_t* tx) { tx[0] = tx[1] = tx[2] = tx[3] = 0; }
+
+        // Program register write: address << 9 | 1 << 8 | value
+        static void RegisterWrite(std::uint8_t address, std::uint8_t value, std::uint8_t* tx)
+        {
+            tx[0] = static_cast<std::uint8_t>((address << 1) | 0x01U);
+            tx[1] = value;
+            tx[2] = tx[3] = 0;
+        }
+
+        // Inverse of RegisterWrite, for the emulator.
+        static bool RegisterWritten(const std::uint8_t* tx, std::uint8_t& address, std::uint8_t& value)
+        {
+            if ((tx[0] & 0x01U) == 0U || tx[0] >= 0x80U) {return false;}
+            address = static_cast<std::uint8_t>(tx[0] >> 1);
+            value = tx[1];
+            return true;
+        }
+
+        static std::uint8_t CommandChannel(const std::uint8_t* tx)
+        {
+            if ((tx[0] & 0xE3U) != 0xC0U) {return Channels;}
+            return static_cast<std::uint8_t>((tx[0] >> 2) & 0x07U);
+        }
+
+        static std::uint16_t Decode(const std::uint8_t* rx) { return static_cast<std::uint16_t>((rx[2] << 8) | rx[3]); }
+
+        static void Encode(std::uint16_t code, std::uint8_t* rx)
+        {
+            rx[0] = rx[1] = 0;
+            rx[2] = static_cast<std::uint8_t>(code >> 8);
+            rx[3] = static_cast<std::uint8_t>(code & 0xFFU);
+        }
+
+        // Halved so it stays positive in an int16 like the ADS1115's single ended codes.
+        static std::int16_t Raw(std::uint16_t code) { return static_cast<std::int16_t>(code >> 1); }
+    };
+
+    // /dev/spidevB.C
+    class SpiBus final
+    {
+        public:
+            SpiBus() = default;
+            ~SpiBus();
+
+            SpiBus(const SpiBus&) = delete;
+            SpiBus& operator=(const SpiBus&) = delete;
+            SpiBus(SpiBus&&) = delete;
+            SpiBus& operator=(SpiBus&&) = delete;
+
+            bool Init(const char* device, std::uint32_t speed_hz);
+
+            // Every transfer in one SPI_IOC_MESSAGE, CS goes up between the ones with cs_change set.
+            bool Transfer(spi_ioc_transfer* xfers, std::size_t n) const;
+
+            std::uint32_t SpeedHz() const noexcept { return speed; }
+            int LastError() const noexcept { return last_error; } // errno of the last failed Transfer
+
+        private:
+            int fd = -1;
+            std::uint32_t speed = 0;
+            mutable int last_error = 0;
+    };
+
+    struct SpiAdc_Config
+    {
+        std::uint8_t channel = 0; // MQ-3
+        int reference_channel = Config::ReferenceChannel; // -1 = none
+        int flow_channel = Config::FlowChannel; // -1 = none
+        std::size_t burst_depth = Config::SpiBurstDepth; // Conversions per channel per sampler tick
+    };
+
+    // Sampler source for an SPI ADC. Same reference / flow members as ReferencePairSource and FlowMuxSource, so
+    // SystemInit attaches the lanes the same way, they just fill from the same burst as the main channel.
+    template<class Chip, class Bus, std::size_t RingN = Config::RingSize>
+    struct SpiAdcSource
+    {
+        Bus& bus;
+        std::size_t burst_depth;
+
+        std::optional<std::uint8_t> reference; // Channel, empty = no reference
+        mutable SpscRing<Sample, RingN> reference_lane;
+
+        std::optional<std::uint8_t> flow;
+        std::size_t flow_reads = 0; // Per tick, one per burst row
+        mutable SpscRing<Sample, RingN> flow_lane;
+
+        SpiAdcSource(Bus& bus_in, const SpiAdc_Config& cfg)
+            : bus(bus_in), burst_depth(std::clamp<std::size_t>(cfg.burst_depth, 1, Config::SpiMaxBurstDepth))
+        {
+            channels[lanes++] = cfg.channel;
+            if (cfg.reference_channel >= 0 && cfg.reference_channel < Chip::Channels)
+            {
+                reference = static_cast<std::uint8_t>(cfg.reference_channel);
+                reference_at = lanes;
+                channels[lanes++] = *reference;
+            }
+            if (cfg.flow_channel >= 0 && cfg.flow_channel < Chip::Channels)
+            {
+                flow = static_cast<std::uint8_t>(cfg.flow_channel);
+                flow_at = lanes;
+                channels[lanes++] = *flow;
+                flow_reads = burst_depth;
+            }
+            // Lanes are routed by position, so a channel given twice still fills both, it's just read twice.
+            for (std::size_t lane = 1; lane < lanes; ++lane)
+            {
+                const std::uint8_t* before = channels.data();
+                if (std::find(before, before + lane, channels[lane]) != before + lane)
+                {
+                    fmt::print(stderr, "Warning: {} CH{} is configured for more than one sensor, they'll all read the same input\n", Chip::Name, channels[lane]);
+                }
+            }
+
+            // Row after row of lanes, then the pipelined chips' flush frame. Built once, every burst reuses it.
+            const std::size_t conversions = burst_depth * lanes;
+            const std::size_t frames = conversions + (Chip::bPipelined ? 1 : 0);
+            tx.assign(frames * Chip::FrameBytes, 0);
+            rx.assign(frames * Chip::FrameBytes, 0);
+            xfers.assign(frames, spi_ioc_transfer{});
+            for (std::size_t f = 0; f < frames; ++f)
+            {
+                if (f < conversions) {Chip::Command(channels[f % lanes], &tx[f * Chip::FrameBytes]);}
+                else if constexpr (Chip::bPipelined) {Chip::NoOp(&tx[f * Chip::FrameBytes]);}
+
+                xfers[f] = MakeTransfer(&tx[f * Chip::FrameBytes], &rx[f * Chip::FrameBytes], Chip::FrameBytes, f + 1 < frames);
+            }
+        }
+
+        SpiAdcSource(const SpiAdcSource&) = delete;
+        SpiAdcSource& operator=(const SpiAdcSource&) = delete;
+
+        // Chip setup after the bus is up (the ADS8688's input ranges), nothing to do for the MCP3208.
+        bool Setup() const
+        {
+            if constexpr (requires (std::uint8_t* buf) { Chip::RegisterWrite(Chip::RangeRegister, Chip::RangeUnipolar1_25, buf); })
+            {
+                std::vector<std::uint8_t> setup_tx(lanes * Chip::FrameBytes, 0);
+                std::vector<std::uint8_t> setup_rx(setup_tx.size(), 0);
+                std::vector<spi_ioc_transfer> setup(lanes);
+                for (std::size_t i = 0; i < lanes; ++i)
+                {
+                    Chip::RegisterWrite(static_cast<std::uint8_t>(Chip::RangeRegister + channels[i]), Chip::RangeUnipolar1_25, &setup_tx[i * Chip::FrameBytes]);
+                    setup[i] = MakeTransfer(&setup_tx[i * Chip::FrameBytes], &setup_rx[i * Chip::FrameBytes], Chip::FrameBytes, i + 1 < lanes);
+                }
+                return bus.Transfer(setup.data(), setup.size());
+            }
+            return true;
+        }
+
+        // One burst: burst_depth main samples into out, the reference / flow rows straight into their lanes.
+        std::size_t sample_block(Sample* out, std::size_t max) const
+        {
+            if (max < burst_depth) {return 0;}
+
+            // A dead bus fails every tick, so it's one warning when a run of failures starts and one when it's over.
+            if (!bus.Transfer(xfers.data(), xfers.size()))
+            {
+                ++failed;
+                if (failed_run++ == 0)
+                {
+                    const char* reason = "transfer failed";
+                    if constexpr (requires { bus.LastError(); }) {reason = std::strerror(bus.LastError());}
+                    fmt::print(stderr, "Warning: SPI burst failed ({}), quiet until the bus is back\n", reason);
+                }
+                return 0;
+            }
+            if (failed_run != 0)
+            {
+                fmt::print(stderr, "Warning: SPI back after {} failed bursts ({} this session)\n", failed_run, failed);
+                failed_run = 0;
+            }
+            const auto end_us = static_cast<std::uint64_t>(SteadyClock::now().count());
+            ++bursts;
+
+            // Stamped once, when the ioctl came back. Frame f sat (frames - f - SamplePoint) frame times before that.
+            const double frame_us = static_cast<double>(Chip::FrameBytes * 8U) * 1e6 / static_cast<double>(bus.SpeedHz()) + Chip::FrameGapUs;
+            const auto frames = static_cast<double>(xfers.size());
+            constexpr std::size_t ResultShift = Chip::bPipelined ? 1 : 0;
+
+            for (std::size_t row = 0; row < burst_depth; ++row)
+            {
+                for (std::size_t lane = 0; lane < lanes; ++lane)
+                {
+                    const std::size_t f = (row * lanes) + lane;
+                    const double back_us = (frames - static_cast<double>(f) - Chip::SamplePoint) * frame_us;
+                    const std::uint16_t code = Chip::Decode(&rx[(f + ResultShift) * Chip::FrameBytes]);
+
+                    Sample sample{};
+                    sample.t_us = end_us - std::min(end_us, static_cast<std::uint64_t>(back_us));
+                    sample.raw = Chip::Raw(code);
+                    sample.volts = static_cast<float>(static_cast<double>(code) * Chip::FullScaleVolts / static_cast<double>(Chip::Codes));
+
+                    if (lane == 0) {out[row] = sample;}
+                    else if (lane == reference_at) {reference_block[row] = sample;}
+                    else if (lane == flow_at) {flow_block[row] = sample;}
+                }
+            }
+
+            if (reference) {reference_lane.push_overwrite_batch(reference_block.data(), burst_depth);}
+            if (flow) {flow_lane.push_overwrite_batch(flow_block.data(), burst_depth);}
+            return burst_depth;
+        }
+
+        std::uint64_t Bursts() const noexcept { return bursts; }
+        std::uint64_t Failed() const noexcept { return failed; }
+
+        private:
+            static spi_ioc_transfer MakeTransfer(std::uint8_t* tx_buf, std::uint8_t* rx_buf, std::size_t len, bool bMore)
+            {
+                spi_ioc_transfer xfer{};
+                xfer.tx_buf = reinterpret_cast<std::uintptr_t>(tx_buf);
+                xfer.rx_buf = reinterpret_cast<std::uintptr_t>(rx_buf);
+                xfer.len = static_cast<std::uint32_t>(len);
+                xfer.bits_per_word = 8;
+                xfer.delay_usecs = bMore ? Chip::FrameGapUs : 0;
+                xfer.cs_change = bMore ? 1 : 0; // Every conversion is its own CS low, the last one lets CS go by itself
+                return xfer;
+            }
+
+            std::array<std::uint8_t, 3> channels{};
+            std::size_t lanes = 0;
+            std::size_t reference_at = 0; // Lane of the reference / flow channel, 0 (the MQ-3's) = not attached
+            std::size_t flow_at = 0;
+
+            // Sampler thread only past construction
+            std::vector<std::uint8_t> tx;
+            mutable std::vector<std::uint8_t> rx;
+            mutable std::vector<spi_ioc_transfer> xfers;
+            mutable std::array<Sample, Config::SpiMaxBurstDepth> reference_block{};
+            mutable std::array<Sample, Config::SpiMaxBurstDepth> flow_block{};
+            mutable std::uint64_t bursts = 0;
+            mutable std::uint64_t failed = 0;
+            mutable std::uint64_t failed_run = 0; // Failed in a row, 0 = the last burst went through
+    };
+}
@@ -0,0 +1,120 @@
+#include "spi_adc_emu.h"
+#include "clock.h"
+#include <algorithm>
+#include <cmath>
+#include <fmt/core.h>
+#include <utility>
+
+namespace DrunkAPI
+{
+    template<class Chip>
+    SpiAdcEmu<Chip>::SpiAdcEmu(SpiAdcEmu_Config in_cfg, Signal_Config signal, std::vector<BreathSpec> script, Signal_Config reference_signal)
+        : cfg(in_cfg), generator(signal, std::move(script)), reference_generator(reference_signal), flow_sensor(in_cfg.flow_zero_volts, in_cfg.flow_noise_volts) {}
+
+    template<class Chip>
+    bool SpiAdcEmu<Chip>::Init(const char* device, std::uint32_t speed_hz)
+    {
+        if (speed_hz == 0)
+        {
+            fmt::print(stderr, "Error: {} emulator needs a clock\n", Chip::Name);
+            return false;
+        }
+
+        speed = speed_hz;
+        bInit = true;
+        fmt::print("Hardware Init: {} Emulator on {} at {} Hz\n", Chip::Name, device, speed);
+        return true;
+    }
+
+    template<class Chip>
+    std::uint16_t SpiAdcEmu<Chip>::Convert(std::uint8_t channel, std::uint64_t t_us) const
+    {
+        if (t0_us == 0) {t0_us = t_us;}
+        const std::uint64_t since_us = t_us - std::min(t_us, t0_us);
+
+        double volts = 0.0;
+        const bool bMain = channel == 0;
+        const bool bReference = !bMain && cfg.reference_channel == channel;
+        if (bMain || bReference)
+        {
+            // No NACK on SPI, a read the model drops just comes back as the last code again.
+            SignalGenerator& source = bMain ? generator : reference_generator;
+            Sample sample{};
+            if (!source.Step(source.GetConfig().start_us + since_us, sample)) {return last_code[channel];}
+            volts = static_cast<double>(sample.volts);
+        }
+        else if (cfg.flow_channel == channel)
+        {
+            volts = flow_sensor.Volts(generator.Script(), static_cast<double>(since_us) / 1'000'000.0);
+        }
+
+        // ADS8688 powers up at +-2.5 x VREF, Setup moves it to 0..1.25 x VREF.
+        double low = 0.0;
+        double span = Chip::FullScaleVolts;
+        if constexpr (Chip::bPipelined)
+        {
+            if (!range_set[channel])
+            {
+                low = -10.24;
+                span = 20.48;
+            }
+        }
+
+        const auto codes = static_cast<long>(Chip::Codes);
+        const auto code = static_cast<std::uint16_t>(std::clamp(std::lround((volts - low) * static_cast<double>(codes) / span), 0L, codes - 1));
+        last_code[channel] = code;
+        ++conversions;
+        return code;
+    }
+
+    template<class Chip>
+    bool SpiAdcEmu<Chip>::Transfer(spi_ioc_transfer* xfers, std::size_t n) const
+    {
+        if (!bInit || n == 0) {return false;}
+
+        // The message is clocked out back to back from when the ioctl gets the bus.
+        const auto start_us = static_cast<std::uint64_t>(SteadyClock::now().count());
+        const double bit_us = 1e6 / static_cast<double>(speed);
+        double at_us = 0.0;
+
+        for (std::size_t f = 0; f < n; ++f)
+        {
+            const spi_ioc_transfer& xfer = xfers[f];
+            const auto* tx = reinterpret_cast<const std::uint8_t*>(static_cast<std::uintptr_t>(xfer.tx_buf));
+            auto* rx = reinterpret_cast<std::uint8_t*>(static_cast<std::uintptr_t>(xfer.rx_buf));
+            const double frame_us = static_cast<double>(xfer.len) * 8.0 * bit_us;
+
+            if (xfer.len >= Chip::FrameBytes)
+            {
+                const std::uint8_t channel = Chip::CommandChannel(tx);
+                const auto sampled_us = start_us + static_cast<std::uint64_t>(at_us + (Chip::SamplePoint * frame_us));
+
+                if constexpr (Chip::bPipelined)
+                {
+                    // This frame shifts out what the last one started, and starts its own as CS goes up.
+                    Chip::Encode(pipelined_code, rx);
+                    std::uint8_t address = 0;
+                    std::uint8_t value = 0;
+                    if (channel < Chip::Channels) {pipelined_code = Convert(channel, sampled_us);}
+                    else if (Chip::RegisterWritten(tx, address, value) && address >= Chip::RangeRegister && address < Chip::RangeRegister + Chip::Channels)
+                    {
+                        range_set[address - Chip::RangeRegister] = value == Chip::RangeUnipolar1_25;
+                    }
+                }
+                else
+                {
+                    Chip::Encode(channel < Chip::Channels ? Convert(channel, sampled_us) : std::uint16_t{0}, rx);
+                }
+            }
+
+            at_us += frame_us + xfer.delay_usecs;
+        }
+
+        ++bursts;
+        if (cfg.bRealTime) {SteadyClock::sleep_for(std::chrono::microseconds(std::llround(at_us)));}
+        return true;
+    }
+
+    template class SpiAdcEmu<Mcp3208>;
+    template class SpiAdcEmu<Ads8688>;
+}
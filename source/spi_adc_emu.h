@@ -0,0 +1,67 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <linux/spi/spidev.h>
+#include "signal_gen.h"
+#include "spi_adc.h"
+
+// Frame level stand in for an SPI ADC behind spidev, so SpiAdcSource runs off the Pi. Same Transfer() as SpiBus:
+// every frame's command is decoded and answered the way the chip would (the ADS8688 a frame late), each conversion
+// sampled at the time its frame would have been on the wire. CH0 is the SignalGenerator's MQ-3, the reference and
+// flow channels get the same models Ads1115Emu uses, the rest are grounded.
+namespace DrunkAPI
+{
+    struct SpiAdcEmu_Config
+    {
+        bool bRealTime = true; // Sleep out the bus time of every burst like the ioctl would
+
+        int reference_channel = -1; // -1 = grounded
+        int flow_channel = -1;
+        double flow_zero_volts = 2.52;
+        double flow_noise_volts = 0.003;
+    };
+
+    template<class Chip>
+    class SpiAdcEmu final
+    {
+        public:
+            explicit SpiAdcEmu(SpiAdcEmu_Config in_cfg = {}, Signal_Config signal = {}, std::vector<BreathSpec> script = {}, Signal_Config reference_signal = {});
+
+            SpiAdcEmu(const SpiAdcEmu&) = delete;
+            SpiAdcEmu& operator=(const SpiAdcEmu&) = delete;
+            SpiAdcEmu(SpiAdcEmu&&) = delete;
+            SpiAdcEmu& operator=(SpiAdcEmu&&) = delete;
+
+            bool Init(const char* device, std::uint32_t speed_hz);
+            bool Transfer(spi_ioc_transfer* xfers, std::size_t n) const;
+            std::uint32_t SpeedHz() const noexcept { return speed; }
+
+            std::uint64_t Conversions() const noexcept { return conversions; }
+            std::uint64_t Bursts() const noexcept { return bursts; }
+            const SignalGenerator& Generator() const noexcept { return generator; }
+
+        private:
+            std::uint16_t Convert(std::uint8_t channel, std::uint64_t t_us) const;
+
+            SpiAdcEmu_Config cfg;
+            std::uint32_t speed = 0;
+            bool bInit = false;
+
+            // Chip state, mutated through the const bus handle like SpiBus's fd.
+            mutable SignalGenerator generator;
+            mutable SignalGenerator reference_generator;
+            mutable FlowSensorModel flow_sensor;
+            mutable std::array<std::uint16_t, Chip::Channels> last_code{}; // Held when the model drops a read
+            mutable std::array<bool, Chip::Channels> range_set{}; // ADS8688 input range programmed, +-10.24V until then
+            mutable std::uint16_t pipelined_code = 0; // Conversion the next frame clocks out
+            mutable std::uint64_t t0_us = 0;
+            mutable std::uint64_t conversions = 0;
+            mutable std::uint64_t bursts = 0;
+    };
+
+    extern template class SpiAdcEmu<Mcp3208>;
+    extern template class SpiAdcEmu<Ads8688>;
+}
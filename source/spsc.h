@@ -49,7 +49,27 @@ public:
         return !overwriten;
     }
 
-    bool pop(T& out) 
+    // A block published with one head store, the consumer sees all of it or none. Makes room by dropping the oldest
+    // like push_overwrite, returns how many went. n must be below N.
+    size_t push_overwrite_batch(const T* values, size_t n)
+    {
+        const auto head = head_.load(std::memory_order_relaxed);
+        const auto tail = tail_.load(std::memory_order_acquire);
+        const size_t room = (N - 1) - ((head - tail) & (N - 1));
+
+        size_t overwritten = 0;
+        if (n > room)
+        {
+            overwritten = n - room;
+            tail_.store((tail + overwritten) & (N - 1), std::memory_order_release);
+        }
+
+        for (size_t i = 0; i < n; ++i) {ring_buffer_[(head + i) & (N - 1)] = values[i];}
+        head_.store((head + n) & (N - 1), std::memory_order_release);
+        return overwritten;
+    }
+
+    bool pop(T& out)
     {
         const auto tail = tail_.load(std::memory_order_relaxed);
 
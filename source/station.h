@@ -0,0 +1,452 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fmt/core.h>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "clock.h"
+#include "config_settings.h"
+#include "gpio_lines.h"
+#include "led_controller.h"
+#include "process_runner.h"
+#include "processor_types.h"
+#include "sampler.h"
+#include "spsc.h"
+#include "stream_executor.h"
+
+// Station mode: N independent MQ-3 pipelines in one process, for a kiosk with several mouthpieces.
+//
+//   bus thread (one per I2C bus) --> SpscRing per sensor --> RuntimeProcess per sensor, drained on a small pool
+//
+// Sensors on the same bus are read back to back by that bus's thread (the bus is shared anyway), each into its own
+// ring. Each sensor's drain is a stream on a StreamExecutor (stream_executor.h): scheduled on its home worker when its
+// ring has data, never queued twice, so a slow pipeline only ever delays itself.
+//
+// Each pipeline is its own cache line aligned block, with the bus thread's counters and the consumer's state on
+// separate lines, so sensors don't bounce each other's lines around and the bus thread doesn't bounce the consumer's.
+//
+// A sensor that keeps failing reads (or sits on a rail) is benched: its bus thread only sends it one probe read per
+// retry period and its LEDs blink red, the rest of the station carries on. When a probe comes back good the sensor gets
+// a fresh analyzer, its old baseline is meaningless after an unplug so it goes back through warmup.
+namespace DrunkAPI
+{
+    // Pi 4/5 (Cortex-A72/A76) and x86 both use 64 byte lines.
+    inline constexpr std::size_t CacheLine = 64;
+
+    enum class SensorHealth : std::uint8_t { Ok, Faulted };
+
+    struct Station_Config
+    {
+        std::size_t analyzer_threads = Config::StationAnalyzerThreads;
+        std::chrono::nanoseconds sample_period{Config::SamplePeriod}; // Per bus, every sensor on it is read once a period
+        Consumer_Config consumer{};
+
+        std::uint32_t fault_after_failures = Config::StationFaultReads;
+        std::uint32_t fault_after_railed = Config::StationRailReads;
+        std::chrono::microseconds retry_after{Config::StationRetry};
+    };
+
+    struct Sensor_Config
+    {
+        std::string name;
+        std::size_t bus = 0; // Sensors with the same bus id share a sampler thread
+        Analyzer_Config analyzer{};
+        BreathAnalyzer_Config breath{};
+    };
+
+    struct SensorStats
+    {
+        SensorHealth health = SensorHealth::Ok;
+        std::uint64_t reads = 0;
+        std::uint64_t failed_reads = 0;
+        std::uint64_t dropped = 0; // Ring overwrites, the consumer fell behind
+        std::uint64_t faults = 0;
+        std::uint64_t processed = 0;
+        StreamLatency latency{}; // Analyzer scheduling, see StreamExecutor
+    };
+
+    template<class Source, std::size_t RingN = Config::RingSize>
+    class Station final
+    {
+        public:
+            explicit Station(Station_Config in_cfg = {}) : cfg(in_cfg), executor(MakeExecutorConfig(in_cfg)) {}
+
+            Station(const Station&) = delete;
+            Station& operator=(const Station&) = delete;
+            Station(Station&&) = delete;
+            Station& operator=(Station&&) = delete;
+
+            ~Station() { StopBuses(); }
+
+            // Before Run(). source and leds belong to the backend and have to outlive the station.
+            std::size_t AddSensor(const Sensor_Config& sensor, Source& source, GpioLines& leds)
+            {
+                pipelines.push_back(std::make_unique<Pipeline>(sensor, source, leds, cfg.consumer.max_batch));
+                return pipelines.size() - 1;
+            }
+
+            // Runs until g_running drops. on_event(sensor, processor, led_worker) is called on an executor worker after a
+            // window produced an event, never concurrently for the same sensor, concurrently for different ones.
+            template<class EventCallback>
+            void Run(EventCallback&& on_event)
+            {
+                for (std::size_t i = 0; i < pipelines.size(); ++i)
+                {
+                    Pipeline& pipeline = *pipelines[i];
+                    executor.Add(pipeline.cfg.name,
+                        [&pipeline]{ return pipeline.ring.size_approx() != 0; },
+                        [this, i, &pipeline, &on_event]{ return Drain(i, pipeline, on_event); });
+                }
+
+                StartBuses();
+                executor.Start();
+
+                while (g_running.load(std::memory_order_relaxed))
+                {
+                    for (const auto& pipeline : pipelines) {CheckHealth(*pipeline);}
+
+                    SteadyClock::sleep_for(cfg.consumer.consumer_tick_sleep);
+                    ::fflush(stdout);
+                }
+
+                executor.Stop();
+                StopBuses();
+            }
+
+            std::size_t Size() const noexcept { return pipelines.size(); }
+            const Sensor_Config& Sensor(std::size_t index) const { return pipelines[index]->cfg; }
+
+            SensorStats Stats(std::size_t index) const
+            {
+                const Pipeline& pipeline = *pipelines[index];
+                SensorStats stats{};
+                stats.health = pipeline.bus.health.load(std::memory_order_relaxed);
+                stats.reads = pipeline.bus.reads.load(std::memory_order_relaxed);
+                stats.failed_reads = pipeline.bus.failed.load(std::memory_order_relaxed);
+                stats.dropped = pipeline.bus.dropped.load(std::memory_order_relaxed);
+                stats.faults = pipeline.bus.faults.load(std::memory_order_relaxed);
+                stats.processed = pipeline.consumer.processed.load(std::memory_order_relaxed);
+                if (index < executor.Size()) {stats.latency = executor.Latency(index);}
+                return stats;
+            }
+
+        private:
+            struct alignas(CacheLine) Pipeline
+            {
+                Pipeline(const Sensor_Config& in_cfg, Source& in_source, GpioLines& leds, std::size_t max_batch)
+                    : cfg(in_cfg), source(in_source), led_ctrl(leds), led_worker(led_ctrl)
+                {
+                    consumer.batch.resize(max_batch);
+                    processor.emplace(cfg.analyzer, cfg.breath);
+                }
+
+                Pipeline(const Pipeline&) = delete;
+                Pipeline& operator=(const Pipeline&) = delete;
+                Pipeline(Pipeline&&) = delete;
+                Pipeline& operator=(Pipeline&&) = delete;
+
+                const Sensor_Config cfg;
+                Source& source;
+
+                // Written by the bus thread only.
+                struct alignas(CacheLine) BusSide
+                {
+                    std::atomic<SensorHealth> health{SensorHealth::Ok};
+                    std::atomic<std::uint32_t> epoch{0}; // Bumped on recovery, the consumer swaps in a fresh analyzer
+                    std::atomic<std::uint64_t> recovered_us{0}; // t_us of the probe that brought it back, set before the bump
+                    std::atomic<std::uint64_t> reads{0};
+                    std::atomic<std::uint64_t> failed{0};
+                    std::atomic<std::uint64_t> dropped{0};
+                    std::atomic<std::uint64_t> faults{0};
+                    std::uint32_t failed_run = 0;
+                    std::uint32_t railed_run = 0;
+                    std::chrono::microseconds next_probe{0};
+                } bus;
+
+                SpscRing<Sample, RingN> ring; // Head/tail already sit on their own lines
+
+                // Written by whichever executor worker drains this sensor, and the station loop.
+                struct alignas(CacheLine) ConsumerSide
+                {
+                    std::atomic<std::uint64_t> processed{0};
+                    std::uint32_t seen_epoch = 0;
+                    std::uint64_t skip_before_us = 0; // Samples still in the ring from before the recovery
+                    std::vector<Sample> batch;
+
+                    // Station loop only
+                    SensorHealth reported = SensorHealth::Ok;
+                    std::chrono::microseconds next_blink{0};
+                } consumer;
+
+                std::optional<RuntimeProcess> processor;
+                LedController led_ctrl;
+                LedWorker led_worker; // Own thread, a 10s BAC hold only ever blocks this sensor's LEDs
+            };
+
+            static bool Railed(const Sample& sample)
+            {
+                // The divider keeps a live MQ-3 well inside 0..4.096V, sitting on either end means a wiring problem.
+                return sample.raw <= 0 || sample.raw == std::numeric_limits<std::int16_t>::max();
+            }
+
+            void StartBuses()
+            {
+                bRunning.store(true, std::memory_order_relaxed);
+
+                std::vector<std::size_t> buses;
+                for (const auto& pipeline : pipelines)
+                {
+                    bool bSeen = false;
+                    for (std::size_t bus : buses) {bSeen = bSeen || bus == pipeline->cfg.bus;}
+                    if (!bSeen) {buses.push_back(pipeline->cfg.bus);}
+                }
+
+                for (std::size_t bus : buses)
+                {
+                    std::vector<Pipeline*> members;
+                    for (const auto& pipeline : pipelines)
+                    {
+                        if (pipeline->cfg.bus == bus) {members.push_back(pipeline.get());}
+                    }
+                    bus_threads.emplace_back([this, members = std::move(members)]{ BusLoop(members); });
+                }
+            }
+
+            void StopBuses()
+            {
+                bRunning.store(false, std::memory_order_relaxed);
+                for (std::thread& thread : bus_threads)
+                {
+                    if (thread.joinable()) {thread.join();}
+                }
+                bus_threads.clear();
+            }
+
+            void BusLoop(const std::vector<Pipeline*>& members)
+            {
+                // Same fixed timestep as Sampler. If a round of reads takes longer than a period the bus just runs slower.
+                auto next = std::chrono::steady_clock::now();
+                while (bRunning.load(std::memory_order_relaxed))
+                {
+                    next += cfg.sample_period;
+                    for (Pipeline* pipeline : members) {ReadSensor(*pipeline);}
+                    std::this_thread::sleep_until(next);
+                }
+            }
+
+            void ReadSensor(Pipeline& pipeline)
+            {
+                auto& bus = pipeline.bus;
+                const auto now = SteadyClock::now();
+                const bool bFaulted = bus.health.load(std::memory_order_relaxed) == SensorHealth::Faulted;
+
+                // Benched, wait for the next probe.
+                if (bFaulted && now < bus.next_probe) {return;}
+
+                Sample sample{};
+                bus.reads.fetch_add(1, std::memory_order_relaxed);
+                const bool bRead = pipeline.source.sample_value(sample);
+                const bool bRailed = bRead && Railed(sample);
+
+                if (!bRead) {bus.failed.fetch_add(1, std::memory_order_relaxed);}
+                bus.failed_run = bRead ? 0U : bus.failed_run + 1U;
+                bus.railed_run = bRailed ? bus.railed_run + 1U : 0U;
+
+                if (bFaulted)
+                {
+                    if (!bRead || bRailed)
+                    {
+                        bus.next_probe = now + cfg.retry_after;
+                        return;
+                    }
+
+                    // Good probe, back in service with a fresh analyzer. Release so the consumer sees recovered_us with it.
+                    bus.recovered_us.store(sample.t_us, std::memory_order_relaxed);
+                    bus.epoch.fetch_add(1, std::memory_order_release);
+                    bus.health.store(SensorHealth::Ok, std::memory_order_release);
+                }
+                else if (bus.failed_run >= cfg.fault_after_failures || bus.railed_run >= cfg.fault_after_railed)
+                {
+                    bus.faults.fetch_add(1, std::memory_order_relaxed);
+                    bus.next_probe = now + cfg.retry_after;
+                    bus.health.store(SensorHealth::Faulted, std::memory_order_release);
+                    return;
+                }
+
+                if (!bRead) {return;}
+                if (!pipeline.ring.push_overwrite(sample)) {bus.dropped.fetch_add(1, std::memory_order_relaxed);}
+            }
+
+            static StreamExecutor_Config MakeExecutorConfig(const Station_Config& in_cfg)
+            {
+                StreamExecutor_Config executor_cfg{};
+                executor_cfg.threads = in_cfg.analyzer_threads;
+                executor_cfg.poll = in_cfg.consumer.consumer_tick_sleep;
+                return executor_cfg;
+            }
+
+            template<class EventCallback>
+            StreamStatus Drain(std::size_t index, Pipeline& pipeline, EventCallback& on_event)
+            {
+                auto& consumer = pipeline.consumer;
+
+                // Recovered since the last drain, whatever the old analyzer was holding predates the fault. So does
+                // anything the ring still has from before the good probe (the railed run that benched it, say), it
+                // would go straight into the new baseline.
+                const std::uint32_t epoch = pipeline.bus.epoch.load(std::memory_order_acquire);
+                if (epoch != consumer.seen_epoch)
+                {
+                    consumer.seen_epoch = epoch;
+                    consumer.skip_before_us = pipeline.bus.recovered_us.load(std::memory_order_relaxed);
+                    pipeline.processor.emplace(pipeline.cfg.analyzer, pipeline.cfg.breath);
+                }
+
+                const std::size_t num_of_samples = pipeline.ring.pop_batch(consumer.batch.data(), consumer.batch.size());
+                if (num_of_samples == 0) {return StreamStatus::Idle;}
+                const StreamStatus status = (num_of_samples == consumer.batch.size()) ? StreamStatus::Backlog : StreamStatus::Idle;
+
+                std::size_t first = 0;
+                if (consumer.skip_before_us != 0)
+                {
+                    while (first < num_of_samples && consumer.batch[first].t_us < consumer.skip_before_us) {++first;}
+                    if (first < num_of_samples) {consumer.skip_before_us = 0;} // Ring is in time order, the rest is all after
+                }
+                if (first == num_of_samples) {return status;}
+
+                const auto step = pipeline.processor->on_batch(consumer.batch.data() + first, num_of_samples - first);
+                consumer.processed.fetch_add(num_of_samples - first, std::memory_order_relaxed);
+
+                if (step.event != StateEvent::None)
+                {
+                    on_event(index, *pipeline.processor, pipeline.led_worker);
+                }
+                return status;
+            }
+
+            void CheckHealth(Pipeline& pipeline)
+            {
+                auto& consumer = pipeline.consumer;
+                const SensorHealth health = pipeline.bus.health.load(std::memory_order_acquire);
+                const auto now = SteadyClock::now();
+
+                if (health != consumer.reported)
+                {
+                    consumer.reported = health;
+                    if (health == SensorHealth::Faulted)
+                    {
+                        fmt::print(stderr, "Error: [{}] sensor not responding, out of service (probing every {}s)\n",
+                            pipeline.cfg.name, std::chrono::duration_cast<std::chrono::seconds>(cfg.retry_after).count());
+                        consumer.next_blink = now;
+                    }
+                    else
+                    {
+                        fmt::print("[{}] Sensor back, warming up again...\n", pipeline.cfg.name);
+                        pipeline.led_worker.SetState(LedState::Warmup);
+                    }
+                }
+
+                // Red blink for as long as it's benched. Re-issued since a LedWorker command is finite.
+                if (health == SensorHealth::Faulted && now >= consumer.next_blink)
+                {
+                    constexpr std::chrono::milliseconds blink_on(250);
+                    constexpr std::chrono::milliseconds blink_off(750);
+                    const auto count = static_cast<std::uint32_t>(std::max<std::int64_t>(1, std::chrono::duration_cast<std::chrono::seconds>(cfg.retry_after).count()));
+
+                    pipeline.led_worker.SetState(LedState::Idle);
+                    pipeline.led_worker.Apply_Command({.type = LedCommandType::BlinkOne, .led = LedType::Red, .count = count, .on = blink_on, .off = blink_off});
+                    consumer.next_blink = now + cfg.retry_after;
+                }
+            }
+
+            Station_Config cfg;
+            std::vector<std::unique_ptr<Pipeline>> pipelines;
+            std::vector<std::thread> bus_threads;
+            std::atomic<bool> bRunning{false};
+            StreamExecutor executor; // Last, so its workers are gone before the pipelines they drain
+    };
+
+    // "/var/lib/drunk_app/results.wal" + "left" -> "/var/lib/drunk_app/results-left.wal"
+    static std::string StationPath(std::string_view path, std::string_view name)
+    {
+        const std::size_t slash = path.rfind('/');
+        const std::size_t dot = path.rfind('.');
+        if (dot == std::string_view::npos || (slash != std::string_view::npos && dot < slash))
+        {
+            return fmt::format("{}-{}", path, name);
+        }
+        return fmt::format("{}-{}{}", path.substr(0, dot), name, path.substr(dot));
+    }
+
+    // --station. Every sensor gets its own history store and journal, so its records never interleave with another
+    // sensor's and the executor workers never share one.
+    template<class StationBackend>
+    static int RunStation(const typename StationBackend::Settings& settings)
+    {
+        std::setvbuf(stdout,nullptr,_IOFBF,0);
+
+        StationBackend hw(settings);
+        if (!hw.Init()) {return 1;}
+
+        struct SensorReporting
+        {
+            TimeSeriesStore history;
+            ResultJournal journal;
+        };
+
+        Station<typename StationBackend::Source> station;
+        std::vector<std::unique_ptr<SensorReporting>> reporting;
+
+        for (std::size_t i = 0; i < hw.Count(); ++i)
+        {
+            const Sensor_Config& sensor = hw.SensorAt(i);
+            station.AddSensor(sensor, hw.SourceAt(i), hw.LinesAt(i));
+
+            SensorReporting& report = *reporting.emplace_back(std::make_unique<SensorReporting>());
+            if (!report.history.Open(StationPath(Config::HistoryPath, sensor.name), MakeHistoryRetention()))
+            {
+                fmt::print(stderr, "Warning: [{}] Window history disabled\n", sensor.name);
+            }
+            if (!report.journal.Open(StationPath(Config::JournalPath, sensor.name), MakeJournalConfig()))
+            {
+                fmt::print(stderr, "Warning: [{}] Result journal disabled\n", sensor.name);
+            }
+        }
+
+        fmt::print("Station: {} sensors, {} analyzer threads\n", station.Size(), Config::StationAnalyzerThreads);
+        const int64_t wall_offset_us = WallOffsetUs();
+
+        station.Run([&](std::size_t index, RuntimeProcess& processor, LedWorker& led_worker)
+        {
+            SensorReporting& report = *reporting[index];
+
+            WindowResult window{};
+            BreathEvent event{};
+            while (processor.pop_window(window, event))
+            {
+                report.history.AppendWindow(static_cast<uint64_t>(static_cast<int64_t>(window.window_end_us) + wall_offset_us), window.mean, window.stddev,
+                    static_cast<double>(window.window_end_us - window.window_start_us) / 1'000'000.0);
+                ReportBreathEvent(event, led_worker, report.history, report.journal, wall_offset_us, station.Sensor(index).name);
+            }
+        });
+
+        for (std::size_t i = 0; i < station.Size(); ++i)
+        {
+            const SensorStats stats = station.Stats(i);
+            fmt::print("[{}] reads={} failed={} dropped={} faults={} processed={} runs={} stolen={} wait p99={:.0f}us run p99={:.0f}us\n",
+                station.Sensor(i).name, stats.reads, stats.failed_reads, stats.dropped, stats.faults, stats.processed,
+                stats.latency.runs, stats.latency.steals, stats.latency.wait_p99_us, stats.latency.run_p99_us);
+            PrintJournalLatency(reporting[i]->journal, station.Sensor(i).name);
+        }
+        return 0;
+    }
+}
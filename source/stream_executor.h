@@ -0,0 +1,282 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fmt/core.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "clock.h"
+#include "config_settings.h"
+#include "process_runner.h"
+#include "thread_pool.h"
+
+// Runs many sensor streams on a few threads instead of a thread (and a ProcessRunner loop) per stream.
+//
+// A stream is has_data() + step(). While a stream is parked the poll thread checks has_data() once per poll period,
+// which batches like the runner's tick sleep does, and a producer can Notify() to skip the wait. A ready stream goes on
+// its home worker's deque so the same core keeps touching its ring and analyzer state, an idle worker steals it when the
+// home worker is busy. step() returning Backlog puts it straight back on the home deque (yielded, so a busy stream can't
+// starve its neighbours), Idle parks it, Done retires it. A stream is never queued or running twice, so step() needs no
+// locking of its own.
+//
+// Per stream latency: wait is ready -> step() starting (queueing + stealing), run is step() itself.
+namespace DrunkAPI
+{
+    struct StreamExecutor_Config
+    {
+        std::size_t threads = 2;
+        std::chrono::microseconds poll{Config::ConsumerTickSleep}; // Parked streams are checked this often
+        bool bPinWorkers = false; // Worker i -> core i
+    };
+
+    struct StreamLatency
+    {
+        std::uint64_t runs = 0;
+        std::uint64_t steals = 0; // Runs that happened off the stream's home worker
+        double wait_p50_us = 0.0;
+        double wait_p99_us = 0.0;
+        double wait_max_us = 0.0;
+        double run_p50_us = 0.0;
+        double run_p99_us = 0.0;
+        double run_max_us = 0.0;
+    };
+
+    class StreamExecutor final
+    {
+        public:
+            using ReadyFn = std::function<bool()>; // Called from the poll thread, possibly while step() runs
+            using StepFn = std::function<StreamStatus()>;
+
+            explicit StreamExecutor(StreamExecutor_Config in_cfg = {}) : cfg(in_cfg), pool(in_cfg.threads)
+            {
+                if (cfg.bPinWorkers && !pool.PinWorkers())
+                {
+                    fmt::print(stderr, "Warning: Failed to pin stream executor workers\n");
+                }
+            }
+
+            StreamExecutor(const StreamExecutor&) = delete;
+            StreamExecutor& operator=(const StreamExecutor&) = delete;
+            StreamExecutor(StreamExecutor&&) = delete;
+            StreamExecutor& operator=(StreamExecutor&&) = delete;
+
+            ~StreamExecutor() { Stop(); }
+
+            // Before Start(). Homes are dealt round robin.
+            std::size_t Add(std::string name, ReadyFn has_data, StepFn step)
+            {
+                auto stream = std::make_unique<Stream>();
+                stream->name = std::move(name);
+                stream->has_data = std::move(has_data);
+                stream->step = std::move(step);
+                stream->home = streams.size() % pool.Size();
+                streams.push_back(std::move(stream));
+                return streams.size() - 1;
+            }
+
+            // A ProcessRunner as a stream, it never runs its own loop. on_event is the same callback run() takes.
+            template<class Runner, class ProcessCallback>
+            std::size_t AddRunner(std::string name, Runner& runner, ProcessCallback on_event)
+            {
+                runner.start();
+                return Add(std::move(name),
+                    [&runner]{ return runner.has_data(); },
+                    [&runner, on_event]() mutable { return runner.step(on_event); });
+            }
+
+            void Start()
+            {
+                bStopping.store(false, std::memory_order_relaxed);
+                poller = std::thread([this]{ PollLoop(); });
+            }
+
+            // Producer side hint that the stream has data, schedules it now rather than on the next poll.
+            void Notify(std::size_t index)
+            {
+                Stream& stream = *streams[index];
+                stream.bNotified.store(true, std::memory_order_release);
+                Schedule(stream);
+            }
+
+            // Stops polling and waits for whatever is queued or running to finish its step.
+            void Stop()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(poll_mutex);
+                    bStopping.store(true, std::memory_order_relaxed);
+                }
+                poll_cv.notify_all();
+                if (poller.joinable()) {poller.join();}
+                pool.Wait();
+            }
+
+            // True once every stream returned Done, false on timeout.
+            bool WaitDone(std::chrono::milliseconds timeout)
+            {
+                std::unique_lock<std::mutex> lock(poll_mutex);
+                return done_cv.wait_for(lock, timeout, [this]{ return done_count == streams.size(); });
+            }
+
+            std::size_t Size() const noexcept { return streams.size(); }
+            std::size_t Threads() const noexcept { return pool.Size(); }
+            std::uint64_t Steals() const noexcept { return pool.Steals(); }
+            const std::string& Name(std::size_t index) const { return streams[index]->name; }
+            std::size_t Home(std::size_t index) const { return streams[index]->home; }
+
+            StreamLatency Latency(std::size_t index) const
+            {
+                const Stream& stream = *streams[index];
+                StreamLatency out{};
+                std::vector<std::uint32_t> waits;
+                std::vector<std::uint32_t> runs;
+                {
+                    std::lock_guard<std::mutex> lock(stream.stats_mutex);
+                    out.runs = stream.runs;
+                    out.steals = stream.steals;
+                    const auto kept = static_cast<std::ptrdiff_t>(std::min<std::uint64_t>(stream.runs, LatencySamples));
+                    waits.assign(stream.wait_us.begin(), stream.wait_us.begin() + kept);
+                    runs.assign(stream.run_us.begin(), stream.run_us.begin() + kept);
+                }
+
+                Percentiles(waits, out.wait_p50_us, out.wait_p99_us, out.wait_max_us);
+                Percentiles(runs, out.run_p50_us, out.run_p99_us, out.run_max_us);
+                return out;
+            }
+
+        private:
+            static constexpr std::size_t LatencySamples = 4096; // Most recent runs per stream
+
+            // Own cache line(s) per stream, the scheduling flags get hammered by the poller and the workers.
+            struct alignas(64) Stream
+            {
+                std::string name;
+                ReadyFn has_data;
+                StepFn step;
+                std::size_t home = 0;
+
+                std::atomic<bool> bScheduled{false}; // Queued or running
+                std::atomic<bool> bNotified{false};
+                std::atomic<bool> bDone{false};
+                std::chrono::microseconds ready_at{0}; // Written before the submit, read by the worker after the pop
+
+                mutable std::mutex stats_mutex;
+                std::uint64_t runs = 0;
+                std::uint64_t steals = 0;
+                std::array<std::uint32_t, LatencySamples> wait_us{};
+                std::array<std::uint32_t, LatencySamples> run_us{};
+            };
+
+            static void Percentiles(std::vector<std::uint32_t>& samples, double& p50, double& p99, double& max)
+            {
+                if (samples.empty()) {return;}
+                std::sort(samples.begin(), samples.end());
+
+                auto percentile = [&](double pct)
+                {
+                    const auto idx = static_cast<std::size_t>(pct * static_cast<double>(samples.size() - 1));
+                    return static_cast<double>(samples[idx]);
+                };
+                p50 = percentile(0.50);
+                p99 = percentile(0.99);
+                max = static_cast<double>(samples.back());
+            }
+
+            void Schedule(Stream& stream)
+            {
+                if (stream.bDone.load(std::memory_order_acquire)) {return;}
+                if (stream.bScheduled.exchange(true, std::memory_order_acq_rel)) {return;}
+
+                stream.ready_at = SteadyClock::now();
+                pool.SubmitTo(stream.home, [this, &stream]{ RunStream(stream); });
+            }
+
+            void RunStream(Stream& stream)
+            {
+                const auto started = SteadyClock::now();
+                const bool bStolen = pool.WorkerIndex() != stream.home;
+                stream.bNotified.store(false, std::memory_order_relaxed); // Whatever was notified so far, this step sees
+
+                const StreamStatus status = stream.step();
+                const auto finished = SteadyClock::now();
+                Record(stream, started - stream.ready_at, finished - started, bStolen);
+
+                if (status == StreamStatus::Done)
+                {
+                    stream.bDone.store(true, std::memory_order_release);
+                    {
+                        std::lock_guard<std::mutex> lock(poll_mutex);
+                        ++done_count;
+                    }
+                    done_cv.notify_all();
+                    return;
+                }
+
+                // More waiting, go again right behind whatever the home worker already has queued.
+                if (status == StreamStatus::Backlog && !bStopping.load(std::memory_order_relaxed))
+                {
+                    stream.ready_at = finished;
+                    pool.SubmitTo(stream.home, [this, &stream]{ RunStream(stream); }, true);
+                    return;
+                }
+
+                stream.bScheduled.store(false, std::memory_order_release);
+
+                // A Notify() that landed while we were running saw bScheduled and backed off, pick it up here.
+                if (stream.bNotified.exchange(false, std::memory_order_acq_rel) && !bStopping.load(std::memory_order_relaxed))
+                {
+                    Schedule(stream);
+                }
+            }
+
+            static void Record(Stream& stream, std::chrono::microseconds wait, std::chrono::microseconds run, bool bStolen)
+            {
+                auto clamp_us = [](std::chrono::microseconds value)
+                {
+                    return static_cast<std::uint32_t>(std::clamp<std::int64_t>(value.count(), 0, UINT32_MAX));
+                };
+
+                std::lock_guard<std::mutex> lock(stream.stats_mutex);
+                stream.wait_us[stream.runs % LatencySamples] = clamp_us(wait);
+                stream.run_us[stream.runs % LatencySamples] = clamp_us(run);
+                ++stream.runs;
+                if (bStolen) {++stream.steals;}
+            }
+
+            void PollLoop()
+            {
+                std::unique_lock<std::mutex> lock(poll_mutex);
+                while (!bStopping.load(std::memory_order_relaxed))
+                {
+                    lock.unlock();
+                    for (const auto& stream : streams)
+                    {
+                        if (!stream->bScheduled.load(std::memory_order_acquire) && stream->has_data()) {Schedule(*stream);}
+                    }
+                    lock.lock();
+
+                    poll_cv.wait_for(lock, cfg.poll, [this]{ return bStopping.load(std::memory_order_relaxed); });
+                }
+            }
+
+            StreamExecutor_Config cfg;
+            std::vector<std::unique_ptr<Stream>> streams;
+
+            std::mutex poll_mutex;
+            std::condition_variable poll_cv;
+            std::condition_variable done_cv;
+            std::size_t done_count = 0; // Guarded by poll_mutex
+            std::atomic<bool> bStopping{false};
+            std::thread poller;
+
+            WorkStealingPool pool; // Last, so its workers are gone before the streams they run
+    };
+}
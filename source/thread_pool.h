@@ -0,0 +1,195 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+#include <vector>
+
+// Work stealing thread pool for the offline tools and the live stream executor (stream_executor.h).
+//
+// Every worker owns a deque. A worker pushes/pops its own tasks at the back (LIFO, the data it just touched is still
+// in cache) and when it runs dry it steals from the front of someone else's deque (FIFO, the oldest and usually
+// biggest piece of work). Tasks submitted from outside the pool are dealt round robin, SubmitTo() puts a task on a
+// given worker's deque so work tied to some state keeps landing on the same core.
+//
+// The deques are mutex guarded rather than lock-free: tasks here are chunks of millions of samples or a batch of a
+// sensor stream, the lock is nowhere near the profile.
+namespace DrunkAPI
+{
+    class WorkStealingPool final
+    {
+        public:
+            using Task = std::function<void()>;
+
+            explicit WorkStealingPool(std::size_t thread_count = std::thread::hardware_concurrency())
+            {
+                if (thread_count == 0) {thread_count = 1;}
+
+                queues.reserve(thread_count);
+                for (std::size_t i = 0; i < thread_count; ++i) {queues.push_back(std::make_unique<WorkerQueue>());}
+
+                threads.reserve(thread_count);
+                for (std::size_t i = 0; i < thread_count; ++i) {threads.emplace_back([this, i]{ WorkerLoop(i); });}
+            }
+
+            WorkStealingPool(const WorkStealingPool&) = delete;
+            WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+            WorkStealingPool(WorkStealingPool&&) = delete;
+            WorkStealingPool& operator=(WorkStealingPool&&) = delete;
+
+            ~WorkStealingPool()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(sleep_mutex);
+                    bStop = true;
+                }
+                work_cv.notify_all();
+                for (std::thread& thread : threads) {thread.join();}
+            }
+
+            // Called from a worker the task stays on that worker's deque, otherwise it's dealt round robin.
+            void Submit(Task task)
+            {
+                const std::size_t target = (CurrentPool() == this) ? CurrentWorker() : next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+                SubmitTo(target, std::move(task));
+            }
+
+            // Onto worker's deque. bYield puts it at the cold end instead: the owner runs everything else it has first
+            // and an idle thief takes it first, for a task that just ran and wants to go again.
+            void SubmitTo(std::size_t worker, Task task, bool bYield = false)
+            {
+                const std::size_t target = worker % queues.size();
+
+                // Counted before the push so a worker can never pop it before it's accounted for.
+                pending.fetch_add(1, std::memory_order_relaxed);
+                {
+                    std::lock_guard<std::mutex> lock(sleep_mutex);
+                    ++queued;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(queues[target]->mutex);
+                    if (bYield) {queues[target]->tasks.push_front(std::move(task));}
+                    else {queues[target]->tasks.push_back(std::move(task));}
+                }
+
+                // notify_one could wake a worker that isn't the target, it'll steal, which is what an idle worker should do anyway.
+                work_cv.notify_one();
+            }
+
+            // Worker i -> core i % cores. Keeps a worker's deque and the streams homed on it on one L1/L2.
+            bool PinWorkers()
+            {
+                const unsigned int cores = std::max(1U, std::thread::hardware_concurrency());
+                bool bOk = true;
+                for (std::size_t i = 0; i < threads.size(); ++i)
+                {
+                    cpu_set_t set;
+                    CPU_ZERO(&set);
+                    CPU_SET(i % cores, &set);
+                    bOk = (pthread_setaffinity_np(threads[i].native_handle(), sizeof(set), &set) == 0) && bOk;
+                }
+                return bOk;
+            }
+
+            // Blocks until every submitted task (including tasks they submitted) has finished.
+            void Wait()
+            {
+                std::unique_lock<std::mutex> lock(sleep_mutex);
+                idle_cv.wait(lock, [this]{ return pending.load(std::memory_order_acquire) == 0; });
+            }
+
+            std::size_t Size() const noexcept { return threads.size(); }
+
+            // Index of the calling worker, Size() when called from outside the pool.
+            std::size_t WorkerIndex() const noexcept { return (CurrentPool() == this) ? CurrentWorker() : threads.size(); }
+            std::uint64_t Steals() const noexcept { return steals.load(std::memory_order_relaxed); }
+
+        private:
+            struct WorkerQueue
+            {
+                std::mutex mutex;
+                std::deque<Task> tasks;
+            };
+
+            static WorkStealingPool*& CurrentPool() { thread_local WorkStealingPool* pool = nullptr; return pool; }
+            static std::size_t& CurrentWorker() { thread_local std::size_t index = 0; return index; }
+
+            bool PopLocal(std::size_t index, Task& out)
+            {
+                WorkerQueue& queue = *queues[index];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (queue.tasks.empty()) {return false;}
+                out = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+                return true;
+            }
+
+            bool Steal(std::size_t thief, Task& out)
+            {
+                for (std::size_t offset = 1; offset < queues.size(); ++offset)
+                {
+                    WorkerQueue& victim = *queues[(thief + offset) % queues.size()];
+                    std::lock_guard<std::mutex> lock(victim.mutex);
+                    if (victim.tasks.empty()) {continue;}
+                    out = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    steals.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+                return false;
+            }
+
+            void WorkerLoop(std::size_t index)
+            {
+                CurrentPool() = this;
+                CurrentWorker() = index;
+
+                for (;;)
+                {
+                    Task task;
+                    if (PopLocal(index, task) || Steal(index, task))
+                    {
+                        {
+                            std::lock_guard<std::mutex> lock(sleep_mutex);
+                            --queued;
+                        }
+
+                        task();
+
+                        if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                        {
+                            std::lock_guard<std::mutex> lock(sleep_mutex);
+                            idle_cv.notify_all();
+                        }
+                        continue;
+                    }
+
+                    // Nothing to run or steal, sleep until a Submit() bumps the queued count.
+                    std::unique_lock<std::mutex> lock(sleep_mutex);
+                    work_cv.wait(lock, [this]{ return bStop || queued > 0; });
+                    if (bStop && queued == 0) {return;}
+                }
+            }
+
+            std::vector<std::unique_ptr<WorkerQueue>> queues;
+            std::vector<std::thread> threads;
+
+            std::mutex sleep_mutex;
+            std::condition_variable work_cv;
+            std::condition_variable idle_cv;
+            std::size_t queued = 0; // Tasks sitting in a deque, guarded by sleep_mutex
+            bool bStop = false;
+
+            std::atomic<std::size_t> pending{0}; // Submitted but not finished
+            std::atomic<std::size_t> next_queue{0};
+            std::atomic<std::uint64_t> steals{0};
+    };
+}
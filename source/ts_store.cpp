@@ -0,0 +1,661 @@
+#include "ts_store.h"
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fmt/core.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace DrunkAPI
+{
+    namespace
+    {
+        constexpr std::uint32_t BlockMagic = 0x4B4C4254; // "TBLK"
+
+        // On disk block header, followed by `bytes` of Gorilla payload.
+        struct TsBlockHeader
+        {
+            std::uint32_t magic;
+            std::uint16_t columns;
+            std::uint16_t count;
+            std::uint64_t t_first;
+            std::uint64_t t_last;
+            std::uint32_t bytes;
+            std::uint32_t reserved;
+        };
+        static_assert(sizeof(TsBlockHeader) == 32, "TsBlockHeader is an on disk format");
+
+        constexpr std::array<const char*, 2> SeriesNames = {"window", "breath"};
+        constexpr std::array<const char*, 3> TierNames = {"raw", "1min", "1h"};
+
+        // Delta of delta buckets: prefix bits, prefix value, payload bits.
+        struct DodBucket { unsigned prefix_bits; std::uint64_t prefix; unsigned bits; };
+        constexpr std::array<DodBucket, 5> DodBuckets = {{
+            {2, 0b10, 7},
+            {3, 0b110, 9},
+            {4, 0b1110, 12},
+            {5, 0b11110, 32},
+            {5, 0b11111, 64},
+        }};
+
+        bool FitsSigned(std::int64_t value, unsigned bits)
+        {
+            if (bits >= 64) {return true;}
+            const std::int64_t lo = -(std::int64_t{1} << (bits - 1));
+            const std::int64_t hi = (std::int64_t{1} << (bits - 1)) - 1;
+            return value >= lo && value <= hi;
+        }
+
+        std::int64_t SignExtend(std::uint64_t raw, unsigned bits)
+        {
+            if (bits >= 64) {return static_cast<std::int64_t>(raw);}
+            if (((raw >> (bits - 1)) & 1U) != 0) {raw |= ~std::uint64_t{0} << bits;}
+            return static_cast<std::int64_t>(raw);
+        }
+
+        class BitReader
+        {
+            public:
+                BitReader(const std::uint8_t* in_data, std::size_t in_bytes) : data(in_data), total_bits(in_bytes * 8) {}
+
+                std::uint64_t Read(unsigned bits)
+                {
+                    std::uint64_t value = 0;
+                    while (bits > 0)
+                    {
+                        if (pos >= total_bits) {bOverflow = true; return 0;}
+
+                        const unsigned bit_in_byte = static_cast<unsigned>(pos & 7U);
+                        const unsigned available = 8U - bit_in_byte;
+                        const unsigned take = std::min(available, bits);
+                        const unsigned shift = available - take;
+                        const auto chunk = static_cast<std::uint64_t>((data[pos >> 3] >> shift) & ((1U << take) - 1U));
+
+                        value = (value << take) | chunk;
+                        pos += take;
+                        bits -= take;
+                    }
+                    return value;
+                }
+
+                bool Overflow() const noexcept { return bOverflow; }
+
+            private:
+                const std::uint8_t* data;
+                std::size_t total_bits;
+                std::size_t pos = 0;
+                bool bOverflow = false;
+        };
+
+        std::vector<std::uint64_t> ListDays(const std::string& stream_dir)
+        {
+            std::vector<std::uint64_t> days;
+            std::error_code error;
+            for (const auto& entry : std::filesystem::directory_iterator(stream_dir, error))
+            {
+                if (entry.path().extension() != ".blk") {continue;}
+                const std::string stem = entry.path().stem().string();
+                char* end = nullptr;
+                const unsigned long long day = std::strtoull(stem.c_str(), &end, 10);
+                if (end != nullptr && *end == '\0') {days.push_back(day);}
+            }
+            std::sort(days.begin(), days.end());
+            return days;
+        }
+    }
+
+    /* Gorilla Block Codec */
+
+    void TsBlockEncoder::Clear()
+    {
+        bytes.clear();
+        bit_pos = 0;
+        count = 0;
+        t_first = 0;
+        prev_t = 0;
+        prev_delta = 0;
+        prev_bits.fill(0);
+        prev_lead.fill(0);
+        prev_trail.fill(0);
+    }
+
+    void TsBlockEncoder::WriteBits(std::uint64_t value, unsigned bits)
+    {
+        // MSB first into a byte stream.
+        while (bits > 0)
+        {
+            if (bit_pos == 0) {bytes.push_back(0);}
+
+            const unsigned available = 8U - bit_pos;
+            const unsigned take = std::min(available, bits);
+            const auto chunk = static_cast<std::uint8_t>((value >> (bits - take)) & ((1U << take) - 1U));
+
+            bytes.back() = static_cast<std::uint8_t>(bytes.back() | (chunk << (available - take)));
+            bit_pos = (bit_pos + take) & 7U;
+            bits -= take;
+        }
+    }
+
+    void TsBlockEncoder::Append(const TsPoint& point)
+    {
+        if (count == 0)
+        {
+            t_first = point.t_us;
+            WriteBits(point.t_us, 64);
+            for (std::size_t col = 0; col < columns; ++col)
+            {
+                prev_bits[col] = std::bit_cast<std::uint64_t>(point.v[col]);
+                prev_lead[col] = 64; // No previous XOR window yet
+                prev_trail[col] = 0;
+                WriteBits(prev_bits[col], 64);
+            }
+            prev_t = point.t_us;
+            prev_delta = 0;
+            ++count;
+            return;
+        }
+
+        // Timestamps: delta of delta. Windows sit on a fixed grid so this is usually the single '0' bit.
+        const auto delta = static_cast<std::int64_t>(point.t_us - prev_t);
+        const std::int64_t dod = delta - prev_delta;
+
+        if (dod == 0)
+        {
+            WriteBits(0, 1);
+        }
+        else
+        {
+            for (const DodBucket& bucket : DodBuckets)
+            {
+                if (!FitsSigned(dod, bucket.bits)) {continue;}
+                WriteBits(bucket.prefix, bucket.prefix_bits);
+                WriteBits(static_cast<std::uint64_t>(dod), bucket.bits);
+                break;
+            }
+        }
+
+        prev_delta = delta;
+        prev_t = point.t_us;
+
+        // Values: XOR with the previous value, store only the meaningful bits.
+        for (std::size_t col = 0; col < columns; ++col)
+        {
+            const auto bits = std::bit_cast<std::uint64_t>(point.v[col]);
+            const std::uint64_t xored = bits ^ prev_bits[col];
+            prev_bits[col] = bits;
+
+            if (xored == 0)
+            {
+                WriteBits(0, 1);
+                continue;
+            }
+
+            WriteBits(1, 1);
+
+            const auto lead = std::min(static_cast<unsigned>(std::countl_zero(xored)), 31U);
+            const auto trail = static_cast<unsigned>(std::countr_zero(xored));
+
+            if (prev_lead[col] < 64 && lead >= prev_lead[col] && trail >= prev_trail[col])
+            {
+                // Fits inside the previous meaningful window, reuse it.
+                WriteBits(0, 1);
+                WriteBits(xored >> prev_trail[col], 64 - prev_lead[col] - prev_trail[col]);
+                continue;
+            }
+
+            const unsigned significant = 64 - lead - trail;
+            WriteBits(1, 1);
+            WriteBits(lead, 5);
+            WriteBits(significant - 1, 6);
+            WriteBits(xored >> trail, significant);
+
+            prev_lead[col] = lead;
+            prev_trail[col] = trail;
+        }
+
+        ++count;
+    }
+
+    bool TsDecodeBlock(const std::uint8_t* data, std::size_t bytes, std::size_t columns, std::size_t count, std::vector<TsPoint>& out)
+    {
+        if (columns > TsMaxColumns) {return false;}
+
+        BitReader reader(data, bytes);
+
+        std::uint64_t t_us = 0;
+        std::int64_t delta = 0;
+        std::array<std::uint64_t, TsMaxColumns> prev_bits{};
+        std::array<unsigned, TsMaxColumns> lead{};
+        std::array<unsigned, TsMaxColumns> trail{};
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            TsPoint point{};
+
+            if (i == 0)
+            {
+                t_us = reader.Read(64);
+                for (std::size_t col = 0; col < columns; ++col) {prev_bits[col] = reader.Read(64);}
+            }
+            else
+            {
+                std::int64_t dod = 0;
+                if (reader.Read(1) != 0)
+                {
+                    // Count the run of 1s in the prefix to find the bucket.
+                    std::size_t bucket = 0;
+                    while (bucket + 1 < DodBuckets.size() && reader.Read(1) != 0) {++bucket;}
+                    dod = SignExtend(reader.Read(DodBuckets[bucket].bits), DodBuckets[bucket].bits);
+                }
+
+                delta += dod;
+                t_us += static_cast<std::uint64_t>(delta);
+
+                for (std::size_t col = 0; col < columns; ++col)
+                {
+                    if (reader.Read(1) == 0) {continue;}
+
+                    if (reader.Read(1) != 0)
+                    {
+                        lead[col] = static_cast<unsigned>(reader.Read(5));
+                        const auto significant = static_cast<unsigned>(reader.Read(6)) + 1;
+                        if (lead[col] + significant > 64) {return false;}
+                        trail[col] = 64 - lead[col] - significant;
+                    }
+
+                    const unsigned significant = 64 - lead[col] - trail[col];
+                    prev_bits[col] ^= reader.Read(significant) << trail[col];
+                }
+            }
+
+            if (reader.Overflow()) {return false;}
+
+            point.t_us = t_us;
+            for (std::size_t col = 0; col < columns; ++col) {point.v[col] = std::bit_cast<double>(prev_bits[col]);}
+            out.push_back(point);
+        }
+
+        return true;
+    }
+
+    /* Rollups */
+
+    void TimeSeriesStore::Rollup::Add(double mean, double stddev, double weight, double in_min, double in_max)
+    {
+        if (n == 0.0)
+        {
+            min = in_min;
+            max = in_max;
+        }
+        sum_mean += weight * mean;
+        sum_sq += weight * ((stddev * stddev) + (mean * mean));
+        min = std::min(min, in_min);
+        max = std::max(max, in_max);
+        n += weight;
+    }
+
+    TsPoint TimeSeriesStore::Rollup::Point() const
+    {
+        TsPoint point{};
+        point.t_us = bucket_start;
+        const double mean = (n > 0.0) ? sum_mean / n : 0.0;
+        const double variance = (n > 0.0) ? std::max(0.0, (sum_sq / n) - (mean * mean)) : 0.0;
+        point.v = {mean, std::sqrt(variance), min, max, n};
+        return point;
+    }
+
+    /* Store */
+
+    bool TimeSeriesStore::Open(const std::string& in_dir, TsRetention in_retention)
+    {
+        retention = in_retention;
+
+        streams[0].series = TsSeries::Window; streams[0].tier = TsTier::Raw;    streams[0].columns = 2;
+        streams[1].series = TsSeries::Window; streams[1].tier = TsTier::Minute; streams[1].columns = 5;
+        streams[2].series = TsSeries::Window; streams[2].tier = TsTier::Hour;   streams[2].columns = 5;
+        streams[3].series = TsSeries::Breath; streams[3].tier = TsTier::Raw;    streams[3].columns = 3;
+
+        for (Stream& stream : streams)
+        {
+            stream.encoder = TsBlockEncoder(stream.columns);
+            stream.index.clear();
+
+            std::error_code error;
+            std::filesystem::create_directories(in_dir + "/" + fmt::format("{}_{}", SeriesNames[static_cast<std::size_t>(stream.series)], TierNames[static_cast<std::size_t>(stream.tier)]), error);
+            if (error)
+            {
+                fmt::print(stderr, "Error: Unable to create history dir '{}': {}\n", in_dir, error.message());
+                return false;
+            }
+        }
+
+        dir = in_dir;
+        rollup_open.fill(false);
+        return true;
+    }
+
+    TimeSeriesStore::Stream& TimeSeriesStore::GetStream(TsSeries series, TsTier tier)
+    {
+        if (series == TsSeries::Breath) {return streams[3];}
+        return streams[static_cast<std::size_t>(tier)];
+    }
+
+    std::string TimeSeriesStore::StreamDir(const Stream& stream) const
+    {
+        return fmt::format("{}/{}_{}", dir, SeriesNames[static_cast<std::size_t>(stream.series)], TierNames[static_cast<std::size_t>(stream.tier)]);
+    }
+
+    std::string TimeSeriesStore::PartitionPath(const Stream& stream, std::uint64_t day) const
+    {
+        return fmt::format("{}/{}.blk", StreamDir(stream), day);
+    }
+
+    std::uint32_t TimeSeriesStore::RetentionDays(const Stream& stream) const
+    {
+        if (stream.series == TsSeries::Breath) {return retention.breath_days;}
+        switch (stream.tier)
+        {
+            case TsTier::Minute: return retention.minute_days;
+            case TsTier::Hour: return retention.hour_days;
+            case TsTier::Raw:
+            default: return retention.raw_days;
+        }
+    }
+
+    void TimeSeriesStore::AppendWindow(std::uint64_t t_us, double mean, double stddev, double window_s)
+    {
+        if (!IsOpen()) {return;}
+
+        TsPoint point{};
+        point.t_us = t_us;
+        point.v[0] = mean;
+        point.v[1] = stddev;
+        Append(GetStream(TsSeries::Window, TsTier::Raw), point);
+
+        FeedRollup(TsTier::Minute, t_us, mean, stddev, window_s, mean, mean);
+    }
+
+    void TimeSeriesStore::AppendBreath(std::uint64_t t_us, double peak_volts, double bac, double duration_s)
+    {
+        if (!IsOpen()) {return;}
+
+        TsPoint point{};
+        point.t_us = t_us;
+        point.v[0] = peak_volts;
+        point.v[1] = bac;
+        point.v[2] = duration_s;
+        Stream& stream = GetStream(TsSeries::Breath, TsTier::Raw);
+        Append(stream, point);
+
+        // Results are rare and the ones we care about, don't leave them sitting in memory. Only this stream's block
+        // though: sealing the window tiers too would cut them into tiny blocks every breath (no compression, a fat
+        // index), and this is one small write on the consumer thread instead of four.
+        FlushBlock(stream);
+    }
+
+    void TimeSeriesStore::FeedRollup(TsTier tier, std::uint64_t t_us, double mean, double stddev, double weight, double in_min, double in_max)
+    {
+        const std::size_t slot = (tier == TsTier::Minute) ? 0 : 1;
+        const std::uint64_t bucket_len = (tier == TsTier::Minute) ? MinuteUs : HourUs;
+        const std::uint64_t bucket_start = t_us - (t_us % bucket_len);
+
+        if (rollup_open[slot] && rollups[slot].bucket_start != bucket_start)
+        {
+            const Rollup finished = rollups[slot];
+            rollup_open[slot] = false;
+            PushRollup(tier, finished);
+        }
+
+        if (!rollup_open[slot])
+        {
+            rollups[slot] = Rollup{};
+            rollups[slot].bucket_start = bucket_start;
+            rollup_open[slot] = true;
+        }
+
+        rollups[slot].Add(mean, stddev, weight, in_min, in_max);
+    }
+
+    void TimeSeriesStore::PushRollup(TsTier tier, const Rollup& finished)
+    {
+        const TsPoint point = finished.Point();
+        Append(GetStream(TsSeries::Window, tier), point);
+
+        // Minute buckets feed the hour tier, weighted by how many window seconds they hold so the merge is exact.
+        if (tier == TsTier::Minute)
+        {
+            FeedRollup(TsTier::Hour, finished.bucket_start, point.v[0], point.v[1], finished.n, finished.min, finished.max);
+            return;
+        }
+
+        // Once an hour is plenty to keep the disk bounded.
+        EnforceRetention(finished.bucket_start + HourUs);
+    }
+
+    void TimeSeriesStore::Append(Stream& stream, const TsPoint& point)
+    {
+        const std::uint64_t day = point.t_us / DayUs;
+
+        if (stream.encoder.Count() > 0 && (day != stream.open_day || stream.encoder.Count() >= BlockPoints))
+        {
+            FlushBlock(stream);
+        }
+
+        stream.open_day = day;
+        stream.encoder.Append(point);
+    }
+
+    void TimeSeriesStore::FlushBlock(Stream& stream)
+    {
+        if (stream.encoder.Count() == 0) {return;}
+
+        const std::string path = PartitionPath(stream, stream.open_day);
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            fmt::print(stderr, "Error: Unable to open history partition '{}': {}\n", path, std::strerror(errno));
+            stream.encoder.Clear();
+            return;
+        }
+
+        const std::vector<std::uint8_t>& payload = stream.encoder.Bytes();
+
+        TsBlockHeader header{};
+        header.magic = BlockMagic;
+        header.columns = static_cast<std::uint16_t>(stream.columns);
+        header.count = static_cast<std::uint16_t>(stream.encoder.Count());
+        header.t_first = stream.encoder.FirstTime();
+        header.t_last = stream.encoder.LastTime();
+        header.bytes = static_cast<std::uint32_t>(payload.size());
+
+        const off_t block_offset = ::lseek(fd, 0, SEEK_END);
+
+        iovec parts[2] = {
+            {&header, sizeof(header)},
+            {const_cast<std::uint8_t*>(payload.data()), payload.size()},
+        };
+
+        const ssize_t written = ::writev(fd, parts, 2);
+        ::close(fd);
+
+        if (written != static_cast<ssize_t>(sizeof(header) + payload.size()))
+        {
+            fmt::print(stderr, "Error: Short write to history partition '{}'\n", path);
+        }
+        else if (auto found = stream.index.find(stream.open_day); found != stream.index.end())
+        {
+            // Keep an already loaded index in sync, otherwise it's scanned on the next query.
+            BlockIndex entry{};
+            entry.t_first = header.t_first;
+            entry.t_last = header.t_last;
+            entry.offset = static_cast<std::uint64_t>(block_offset) + sizeof(header);
+            entry.bytes = header.bytes;
+            entry.count = header.count;
+            found->second.push_back(entry);
+        }
+
+        stream.encoder.Clear();
+    }
+
+    void TimeSeriesStore::Flush()
+    {
+        if (!IsOpen()) {return;}
+        for (Stream& stream : streams) {FlushBlock(stream);}
+    }
+
+    const std::vector<TimeSeriesStore::BlockIndex>& TimeSeriesStore::LoadIndex(Stream& stream, std::uint64_t day)
+    {
+        auto found = stream.index.find(day);
+        if (found != stream.index.end()) {return found->second;}
+
+        std::vector<BlockIndex>& blocks = stream.index[day];
+
+        const std::string path = PartitionPath(stream, day);
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {return blocks;}
+
+        struct stat file_stat{};
+        ::fstat(fd, &file_stat);
+        const auto file_size = static_cast<std::uint64_t>(file_stat.st_size);
+
+        // Only the 32 byte headers are read, payloads are skipped. A torn tail block (power cut mid write) ends the scan.
+        std::uint64_t offset = 0;
+        while (offset + sizeof(TsBlockHeader) <= file_size)
+        {
+            TsBlockHeader header{};
+            if (::pread(fd, &header, sizeof(header), static_cast<off_t>(offset)) != static_cast<ssize_t>(sizeof(header))) {break;}
+            if (header.magic != BlockMagic || header.columns != stream.columns) {break;}
+
+            const std::uint64_t payload_offset = offset + sizeof(header);
+            if (payload_offset + header.bytes > file_size) {break;}
+
+            BlockIndex entry{};
+            entry.t_first = header.t_first;
+            entry.t_last = header.t_last;
+            entry.offset = payload_offset;
+            entry.bytes = header.bytes;
+            entry.count = header.count;
+            blocks.push_back(entry);
+
+            offset = payload_offset + header.bytes;
+        }
+
+        ::close(fd);
+        return blocks;
+    }
+
+    std::size_t TimeSeriesStore::Query(TsSeries series, TsTier tier, std::uint64_t from_us, std::uint64_t to_us, std::vector<TsPoint>& out)
+    {
+        if (!IsOpen() || from_us >= to_us) {return 0;}
+
+        Stream& stream = GetStream(series, tier);
+        const std::size_t before = out.size();
+        const std::uint64_t first_day = from_us / DayUs;
+        const std::uint64_t last_day = (to_us - 1) / DayUs;
+
+        std::vector<TsPoint> decoded;
+        std::vector<std::uint8_t> payload;
+
+        auto keep_in_range = [&]()
+        {
+            for (const TsPoint& point : decoded)
+            {
+                if (point.t_us >= from_us && point.t_us < to_us) {out.push_back(point);}
+            }
+            decoded.clear();
+        };
+
+        for (const std::uint64_t day : ListDays(StreamDir(stream)))
+        {
+            if (day < first_day || day > last_day) {continue;}
+
+            const std::vector<BlockIndex>& blocks = LoadIndex(stream, day);
+            if (blocks.empty()) {continue;}
+
+            const std::string path = PartitionPath(stream, day);
+            const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {continue;}
+
+            for (const BlockIndex& block : blocks)
+            {
+                if (block.t_last < from_us || block.t_first >= to_us) {continue;}
+
+                payload.resize(block.bytes);
+                if (::pread(fd, payload.data(), block.bytes, static_cast<off_t>(block.offset)) != static_cast<ssize_t>(block.bytes)) {continue;}
+
+                if (!TsDecodeBlock(payload.data(), payload.size(), stream.columns, block.count, decoded))
+                {
+                    fmt::print(stderr, "Warning: Corrupt history block in '{}' @ {}\n", path, block.offset);
+                    decoded.clear();
+                    continue;
+                }
+                keep_in_range();
+            }
+
+            ::close(fd);
+        }
+
+        // Points that haven't been flushed yet.
+        const TsBlockEncoder& open_block = stream.encoder;
+        if (open_block.Count() > 0 && open_block.LastTime() >= from_us && open_block.FirstTime() < to_us)
+        {
+            if (TsDecodeBlock(open_block.Bytes().data(), open_block.Bytes().size(), stream.columns, open_block.Count(), decoded))
+            {
+                keep_in_range();
+            }
+        }
+
+        return out.size() - before;
+    }
+
+    void TimeSeriesStore::EnforceRetention(std::uint64_t now_us)
+    {
+        if (!IsOpen()) {return;}
+
+        const std::uint64_t today = now_us / DayUs;
+
+        for (Stream& stream : streams)
+        {
+            const std::uint64_t keep_days = RetentionDays(stream);
+            if (today < keep_days) {continue;}
+            const std::uint64_t oldest_day = today - keep_days;
+
+            for (const std::uint64_t day : ListDays(StreamDir(stream)))
+            {
+                if (day >= oldest_day) {break;}
+                if (day == stream.open_day && stream.encoder.Count() > 0) {continue;}
+
+                std::error_code error;
+                std::filesystem::remove(PartitionPath(stream, day), error);
+                stream.index.erase(day);
+            }
+        }
+    }
+
+    TsUsage TimeSeriesStore::Usage()
+    {
+        TsUsage usage{};
+        if (!IsOpen()) {return usage;}
+
+        for (Stream& stream : streams)
+        {
+            for (const std::uint64_t day : ListDays(StreamDir(stream)))
+            {
+                std::error_code error;
+                usage.bytes += std::filesystem::file_size(PartitionPath(stream, day), error);
+                ++usage.partitions;
+
+                for (const BlockIndex& block : LoadIndex(stream, day)) {usage.points += block.count;}
+            }
+            usage.points += stream.encoder.Count();
+        }
+
+        return usage;
+    }
+}
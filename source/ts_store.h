@@ -0,0 +1,173 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// On device time-series history for window baselines and breath results.
+//
+// - Points are packed into blocks with Gorilla style compression (Facebook's "Gorilla" TSDB paper):
+//     timestamps -> delta of delta, windows land on a fixed grid so most cost a single bit
+//     values     -> XOR against the previous value, slow moving baselines only store a few meaningful bits
+// - Windows are rolled up 1s -> 1min -> 1h as they arrive, so long range queries never touch raw data.
+// - Every (series, tier) is partitioned by day on disk: <dir>/<series>_<tier>/<day>.blk
+//   Queries only open the partitions overlapping the range and skip blocks by their [t_first, t_last] header.
+// - Retention is per tier, so disk usage stays bounded no matter how long a unit runs.
+namespace DrunkAPI
+{
+    inline constexpr std::size_t TsMaxColumns = 5;
+
+    enum class TsSeries : std::uint8_t
+    {
+        Window = 0, // mean, stddev (raw tier) / mean, stddev, min, max, seconds of windows (rollups, = window count at 1s)
+        Breath = 1, // peak volts, bac, blow duration seconds
+    };
+
+    enum class TsTier : std::uint8_t
+    {
+        Raw = 0, // One point per finalized window (1 s default)
+        Minute = 1,
+        Hour = 2,
+    };
+
+    struct TsPoint
+    {
+        std::uint64_t t_us = 0; // Wall clock microseconds
+        std::array<double, TsMaxColumns> v{};
+    };
+
+    // Gorilla block codec, exposed so tools can pack/unpack without the store.
+    class TsBlockEncoder
+    {
+        public:
+            explicit TsBlockEncoder(std::size_t in_columns) : columns(in_columns) {}
+
+            void Append(const TsPoint& point);
+            void Clear();
+
+            std::size_t Count() const noexcept { return count; }
+            std::size_t Columns() const noexcept { return columns; }
+            std::uint64_t FirstTime() const noexcept { return t_first; }
+            std::uint64_t LastTime() const noexcept { return prev_t; }
+            const std::vector<std::uint8_t>& Bytes() const noexcept { return bytes; }
+
+        private:
+            void WriteBits(std::uint64_t value, unsigned bits);
+
+            std::size_t columns;
+            std::vector<std::uint8_t> bytes;
+            unsigned bit_pos = 0;
+            std::size_t count = 0;
+
+            std::uint64_t t_first = 0;
+            std::uint64_t prev_t = 0;
+            std::int64_t prev_delta = 0;
+            std::array<std::uint64_t, TsMaxColumns> prev_bits{};
+            std::array<unsigned, TsMaxColumns> prev_lead{};
+            std::array<unsigned, TsMaxColumns> prev_trail{};
+    };
+
+    bool TsDecodeBlock(const std::uint8_t* data, std::size_t bytes, std::size_t columns, std::size_t count, std::vector<TsPoint>& out);
+
+    struct TsRetention
+    {
+        std::uint32_t raw_days = 14;
+        std::uint32_t minute_days = 180;
+        std::uint32_t hour_days = 3650;
+        std::uint32_t breath_days = 3650;
+    };
+
+    struct TsUsage
+    {
+        std::uint64_t bytes = 0;
+        std::uint64_t partitions = 0;
+        std::uint64_t points = 0;
+    };
+
+    class TimeSeriesStore final
+    {
+        public:
+            static constexpr std::uint64_t MinuteUs = 60ULL * 1'000'000ULL;
+            static constexpr std::uint64_t HourUs = 60ULL * MinuteUs;
+            static constexpr std::uint64_t DayUs = 24ULL * HourUs;
+            static constexpr std::size_t BlockPoints = 1024; // Flush a block once it holds this many points
+
+            TimeSeriesStore() = default;
+            TimeSeriesStore(const TimeSeriesStore&) = delete;
+            TimeSeriesStore& operator=(const TimeSeriesStore&) = delete;
+            TimeSeriesStore(TimeSeriesStore&&) = delete;
+            TimeSeriesStore& operator=(TimeSeriesStore&&) = delete;
+            ~TimeSeriesStore() { Flush(); }
+
+            bool Open(const std::string& in_dir, TsRetention in_retention = {});
+            bool IsOpen() const noexcept { return !dir.empty(); }
+
+            // Wall clock timestamps, must be non decreasing per series.
+            // window_s weights the rollups, so adaptive windows of different lengths average by time.
+            void AppendWindow(std::uint64_t t_us, double mean, double stddev, double window_s = 1.0);
+            void AppendBreath(std::uint64_t t_us, double peak_volts, double bac, double duration_s);
+
+            // Returns points with from_us <= t < to_us, in time order. Includes points still in the open block.
+            std::size_t Query(TsSeries series, TsTier tier, std::uint64_t from_us, std::uint64_t to_us, std::vector<TsPoint>& out);
+
+            // Writes the open blocks. Open rollup buckets stay in memory until their minute/hour closes.
+            void Flush();
+
+            // Drops day partitions older than the tier's retention relative to now_us.
+            void EnforceRetention(std::uint64_t now_us);
+
+            TsUsage Usage();
+
+        private:
+            struct BlockIndex
+            {
+                std::uint64_t t_first = 0;
+                std::uint64_t t_last = 0;
+                std::uint64_t offset = 0; // Payload offset in the partition file
+                std::uint32_t bytes = 0;
+                std::uint16_t count = 0;
+            };
+
+            struct Rollup
+            {
+                std::uint64_t bucket_start = 0;
+                double n = 0.0;
+                double sum_mean = 0.0;
+                double sum_sq = 0.0; // sum of n * (var + mean^2), lets us merge buckets exactly (law of total variance)
+                double min = 0.0;
+                double max = 0.0;
+
+                void Add(double mean, double stddev, double weight, double in_min, double in_max);
+                TsPoint Point() const;
+            };
+
+            struct Stream
+            {
+                TsSeries series = TsSeries::Window;
+                TsTier tier = TsTier::Raw;
+                std::size_t columns = 0;
+                TsBlockEncoder encoder{0};
+                std::uint64_t open_day = 0;
+                std::map<std::uint64_t, std::vector<BlockIndex>> index; // day -> blocks, loaded lazily
+            };
+
+            Stream& GetStream(TsSeries series, TsTier tier);
+            std::string StreamDir(const Stream& stream) const;
+            std::string PartitionPath(const Stream& stream, std::uint64_t day) const;
+
+            void Append(Stream& stream, const TsPoint& point);
+            void FlushBlock(Stream& stream);
+            const std::vector<BlockIndex>& LoadIndex(Stream& stream, std::uint64_t day);
+            void PushRollup(TsTier tier, const Rollup& finished);
+            void FeedRollup(TsTier tier, std::uint64_t t_us, double mean, double stddev, double weight, double in_min, double in_max);
+            std::uint32_t RetentionDays(const Stream& stream) const;
+
+            std::string dir;
+            TsRetention retention;
+            std::array<Stream, 4> streams{}; // Window raw/minute/hour + Breath raw
+            std::array<Rollup, 2> rollups{}; // Open minute and hour buckets
+            std::array<bool, 2> rollup_open{};
+    };
+}
@@ -0,0 +1,147 @@
+#include "window_replay.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fmt/core.h>
+
+namespace DrunkAPI
+{
+    double ReplaySampleRateHz(const std::string& path, std::uint32_t header_hz, std::span<const Sample> samples)
+    {
+        const double live_hz = Config::SampleRate_Hz;
+        if (header_hz != 0)
+        {
+            if (header_hz != Config::SampleRate_Hz)
+            {
+                fmt::print(stderr, "Warning: {} was sampled at {} Hz, not {} Hz. Windows are held to its rate, the defaults weren't tuned there\n",
+                    path, header_hz, Config::SampleRate_Hz);
+            }
+            return header_hz;
+        }
+
+        // Gaps past a second are dropped reads or a paused session, not the rate.
+        std::vector<std::uint64_t> gaps;
+        gaps.reserve(samples.size());
+        for (std::size_t i = 1; i < samples.size(); ++i)
+        {
+            const std::uint64_t gap_us = samples[i].t_us - samples[i - 1].t_us;
+            if (gap_us > 0 && gap_us <= 1'000'000) {gaps.push_back(gap_us);}
+        }
+        if (gaps.empty()) {return live_hz;}
+
+        // 90th percentile: the slow stretch of a dynamic rate session, the odd dropped read doesn't move it.
+        auto slow = gaps.begin() + static_cast<std::ptrdiff_t>(gaps.size() * 9 / 10);
+        std::nth_element(gaps.begin(), slow, gaps.end());
+        const double hz = 1e6 / static_cast<double>(*slow);
+        if (std::abs(hz - live_hz) <= live_hz * 0.1) {return live_hz;} // Sampler jitter
+
+        fmt::print(stderr, "Warning: {} was sampled at a variable or unknown rate, windows are held to its slowest ({:.0f} Hz, not {} Hz)\n",
+            path, hz, Config::SampleRate_Hz);
+        return hz;
+    }
+
+    Analyzer_Config AtSampleRate(Analyzer_Config cfg, double hz)
+    {
+        if (hz <= 0.0 || hz == cfg.sample_rate_hz) {return cfg;}
+        cfg.min_window_sample_size = std::max<std::size_t>(1, static_cast<std::size_t>(std::llround(static_cast<double>(cfg.min_window_sample_size) * hz / cfg.sample_rate_hz)));
+        cfg.sample_rate_hz = hz;
+        return cfg;
+    }
+
+    std::vector<WindowChunk> MakeWindowChunks(std::size_t sample_count, std::size_t chunk_samples)
+    {
+        chunk_samples = std::max<std::size_t>(1, chunk_samples);
+
+        std::vector<WindowChunk> chunks;
+        chunks.reserve((sample_count + chunk_samples - 1) / chunk_samples);
+        for (std::size_t begin = 0; begin < sample_count; begin += chunk_samples)
+        {
+            WindowChunk chunk{};
+            chunk.begin = begin;
+            chunk.end = std::min(begin + chunk_samples, sample_count);
+            chunks.push_back(std::move(chunk));
+        }
+        return chunks;
+    }
+
+    void AccumulateChunk(std::span<const Sample> samples, WindowChunk& chunk, std::uint64_t window_us)
+    {
+        const std::uint64_t t0 = samples.front().t_us;
+
+        chunk.first_window = (samples[chunk.begin].t_us - t0) / window_us;
+        const std::uint64_t last_window = (samples[chunk.end - 1].t_us - t0) / window_us;
+        chunk.windows.assign(static_cast<std::size_t>(last_window - chunk.first_window + 1), WelfordStats{});
+
+        // Only divide when we cross a window edge, not per sample.
+        std::size_t slot = 0;
+        std::uint64_t next_edge = t0 + ((chunk.first_window + 1) * window_us);
+        for (std::size_t i = chunk.begin; i < chunk.end; ++i)
+        {
+            const std::uint64_t t_us = samples[i].t_us;
+            if (t_us >= next_edge)
+            {
+                const std::uint64_t window = (t_us - t0) / window_us;
+                slot = static_cast<std::size_t>(window - chunk.first_window);
+                next_edge = t0 + ((window + 1) * window_us);
+            }
+            chunk.windows[slot].push(static_cast<double>(samples[i].volts));
+        }
+    }
+
+    std::vector<WelfordStats> MergeChunks(std::span<const Sample> samples, std::span<const WindowChunk> chunks, std::uint64_t window_us)
+    {
+        if (samples.empty()) {return {};}
+
+        const std::uint64_t t0 = samples.front().t_us;
+        std::vector<WelfordStats> windows(static_cast<std::size_t>((samples.back().t_us - t0) / window_us + 1));
+
+        // Interior windows just get copied in, only the ones cut by a chunk edge really combine.
+        for (const WindowChunk& chunk : chunks)
+        {
+            for (std::size_t i = 0; i < chunk.windows.size(); ++i)
+            {
+                windows[static_cast<std::size_t>(chunk.first_window) + i].merge(chunk.windows[i]);
+            }
+        }
+        return windows;
+    }
+
+    std::vector<WindowResult> FinalizeWindows(std::span<const WelfordStats> windows, std::uint64_t t0, const Analyzer_Config& cfg)
+    {
+        WelfordAnalyzer analyzer(cfg);
+        std::vector<WindowResult> results;
+        results.reserve(windows.size());
+
+        // The window holding the last sample never closes. A window is finalized by the first sample of a later
+        // window, and when a gap closes several at once the live path only hands the last one to the breath
+        // analyzer, so a window reaches it only if the next window has samples.
+        for (std::size_t idx = 0; idx + 1 < windows.size(); ++idx)
+        {
+            const StepResult<WindowResult> step = analyzer.FinalizeStats(windows[idx], t0 + (idx * cfg.window_micro));
+            if (windows[idx + 1].num_samples == 0) {continue;}
+            results.push_back(step.result);
+        }
+        return results;
+    }
+
+    std::vector<ReplayEvent> ReplayBreaths(std::span<const WindowResult> windows, const BreathAnalyzer_Config& cfg)
+    {
+        BreathAnalyzer analyzer(cfg);
+        BreathResult snapshot{};
+        BreathAnalyzerState last_state = BreathAnalyzerState::None;
+        std::vector<ReplayEvent> events;
+
+        for (const WindowResult& window : windows)
+        {
+            BreathEvent event{};
+            analyzer.AnalyzeBreath(window, snapshot, event);
+
+            if (event.State != last_state)
+            {
+                events.push_back({window.window_end_us, event, snapshot.peak_volts});
+                last_state = event.State;
+            }
+        }
+        return events;
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+#include "analyzer.h"
+#include "config_settings.h"
+#include "sampler.h"
+
+// Offline replay building blocks shared by drunk_offline and drunk_tune.
+//
+// Replay is split in the same three stages the live path goes through:
+//   1) samples -> per window WelfordStats (parallel, chunks stitched with WelfordStats::merge)
+//   2) stats   -> WindowResult via WelfordAnalyzer::FinalizeStats (depends only on Analyzer_Config)
+//   3) windows -> breath transitions via BreathAnalyzer (depends only on BreathAnalyzer_Config)
+// so a tuner can cache stage 1/2 per window size and only rerun stage 3 per config. Windows are fixed at window_micro,
+// Analyzer_Config::bAdaptiveWindow only changes the live path (a window's length depends on every window before it).
+namespace DrunkAPI
+{
+    struct WindowChunk
+    {
+        std::size_t begin = 0; // Sample range [begin, end)
+        std::size_t end = 0;
+        std::uint64_t first_window = 0; // Window index of windows[0], relative to the first sample
+        std::vector<WelfordStats> windows;
+    };
+
+    struct ReplayEvent
+    {
+        std::uint64_t t_us = 0; // Window end that caused the transition
+        BreathEvent event{}; // start/end/peak are only set when State == Analyzed
+        double peak_volts = 0.0; // Running peak at the transition
+    };
+
+    // Rate to hold a capture's windows to. A fixed rate .drec says so in its header (LoadRecording's sample_rate_hz),
+    // a variable rate one (0) or a capture that doesn't say goes by the t_us spacing, its slowest stretch, so a window
+    // at the Ready rate isn't thrown out for having a quarter of the samples. Warns when it isn't SampleRate_Hz, the
+    // defaults were tuned at that.
+    double ReplaySampleRateHz(const std::string& path, std::uint32_t header_hz, std::span<const Sample> samples);
+
+    // cfg with min_window_sample_size moved from cfg.sample_rate_hz to hz, what WelfordAnalyzer::SetSampleRate does live.
+    Analyzer_Config AtSampleRate(Analyzer_Config cfg, double hz);
+
+    // Cuts `sample_count` samples into chunks of at most `chunk_samples`.
+    std::vector<WindowChunk> MakeWindowChunks(std::size_t sample_count, std::size_t chunk_samples);
+
+    // Stage 1, safe to run for different chunks on different threads.
+    void AccumulateChunk(std::span<const Sample> samples, WindowChunk& chunk, std::uint64_t window_us);
+
+    // Dense stats for the whole recording, index = (t_us - first t_us) / window_us.
+    std::vector<WelfordStats> MergeChunks(std::span<const Sample> samples, std::span<const WindowChunk> chunks, std::uint64_t window_us);
+
+    // Stage 2. Closes windows the way the live path does and returns the ones that reach the breath analyzer.
+    std::vector<WindowResult> FinalizeWindows(std::span<const WelfordStats> windows, std::uint64_t t0, const Analyzer_Config& cfg);
+
+    // Stage 3, one entry per state transition.
+    std::vector<ReplayEvent> ReplayBreaths(std::span<const WindowResult> windows, const BreathAnalyzer_Config& cfg);
+}
@@ -0,0 +1,264 @@
+// drunk_adc_timing: how well ADS1115 samples are timestamped. Runs Ads1115_Source at the sampler's pace and compares
+// the conversion end stamp against where the sample used to be stamped (after the conversion register read).
+//
+//   drunk_adc_timing [--seconds s] [--sps n] [--rdy] [--osc-error pct] [--bus-us us] [--bus-hz hz] [--load threads]
+//   drunk_adc_timing --real [--i2c-bus n] [--addr 0x48] [--rdy-gpio n] [--bus-hz hz] [--seconds s] [--sps n]     (Pi build only)
+//
+// Emulated (default) the true conversion end is known, so both stamps are scored against it. --load spins busy threads
+// so the sampler gets scheduled out like it does on a loaded Pi. On the real chip there's no ground truth: the readout
+// lag is the jitter the old stamp carried, and the estimate's +- (or the edge) is what's left.
+//
+// Both end with the bus self test's verdict and the time per register write / read. --bus-hz emulated runs every
+// transaction at that clock's wire time (100000, 400000, 3400000 with the HS master code) plus --bus-us for the
+// driver, so the speed modes can be compared off the Pi. On the Pi it's the speed asked of the adapter.
+#include "ads1115.h"
+#include "ads1115_emu.h"
+#include "clock.h"
+#include "config_settings.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/core.h>
+#include <thread>
+#include <vector>
+#if defined(DRUNK_ADC_TIMING_REAL)
+#include "backend_real.h"
+#endif
+
+namespace
+{
+    using namespace DrunkAPI;
+
+    struct Options
+    {
+        double seconds = 10.0;
+        int sps = 128;
+        unsigned int load_threads = 0;
+        Ads1115Emu_Config emu{};
+        bool bBusUs = false; // --bus-us given
+        std::uint32_t bus_hz = Config::I2cBusHz;
+
+        bool bReal = false;
+        int i2c_bus = 1;
+        unsigned int addr = 0x48;
+        int rdy_gpio = Config::AdcReadyGpio;
+    };
+
+    struct Timings
+    {
+        std::uint64_t samples = 0;
+        std::uint64_t failed = 0;
+        std::uint64_t edges = 0;
+        std::uint64_t edge_misses = 0;
+        std::vector<double> old_error_us; // read_us - truth (emulated only)
+        std::vector<double> new_error_us; // done_us - truth (emulated only)
+        std::vector<double> lag_us; // read_us - done_us
+        std::vector<double> conversion_us; // done_us - start_us
+        std::vector<double> uncertainty_us;
+    };
+
+    bool RateFromSps(int sps, ADS1115::DataRate& out)
+    {
+        for (std::uint8_t code = 0; code < 8; ++code)
+        {
+            const auto rate = static_cast<ADS1115::DataRate>(code << 5);
+            if (ADS1115::Get_SpsRate(rate) == sps)
+            {
+                out = rate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void PrintRow(const char* label, std::vector<double> values)
+    {
+        if (values.empty()) {return;}
+        std::sort(values.begin(), values.end());
+
+        double mean = 0.0;
+        for (const double value : values) {mean += value;}
+        mean /= static_cast<double>(values.size());
+        double var = 0.0;
+        for (const double value : values) {var += (value - mean) * (value - mean);}
+
+        auto at = [&values](double q){ return values[std::min(values.size() - 1, static_cast<std::size_t>(q * static_cast<double>(values.size())))]; };
+        fmt::print("{:<28} {:>9.0f} {:>9.0f} {:>9.0f} {:>9.0f} {:>9.1f}\n", label, values.front(), at(0.5), at(0.99), values.back(),
+            std::sqrt(var / static_cast<double>(values.size())));
+    }
+
+    // Same fixed timestep loop as Sampler, with the stamps collected instead of pushed to the ring.
+    template<class Device, class Truth>
+    Timings Run(const Options& opts, Device& device, ADS1115::DataRate rate, Truth truth_us)
+    {
+        Ads1115_Source<Device> source(device, static_cast<ADS1115::i2c_device::SlaveAddress>(opts.addr), ADS1115::Mux::AIN0_GND, ADS1115::Pga::FS_4_096V, rate);
+
+        Timings out{};
+        const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(Config::SamplePeriod);
+        const auto stop = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(opts.seconds));
+        auto next = std::chrono::steady_clock::now();
+
+        while (std::chrono::steady_clock::now() < stop)
+        {
+            next += period;
+
+            Sample sample{};
+            if (source.sample_value(sample))
+            {
+                const ConversionStamp& stamp = source.LastStamp();
+                ++out.samples;
+                if (stamp.bEdge) {++out.edges;}
+                if (stamp.bEdgeMissed) {++out.edge_misses;}
+
+                std::uint64_t truth = 0;
+                if (truth_us(truth))
+                {
+                    out.old_error_us.push_back(static_cast<double>(static_cast<std::int64_t>(stamp.read_us - truth)));
+                    out.new_error_us.push_back(static_cast<double>(static_cast<std::int64_t>(stamp.done_us - truth)));
+                }
+                out.lag_us.push_back(static_cast<double>(stamp.read_us - stamp.done_us));
+                out.conversion_us.push_back(static_cast<double>(stamp.done_us - stamp.start_us));
+                out.uncertainty_us.push_back(static_cast<double>(stamp.uncertainty_us));
+            }
+            else
+            {
+                ++out.failed;
+            }
+
+            std::this_thread::sleep_until(next);
+        }
+        return out;
+    }
+
+    void Report(const Timings& timings, bool bEdgeMode)
+    {
+        fmt::print("{} samples ({} failed), {} stamped from the RDY edge, {} edge timeouts\n", timings.samples, timings.failed, timings.edges, timings.edge_misses);
+        fmt::print("{:<28} {:>9} {:>9} {:>9} {:>9} {:>9}\n", "us", "min", "p50", "p99", "max", "sd");
+        PrintRow("old stamp - true end", timings.old_error_us);
+        PrintRow("new stamp - true end", timings.new_error_us);
+        PrintRow("readout lag (old - new)", timings.lag_us);
+        PrintRow("conversion as stamped", timings.conversion_us);
+        if (!bEdgeMode) {PrintRow("estimate +-", timings.uncertainty_us);}
+    }
+
+    void ReportBus(const I2cBusTiming& timing, std::uint32_t bus_hz)
+    {
+        fmt::print("I2C {} mode at {} Hz, per transaction (ioctl in to out):\n", ADS1115::BusModeName(ADS1115::BusModeAt(bus_hz)), bus_hz);
+        fmt::print("{:<28} {:>9} {:>9} {:>9} {:>9} {:>9}\n", "us", "count", "min", "mean", "max", "wire");
+        auto row = [bus_hz](const char* label, const I2cTransactionTiming& kind, ADS1115::Transaction transaction)
+        {
+            if (kind.count == 0) {return;}
+            fmt::print("{:<28} {:>9} {:>9} {:>9.1f} {:>9} {:>9.1f}\n", label, kind.count, kind.min_us, kind.MeanUs(), kind.max_us,
+                ADS1115::TransactionUs(transaction, bus_hz));
+        };
+        row("register write", timing.writes, ADS1115::Transaction::WriteWord);
+        row("register read", timing.reads, ADS1115::Transaction::ReadWord);
+    }
+
+    void PrintUsage(const char* argv0)
+    {
+        fmt::print("usage: {} [--seconds s] [--sps n] [--rdy] [--osc-error pct] [--bus-us us] [--bus-hz hz] [--load threads]\n", argv0);
+#if defined(DRUNK_ADC_TIMING_REAL)
+        fmt::print("       {} --real [--i2c-bus n] [--addr 0x48] [--rdy-gpio n] [--bus-hz hz] [--seconds s] [--sps n]\n", argv0);
+#endif
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options opts{};
+    opts.emu.bus_time = std::chrono::microseconds(300); // Register read at 100kHz
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--seconds") == 0 && has_value) {opts.seconds = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--sps") == 0 && has_value) {opts.sps = std::atoi(argv[++i]);}
+        else if (std::strcmp(argv[i], "--rdy") == 0) {opts.emu.bReadyPin = true;}
+        else if (std::strcmp(argv[i], "--osc-error") == 0 && has_value) {opts.emu.osc_error_pct = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--bus-us") == 0 && has_value)
+        {
+            opts.emu.bus_time = std::chrono::microseconds(std::strtoll(argv[++i], nullptr, 10));
+            opts.bBusUs = true;
+        }
+        else if (std::strcmp(argv[i], "--bus-hz") == 0 && has_value) {opts.bus_hz = opts.emu.bus_hz = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));}
+        else if (std::strcmp(argv[i], "--load") == 0 && has_value) {opts.load_threads = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));}
+        else if (std::strcmp(argv[i], "--real") == 0) {opts.bReal = true;}
+        else if (std::strcmp(argv[i], "--i2c-bus") == 0 && has_value) {opts.i2c_bus = std::atoi(argv[++i]);}
+        else if (std::strcmp(argv[i], "--addr") == 0 && has_value) {opts.addr = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 0));}
+        else if (std::strcmp(argv[i], "--rdy-gpio") == 0 && has_value) {opts.rdy_gpio = std::atoi(argv[++i]);}
+        else
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    // With the wire time modelled, the default bus time is just the driver's: ioctl, IRQ and wakeup on a Pi 4.
+    if (opts.emu.bus_hz != 0 && !opts.bBusUs) {opts.emu.bus_time = std::chrono::microseconds(40);}
+    if (opts.bus_hz == 0)
+    {
+        fmt::print(stderr, "Error: --bus-hz needs a clock\n");
+        return 1;
+    }
+
+    ADS1115::DataRate rate{};
+    if (!RateFromSps(opts.sps, rate))
+    {
+        fmt::print(stderr, "Error: --sps must be one of 8 16 32 64 128 250 475 860\n");
+        return 1;
+    }
+
+    if (opts.bReal)
+    {
+#if defined(DRUNK_ADC_TIMING_REAL)
+        const auto addr = static_cast<ADS1115::i2c_device::SlaveAddress>(opts.addr);
+        ADS1115 ads;
+        if (!ads.Init(opts.i2c_bus, addr)) {return 1;}
+        VerifyI2cBus(ads, addr, opts.bus_hz);
+        const bool bEdge = opts.rdy_gpio >= 0 && AttachAdcReadyLine(ads, "/dev/gpiochip0", opts.rdy_gpio, {addr});
+
+        fmt::print("ADS1115 0x{:02x} on /dev/i2c-{} at {} SPS, {}\n", opts.addr, opts.i2c_bus, opts.sps, bEdge ? "ALERT/RDY edge stamps" : "OS bit poll estimates");
+        Report(Run(opts, ads, rate, [](std::uint64_t&){ return false; }), bEdge);
+        ReportBus(ads.Timing(), ads.BusHz());
+        return 0;
+#else
+        fmt::print(stderr, "Error: built without libgpiod, --real isn't available\n");
+        return 1;
+#endif
+    }
+
+    // Emulated chip, optionally with the sampler fighting busy threads for the CPU.
+    std::atomic<bool> bStop{false};
+    std::vector<std::thread> load;
+    for (unsigned int i = 0; i < opts.load_threads; ++i)
+    {
+        load.emplace_back([&bStop]{ while (!bStop.load(std::memory_order_relaxed)) {} });
+    }
+
+    Ads1115Emu emu(opts.emu);
+    const bool bUp = emu.Init(1, opts.emu.addr);
+    if (bUp) {VerifyI2cBus(emu, opts.emu.addr, opts.bus_hz);}
+    if (!bUp || (opts.emu.bReadyPin && !EnableConversionReady(emu, opts.emu.addr)))
+    {
+        bStop.store(true);
+        for (std::thread& thread : load) {thread.join();}
+        return 1;
+    }
+
+    fmt::print("Emulated ADS1115 at {} SPS, oscillator {:+.1f}%, {}us per I2C transaction{}, {} load threads, {}\n", opts.sps,
+        opts.emu.osc_error_pct, opts.emu.bus_time.count(), opts.emu.bus_hz != 0 ? " + wire time" : "", opts.load_threads,
+        opts.emu.bReadyPin ? "ALERT/RDY edge stamps" : "OS bit poll estimates");
+
+    const Timings timings = Run(opts, emu, rate, [&emu](std::uint64_t& out){ out = emu.LastConversionDoneUs(); return true; });
+    bStop.store(true);
+    for (std::thread& thread : load) {thread.join();}
+
+    Report(timings, opts.emu.bReadyPin);
+    ReportBus(emu.Timing(), emu.BusHz());
+    return 0;
+}
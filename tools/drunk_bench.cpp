@@ -0,0 +1,724 @@
+// drunk_bench: microbenchmarks for every hot path component.
+//
+//   drunk_bench [--filter substr] [--min-time ms] [--reps n] [--json out.json] [--baseline base.json] [--max-regression pct]
+//
+// Covers the SPSC ring (single thread, batch pops, producer/consumer pinned to the same core / different cores),
+// WelfordStats::push, WelfordAnalyzer::AnalyzeBatch, ReferenceCompensator::Process, FlowDetector::Process,
+// BreathAnalyzer::AnalyzeBreath, BreathModel::Score, the mq3_helper.h conversions and LedController writes against the in-memory GPIO lines (gpio_emu.h).
+//
+// Each bench is grown until one run takes --min-time, then run --reps times and the median ns/op is kept. The table
+// goes to stdout, --json writes the results, --baseline diffs against a JSON written by an earlier run and exits 3
+// when anything got slower than --max-regression percent (default 15) and than its own rep to rep spread. The JSON
+// records the build type, compiler and CPU, and the diff warns when they don't match the baseline's (then it's
+// comparing machines, not code). Baselines aren't committed, record one on the machine you compare on.
+#include "analyzer.h"
+#include "breath_classifier.h"
+#include "breath_classifier_model.h"
+#include "config_settings.h"
+#include "flow_gate.h"
+#include "gpio_emu.h"
+#include "led_controller.h"
+#include "mq3_helper.h"
+#include "reference_comp.h"
+#include "sampler.h"
+#include "spsc.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/core.h>
+#include <map>
+#include <memory>
+#include <numbers>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <sys/utsname.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if !defined(DRUNK_BUILD_TYPE)
+#define DRUNK_BUILD_TYPE ""
+#endif
+
+namespace
+{
+    using namespace DrunkAPI;
+    using Clock = std::chrono::steady_clock;
+
+    // Keep the compiler from throwing away results we never read.
+    template<class T>
+    inline void DoNotOptimize(const T& value)
+    {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    struct BenchResult
+    {
+        std::string name;
+        double ns_per_op = 0.0; // Median over reps
+        double spread_pct = 0.0; // (max - min) / median
+        std::uint64_t ops = 0; // Ops per rep
+    };
+
+    class BenchRunner
+    {
+        public:
+            BenchRunner(std::chrono::milliseconds in_min_time, std::size_t in_reps, std::string in_filter)
+            : min_time(in_min_time), reps(in_reps), filter(std::move(in_filter)) {}
+
+            // fn(ops) has to do `ops` units of work.
+            template<class Fn>
+            void Run(const std::string& name, Fn&& fn)
+            {
+                if (!filter.empty() && name.find(filter) == std::string::npos) {return;}
+
+                auto time_ops = [&](std::uint64_t ops)
+                {
+                    const auto start = Clock::now();
+                    fn(ops);
+                    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+                };
+
+                // Grow until a single run is long enough for the clock to not matter.
+                const double min_ns = std::chrono::duration<double, std::nano>(min_time).count();
+                std::uint64_t ops = 1;
+                double elapsed = time_ops(ops);
+                while (elapsed < min_ns)
+                {
+                    const double scale = (elapsed > 0.0) ? std::clamp(1.2 * min_ns / elapsed, 2.0, 100.0) : 100.0;
+                    ops = static_cast<std::uint64_t>(static_cast<double>(ops) * scale);
+                    elapsed = time_ops(ops);
+                }
+
+                std::vector<double> ns_per_op;
+                for (std::size_t r = 0; r < reps; ++r) {ns_per_op.push_back(time_ops(ops) / static_cast<double>(ops));}
+                std::sort(ns_per_op.begin(), ns_per_op.end());
+
+                BenchResult result{};
+                result.name = name;
+                result.ns_per_op = ns_per_op[ns_per_op.size() / 2];
+                result.spread_pct = (result.ns_per_op > 0.0) ? 100.0 * (ns_per_op.back() - ns_per_op.front()) / result.ns_per_op : 0.0;
+                result.ops = ops;
+
+                fmt::print("{:<48} {:>12.2f} ns/op {:>14.0f} ops/s  +-{:.1f}%\n", name, result.ns_per_op, 1e9 / result.ns_per_op, result.spread_pct / 2.0);
+                std::fflush(stdout);
+                results.push_back(std::move(result));
+            }
+
+            // Lets a group skip expensive setup when --filter can't match anything in it.
+            bool GroupEnabled(const std::string& group) const
+            {
+                return filter.empty() || filter.find(group) != std::string::npos || group.find(filter) != std::string::npos;
+            }
+
+            const std::vector<BenchResult>& Results() const { return results; }
+
+        private:
+            std::chrono::milliseconds min_time;
+            std::size_t reps;
+            std::string filter;
+            std::vector<BenchResult> results;
+    };
+
+    // cpu < 0 leaves the thread wherever the scheduler wants it.
+    void PinThread(int cpu)
+    {
+        if (cpu < 0) {return;}
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(static_cast<std::size_t>(cpu), &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    // Deterministic noise so runs are comparable.
+    struct Lcg
+    {
+        std::uint64_t state = 0x9E3779B97F4A7C15ULL;
+        double next()
+        {
+            state = (state * 6364136223846793005ULL) + 1442695040888963407ULL;
+            return static_cast<double>(state >> 11U) * (1.0 / 9007199254740992.0); // [0, 1)
+        }
+    };
+
+    // Clean air baseline with a breath every 2 minutes, same shape the MQ-3 gives on the bench.
+    std::vector<Sample> MakeSamples(std::size_t count)
+    {
+        constexpr auto period_us = static_cast<std::uint64_t>(Config::SamplePeriod.count());
+        std::vector<Sample> samples(count);
+        Lcg noise;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const double t_s = static_cast<double>(i) / Config::SampleRate_Hz;
+            const double since_breath = t_s - (120.0 * std::floor(t_s / 120.0)) - 60.0;
+            const double breath = (since_breath > 0.0) ? 0.4 * (1.0 - std::exp(-since_breath / 1.5)) * std::exp(-since_breath / 20.0) : 0.0;
+            const double volts = 1.2 + breath + ((noise.next() - 0.5) * 0.001);
+
+            samples[i].t_us = 1'000'000 + (i * period_us);
+            samples[i].volts = static_cast<float>(volts);
+            samples[i].raw = static_cast<std::int16_t>(volts / 4.096 * 32767.0);
+        }
+        return samples;
+    }
+
+    // ------------------------------------------------------------------------------------------------------------
+    // SPSC ring
+    // ------------------------------------------------------------------------------------------------------------
+
+    template<std::size_t N>
+    void BenchRing(BenchRunner& bench)
+    {
+        auto ring = std::make_unique<SpscRing<Sample, N>>();
+        const Sample sample{1, 2, 3.0F};
+
+        bench.Run(fmt::format("spsc/push_pop/n={}", N), [&](std::uint64_t ops)
+        {
+            Sample out{};
+            for (std::uint64_t i = 0; i < ops; ++i)
+            {
+                ring->push(sample);
+                ring->pop(out);
+                DoNotOptimize(out);
+            }
+        });
+
+        // Sampler side when the consumer fell behind, every push stomps the oldest.
+        bench.Run(fmt::format("spsc/push_overwrite_full/n={}", N), [&](std::uint64_t ops)
+        {
+            for (std::uint64_t i = 0; i < ops; ++i) {DoNotOptimize(ring->push_overwrite(sample));}
+        });
+        Sample drain{};
+        while (ring->pop(drain)) {}
+
+        for (const std::size_t batch : {std::size_t{1}, std::size_t{32}, Config::ConsumerMaxBatch})
+        {
+            if (batch >= N) {continue;}
+            std::vector<Sample> out(batch);
+            bench.Run(fmt::format("spsc/push_then_pop_batch/n={}/batch={}", N, batch), [&](std::uint64_t ops)
+            {
+                for (std::uint64_t done = 0; done < ops; done += batch)
+                {
+                    for (std::size_t k = 0; k < batch; ++k) {ring->push(sample);}
+                    DoNotOptimize(ring->pop_batch(out.data(), batch));
+                }
+            });
+        }
+    }
+
+    // One producer, one consumer, ops = samples moved through the ring.
+    template<std::size_t N>
+    void BenchRingThreads(BenchRunner& bench, const char* placement, int producer_cpu, int consumer_cpu)
+    {
+        auto ring = std::make_unique<SpscRing<Sample, N>>();
+        constexpr std::size_t batch = 32;
+
+        bench.Run(fmt::format("spsc/threads/{}/n={}/batch={}", placement, N, batch), [&](std::uint64_t ops)
+        {
+            std::thread producer([&]
+            {
+                PinThread(producer_cpu);
+                Sample sample{0, 0, 1.0F};
+                for (std::uint64_t i = 0; i < ops; ++i)
+                {
+                    sample.t_us = i;
+                    while (!ring->push(sample)) {std::this_thread::yield();}
+                }
+            });
+
+            std::thread consumer([&]
+            {
+                PinThread(consumer_cpu);
+                std::array<Sample, batch> out{};
+                std::uint64_t received = 0;
+                while (received < ops)
+                {
+                    const std::size_t n = ring->pop_batch(out.data(), batch);
+                    if (n == 0) {std::this_thread::yield();}
+                    received += n;
+                }
+                DoNotOptimize(out);
+            });
+
+            producer.join();
+            consumer.join();
+        });
+    }
+
+    // ------------------------------------------------------------------------------------------------------------
+    // Analyzers
+    // ------------------------------------------------------------------------------------------------------------
+
+    void BenchWelford(BenchRunner& bench, const std::vector<Sample>& samples)
+    {
+        bench.Run("welford/push", [&](std::uint64_t ops)
+        {
+            WelfordStats stats;
+            for (std::uint64_t i = 0; i < ops; ++i) {stats.push(static_cast<double>(samples[i & (samples.size() - 1)].volts));}
+            DoNotOptimize(stats);
+        });
+
+        Analyzer_Config cfg{};
+        cfg.bDebugPrint = false;
+        auto get_volts = +[](const Sample& sample)->double { return sample.volts; };
+
+        // 7 is what a 50ms consumer tick sees at 128 SPS, 256 is ConsumerMaxBatch.
+        for (const std::size_t batch : {std::size_t{1}, std::size_t{7}, Config::ConsumerMaxBatch})
+        {
+            bench.Run(fmt::format("welford/analyze_batch/batch={}", batch), [&](std::uint64_t ops)
+            {
+                auto analyzer = std::make_unique<WelfordAnalyzer>(cfg);
+                std::size_t cursor = 0;
+                for (std::uint64_t done = 0; done < ops; done += batch)
+                {
+                    // Fresh analyzer on wrap so time keeps moving forward.
+                    if (cursor + batch > samples.size())
+                    {
+                        analyzer = std::make_unique<WelfordAnalyzer>(cfg);
+                        cursor = 0;
+                    }
+                    DoNotOptimize(analyzer->AnalyzeBatch(samples.data() + cursor, batch, get_volts));
+                    cursor += batch;
+                }
+            });
+        }
+    }
+
+    // The reference MQ-3 stage: pairing, the cross-correlation over every lag and the ambient removal, per main sample.
+    void BenchReference(BenchRunner& bench, const std::vector<Sample>& samples)
+    {
+        if (!bench.GroupEnabled("reference/")) {return;}
+
+        // Both sensors sit in the same slowly swinging room, the reference is read right after the main one.
+        std::vector<Sample> main = samples;
+        std::vector<Sample> reference = samples;
+        for (std::size_t i = 0; i < samples.size(); ++i)
+        {
+            const double t_s = static_cast<double>(i) / Config::SampleRate_Hz;
+            const double room = 0.05 * (1.0 + std::sin(2.0 * std::numbers::pi * t_s / 300.0));
+            main[i].volts = static_cast<float>(static_cast<double>(samples[i].volts) + room);
+            reference[i].t_us += 2'000;
+            reference[i].volts = static_cast<float>(1.15 + room + (static_cast<double>(samples[(i * 7U) & (samples.size() - 1)].volts) - 1.2) * 0.01);
+        }
+
+        for (const std::size_t batch : {std::size_t{7}, Config::ConsumerMaxBatch})
+        {
+            bench.Run(fmt::format("reference/process/batch={}", batch), [&](std::uint64_t ops)
+            {
+                auto compensator = std::make_unique<ReferenceCompensator>();
+                std::array<Sample, Config::ConsumerMaxBatch> out{};
+                std::size_t cursor = 0;
+                for (std::uint64_t done = 0; done < ops; done += batch)
+                {
+                    if (cursor + batch > main.size())
+                    {
+                        compensator = std::make_unique<ReferenceCompensator>();
+                        cursor = 0;
+                    }
+                    compensator->PushReference(reference.data() + cursor, batch);
+                    DoNotOptimize(compensator->Process(main.data() + cursor, batch, out.data()));
+                    cursor += batch;
+                }
+                DoNotOptimize(out);
+            });
+        }
+    }
+
+    void BenchFlow(BenchRunner& bench, const std::vector<Sample>& samples)
+    {
+        if (!bench.GroupEnabled("flow/")) {return;}
+
+        // Three pressure reads per MQ-3 sample, a 3s blow every 20s, the sample noise riding on the sensor's zero.
+        const Flow_Config flow_cfg{};
+        std::vector<Sample> flow(samples.size() * 3);
+        for (std::size_t i = 0; i < flow.size(); ++i)
+        {
+            const double t_s = static_cast<double>(i) / (3.0 * Config::SampleRate_Hz);
+            const double lps = std::fmod(t_s, 20.0) < 3.0 ? 0.5 : 0.0;
+            const double noise = static_cast<double>(samples[i / 3].volts) - 1.2;
+            flow[i].t_us = samples[i / 3].t_us + ((i % 3) * 1'500);
+            flow[i].volts = static_cast<float>(FlowToAdcVolts(flow_cfg, 2.5 + (noise * 0.5), lps));
+        }
+
+        for (const std::size_t batch : {std::size_t{3}, Config::ConsumerMaxBatch})
+        {
+            bench.Run(fmt::format("flow/process/batch={}", batch), [&](std::uint64_t ops)
+            {
+                FlowDetector detector(flow_cfg);
+                std::size_t cursor = 0;
+                for (std::uint64_t done = 0; done < ops; done += batch)
+                {
+                    if (cursor + batch > flow.size())
+                    {
+                        detector = FlowDetector(flow_cfg);
+                        cursor = 0;
+                    }
+                    detector.Process(flow.data() + cursor, batch);
+                    cursor += batch;
+                }
+                DoNotOptimize(detector.Status());
+            });
+        }
+    }
+
+    void BenchBreath(BenchRunner& bench, const std::vector<Sample>& samples)
+    {
+        if (!bench.GroupEnabled("breath/")) {return;}
+
+        // Real windows out of the Welford stage so the state machine walks warmup -> ready -> processing -> cooldown.
+        Analyzer_Config analyzer_cfg{};
+        analyzer_cfg.bDebugPrint = false;
+        WelfordAnalyzer analyzer(analyzer_cfg);
+        auto get_volts = +[](const Sample& sample)->double { return sample.volts; };
+
+        std::vector<WindowResult> windows;
+        for (const Sample& sample : samples)
+        {
+            const StepResult<WindowResult> step = analyzer.AnalyzeBatch(&sample, 1, get_volts);
+            if (step.result.window_end_us != 0) {windows.push_back(step.result);}
+        }
+
+        BreathAnalyzer_Config breath_cfg{};
+        breath_cfg.bPrintStatus = false;
+
+        bench.Run("breath/analyze_breath", [&](std::uint64_t ops)
+        {
+            auto breath = std::make_unique<BreathAnalyzer>(breath_cfg);
+            BreathResult result{};
+            BreathEvent event{};
+            for (std::uint64_t i = 0; i < ops; ++i)
+            {
+                const std::size_t idx = static_cast<std::size_t>(i % windows.size());
+                if (idx == 0 && i != 0)
+                {
+                    breath = std::make_unique<BreathAnalyzer>(breath_cfg);
+                    result = BreathResult{};
+                }
+                DoNotOptimize(breath->AnalyzeBreath(windows[idx], result, event));
+            }
+            DoNotOptimize(event);
+        });
+    }
+
+    // Once per candidate breath, the budget is microseconds.
+    void BenchClassifier(BenchRunner& bench)
+    {
+        constexpr std::size_t count = 64;
+        std::vector<BreathFeatures> features(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const double k = static_cast<double>(i) / count;
+            features[i] = {0.05 + k, 0.5 + (4.0 * k), 5.0, 0.1 + (2.0 * k), k, 0.5 * k};
+        }
+
+        bench.Run("classifier/score", [&](std::uint64_t ops)
+        {
+            for (std::uint64_t i = 0; i < ops; ++i) {DoNotOptimize(DefaultBreathModel.Score(features[i & (count - 1)]));}
+        });
+    }
+
+    // ------------------------------------------------------------------------------------------------------------
+    // MQ-3 conversions
+    // ------------------------------------------------------------------------------------------------------------
+
+    void BenchMq3(BenchRunner& bench)
+    {
+        constexpr std::size_t count = 4096;
+        std::vector<double> volts(count);
+        for (std::size_t i = 0; i < count; ++i) {volts[i] = 0.3 + (2.7 * static_cast<double>(i) / count);}
+
+        std::vector<double> ratios(count);
+        for (std::size_t i = 0; i < count; ++i) {ratios[i] = MQ3::adc3v3_to_ratio(volts[i], Config::RLoad, Config::Ro_Air);}
+
+        bench.Run("mq3/adc3v3_to_ratio", [&](std::uint64_t ops)
+        {
+            for (std::uint64_t i = 0; i < ops; ++i) {DoNotOptimize(MQ3::adc3v3_to_ratio(volts[i & (count - 1)], Config::RLoad, Config::Ro_Air));}
+        });
+
+        bench.Run("mq3/concentration_exp", [&](std::uint64_t ops)
+        {
+            for (std::uint64_t i = 0; i < ops; ++i) {DoNotOptimize(MQ3::calculate_concentration_exp(ratios[i & (count - 1)]));}
+        });
+
+        bench.Run("mq3/concentration_log10", [&](std::uint64_t ops)
+        {
+            for (std::uint64_t i = 0; i < ops; ++i) {DoNotOptimize(MQ3::calculate_concentration_Log_10(ratios[i & (count - 1)]));}
+        });
+
+        // What the runtime does once per analyzed breath.
+        bench.Run("mq3/volts_to_bac", [&](std::uint64_t ops)
+        {
+            for (std::uint64_t i = 0; i < ops; ++i)
+            {
+                const double ratio = MQ3::adc3v3_to_ratio(volts[i & (count - 1)], Config::RLoad, Config::Ro_Air);
+                DoNotOptimize(MQ3::calculate_bac(MQ3::calculate_ppm(MQ3::calculate_concentration_exp(ratio))));
+            }
+        });
+    }
+
+    // ------------------------------------------------------------------------------------------------------------
+    // LED frames against the GPIO emulator
+    // ------------------------------------------------------------------------------------------------------------
+
+    // bank is set up in main, its init line would land in the middle of the table otherwise.
+    void BenchLeds(BenchRunner& bench, EmuGpio& bank)
+    {
+        if (!bench.GroupEnabled("led/")) {return;}
+
+        LedController leds(bank);
+
+        bench.Run("led/set_led", [&](std::uint64_t ops)
+        {
+            for (std::uint64_t i = 0; i < ops; ++i) {leds.SetLed(LedType::Green, (i & 1U) != 0);}
+        });
+
+        // One frame = every LED written once.
+        bench.Run("led/apply_mask_frame", [&](std::uint64_t ops)
+        {
+            for (std::uint64_t i = 0; i < ops; ++i) {leds.ApplyMask(static_cast<std::uint8_t>(i & 0x1FU));}
+        });
+
+        bench.Run("led/drive_bac_frame", [&](std::uint64_t ops)
+        {
+            for (std::uint64_t i = 0; i < ops; ++i) {leds.DriveBAC(static_cast<double>(i & 127U) * 0.001, std::chrono::seconds(0));}
+        });
+
+        DoNotOptimize(bank.Writes());
+        leds.Clear();
+    }
+
+    // ------------------------------------------------------------------------------------------------------------
+    // JSON in / out
+    // ------------------------------------------------------------------------------------------------------------
+
+    // What the numbers were measured on, a baseline from another board or a debug build isn't comparable.
+    struct BenchHost
+    {
+        std::string build_type;
+        std::string compiler;
+        std::string cpu;
+    };
+
+    BenchHost ThisHost()
+    {
+        BenchHost host{};
+        host.build_type = (DRUNK_BUILD_TYPE[0] != '\0') ? DRUNK_BUILD_TYPE : "None";
+#if defined(__GNUC__) && !defined(__clang__)
+        host.compiler = fmt::format("gcc {}", __VERSION__);
+#else
+        host.compiler = __VERSION__;
+#endif
+
+        // The Pi's kernel puts the board in "Model", x86 the part in "model name".
+        std::string model;
+        std::string model_name;
+        if (std::FILE* file = std::fopen("/proc/cpuinfo", "r"))
+        {
+            char line[256];
+            while (std::fgets(line, sizeof(line), file) != nullptr)
+            {
+                const char* colon = std::strchr(line, ':');
+                if (colon == nullptr) {continue;}
+                std::string value(colon + 1 + std::strspn(colon + 1, " \t"));
+                while (!value.empty() && (value.back() == '\n' || value.back() == ' ')) {value.pop_back();}
+                if (model.empty() && std::strncmp(line, "Model", 5) == 0) {model = value;}
+                if (model_name.empty() && std::strncmp(line, "model name", 10) == 0) {model_name = value;}
+            }
+            std::fclose(file);
+        }
+
+        utsname uts{};
+        const std::string arch = (uname(&uts) == 0) ? uts.machine : "unknown";
+        host.cpu = fmt::format("{} ({}, {} cpus)", !model.empty() ? model : (!model_name.empty() ? model_name : arch), arch, std::thread::hardware_concurrency());
+        return host;
+    }
+
+    std::string JsonEscaped(const std::string& text)
+    {
+        std::string out;
+        for (const char c : text)
+        {
+            if (c == '"' || c == '\\') {out.push_back('\\');}
+            out.push_back(c);
+        }
+        return out;
+    }
+
+    bool WriteJson(const std::string& path, const std::vector<BenchResult>& results, std::chrono::milliseconds min_time, std::size_t reps)
+    {
+        std::FILE* file = std::fopen(path.c_str(), "w");
+        if (file == nullptr)
+        {
+            fmt::print(stderr, "Error: cannot write {}\n", path);
+            return false;
+        }
+
+        const BenchHost host = ThisHost();
+        fmt::print(file, "{{\n  \"tool\": \"drunk_bench\",\n  \"version\": 1,\n  \"build_type\": \"{}\",\n  \"compiler\": \"{}\",\n  \"cpu\": \"{}\",\n"
+            "  \"cpus\": {},\n  \"min_time_ms\": {},\n  \"reps\": {},\n  \"benchmarks\": [\n",
+            JsonEscaped(host.build_type), JsonEscaped(host.compiler), JsonEscaped(host.cpu), std::thread::hardware_concurrency(), min_time.count(), reps);
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            const BenchResult& r = results[i];
+            // One benchmark per line, ReadBaseline relies on it.
+            fmt::print(file, "    {{\"name\": \"{}\", \"ns_per_op\": {:.4f}, \"ops_per_s\": {:.1f}, \"spread_pct\": {:.2f}, \"ops\": {}}}{}\n",
+                r.name, r.ns_per_op, 1e9 / r.ns_per_op, r.spread_pct, r.ops, (i + 1 < results.size()) ? "," : "");
+        }
+        fmt::print(file, "  ]\n}}\n");
+
+        const bool bOk = std::ferror(file) == 0;
+        return (std::fclose(file) == 0) && bOk;
+    }
+
+    // The value of a "key": "value" line, as written by WriteJson (no escapes in anything we compare).
+    bool JsonStringField(const char* line, const char* key, std::string& out)
+    {
+        const std::string prefix = fmt::format("\"{}\": \"", key);
+        const char* start = std::strstr(line, prefix.c_str());
+        if (start == nullptr) {return false;}
+        start += prefix.size();
+        const char* end = std::strrchr(start, '"');
+        if (end == nullptr) {return false;}
+        out.assign(start, end);
+        return true;
+    }
+
+    // Reads back a file written by WriteJson, not a general JSON parser.
+    bool ReadBaseline(const std::string& path, std::map<std::string, double>& ns_per_op, BenchHost& host)
+    {
+        std::FILE* file = std::fopen(path.c_str(), "r");
+        if (file == nullptr)
+        {
+            fmt::print(stderr, "Error: cannot open baseline {}\n", path);
+            return false;
+        }
+
+        char line[512];
+        while (std::fgets(line, sizeof(line), file) != nullptr)
+        {
+            JsonStringField(line, "build_type", host.build_type);
+            JsonStringField(line, "compiler", host.compiler);
+            JsonStringField(line, "cpu", host.cpu);
+
+            const char* name = std::strstr(line, "\"name\": \"");
+            const char* ns = std::strstr(line, "\"ns_per_op\": ");
+            if (name == nullptr || ns == nullptr) {continue;}
+
+            name += std::strlen("\"name\": \"");
+            const char* name_end = std::strchr(name, '"');
+            if (name_end == nullptr) {continue;}
+            ns_per_op[std::string(name, name_end)] = std::strtod(ns + std::strlen("\"ns_per_op\": "), nullptr);
+        }
+
+        std::fclose(file);
+        return true;
+    }
+
+    void PrintUsage(const char* argv0)
+    {
+        fmt::print("usage: {} [--filter substr] [--min-time ms] [--reps n] [--json out.json] [--baseline base.json] [--max-regression pct (15)]\n", argv0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string filter;
+    std::chrono::milliseconds min_time{50};
+    std::size_t reps = 5;
+    std::string json_path;
+    std::string baseline_path;
+    double max_regression_pct = 15.0; // Above the +-12% a bench spreads between reps on a shared host
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = (i + 1 < argc);
+        if (std::strcmp(argv[i], "--filter") == 0 && has_value) {filter = argv[++i];}
+        else if (std::strcmp(argv[i], "--min-time") == 0 && has_value) {min_time = std::chrono::milliseconds(std::strtoll(argv[++i], nullptr, 10));}
+        else if (std::strcmp(argv[i], "--reps") == 0 && has_value) {reps = std::max<std::size_t>(1, std::strtoull(argv[++i], nullptr, 10));}
+        else if (std::strcmp(argv[i], "--json") == 0 && has_value) {json_path = argv[++i];}
+        else if (std::strcmp(argv[i], "--baseline") == 0 && has_value) {baseline_path = argv[++i];}
+        else if (std::strcmp(argv[i], "--max-regression") == 0 && has_value) {max_regression_pct = std::strtod(argv[++i], nullptr);}
+        else
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    BenchRunner bench(min_time, reps, filter);
+
+    EmuGpio bank;
+    if (bench.GroupEnabled("led/") && !bank.Init("drunk_bench"))
+    {
+        fmt::print(stderr, "Error: GPIO emulator failed to init\n");
+        return 1;
+    }
+
+    BenchRing<64>(bench);
+    BenchRing<Config::RingSize>(bench);
+    BenchRing<65'536>(bench);
+
+    // Cross core only means something with more than one core to put the threads on.
+    const unsigned cpus = std::thread::hardware_concurrency();
+    BenchRingThreads<Config::RingSize>(bench, "unpinned", -1, -1);
+    BenchRingThreads<Config::RingSize>(bench, "same_core", 0, 0);
+    if (cpus > 1)
+    {
+        BenchRingThreads<64>(bench, "cross_core", 0, 1);
+        BenchRingThreads<Config::RingSize>(bench, "cross_core", 0, 1);
+    }
+
+    const std::vector<Sample> samples = MakeSamples(1U << 16U); // ~8.5 min, power of two for cheap wrapping
+    BenchWelford(bench, samples);
+    BenchReference(bench, samples);
+    BenchFlow(bench, samples);
+    BenchBreath(bench, samples);
+    BenchClassifier(bench);
+    BenchMq3(bench);
+    BenchLeds(bench, bank);
+
+    if (!json_path.empty() && !WriteJson(json_path, bench.Results(), min_time, reps)) {return 1;}
+    if (baseline_path.empty()) {return 0;}
+
+    std::map<std::string, double> baseline;
+    BenchHost baseline_host{};
+    if (!ReadBaseline(baseline_path, baseline, baseline_host)) {return 1;}
+
+    std::size_t regressions = 0;
+    const BenchHost host = ThisHost();
+    fmt::print("\nvs {} (regression > {:.1f}%)\n", baseline_path, max_regression_pct);
+    fmt::print("baseline: {} build on {}\nthis run: {} build on {}\n", baseline_host.build_type.empty() ? "?" : baseline_host.build_type,
+        baseline_host.cpu.empty() ? "?" : baseline_host.cpu, host.build_type, host.cpu);
+    if (baseline_host.cpu != host.cpu || baseline_host.build_type != host.build_type)
+    {
+        fmt::print(stderr, "Warning: baseline is from a different CPU or build type, the deltas compare machines rather than code\n");
+    }
+    if (host.build_type != "Release" && host.build_type != "RelWithDebInfo")
+    {
+        fmt::print(stderr, "Warning: {} build, benchmark numbers are only meaningful in Release\n", host.build_type);
+    }
+    for (const BenchResult& r : bench.Results())
+    {
+        const auto it = baseline.find(r.name);
+        if (it == baseline.end() || it->second <= 0.0)
+        {
+            fmt::print("{:<48} {:>12.2f} ns/op   (new)\n", r.name, r.ns_per_op);
+            continue;
+        }
+
+        // Slower than the threshold but no more than the bench moved between its own reps is noise, not a regression.
+        const double delta_pct = 100.0 * ((r.ns_per_op / it->second) - 1.0);
+        const bool bSlower = delta_pct > max_regression_pct;
+        const bool bRegressed = bSlower && delta_pct > r.spread_pct;
+        regressions += bRegressed ? 1U : 0U;
+        fmt::print("{:<48} {:>12.2f} -> {:>10.2f} ns/op {:+7.1f}%{}\n", r.name, it->second, r.ns_per_op, delta_pct,
+            bRegressed ? "  REGRESSED" : (bSlower ? fmt::format("  (within its {:.0f}% spread)", r.spread_pct) : std::string{}));
+    }
+
+    return (regressions > 0) ? 3 : 0;
+}
@@ -0,0 +1,100 @@
+// drunk_collector: receive the sample streams of a fleet of units (NetStreamSink, Config::CollectorHost) and archive
+// them merged by timestamp, one .darc segment per time bucket with a partition per unit.
+//
+//   drunk_collector [--port p] [--archive dir] [--bucket-s s] [--lateness-ms ms] [--stall-s s] [--max-buffered n]
+//                   [--stats-s s] [--seconds s]
+//
+// SIGINT / SIGTERM (or --seconds running out) merges what's still buffered and seals the open segment before exiting.
+#include "config_settings.h"
+#include "fleet_collector.h"
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/core.h>
+#include <thread>
+
+namespace
+{
+    using namespace DrunkAPI;
+
+    std::atomic<bool> g_stop{false};
+
+    void OnSignal(int) { g_stop.store(true); }
+
+    void PrintStats(const FleetCollectorStats& stats)
+    {
+        const FleetArchiveStats& archive = stats.archive;
+        fmt::print("conns {} (live units {}/{}) | recv {} merged {} late {} forced {} buffered {} | segments {} late files {} | lag p50 {:.0f}ms p99 {:.0f}ms | proto errors {}\n",
+            stats.connections, archive.live, archive.units, archive.received, archive.merged, archive.late, archive.forced,
+            archive.buffered, archive.segments, archive.late_files, archive.lag_p50_ms, archive.lag_p99_ms, stats.protocol_errors);
+        std::fflush(stdout);
+    }
+
+    void PrintUsage(const char* argv0)
+    {
+        fmt::print("usage: {} [--port p] [--archive dir] [--bucket-s s] [--lateness-ms ms] [--stall-s s] [--max-buffered n]\n"
+                   "          [--stats-s s] [--seconds s]\n", argv0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    FleetCollector_Config cfg{};
+    double stats_s = 10.0;
+    double seconds = 0.0; // Forever
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--port") == 0 && has_value) {cfg.port = static_cast<std::uint16_t>(std::strtoul(argv[++i], nullptr, 10));}
+        else if (std::strcmp(argv[i], "--archive") == 0 && has_value) {cfg.archive.dir = argv[++i];}
+        else if (std::strcmp(argv[i], "--bucket-s") == 0 && has_value) {cfg.archive.bucket = std::chrono::microseconds(static_cast<std::int64_t>(std::strtod(argv[++i], nullptr) * 1e6));}
+        else if (std::strcmp(argv[i], "--lateness-ms") == 0 && has_value) {cfg.archive.lateness = std::chrono::microseconds(static_cast<std::int64_t>(std::strtod(argv[++i], nullptr) * 1e3));}
+        else if (std::strcmp(argv[i], "--stall-s") == 0 && has_value) {cfg.archive.stall_after = std::chrono::microseconds(static_cast<std::int64_t>(std::strtod(argv[++i], nullptr) * 1e6));}
+        else if (std::strcmp(argv[i], "--max-buffered") == 0 && has_value) {cfg.archive.max_buffered = std::strtoull(argv[++i], nullptr, 10);}
+        else if (std::strcmp(argv[i], "--stats-s") == 0 && has_value) {stats_s = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--seconds") == 0 && has_value) {seconds = std::strtod(argv[++i], nullptr);}
+        else
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::signal(SIGINT, OnSignal);
+    std::signal(SIGTERM, OnSignal);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    FleetCollector collector;
+    if (!collector.Open(cfg)) {return 1;}
+    fmt::print("Collecting on port {} into {}\n", collector.Port(), cfg.archive.dir);
+    std::fflush(stdout);
+
+    // Stats + the --seconds deadline off the event loop, it only has to watch g_stop.
+    std::thread reporter([&]
+    {
+        const auto started = std::chrono::steady_clock::now();
+        auto next_stats = started + std::chrono::duration<double>(stats_s);
+        while (!g_stop.load())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            const auto now = std::chrono::steady_clock::now();
+            if (seconds > 0.0 && now - started >= std::chrono::duration<double>(seconds)) {g_stop.store(true);}
+            if (stats_s > 0.0 && now >= next_stats)
+            {
+                PrintStats(collector.Stats());
+                next_stats = now + std::chrono::duration<double>(stats_s);
+            }
+        }
+    });
+
+    collector.Run(g_stop);
+    g_stop.store(true); // Run() gave up on its own (epoll error)
+    reporter.join();
+
+    PrintStats(collector.Stats());
+    return 0;
+}
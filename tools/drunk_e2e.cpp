@@ -0,0 +1,583 @@
+// drunk_e2e: end to end load test of the live pipeline with a synthetic sensor.
+//
+//   drunk_e2e [--rates list] [--batch list] [--ring list] [--tick list] [--idle list] [--seconds s] [--window-us us]
+//   drunk_e2e --streams n [--workers list] [--rates list] [--batch b] [--tick ms] [--idle ms] [--seconds s] [--window-us us]
+//   drunk_e2e --i2c-faults
+//
+// Drives the real Sampler -> SpscRing -> ProcessRunner -> RuntimeProcess -> event callback chain, only the ADS1115 is
+// swapped for a source that stamps samples with the steady clock as fast as the sampler asks. Every combination of
+// sample rate, ConsumerMaxBatch (--batch), RingSize (--ring: 256, 4096 or 65536), consumer tick sleep and idle sleep
+// (ms) runs for --seconds. Lists are "a,b,c".
+//
+// Event latency is the time from the steady clock stamp of the sample that closed a window to the event callback
+// running for it, so it covers ring wait, consumer sleeps and both analyzers. Windows are shortened (--window-us,
+// default 1ms) so there are enough events for a p999.
+//
+// One CSV row per run goes to stdout. stderr gets, per consumer setting, the highest rate that ran without drops,
+// where drops start, and what that means in 128 SPS sensors per core.
+//
+// --streams is the many sensor case: n streams (default 128 SPS each) filled by one producer thread, the way a station
+// bus thread fills its sensors' rings, consumed either by a ProcessRunner thread per stream (workers 0) or by the
+// same runners as tasks on a StreamExecutor with each --workers count. Rows add the executor's scheduling wait p99
+// (worst stream) and steals.
+//
+// --i2c-faults is the recovery check the regress target runs: an Ads1115_Source on the emulator loses its fd, has
+// its bus wedged and gets unplugged, one after the other, and the I2cRecovery counts have to show each fault type,
+// a reopen and a bus recovery, one outage per fault and the thresholds written back after every one. Exits 1 if not.
+#include "ads1115.h"
+#include "ads1115_emu.h"
+#include "config_settings.h"
+#include "process_runner.h"
+#include "processor_types.h"
+#include "sampler.h"
+#include "spsc.h"
+#include "stream_executor.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/core.h>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using namespace DrunkAPI;
+
+    // Stand in for Ads1115_Source, clean air with a bit of noise.
+    struct SyntheticSource
+    {
+        mutable std::uint64_t produced = 0;
+        mutable std::uint64_t noise = 0x9E3779B97F4A7C15ULL;
+
+        bool sample_value(Sample& out) const
+        {
+            noise = (noise * 6364136223846793005ULL) + 1442695040888963407ULL;
+            const double volts = 1.2 + (static_cast<double>(noise >> 40U) / 16777216.0 - 0.5) * 0.001;
+
+            out.t_us = static_cast<std::uint64_t>(SteadyClock::now().count());
+            out.volts = static_cast<float>(volts);
+            out.raw = static_cast<std::int16_t>(volts / 4.096 * 32767.0);
+            ++produced;
+            return true;
+        }
+    };
+
+    // RuntimeProcess plus the bookkeeping the bench needs. ProcessRunner only sees on_batch/result.
+    class TimedProcess final
+    {
+        public:
+            TimedProcess(Analyzer_Config cfg, BreathAnalyzer_Config bcfg) : inner(cfg, bcfg) {}
+
+            static constexpr bool bEnableTimeout = false;
+
+            StepResult<BreathResult> on_batch(const Sample* sample, std::size_t n)
+            {
+                processed += n;
+                trigger_us = 0;
+
+                StepResult<BreathResult> step = inner.on_batch(sample, n);
+                if (step.event != StateEvent::None)
+                {
+                    // The window was closed by the first sample at or past its end.
+                    const std::uint64_t end_us = step.result.last_window.window_end_us;
+                    for (std::size_t i = 0; i < n; ++i)
+                    {
+                        if (sample[i].t_us >= end_us)
+                        {
+                            trigger_us = sample[i].t_us;
+                            break;
+                        }
+                    }
+                }
+                return step;
+            }
+
+            BreathResult result() const { return inner.result(); }
+
+            std::uint64_t processed = 0;
+            std::uint64_t trigger_us = 0; // Stamp of the sample that produced the current event, 0 if unknown
+
+        private:
+            RuntimeProcess inner;
+    };
+
+    struct RunConfig
+    {
+        double rate_hz = Config::SampleRate_Hz;
+        std::size_t ring = Config::RingSize;
+        std::size_t max_batch = Config::ConsumerMaxBatch;
+        std::chrono::milliseconds tick{Config::ConsumerTickSleep};
+        std::chrono::milliseconds idle{Config::ConsumerIdleSleep};
+    };
+
+    struct RunResult
+    {
+        double produced_sps = 0.0;
+        double processed_sps = 0.0;
+        std::uint64_t produced = 0;
+        std::uint64_t processed = 0;
+        std::uint64_t dropped = 0;
+        std::uint64_t events = 0;
+        double p50_us = 0.0;
+        double p99_us = 0.0;
+        double p999_us = 0.0;
+        double cpu_ns_per_sample = 0.0;
+        double cpu_pct = 0.0;
+    };
+
+    double CpuSeconds()
+    {
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        auto seconds = [](const timeval& tv) { return static_cast<double>(tv.tv_sec) + (static_cast<double>(tv.tv_usec) * 1e-6); };
+        return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+    }
+
+    double Percentile(const std::vector<std::uint64_t>& sorted, double q)
+    {
+        if (sorted.empty()) {return 0.0;}
+        const auto idx = std::min(sorted.size() - 1, static_cast<std::size_t>(q * static_cast<double>(sorted.size())));
+        return static_cast<double>(sorted[idx]);
+    }
+
+    template<std::size_t RingN>
+    RunResult RunPipeline(const RunConfig& run, std::chrono::duration<double> duration, std::uint32_t window_us)
+    {
+        Analyzer_Config analyzer_cfg{};
+        analyzer_cfg.window_micro = window_us;
+        analyzer_cfg.min_window_sample_size = 1;
+        analyzer_cfg.bDebugPrint = false;
+        BreathAnalyzer_Config breath_cfg{};
+        breath_cfg.bPrintStatus = false;
+
+        SamplerConfg sampler_cfg{};
+        sampler_cfg.sample_rate = std::chrono::nanoseconds(std::max<long long>(1, std::llround(1e9 / run.rate_hz)));
+
+        Consumer_Config consumer_cfg{};
+        consumer_cfg.max_batch = run.max_batch;
+        consumer_cfg.consumer_tick_sleep = run.tick;
+        consumer_cfg.consumer_idle_sleep = run.idle;
+
+        SyntheticSource source;
+        auto sampler = std::make_unique<Sampler<SyntheticSource, RingN>>(source, sampler_cfg);
+        TimedProcess processor(analyzer_cfg, breath_cfg);
+
+        // Reserve so the callback never allocates mid run.
+        std::vector<std::uint64_t> latencies;
+        latencies.reserve(static_cast<std::size_t>(std::min(1e7, (duration.count() * 1e6 / window_us) + (duration.count() * run.rate_hz) + 16.0)));
+
+        g_running.store(true, std::memory_order_relaxed);
+        std::thread stopper([duration]
+        {
+            std::this_thread::sleep_for(duration);
+            g_running.store(false, std::memory_order_relaxed);
+        });
+
+        const double cpu_start = CpuSeconds();
+        const auto wall_start = std::chrono::steady_clock::now();
+        {
+            ProcessRunner<Sampler<SyntheticSource, RingN>, TimedProcess> runner(*sampler, consumer_cfg, processor);
+            runner.run([&](TimedProcess& process)
+            {
+                if (process.trigger_us == 0 || latencies.size() == latencies.capacity()) {return;}
+                const auto now_us = static_cast<std::uint64_t>(SteadyClock::now().count());
+                latencies.push_back(now_us - process.trigger_us);
+            });
+        } // Runner stops the sampler on the way out
+        const double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+        const double cpu_s = CpuSeconds() - cpu_start;
+        stopper.join();
+        g_running.store(true, std::memory_order_relaxed);
+
+        std::sort(latencies.begin(), latencies.end());
+
+        RunResult result{};
+        result.produced = source.produced;
+        result.processed = processor.processed;
+        result.dropped = sampler->dropped();
+        result.events = latencies.size();
+        result.produced_sps = static_cast<double>(result.produced) / wall_s;
+        result.processed_sps = static_cast<double>(result.processed) / wall_s;
+        result.p50_us = Percentile(latencies, 0.50);
+        result.p99_us = Percentile(latencies, 0.99);
+        result.p999_us = Percentile(latencies, 0.999);
+        result.cpu_ns_per_sample = (result.processed > 0) ? cpu_s * 1e9 / static_cast<double>(result.processed) : 0.0;
+        result.cpu_pct = 100.0 * cpu_s / wall_s;
+        return result;
+    }
+
+    bool RunRing(const RunConfig& run, std::chrono::duration<double> duration, std::uint32_t window_us, RunResult& out)
+    {
+        switch (run.ring)
+        {
+            case 256: out = RunPipeline<256>(run, duration, window_us); return true;
+            case 4096: out = RunPipeline<4096>(run, duration, window_us); return true;
+            case 65536: out = RunPipeline<65536>(run, duration, window_us); return true;
+            default:
+                fmt::print(stderr, "Error: ring size {} not built in (256, 4096, 65536)\n", run.ring);
+                return false;
+        }
+    }
+
+    // Sampler shaped ring so a ProcessRunner can sit on it, the many-stream producer fills it from outside.
+    template<std::size_t RingN>
+    struct RingFeed
+    {
+        SpscRing<Sample, RingN> ring;
+        SpscRing<Sample, RingN>& buffer() { return ring; }
+        void start_sampler() {}
+        void stop_sampler() {}
+    };
+
+    struct StreamsConfig
+    {
+        std::size_t streams = 16;
+        std::size_t workers = 0; // 0 = a ProcessRunner thread per stream
+        double rate_hz = Config::SampleRate_Hz; // Per stream
+        std::size_t max_batch = Config::ConsumerMaxBatch;
+        std::chrono::milliseconds tick{Config::ConsumerTickSleep};
+        std::chrono::milliseconds idle{Config::ConsumerIdleSleep};
+    };
+
+    struct StreamsResult
+    {
+        std::size_t threads = 0; // Consumer side threads (runners, or executor workers + poller)
+        double processed_sps = 0.0;
+        std::uint64_t dropped = 0;
+        std::uint64_t events = 0;
+        double p50_us = 0.0;
+        double p99_us = 0.0;
+        double p999_us = 0.0;
+        double sched_wait_p99_us = 0.0;
+        std::uint64_t steals = 0;
+        double cpu_pct = 0.0;
+    };
+
+    StreamsResult RunStreams(const StreamsConfig& run, std::chrono::duration<double> duration, std::uint32_t window_us)
+    {
+        constexpr std::size_t RingN = Config::RingSize;
+        using Feed = RingFeed<RingN>;
+        using Runner = ProcessRunner<Feed, TimedProcess>;
+
+        Analyzer_Config analyzer_cfg{};
+        analyzer_cfg.window_micro = window_us;
+        analyzer_cfg.min_window_sample_size = 1;
+        analyzer_cfg.bDebugPrint = false;
+        BreathAnalyzer_Config breath_cfg{};
+        breath_cfg.bPrintStatus = false;
+
+        Consumer_Config consumer_cfg{};
+        consumer_cfg.max_batch = run.max_batch;
+        consumer_cfg.consumer_tick_sleep = run.tick;
+        consumer_cfg.consumer_idle_sleep = run.idle;
+
+        std::vector<std::unique_ptr<Feed>> feeds;
+        std::vector<std::unique_ptr<TimedProcess>> processors;
+        std::vector<std::unique_ptr<Runner>> runners;
+        std::vector<std::vector<std::uint64_t>> latencies(run.streams);
+        const auto expected_events = static_cast<std::size_t>(std::min(1e6, (duration.count() * 1e6 / window_us) + (duration.count() * run.rate_hz) + 16.0));
+        for (std::size_t i = 0; i < run.streams; ++i)
+        {
+            feeds.push_back(std::make_unique<Feed>());
+            processors.push_back(std::make_unique<TimedProcess>(analyzer_cfg, breath_cfg));
+            runners.push_back(std::make_unique<Runner>(*feeds.back(), consumer_cfg, *processors.back()));
+            latencies[i].reserve(expected_events);
+        }
+
+        auto on_event = [&latencies](std::size_t stream, TimedProcess& process)
+        {
+            std::vector<std::uint64_t>& out = latencies[stream];
+            if (process.trigger_us == 0 || out.size() == out.capacity()) {return;}
+            out.push_back(static_cast<std::uint64_t>(SteadyClock::now().count()) - process.trigger_us);
+        };
+
+        // One producer for every stream, like a bus thread.
+        std::atomic<bool> bProducing{true};
+        std::uint64_t dropped = 0;
+        SyntheticSource source;
+        const auto period = std::chrono::nanoseconds(std::max<long long>(1, std::llround(1e9 / run.rate_hz)));
+
+        const double cpu_start = CpuSeconds();
+        const auto wall_start = std::chrono::steady_clock::now();
+        std::thread producer([&]
+        {
+            auto next = std::chrono::steady_clock::now();
+            while (bProducing.load(std::memory_order_relaxed))
+            {
+                next += period;
+                for (const auto& feed : feeds)
+                {
+                    Sample sample{};
+                    source.sample_value(sample);
+                    if (!feed->ring.push_overwrite(sample)) {++dropped;}
+                }
+                std::this_thread::sleep_until(next);
+            }
+        });
+
+        StreamsResult result{};
+        if (run.workers == 0)
+        {
+            g_running.store(true, std::memory_order_relaxed);
+            std::vector<std::thread> threads;
+            for (std::size_t i = 0; i < run.streams; ++i)
+            {
+                threads.emplace_back([&, i]{ runners[i]->run([&, i](TimedProcess& process){ on_event(i, process); }); });
+            }
+            std::this_thread::sleep_for(duration);
+            g_running.store(false, std::memory_order_relaxed);
+            for (std::thread& thread : threads) {thread.join();}
+            g_running.store(true, std::memory_order_relaxed);
+            result.threads = run.streams;
+        }
+        else
+        {
+            StreamExecutor_Config executor_cfg{};
+            executor_cfg.threads = run.workers;
+            executor_cfg.poll = run.tick;
+            StreamExecutor executor(executor_cfg);
+            for (std::size_t i = 0; i < run.streams; ++i)
+            {
+                executor.AddRunner(fmt::format("stream{}", i), *runners[i], [&on_event, i](TimedProcess& process){ on_event(i, process); });
+            }
+
+            executor.Start();
+            std::this_thread::sleep_for(duration);
+            executor.Stop();
+
+            for (std::size_t i = 0; i < executor.Size(); ++i)
+            {
+                const StreamLatency latency = executor.Latency(i);
+                result.sched_wait_p99_us = std::max(result.sched_wait_p99_us, latency.wait_p99_us);
+                result.steals += latency.steals;
+            }
+            result.threads = executor.Threads() + 1;
+        }
+
+        bProducing.store(false, std::memory_order_relaxed);
+        producer.join();
+        const double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+        const double cpu_s = CpuSeconds() - cpu_start;
+
+        std::vector<std::uint64_t> all;
+        std::uint64_t processed = 0;
+        for (std::size_t i = 0; i < run.streams; ++i)
+        {
+            all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+            processed += processors[i]->processed;
+        }
+        std::sort(all.begin(), all.end());
+
+        result.processed_sps = static_cast<double>(processed) / wall_s;
+        result.dropped = dropped;
+        result.events = all.size();
+        result.p50_us = Percentile(all, 0.50);
+        result.p99_us = Percentile(all, 0.99);
+        result.p999_us = Percentile(all, 0.999);
+        result.cpu_pct = 100.0 * cpu_s / wall_s;
+        return result;
+    }
+
+    // Each fault ends before the next one starts, reads every 2ms like a 475 SPS source would.
+    int RunI2cFaults()
+    {
+        Ads1115Emu_Config adc{};
+        adc.bRealTime = false;
+        adc.lose_fd_at_s = 0.5;
+        adc.wedge_at_s = 1.5;
+        adc.unplug_at_s = 2.5;
+        adc.unplug_for_s = 0.5;
+
+        Ads1115Emu ads(adc);
+        if (!ads.Init(1, adc.addr) || !EnableConversionReady(ads, adc.addr)) {return 1;}
+        Ads1115_Source<Ads1115Emu> source(ads, adc.addr, ADS1115::Mux::AIN0_GND, ADS1115::Pga::FS_4_096V, ADS1115::DataRate::SPS_475);
+
+        Sample sample{};
+        std::uint64_t good = 0;
+        const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(3'500);
+        while (std::chrono::steady_clock::now() < end)
+        {
+            if (source.sample_value(sample)) {++good;}
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+
+        const I2cHealth health = ads.Recovery().Health(static_cast<std::uint64_t>(SteadyClock::now().count()));
+        constexpr auto Fault = [](I2cFault fault) { return static_cast<std::size_t>(fault); };
+        fmt::print("i2c faults: {} good reads, {} failed, nack={} bus_timeout={} io={}, {} outages, {} reopens, {} bus recoveries, {} reprograms, "
+            "availability {:.1f}% over {:.1f}s\n", good, health.failed_reads, health.faults[Fault(I2cFault::Nack)],
+            health.faults[Fault(I2cFault::BusTimeout)], health.faults[Fault(I2cFault::Io)], health.outages, health.reopens, health.bus_recoveries,
+            health.reprograms, health.availability * 100.0, static_cast<double>(health.session_us) / 1e6);
+
+        bool bOk = true;
+        const auto expect = [&](bool bCond, const char* what)
+        {
+            if (!bCond) {fmt::print(stderr, "Error: I2C fault check failed: {}\n", what); bOk = false;}
+        };
+        expect(health.faults[Fault(I2cFault::Io)] > 0, "lost fd not seen as io faults");
+        expect(health.faults[Fault(I2cFault::BusTimeout)] > 0, "wedged bus not seen as bus timeouts");
+        expect(health.faults[Fault(I2cFault::Nack)] > 0, "unplugged board not seen as nacks");
+        expect(health.outages == 3, "expected one outage per fault");
+        expect(health.current_outage_us == 0, "bus still out at the end");
+        expect(health.reopens >= 3, "every outage should get a reopen");
+        expect(health.bus_recoveries >= 2, "the wedge and the unplug should get bus recoveries");
+        expect(health.reprograms == health.outages, "thresholds not written back after every outage");
+        expect(!health.bSloJudged && health.bSloMet, "SLO judged on a session shorter than I2cSloMinSessionS");
+        return bOk ? 0 : 1;
+    }
+
+    bool ParseList(const char* text, std::vector<double>& out)
+    {
+        out.clear();
+        const char* cursor = text;
+        while (*cursor != '\0')
+        {
+            char* end = nullptr;
+            const double value = std::strtod(cursor, &end);
+            if (end == cursor) {return false;}
+            out.push_back(value);
+            cursor = (*end == ',') ? end + 1 : end;
+        }
+        return !out.empty();
+    }
+
+    void PrintUsage(const char* argv0)
+    {
+        fmt::print("usage: {} [--rates list] [--batch list] [--ring list] [--tick list] [--idle list] [--seconds s] [--window-us us]\n", argv0);
+        fmt::print("       {} --streams n [--workers list] [--rates list] [--batch b] [--tick ms] [--idle ms] [--seconds s] [--window-us us]\n", argv0);
+        fmt::print("       {} --i2c-faults\n", argv0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<double> rates{128, 1'000, 10'000, 100'000, 1'000'000, 4'000'000};
+    std::vector<double> batches{static_cast<double>(Config::ConsumerMaxBatch), 4096};
+    std::vector<double> rings{static_cast<double>(Config::RingSize), 65536};
+    std::vector<double> ticks{0, static_cast<double>(Config::ConsumerTickSleep.count())};
+    std::vector<double> idles{static_cast<double>(Config::ConsumerIdleSleep.count())};
+    double seconds = 0.5;
+    std::uint32_t window_us = 1'000;
+
+    // Many-stream mode
+    std::size_t streams = 0;
+    std::vector<double> workers{0, 1, 2, 4};
+    bool bRatesGiven = false;
+    bool bTickGiven = false;
+    bool bIdleGiven = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = (i + 1 < argc);
+        bool bOk = has_value;
+        if (std::strcmp(argv[i], "--i2c-faults") == 0) {return RunI2cFaults();}
+        else if (std::strcmp(argv[i], "--rates") == 0 && has_value) {bOk = ParseList(argv[++i], rates); bRatesGiven = true;}
+        else if (std::strcmp(argv[i], "--batch") == 0 && has_value) {bOk = ParseList(argv[++i], batches);}
+        else if (std::strcmp(argv[i], "--ring") == 0 && has_value) {bOk = ParseList(argv[++i], rings);}
+        else if (std::strcmp(argv[i], "--tick") == 0 && has_value) {bOk = ParseList(argv[++i], ticks); bTickGiven = true;}
+        else if (std::strcmp(argv[i], "--idle") == 0 && has_value) {bOk = ParseList(argv[++i], idles); bIdleGiven = true;}
+        else if (std::strcmp(argv[i], "--streams") == 0 && has_value) {streams = std::strtoull(argv[++i], nullptr, 10); bOk = streams > 0;}
+        else if (std::strcmp(argv[i], "--workers") == 0 && has_value) {bOk = ParseList(argv[++i], workers);}
+        else if (std::strcmp(argv[i], "--seconds") == 0 && has_value) {seconds = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--window-us") == 0 && has_value) {window_us = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));}
+        else {bOk = false;}
+
+        if (!bOk || seconds <= 0.0 || window_us == 0)
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    std::sort(rates.begin(), rates.end());
+
+    const std::chrono::duration<double> duration(seconds);
+
+    if (streams > 0)
+    {
+        StreamsConfig run{};
+        run.streams = streams;
+        run.max_batch = std::max<std::size_t>(1, static_cast<std::size_t>(batches.front()));
+        if (bTickGiven) {run.tick = std::chrono::milliseconds(static_cast<long long>(ticks.front()));}
+        if (bIdleGiven) {run.idle = std::chrono::milliseconds(static_cast<long long>(idles.front()));}
+        if (!bRatesGiven) {rates.assign(1, Config::SampleRate_Hz);}
+
+        fmt::print("streams,workers,threads,rate_hz,processed_sps,dropped,events,p50_us,p99_us,p999_us,sched_wait_p99_us,steals,cpu_pct\n");
+        for (const double rate : rates)
+        {
+            for (const double worker_count : workers)
+            {
+                run.rate_hz = rate;
+                run.workers = static_cast<std::size_t>(worker_count);
+                const StreamsResult result = RunStreams(run, duration, window_us);
+                fmt::print("{},{},{},{},{:.0f},{},{},{:.0f},{:.0f},{:.0f},{:.0f},{},{:.1f}\n", run.streams, run.workers, result.threads, rate,
+                    result.processed_sps, result.dropped, result.events, result.p50_us, result.p99_us, result.p999_us,
+                    result.sched_wait_p99_us, result.steals, result.cpu_pct);
+                std::fflush(stdout);
+            }
+        }
+        return 0;
+    }
+
+    fmt::print("rate_hz,ring,max_batch,tick_ms,idle_ms,produced_sps,processed_sps,dropped,drop_pct,events,p50_us,p99_us,p999_us,cpu_ns_per_sample,cpu_pct\n");
+
+    for (const double ring : rings)
+    {
+        for (const double batch : batches)
+        {
+            for (const double tick : ticks)
+            {
+                for (const double idle : idles)
+                {
+                    RunConfig run{};
+                    run.ring = static_cast<std::size_t>(ring);
+                    run.max_batch = std::max<std::size_t>(1, static_cast<std::size_t>(batch));
+                    run.tick = std::chrono::milliseconds(static_cast<long long>(tick));
+                    run.idle = std::chrono::milliseconds(static_cast<long long>(idle));
+
+                    double sustained_sps = 0.0;
+                    double sustained_cpu_ns = 0.0;
+                    double drop_onset_hz = 0.0;
+
+                    for (const double rate : rates)
+                    {
+                        run.rate_hz = rate;
+                        RunResult result{};
+                        if (!RunRing(run, duration, window_us, result)) {return 1;}
+
+                        const double drop_pct = (result.produced > 0) ? 100.0 * static_cast<double>(result.dropped) / static_cast<double>(result.produced) : 0.0;
+                        fmt::print("{},{},{},{},{},{:.0f},{:.0f},{},{:.3f},{},{:.0f},{:.0f},{:.0f},{:.1f},{:.1f}\n", rate, run.ring, run.max_batch,
+                            run.tick.count(), run.idle.count(), result.produced_sps, result.processed_sps, result.dropped, drop_pct, result.events,
+                            result.p50_us, result.p99_us, result.p999_us, result.cpu_ns_per_sample, result.cpu_pct);
+                        std::fflush(stdout);
+
+                        // Sustained = nothing dropped and the consumer ended at most one loop (a batch, or a tick + idle
+                        // worth of samples) behind the sampler, anything more means the ring was filling up.
+                        const std::uint64_t backlog = result.produced - std::min(result.produced, result.processed + result.dropped);
+                        const double one_loop = std::max(static_cast<double>(run.max_batch), rate * static_cast<double>((run.tick + run.idle).count()) / 1e3);
+                        if (result.dropped == 0 && static_cast<double>(backlog) <= one_loop && result.processed_sps > sustained_sps)
+                        {
+                            sustained_sps = result.processed_sps;
+                            sustained_cpu_ns = result.cpu_ns_per_sample;
+                        }
+                        if (result.dropped > 0 && drop_onset_hz == 0.0) {drop_onset_hz = rate;}
+                    }
+
+                    const double sensor_sps = Config::SampleRate_Hz;
+                    fmt::print(stderr, "ring {} batch {} tick {}ms idle {}ms: sustained {:.0f} samples/s ({:.0f} sensors @{} SPS), drops from {}, "
+                        "{:.0f} ns CPU/sample (~{:.0f} sensors per core)\n", run.ring, run.max_batch, run.tick.count(), run.idle.count(),
+                        sustained_sps, sustained_sps / sensor_sps, Config::SampleRate_Hz,
+                        (drop_onset_hz > 0.0) ? fmt::format("{:.0f} Hz", drop_onset_hz) : std::string("never"), sustained_cpu_ns,
+                        (sustained_cpu_ns > 0.0) ? 1e9 / (sustained_cpu_ns * sensor_sps) : 0.0);
+                }
+            }
+        }
+    }
+    return 0;
+}
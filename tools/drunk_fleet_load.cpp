@@ -0,0 +1,458 @@
+// drunk_fleet_load: hundreds of simulated units streaming to a collector on localhost, then an audit of the archive.
+//
+//   drunk_fleet_load [--units n] [--seconds s] [--rate hz] [--threads t] [--reorder p] [--late p] [--late-ms ms]
+//                    [--bucket-s s] [--lateness-ms ms] [--skew-s s] [--drift-ppm p] [--wall-error-ms ms] [--no-sync]
+//                    [--archive dir] [--keep]
+//   drunk_fleet_load --port p [--host h] [--units n] ...     (someone else's drunk_collector, no audit)
+//
+// Every unit is a real NetStreamSink (own sender thread + TCP connection) fed with SignalGenerator samples in real time
+// by a few driver threads. --reorder swaps neighbouring samples inside a batch (merged fine as long as it's within the
+// lateness allowance), --late holds samples back for --late-ms before sending them (past the allowance, so they must
+// end up in the late files). By default the collector runs in process on a free port with a scratch archive, and the
+// audit checks every sample the units got out is in the archive exactly once: segments in bucket order, partitions in
+// time order, per unit counts matching.
+//
+// Each unit also gets its own steady clock: a random epoch (--skew-s), a crystal error (--drift-ppm) and a wall clock
+// that's off by up to --wall-error-ms (what the hello fallback would go by). Units stream once their clock sync has
+// an estimate. Every unit samples on an exact grid of true steady time, so the audit maps each archived stamp back to
+// the collector's steady clock and measures how far it landed from the grid: that's the cross unit alignment error.
+// It can only see errors up to half a sample period, --no-sync shows what unaligned looks like (noise over the period).
+//
+// Exit: 0 audit passed, 2 audit failed, 1 setup error.
+#include "config_settings.h"
+#include "fleet_collector.h"
+#include "net_stream.h"
+#include "signal_gen.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fmt/core.h>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    using namespace DrunkAPI;
+
+    struct LoadConfig
+    {
+        std::size_t units = 300;
+        double seconds = 10.0;
+        double rate_hz = Config::SampleRate_Hz;
+        std::size_t threads = 4;
+        double reorder = 0.01; // Per sample
+        double late = 0.001; // Per sample
+        double late_ms = 5000.0;
+        double bucket_s = 1.0;
+        double lateness_ms = 1000.0;
+        std::string archive;
+        bool bKeep = false;
+        double skew_s = 30.0;
+        double drift_ppm = 50.0;
+        double wall_error_ms = 500.0;
+        bool bSync = true;
+        std::string host = "127.0.0.1";
+        std::uint16_t port = 0; // 0 = in process collector
+    };
+
+    struct SimUnit
+    {
+        std::uint64_t id = 0;
+        std::int64_t skew_us = 0; // Unit steady = true steady + skew + drift since start
+        double drift_ppm = 0.0;
+        std::uint64_t epoch_us = 0;
+        std::uint64_t origin_us = 0; // True steady time of the first sample, the grid starts here
+
+        NetStreamSink sink;
+        std::unique_ptr<SignalGenerator> generator;
+        std::uint64_t next_t_us = 0;
+        std::vector<Sample> batch;
+        std::vector<std::pair<std::uint64_t, Sample>> held; // release at (steady us), sample
+        std::uint64_t injected_late = 0;
+        std::uint64_t reordered = 0;
+
+        std::uint64_t Mono(std::uint64_t true_us) const
+        {
+            const double drift = drift_ppm * 1e-6 * static_cast<double>(static_cast<std::int64_t>(true_us - epoch_us));
+            return true_us + static_cast<std::uint64_t>(skew_us + static_cast<std::int64_t>(drift));
+        }
+    };
+
+    struct Rng
+    {
+        std::uint64_t state;
+        double Uniform()
+        {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return static_cast<double>(state >> 11) * 0x1.0p-53;
+        }
+    };
+
+    std::uint64_t SteadyUs()
+    {
+        return static_cast<std::uint64_t>(SteadyClock::now().count());
+    }
+
+    // One tick of a unit: everything due since the last tick, with the configured damage.
+    void Produce(SimUnit& unit, const LoadConfig& cfg, Rng& rng, std::uint64_t now_us, bool bFinal)
+    {
+        const auto period_us = static_cast<std::uint64_t>(1e6 / cfg.rate_hz);
+        const auto late_us = static_cast<std::uint64_t>(cfg.late_ms * 1e3);
+
+        unit.batch.clear();
+        Sample sample{};
+        for (; unit.next_t_us <= now_us; unit.next_t_us += period_us)
+        {
+            if (!unit.generator->Step(unit.next_t_us, sample)) {continue;} // Simulated I2C drop
+            sample.t_us = unit.Mono(unit.next_t_us);
+            if (!bFinal && rng.Uniform() < cfg.late)
+            {
+                unit.held.emplace_back(now_us + late_us, sample);
+                ++unit.injected_late;
+                continue;
+            }
+            unit.batch.push_back(sample);
+        }
+
+        for (std::size_t i = 0; i + 1 < unit.batch.size(); ++i)
+        {
+            if (rng.Uniform() < cfg.reorder)
+            {
+                std::swap(unit.batch[i], unit.batch[i + 1]);
+                ++unit.reordered;
+                ++i;
+            }
+        }
+
+        auto due = std::partition(unit.held.begin(), unit.held.end(), [&](const auto& entry){ return !bFinal && entry.first > now_us; });
+        for (auto it = due; it != unit.held.end(); ++it) {unit.batch.push_back(it->second);}
+        unit.held.erase(due, unit.held.end());
+
+        unit.sink.OnSamples(unit.batch.data(), unit.batch.size());
+    }
+
+    struct AuditResult
+    {
+        std::uint64_t archived = 0;
+        std::uint64_t late = 0;
+        std::size_t segments = 0;
+        std::vector<std::uint32_t> align_us; // |distance to the unit's sample grid| per archived sample
+    };
+
+    bool Audit(const LoadConfig& cfg, const std::vector<std::unique_ptr<SimUnit>>& units, std::int64_t shared_offset_us, AuditResult& result)
+    {
+        bool bOk = true;
+        std::unordered_map<std::uint64_t, std::uint64_t> per_unit;
+        std::unordered_map<std::uint64_t, std::uint64_t> origins;
+        for (const auto& unit : units) {origins[unit->id] = unit->origin_us;}
+
+        const auto period = static_cast<std::int64_t>(1e6 / cfg.rate_hz);
+        auto align = [&](std::uint64_t unit_id, std::uint64_t shared_us)
+        {
+            const auto since_origin = static_cast<std::int64_t>(shared_us - static_cast<std::uint64_t>(shared_offset_us) - origins[unit_id]);
+            const std::int64_t phase = ((since_origin % period) + period) % period;
+            result.align_us.push_back(static_cast<std::uint32_t>(std::min(phase, period - phase)));
+        };
+        std::uint64_t prev_bucket_end = 0;
+
+        const std::vector<std::string> paths = ListArchive(cfg.archive);
+        result.segments = paths.size();
+        for (const std::string& path : paths)
+        {
+            ArchiveSegment segment;
+            if (!segment.Open(path)) {return false;}
+
+            const ArchiveHeader& header = segment.Header();
+            const std::uint64_t start = header.bucket_start_wall_us;
+            const std::uint64_t end = start + header.bucket_us;
+            if (start < prev_bucket_end)
+            {
+                fmt::print(stderr, "FAIL: {} overlaps the previous segment\n", path);
+                bOk = false;
+            }
+            prev_bucket_end = end;
+
+            std::uint64_t prev_unit = 0;
+            for (const ArchivePartition& partition : segment.Partitions())
+            {
+                if (partition.unit_id <= prev_unit && prev_unit != 0)
+                {
+                    fmt::print(stderr, "FAIL: {} partitions out of unit order\n", path);
+                    bOk = false;
+                }
+                prev_unit = partition.unit_id;
+
+                const auto samples = segment.Samples(partition);
+                for (std::size_t i = 0; i < samples.size(); ++i)
+                {
+                    if (samples[i].t_us < start || samples[i].t_us >= end || (i > 0 && samples[i].t_us < samples[i - 1].t_us))
+                    {
+                        fmt::print(stderr, "FAIL: {} unit {} sample {} out of order / outside its bucket\n", path, partition.unit_id, i);
+                        bOk = false;
+                        break;
+                    }
+                    align(partition.unit_id, samples[i].t_us);
+                }
+                per_unit[partition.unit_id] += partition.count;
+                result.archived += partition.count;
+            }
+        }
+
+        for (const std::string& path : ListArchive(cfg.archive, true))
+        {
+            ArchiveSegment segment;
+            if (!segment.Open(path)) {return false;}
+            for (const ArchivePartition& partition : segment.Partitions())
+            {
+                for (const Sample& sample : segment.Samples(partition)) {align(partition.unit_id, sample.t_us);}
+                per_unit[partition.unit_id] += partition.count;
+                result.late += partition.count;
+            }
+        }
+
+        for (const auto& unit : units)
+        {
+            const std::uint64_t sent = unit->sink.Stats().sent;
+            if (per_unit[unit->id] != sent)
+            {
+                fmt::print(stderr, "FAIL: unit {} sent {} samples, archive has {}\n", unit->id, sent, per_unit[unit->id]);
+                bOk = false;
+            }
+        }
+        return bOk;
+    }
+
+    void PrintUsage(const char* argv0)
+    {
+        fmt::print("usage: {} [--units n] [--seconds s] [--rate hz] [--threads t] [--reorder p] [--late p] [--late-ms ms]\n"
+                   "          [--bucket-s s] [--lateness-ms ms] [--skew-s s] [--drift-ppm p] [--wall-error-ms ms] [--no-sync]\n"
+                   "          [--archive dir] [--keep] [--host h --port p]\n", argv0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    LoadConfig cfg{};
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--units") == 0 && has_value) {cfg.units = std::strtoull(argv[++i], nullptr, 10);}
+        else if (std::strcmp(argv[i], "--seconds") == 0 && has_value) {cfg.seconds = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--rate") == 0 && has_value) {cfg.rate_hz = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--threads") == 0 && has_value) {cfg.threads = std::strtoull(argv[++i], nullptr, 10);}
+        else if (std::strcmp(argv[i], "--reorder") == 0 && has_value) {cfg.reorder = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--late") == 0 && has_value) {cfg.late = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--late-ms") == 0 && has_value) {cfg.late_ms = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--bucket-s") == 0 && has_value) {cfg.bucket_s = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--lateness-ms") == 0 && has_value) {cfg.lateness_ms = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--skew-s") == 0 && has_value) {cfg.skew_s = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--drift-ppm") == 0 && has_value) {cfg.drift_ppm = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--wall-error-ms") == 0 && has_value) {cfg.wall_error_ms = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--no-sync") == 0) {cfg.bSync = false;}
+        else if (std::strcmp(argv[i], "--archive") == 0 && has_value) {cfg.archive = argv[++i];}
+        else if (std::strcmp(argv[i], "--keep") == 0) {cfg.bKeep = true;}
+        else if (std::strcmp(argv[i], "--host") == 0 && has_value) {cfg.host = argv[++i];}
+        else if (std::strcmp(argv[i], "--port") == 0 && has_value) {cfg.port = static_cast<std::uint16_t>(std::strtoul(argv[++i], nullptr, 10));}
+        else
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.units == 0 || cfg.rate_hz <= 0.0 || cfg.threads == 0)
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // Two sockets per unit in process, the default 1024 fds runs out around 500 units.
+    rlimit files{};
+    if (::getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max)
+    {
+        files.rlim_cur = files.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    // In process collector on a free port unless pointed at a running one.
+    const bool bLocal = cfg.port == 0;
+    FleetCollector collector;
+    std::atomic<bool> bStopCollector{false};
+    std::thread collector_thread;
+    if (bLocal)
+    {
+        if (cfg.archive.empty()) {cfg.archive = fmt::format("{}/drunk_fleet_load-{}", std::filesystem::temp_directory_path().string(), ::getpid());}
+        std::error_code ec;
+        std::filesystem::remove_all(cfg.archive, ec);
+
+        FleetCollector_Config collector_cfg{};
+        collector_cfg.port = 0;
+        collector_cfg.archive.dir = cfg.archive;
+        collector_cfg.archive.bucket = std::chrono::microseconds(static_cast<std::int64_t>(cfg.bucket_s * 1e6));
+        collector_cfg.archive.lateness = std::chrono::microseconds(static_cast<std::int64_t>(cfg.lateness_ms * 1e3));
+        if (!collector.Open(collector_cfg)) {return 1;}
+        cfg.port = collector.Port();
+        collector_thread = std::thread([&]{ collector.Run(bStopCollector); });
+    }
+
+    const std::int64_t wall_offset_us = static_cast<std::int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch() - std::chrono::steady_clock::now().time_since_epoch()).count());
+
+    NetStream_Config net_cfg{};
+    net_cfg.host = cfg.host;
+    net_cfg.port = cfg.port;
+    net_cfg.max_buffered = static_cast<std::size_t>(cfg.rate_hz * 60.0);
+    net_cfg.bQuiet = true;
+
+    if (!cfg.bSync) {net_cfg.ping_every = std::chrono::hours(24);}
+
+    // Every unit gets its own clock, then streams once it has synced (or gave up after 5s).
+    std::vector<std::unique_ptr<SimUnit>> units;
+    units.reserve(cfg.units);
+    Rng clock_rng{0xC10C5EEDULL};
+    const std::uint64_t epoch_us = SteadyUs();
+    for (std::size_t i = 0; i < cfg.units; ++i)
+    {
+        auto unit = std::make_unique<SimUnit>();
+        unit->id = i + 1;
+        unit->epoch_us = epoch_us;
+        unit->skew_us = static_cast<std::int64_t>((clock_rng.Uniform() * 2.0 - 1.0) * cfg.skew_s * 1e6);
+        unit->drift_ppm = (clock_rng.Uniform() * 2.0 - 1.0) * cfg.drift_ppm;
+        const auto wall_error_us = static_cast<std::int64_t>((clock_rng.Uniform() * 2.0 - 1.0) * cfg.wall_error_ms * 1e3);
+
+        const SimUnit* clock = unit.get();
+        NetStream_Config unit_cfg = net_cfg;
+        unit_cfg.mono_now = [clock]{ return clock->Mono(SteadyUs()); };
+        if (!unit->sink.Open(unit_cfg, unit->id, static_cast<std::uint32_t>(cfg.rate_hz), wall_offset_us - unit->skew_us + wall_error_us)) {return 1;}
+        units.push_back(std::move(unit));
+    }
+
+    std::size_t synced = 0;
+    for (int wait = 0; cfg.bSync && wait < 100 && synced < units.size(); ++wait)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        synced = static_cast<std::size_t>(std::count_if(units.begin(), units.end(), [](const auto& unit){ return unit->sink.Stats().clock.points > 0; }));
+    }
+
+    const std::uint64_t start_us = SteadyUs();
+    for (std::size_t i = 0; i < units.size(); ++i)
+    {
+        SimUnit& unit = *units[i];
+        Signal_Config signal{};
+        signal.seed = unit.id;
+        signal.sample_rate_hz = cfg.rate_hz;
+        signal.start_us = start_us;
+        unit.generator = std::make_unique<SignalGenerator>(signal);
+        unit.origin_us = start_us + (i * 997) % static_cast<std::uint64_t>(1e6 / cfg.rate_hz); // Don't all sample in lockstep
+        unit.next_t_us = unit.origin_us;
+    }
+
+    fmt::print("{} units x {:.0f} Hz for {:.0f}s -> {}:{} (reorder {}, late {} held {:.0f}ms, lateness {:.0f}ms)\n",
+        cfg.units, cfg.rate_hz, cfg.seconds, cfg.host, cfg.port, cfg.reorder, cfg.late, cfg.late_ms, cfg.lateness_ms);
+    fmt::print("clocks: skew +-{:.0f}s drift +-{:.0f}ppm wall error +-{:.0f}ms, {}/{} units synced before streaming\n",
+        cfg.skew_s, cfg.drift_ppm, cfg.wall_error_ms, synced, units.size());
+    std::fflush(stdout);
+
+    // Drivers: each owns every threads-th unit, wakes every 50ms and produces whatever came due.
+    const std::uint64_t end_us = start_us + static_cast<std::uint64_t>(cfg.seconds * 1e6);
+    std::vector<std::thread> drivers;
+    for (std::size_t t = 0; t < cfg.threads; ++t)
+    {
+        drivers.emplace_back([&, t]
+        {
+            Rng rng{0x9E3779B97F4A7C15ULL * (t + 1)};
+            while (true)
+            {
+                const std::uint64_t now_us = SteadyUs();
+                const bool bFinal = now_us >= end_us;
+                for (std::size_t i = t; i < units.size(); i += cfg.threads) {Produce(*units[i], cfg, rng, std::min(now_us, end_us), bFinal);}
+                if (bFinal) {break;}
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+        });
+    }
+    for (std::thread& driver : drivers) {driver.join();}
+
+    FleetCollectorStats live{};
+    if (bLocal) {live = collector.Stats();} // Lag while streaming, before the final drain skews it
+
+    std::uint64_t sent = 0;
+    std::uint64_t dropped = 0;
+    std::uint64_t injected_late = 0;
+    std::uint64_t reordered = 0;
+    std::vector<std::uint32_t> uncertainty;
+    for (const auto& unit : units)
+    {
+        unit->sink.Close();
+        const NetStreamStats stats = unit->sink.Stats();
+        sent += stats.sent;
+        dropped += stats.dropped;
+        if (stats.clock.points > 0) {uncertainty.push_back(stats.clock.uncertainty_us);}
+        injected_late += unit->injected_late;
+        reordered += unit->reordered;
+    }
+
+    fmt::print("units sent {} samples ({:.0f}/s), dropped {}, reordered {}, held back late {}\n",
+        sent, static_cast<double>(sent) / cfg.seconds, dropped, reordered, injected_late);
+    if (!uncertainty.empty())
+    {
+        std::sort(uncertainty.begin(), uncertainty.end());
+        fmt::print("clock sync: {} units, estimated uncertainty p50 {}us max {}us\n", uncertainty.size(), uncertainty[uncertainty.size() / 2], uncertainty.back());
+    }
+    if (!bLocal) {return 0;}
+
+    // Let the collector read what's still in flight, then stop it (merges + seals everything left).
+    for (int i = 0; i < 100 && collector.Stats().archive.received < sent; ++i) {std::this_thread::sleep_for(std::chrono::milliseconds(50));}
+    bStopCollector.store(true);
+    collector_thread.join();
+
+    const FleetCollectorStats stats = collector.Stats();
+    fmt::print("collector: accepted {} received {} merged {} late {} forced {} segments {} late files {} protocol errors {}\n",
+        stats.accepted, stats.archive.received, stats.archive.merged, stats.archive.late, stats.archive.forced,
+        stats.archive.segments, stats.archive.late_files, stats.protocol_errors);
+    fmt::print("merge lag while streaming: p50 {:.0f}ms p99 {:.0f}ms (lateness {:.0f}ms)\n", live.archive.lag_p50_ms, live.archive.lag_p99_ms, cfg.lateness_ms);
+
+    AuditResult audit{};
+    bool bOk = Audit(cfg, units, collector.SharedOffsetUs(), audit);
+    if (audit.archived + audit.late != sent)
+    {
+        fmt::print(stderr, "FAIL: units sent {}, archive holds {} + {} late\n", sent, audit.archived, audit.late);
+        bOk = false;
+    }
+    fmt::print("archive: {} segments, {} samples in order + {} late (held back {}) -> {}\n",
+        audit.segments, audit.archived, audit.late, injected_late, bOk ? "OK" : "FAILED");
+
+    if (!audit.align_us.empty())
+    {
+        std::sort(audit.align_us.begin(), audit.align_us.end());
+        auto percentile = [&](double pct){ return audit.align_us[static_cast<std::size_t>(pct * static_cast<double>(audit.align_us.size() - 1))]; };
+        fmt::print("alignment vs true time: p50 {}us p99 {}us max {}us (visible up to {}us)\n",
+            percentile(0.50), percentile(0.99), audit.align_us.back(), static_cast<std::int64_t>(1e6 / cfg.rate_hz) / 2);
+    }
+
+    if (!cfg.bKeep)
+    {
+        std::error_code ec;
+        std::filesystem::remove_all(cfg.archive, ec);
+    }
+    else
+    {
+        fmt::print("archive kept in {}\n", cfg.archive);
+    }
+    return bOk ? 0 : 2;
+}
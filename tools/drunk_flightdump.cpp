@@ -0,0 +1,58 @@
+// drunk_flightdump: prints the flight recorder ring as CSV.
+//
+//   drunk_flightdump                       -> dump the last crashed run (<FlightRecorderPath>.prev)
+//   drunk_flightdump <file>                -> dump any recorder file (live or crashed)
+//   drunk_flightdump --pid <pid> [file]    -> SIGUSR1 a running drunk_app, it writes <file>.txt itself
+#include "config_settings.h"
+#include "flight_recorder.h"
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/core.h>
+#include <string>
+#include <sys/types.h>
+
+int main(int argc, char** argv)
+{
+    std::string path = std::string(DrunkAPI::Config::FlightRecorderPath) + ".prev";
+    pid_t pid = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--pid") == 0 && i + 1 < argc)
+        {
+            pid = static_cast<pid_t>(std::atoi(argv[++i]));
+            path = DrunkAPI::Config::FlightRecorderPath;
+        }
+        else if (std::strcmp(argv[i], "--help") == 0)
+        {
+            fmt::print("usage: {} [--pid <pid>] [file]\n", argv[0]);
+            return 0;
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+
+    if (pid > 0)
+    {
+        if (::kill(pid, SIGUSR1) != 0)
+        {
+            std::perror("Error: Unable to signal drunk_app");
+            return 1;
+        }
+        fmt::print(stderr, "Requested dump from pid {} -> {}.txt\n", pid, path);
+    }
+
+    // The ring is MAP_SHARED, so reading it directly also works while the app is alive.
+    DrunkAPI::FlightRecorder recorder;
+    if (!recorder.OpenReadOnly(path.c_str()))
+    {
+        return 1;
+    }
+
+    recorder.DumpText(stdout);
+    return 0;
+}
@@ -0,0 +1,88 @@
+// drunk_history: query the on device window/breath history.
+//
+//   drunk_history [--dir <path>] [--series window|breath] [--tier raw|1min|1h] [--from <unix_s>] [--to <unix_s>]
+//   drunk_history [--dir <path>] --usage
+//
+// Prints CSV to stdout, query time and point counts to stderr.
+#include "config_settings.h"
+#include "ts_store.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/core.h>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    using namespace DrunkAPI;
+
+    std::string dir = Config::HistoryPath;
+    TsSeries series = TsSeries::Window;
+    TsTier tier = TsTier::Raw;
+    std::uint64_t from_us = 0;
+    std::uint64_t to_us = UINT64_MAX;
+    bool bUsage = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = (i + 1 < argc);
+        if (std::strcmp(argv[i], "--dir") == 0 && has_value) {dir = argv[++i];}
+        else if (std::strcmp(argv[i], "--series") == 0 && has_value) {series = (std::strcmp(argv[++i], "breath") == 0) ? TsSeries::Breath : TsSeries::Window;}
+        else if (std::strcmp(argv[i], "--tier") == 0 && has_value)
+        {
+            const char* name = argv[++i];
+            tier = (std::strcmp(name, "1h") == 0) ? TsTier::Hour : (std::strcmp(name, "1min") == 0) ? TsTier::Minute : TsTier::Raw;
+        }
+        else if (std::strcmp(argv[i], "--from") == 0 && has_value) {from_us = std::strtoull(argv[++i], nullptr, 10) * 1'000'000ULL;}
+        else if (std::strcmp(argv[i], "--to") == 0 && has_value) {to_us = std::strtoull(argv[++i], nullptr, 10) * 1'000'000ULL;}
+        else if (std::strcmp(argv[i], "--usage") == 0) {bUsage = true;}
+        else
+        {
+            fmt::print("usage: {} [--dir path] [--series window|breath] [--tier raw|1min|1h] [--from unix_s] [--to unix_s] [--usage]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    TimeSeriesStore store;
+    if (!store.Open(dir))
+    {
+        return 1;
+    }
+
+    if (bUsage)
+    {
+        const TsUsage usage = store.Usage();
+        const double per_point = usage.points > 0 ? static_cast<double>(usage.bytes) / static_cast<double>(usage.points) : 0.0;
+        fmt::print("bytes={} partitions={} points={} bytes_per_point={:.2f}\n", usage.bytes, usage.partitions, usage.points, per_point);
+        return 0;
+    }
+
+    std::vector<TsPoint> points;
+    const auto start = std::chrono::steady_clock::now();
+    const std::size_t found = store.Query(series, tier, from_us, to_us, points);
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    if (series == TsSeries::Breath)
+    {
+        fmt::print("t_us,peak_volts,bac,blow_s\n");
+        for (const TsPoint& point : points) {fmt::print("{},{:.6f},{:.6f},{:.3f}\n", point.t_us, point.v[0], point.v[1], point.v[2]);}
+    }
+    else if (tier == TsTier::Raw)
+    {
+        fmt::print("t_us,mean,stddev\n");
+        for (const TsPoint& point : points) {fmt::print("{},{:.6f},{:.6f}\n", point.t_us, point.v[0], point.v[1]);}
+    }
+    else
+    {
+        fmt::print("t_us,mean,stddev,min,max,window_s\n");
+        for (const TsPoint& point : points)
+        {
+            fmt::print("{},{:.6f},{:.6f},{:.6f},{:.6f},{:.2f}\n", point.t_us, point.v[0], point.v[1], point.v[2], point.v[3], point.v[4]);
+        }
+    }
+
+    fmt::print(stderr, "{} points in {} us\n", found, elapsed.count());
+    return 0;
+}
@@ -0,0 +1,197 @@
+// drunk_journal: inspect the breath/calibration journal, or measure group commit latency on this storage.
+//
+//   drunk_journal [path]                                   -> CSV of every valid record
+//   drunk_journal --bench <records> [--rate <hz>] [--budget <us>] [path]
+//                                                          -> append synthetic results and report durable latency
+//   drunk_journal --check <dir>                            -> corrupt a journal in <dir> on purpose, check recovery keeps
+//                                                             every record that still validates (make regress runs it)
+#include "config_settings.h"
+#include "result_journal.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    int DumpJournal(const std::string& path)
+    {
+        std::vector<DrunkAPI::JournalEntry> entries;
+        std::uint64_t good_bytes = 0;
+        std::uint64_t skipped_bytes = 0;
+        if (!DrunkAPI::ResultJournal::ReadAll(path, entries, &good_bytes, &skipped_bytes))
+        {
+            std::perror("Error: Unable to read journal");
+            return 1;
+        }
+
+        fmt::print("seq,type,wall_us,start_us,end_us,peak_volts|mean_volts,ppm|stddev,bac|rs_ohms,rs_ro_ratio,stable\n");
+        for (const auto& entry : entries)
+        {
+            if (entry.type == DrunkAPI::JournalRecordType::Breath)
+            {
+                const auto& breath = entry.breath;
+                fmt::print("{},breath,{},{},{},{:.6f},{:.6f},{:.6f},,\n", entry.seq, breath.wall_us, breath.start_us, breath.end_us, breath.peak_volts, breath.ppm, breath.bac);
+            }
+            else
+            {
+                const auto& cal = entry.calibration;
+                fmt::print("{},calibration,{},,,{:.6f},{:.6f},{:.6f},{:.6f},{}\n", entry.seq, cal.wall_us, cal.mean_volts, cal.stddev, cal.rs_ohms, cal.rs_ro_ratio, cal.stable);
+            }
+        }
+
+        fmt::print(stderr, "{} records, {} valid bytes, {} corrupt bytes skipped\n", entries.size(), good_bytes, skipped_bytes);
+        return 0;
+    }
+
+    int BenchJournal(const std::string& path, std::size_t records, double rate_hz, std::chrono::microseconds budget)
+    {
+        DrunkAPI::Journal_Config cfg{};
+        cfg.group_commit_budget = budget;
+
+        DrunkAPI::ResultJournal journal;
+        if (!journal.Open(path, cfg)) {return 1;}
+
+        const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / rate_hz));
+        auto next = std::chrono::steady_clock::now();
+        std::uint64_t last_seq = 0;
+
+        for (std::size_t i = 0; i < records; ++i)
+        {
+            DrunkAPI::JournalBreath breath{};
+            breath.wall_us = static_cast<std::uint64_t>(i);
+            breath.peak_volts = 1.5;
+            last_seq = journal.AppendBreath(breath);
+
+            next += period;
+            std::this_thread::sleep_until(next);
+        }
+
+        const bool bDurable = journal.WaitDurable(last_seq, std::chrono::seconds(10));
+        const DrunkAPI::JournalLatency latency = journal.Latency();
+        fmt::print("records={} commits={} ({:.1f} records/sync) p50={:.0f}us p90={:.0f}us p99={:.0f}us p999={:.0f}us max={:.0f}us failed={}\n",
+            latency.records, latency.commits,
+            latency.commits > 0 ? static_cast<double>(latency.records) / static_cast<double>(latency.commits) : 0.0,
+            latency.p50_us, latency.p90_us, latency.p99_us, latency.p999_us, latency.max_us, latency.failed_records);
+        return bDurable && latency.failed_records == 0 ? 0 : 1;
+    }
+
+    bool CheckSeqs(const char* step, const std::vector<DrunkAPI::JournalEntry>& entries, std::uint64_t records, std::uint64_t lost_seq)
+    {
+        std::vector<std::uint64_t> want;
+        for (std::uint64_t seq = 1; seq <= records; ++seq)
+        {
+            if (seq != lost_seq) {want.push_back(seq);}
+        }
+        std::vector<std::uint64_t> got;
+        for (const auto& entry : entries) {got.push_back(entry.seq);}
+        if (got == want) {return true;}
+        fmt::print(stderr, "Error: {}: {} records came back, wanted {} (every seq but {})\n", step, got.size(), want.size(), lost_seq);
+        return false;
+    }
+
+    // One flipped byte in frame `corrupt_seq`, then a torn half frame on the end. Open() has to keep every record but
+    // the flipped one, cut only the torn tail, and Compact() has to carry the records after the bad frame over.
+    int CheckJournal(const std::string& dir)
+    {
+        constexpr std::uint64_t Records = 40;
+        constexpr std::uint64_t CorruptSeq = 12;
+        const std::string path = dir + "/check.journal";
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        std::filesystem::remove(path, ec);
+
+        {
+            DrunkAPI::ResultJournal journal;
+            if (!journal.Open(path)) {return 1;}
+            std::uint64_t last_seq = 0;
+            for (std::uint64_t i = 0; i < Records; ++i)
+            {
+                DrunkAPI::JournalBreath breath{};
+                breath.wall_us = i;
+                breath.bac = 0.01 * static_cast<double>(i);
+                last_seq = journal.AppendBreath(breath);
+            }
+            if (!journal.WaitDurable(last_seq, std::chrono::seconds(10)))
+            {
+                fmt::print(stderr, "Error: check journal never became durable\n");
+                return 1;
+            }
+        }
+
+        // Every record is a breath, so frames are all the same size.
+        const auto frame_bytes = std::filesystem::file_size(path) / Records;
+        const auto clean_bytes = std::filesystem::file_size(path);
+        {
+            std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+            file.seekg(static_cast<std::streamoff>(((CorruptSeq - 1) * frame_bytes) + frame_bytes - 4));
+            const int byte = file.get();
+            file.seekp(static_cast<std::streamoff>(((CorruptSeq - 1) * frame_bytes) + frame_bytes - 4));
+            file.put(static_cast<char>(byte ^ 0x10));
+            file.seekp(0, std::ios::end);
+            const std::string torn(frame_bytes / 2, '\x5a');
+            file.write(torn.data(), static_cast<std::streamsize>(torn.size()));
+        }
+
+        {
+            std::vector<DrunkAPI::JournalEntry> recovered;
+            DrunkAPI::ResultJournal journal;
+            if (!journal.Open(path, {}, &recovered)) {return 1;}
+            if (!CheckSeqs("open", recovered, Records, CorruptSeq)) {return 1;}
+            if (std::filesystem::file_size(path) != clean_bytes)
+            {
+                fmt::print(stderr, "Error: open left {} bytes, wanted {} (only the torn tail cut)\n", std::filesystem::file_size(path), clean_bytes);
+                return 1;
+            }
+            if (!journal.Compact(Records)) {return 1;}
+        }
+
+        std::vector<DrunkAPI::JournalEntry> compacted;
+        std::uint64_t skipped_bytes = 0;
+        if (!DrunkAPI::ResultJournal::ReadAll(path, compacted, nullptr, &skipped_bytes)) {return 1;}
+        if (!CheckSeqs("compact", compacted, Records, CorruptSeq)) {return 1;}
+        if (skipped_bytes != 0)
+        {
+            fmt::print(stderr, "Error: compacted journal still has {} corrupt bytes\n", skipped_bytes);
+            return 1;
+        }
+
+        std::filesystem::remove(path, ec);
+        fmt::print("journal check OK: {} of {} records kept past a corrupt frame and a torn tail, through open and compact\n", Records - 1, Records);
+        return 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string path = DrunkAPI::Config::JournalPath;
+    std::size_t bench_records = 0;
+    double rate_hz = 200.0;
+    std::string check_dir;
+    std::chrono::microseconds budget{20'000};
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = (i + 1 < argc);
+        if (std::strcmp(argv[i], "--bench") == 0 && has_value) {bench_records = std::strtoull(argv[++i], nullptr, 10);}
+        else if (std::strcmp(argv[i], "--rate") == 0 && has_value) {rate_hz = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--budget") == 0 && has_value) {budget = std::chrono::microseconds(std::strtoll(argv[++i], nullptr, 10));}
+        else if (std::strcmp(argv[i], "--check") == 0 && has_value) {check_dir = argv[++i];}
+        else if (argv[i][0] == '-')
+        {
+            fmt::print("usage: {} [--bench records [--rate hz] [--budget us]] [--check dir] [path]\n", argv[0]);
+            return 1;
+        }
+        else {path = argv[i];}
+    }
+
+    if (!check_dir.empty()) {return CheckJournal(check_dir);}
+    if (bench_records > 0) {return BenchJournal(path, bench_records, rate_hz, budget);}
+    return DumpJournal(path);
+}
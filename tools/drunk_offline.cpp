@@ -0,0 +1,258 @@
+// drunk_offline: re-run the window + breath analyzers over a pile of recordings using every core.
+//
+//   drunk_offline [--threads N] [--chunk samples] [--verify] <recording>...
+//
+// Each recording is mmapped (.drec) or loaded (flight recorder / CSV), cut into chunks of samples, and the chunks are
+// spread over a work stealing pool. A chunk only builds Welford stats for the windows it touches; windows cut in
+// half by a chunk edge are stitched back together with Chan's combination. The breath state machine depends on the
+// previous window so it's replayed sequentially over the merged windows (one task per recording, it's ~1/128th of
+// the work).
+//
+// Breath state transitions go to stdout as CSV, the summary goes to stderr. --verify also runs the plain single
+// threaded RuntimeProcess over every recording and diffs the two.
+#include "config_settings.h"
+#include "mq3_helper.h"
+#include "processor_types.h"
+#include "recording.h"
+#include "thread_pool.h"
+#include "window_replay.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/core.h>
+#include <memory>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using namespace DrunkAPI;
+
+    struct Segment
+    {
+        std::string path;
+        RecordingReader reader; // .drec segments are walked in place
+        std::vector<Sample> loaded; // Anything else is parsed into memory
+        std::span<const Sample> samples;
+        std::int64_t wall_minus_mono_us = 0;
+        double sample_hz = Config::SampleRate_Hz; // ReplaySampleRateHz
+        bool bLoaded = false;
+
+        std::vector<WindowChunk> chunks;
+        std::vector<WindowResult> results; // Windows that reached the breath analyzer
+        std::vector<ReplayEvent> events;
+    };
+
+    bool IsDrec(const std::string& path)
+    {
+        return path.size() > 5 && path.compare(path.size() - 5, 5, ".drec") == 0;
+    }
+
+    void LoadSegment(Segment& segment)
+    {
+        std::uint32_t header_hz = 0;
+        if (IsDrec(segment.path))
+        {
+            if (!segment.reader.Open(segment.path)) {return;}
+            segment.samples = segment.reader.Samples();
+            segment.wall_minus_mono_us = segment.reader.Header().wall_minus_mono_us;
+            header_hz = segment.reader.Header().sample_rate_hz;
+        }
+        else
+        {
+            if (!LoadRecording(segment.path, segment.loaded, segment.wall_minus_mono_us, &header_hz)) {return;}
+            segment.samples = segment.loaded;
+        }
+        segment.sample_hz = ReplaySampleRateHz(segment.path, header_hz, segment.samples);
+        segment.bLoaded = true;
+    }
+
+    // Sequential part: stitch the chunks and walk the state machine like RuntimeProcess would.
+    void ReplaySegment(Segment& segment, const Analyzer_Config& analyzer_cfg, const BreathAnalyzer_Config& breath_cfg)
+    {
+        const std::vector<WelfordStats> windows = MergeChunks(segment.samples, segment.chunks, analyzer_cfg.window_micro);
+        segment.results = FinalizeWindows(windows, segment.samples.front().t_us, AtSampleRate(analyzer_cfg, segment.sample_hz));
+        segment.events = ReplayBreaths(segment.results, breath_cfg);
+    }
+
+    // Reference: the live code path, one sample at a time.
+    class CaptureSink final : public PipelineSink
+    {
+        public:
+            std::vector<WindowResult> windows;
+            std::vector<ReplayEvent> events;
+
+            void OnSamples(const Sample*, std::size_t) override {}
+            void OnWindow(const WindowResult& window) override { windows.push_back(window); }
+            void OnState(std::uint64_t t_us, const BreathEvent& event, const BreathResult& snapshot) override { events.push_back({t_us, event, snapshot.peak_volts}); }
+    };
+
+    bool VerifySegment(const Segment& segment, const Analyzer_Config& analyzer_cfg, const BreathAnalyzer_Config& breath_cfg)
+    {
+        CaptureSink reference;
+        RuntimeProcess processor(AtSampleRate(analyzer_cfg, segment.sample_hz), breath_cfg);
+        processor.AttachSink(&reference);
+        for (const Sample& sample : segment.samples) {processor.on_batch(&sample, 1);}
+
+        double max_mean_diff = 0.0;
+        double max_sd_diff = 0.0;
+        std::size_t stable_mismatch = 0;
+        const std::size_t windows = std::min(reference.windows.size(), segment.results.size());
+        for (std::size_t i = 0; i < windows; ++i)
+        {
+            max_mean_diff = std::max(max_mean_diff, std::abs(reference.windows[i].mean - segment.results[i].mean));
+            max_sd_diff = std::max(max_sd_diff, std::abs(reference.windows[i].stddev - segment.results[i].stddev));
+            stable_mismatch += (reference.windows[i].stable != segment.results[i].stable) ? 1U : 0U;
+        }
+
+        bool bEventsMatch = reference.events.size() == segment.events.size();
+        for (std::size_t i = 0; bEventsMatch && i < reference.events.size(); ++i)
+        {
+            bEventsMatch = reference.events[i].t_us == segment.events[i].t_us && reference.events[i].event.State == segment.events[i].event.State;
+        }
+
+        const bool bOk = bEventsMatch && stable_mismatch == 0 && reference.windows.size() == segment.results.size();
+        fmt::print(stderr, "verify {}: windows {}/{} events {}/{} max|dmean|={:.3g} max|dsd|={:.3g} stable mismatches={} -> {}\n",
+            segment.path, segment.results.size(), reference.windows.size(), segment.events.size(), reference.events.size(),
+            max_mean_diff, max_sd_diff, stable_mismatch, bOk ? "OK" : "MISMATCH");
+        return bOk;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    using namespace DrunkAPI;
+
+    std::size_t thread_count = std::thread::hardware_concurrency();
+    std::size_t chunk_samples = 1U << 20U; // ~2.3h of samples at 128 SPS
+    bool bVerify = false;
+    std::vector<std::unique_ptr<Segment>> segments;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = (i + 1 < argc);
+        if (std::strcmp(argv[i], "--threads") == 0 && has_value) {thread_count = std::strtoull(argv[++i], nullptr, 10);}
+        else if (std::strcmp(argv[i], "--chunk") == 0 && has_value) {chunk_samples = std::max<std::size_t>(1, std::strtoull(argv[++i], nullptr, 10));}
+        else if (std::strcmp(argv[i], "--verify") == 0) {bVerify = true;}
+        else if (argv[i][0] != '-')
+        {
+            segments.push_back(std::make_unique<Segment>());
+            segments.back()->path = argv[i];
+        }
+        else
+        {
+            fmt::print("usage: {} [--threads N] [--chunk samples] [--verify] <recording>...\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (segments.empty())
+    {
+        fmt::print("usage: {} [--threads N] [--chunk samples] [--verify] <recording>...\n", argv[0]);
+        return 1;
+    }
+
+    Analyzer_Config analyzer_cfg{};
+    analyzer_cfg.bDebugPrint = false;
+    analyzer_cfg.bAdaptiveWindow = false; // Chunks need fixed windows, adaptive boundaries depend on every window before them
+    BreathAnalyzer_Config breath_cfg{};
+    breath_cfg.bPrintStatus = false;
+
+    using Clock = std::chrono::steady_clock;
+    const auto t_start = Clock::now();
+
+    WorkStealingPool pool(thread_count);
+
+    // 1) Load / map every recording
+    for (auto& segment : segments)
+    {
+        pool.Submit([seg = segment.get()]{ LoadSegment(*seg); });
+    }
+    pool.Wait();
+    const auto t_loaded = Clock::now();
+
+    // 2) Chunk every recording and accumulate windows in parallel
+    std::uint64_t total_samples = 0;
+    std::uint64_t total_span_us = 0; // Not samples / SampleRate_Hz, recordings can be at other rates
+    for (auto& segment : segments)
+    {
+        if (!segment->bLoaded || segment->samples.empty()) {continue;}
+
+        total_samples += segment->samples.size();
+        total_span_us += segment->samples.back().t_us - segment->samples.front().t_us;
+        segment->chunks = MakeWindowChunks(segment->samples.size(), chunk_samples);
+        for (WindowChunk& chunk : segment->chunks)
+        {
+            pool.Submit([&chunk, seg = segment.get(), window_us = static_cast<std::uint64_t>(analyzer_cfg.window_micro)]{ AccumulateChunk(seg->samples, chunk, window_us); });
+        }
+    }
+    pool.Wait();
+    const auto t_accumulated = Clock::now();
+
+    // 3) Merge + state machine, sequential per recording, recordings in parallel
+    for (auto& segment : segments)
+    {
+        if (segment->chunks.empty()) {continue;}
+        pool.Submit([&, seg = segment.get()]{ ReplaySegment(*seg, analyzer_cfg, breath_cfg); });
+    }
+    pool.Wait();
+    const auto t_replayed = Clock::now();
+
+    // Output
+    fmt::print("file,t_us,wall_us,state,peak_volts,start_us,end_us,ppm,bac\n");
+    std::uint64_t total_windows = 0;
+    std::uint64_t stable_windows = 0;
+    std::uint64_t breaths = 0;
+    double max_bac = 0.0;
+
+    for (const auto& segment : segments)
+    {
+        total_windows += segment->results.size();
+        stable_windows += static_cast<std::uint64_t>(std::count_if(segment->results.begin(), segment->results.end(), [](const WindowResult& w) { return w.stable; }));
+
+        for (const ReplayEvent& offline : segment->events)
+        {
+            const auto wall_us = static_cast<std::int64_t>(offline.t_us) + segment->wall_minus_mono_us;
+            if (offline.event.State != BreathAnalyzerState::Analyzed)
+            {
+                fmt::print("{},{},{},{},{:.6f},,,,\n", segment->path, offline.t_us, wall_us, static_cast<int>(offline.event.State), offline.peak_volts);
+                continue;
+            }
+
+            const double ppm = MQ3::calculate_ppm(MQ3::calculate_concentration_exp(MQ3::adc3v3_to_ratio(offline.event.peak_voltage, Config::RLoad, Config::Ro_Air)));
+            const double bac = MQ3::calculate_bac(ppm);
+            max_bac = std::max(max_bac, bac);
+            ++breaths;
+
+            fmt::print("{},{},{},{},{:.6f},{},{},{:.6f},{:.6f}\n", segment->path, offline.t_us, wall_us, static_cast<int>(offline.event.State),
+                offline.event.peak_voltage, offline.event.start_us, offline.event.end_us, ppm, bac);
+        }
+    }
+    std::fflush(stdout);
+
+    auto seconds = [](Clock::time_point from, Clock::time_point to) { return std::chrono::duration<double>(to - from).count(); };
+    const double total_s = seconds(t_start, t_replayed);
+
+    fmt::print(stderr, "{} recordings, {} samples ({:.1f} h), {} windows ({:.1f}% stable), {} breaths, max BAC {:.4f}\n",
+        segments.size(), total_samples, static_cast<double>(total_span_us) / 3.6e9,
+        total_windows, (total_windows > 0) ? 100.0 * static_cast<double>(stable_windows) / static_cast<double>(total_windows) : 0.0, breaths, max_bac);
+    fmt::print(stderr, "{} threads, {} steals: load {:.3f}s, windows {:.3f}s, replay {:.3f}s, total {:.3f}s ({:.1f} M samples/s)\n",
+        pool.Size(), pool.Steals(), seconds(t_start, t_loaded), seconds(t_loaded, t_accumulated), seconds(t_accumulated, t_replayed), total_s,
+        (total_s > 0.0) ? static_cast<double>(total_samples) / total_s / 1e6 : 0.0);
+
+    if (bVerify)
+    {
+        bool bAllOk = true;
+        for (const auto& segment : segments)
+        {
+            if (segment->bLoaded && !segment->samples.empty()) {bAllOk = VerifySegment(*segment, analyzer_cfg, breath_cfg) && bAllOk;}
+        }
+        return bAllOk ? 0 : 2;
+    }
+    return 0;
+}
@@ -0,0 +1,409 @@
+// drunk_regress: golden trace regression for the window + breath analyzers.
+//
+//   drunk_regress [--update] [--golden-dir dir] [--abs-tol x] [--rel-tol x] [--time-tol-us n] [--repeat n]
+//                 [--max-slowdown pct] [--max-alloc-growth n] <recording>...
+//
+// Every recording is played through the real ProcessRunner + RuntimeProcess on a ManualClock, so the consumer cuts
+// the same batches it would live (tick/idle sleeps, max batch, ring overwrite) but an hour of samples runs in well
+// under a second. The windows that reach the breath analyzer and every state transition are diffed against
+// <recording>.golden (or <golden-dir>/<name>.golden). --update rewrites the goldens instead.
+//
+// Means/stddevs are compared with abs/rel tolerances, timestamps and states have to match (within --time-tol-us).
+// Alongside correctness it reports samples/s (best of --repeat runs) and heap allocations per run against the numbers
+// stored in the golden, and can fail on either with --max-slowdown / --max-alloc-growth.
+//
+// Exit: 0 all match, 2 output mismatch, 3 perf gate, 1 usage / IO error.
+#include "clock.h"
+#include "config_settings.h"
+#include "process_runner.h"
+#include "processor_types.h"
+#include "recording.h"
+#include "replay_sampler.h"
+#include "window_replay.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fmt/core.h>
+#include <new>
+#include <string>
+#include <vector>
+
+// Count every heap allocation in the process, the replay loop should be allocation free once warmed up.
+namespace
+{
+    std::atomic<std::uint64_t> g_alloc_count{0};
+    std::atomic<std::uint64_t> g_alloc_bytes{0};
+
+    void* CountedAlloc(std::size_t size)
+    {
+        g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+        g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+        if (void* ptr = std::malloc(size == 0 ? 1 : size)) {return ptr;}
+        throw std::bad_alloc();
+    }
+}
+
+void* operator new(std::size_t size) { return CountedAlloc(size); }
+void* operator new[](std::size_t size) { return CountedAlloc(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace
+{
+    using namespace DrunkAPI;
+
+    struct WindowRow
+    {
+        std::uint64_t start_us = 0;
+        std::uint64_t end_us = 0;
+        bool stable = false;
+        double mean = 0.0;
+        double stddev = 0.0;
+        double drift_per_sec = 0.0;
+    };
+
+    struct EventRow
+    {
+        std::uint64_t t_us = 0;
+        int state = 0;
+        double peak_volts = 0.0; // Running peak at the transition
+        std::uint64_t start_us = 0;
+        std::uint64_t end_us = 0;
+        double peak_voltage = 0.0; // Only set on Analyzed
+    };
+
+    struct TraceOutput
+    {
+        std::uint64_t samples = 0;
+        std::uint64_t dropped = 0;
+        double samples_per_s = 0.0;
+        std::uint64_t allocs = 0;
+        std::uint64_t alloc_bytes = 0;
+        std::vector<WindowRow> windows;
+        std::vector<EventRow> events;
+    };
+
+    struct Tolerance
+    {
+        double abs = 1e-12;
+        double rel = 1e-9;
+        std::uint64_t time_us = 0;
+    };
+
+    class CaptureSink final : public PipelineSink
+    {
+        public:
+            explicit CaptureSink(TraceOutput& in_out) : out(in_out) {}
+
+            void OnSamples(const Sample*, std::size_t) override {}
+            void OnWindow(const WindowResult& w) override
+            {
+                out.windows.push_back({w.window_start_us, w.window_end_us, w.stable, w.mean, w.stddev, w.drift_per_sec});
+            }
+            void OnState(std::uint64_t t_us, const BreathEvent& event, const BreathResult& snapshot) override
+            {
+                out.events.push_back({t_us, static_cast<int>(event.State), snapshot.peak_volts, event.start_us, event.end_us, event.peak_voltage});
+            }
+
+        private:
+            TraceOutput& out;
+    };
+
+    // One pass through the live consumer loop on recorded time.
+    double RunTrace(const std::vector<Sample>& samples, double sample_hz, TraceOutput& out)
+    {
+        Analyzer_Config analyzer_cfg{};
+        analyzer_cfg.bDebugPrint = false;
+        analyzer_cfg = AtSampleRate(analyzer_cfg, sample_hz);
+        BreathAnalyzer_Config breath_cfg{};
+        breath_cfg.bPrintStatus = false;
+
+        out.windows.clear();
+        out.events.clear();
+
+        // Reserve the capture up front so it doesn't show up in the allocation count.
+        const std::uint64_t span_us = samples.empty() ? 0 : samples.back().t_us - samples.front().t_us;
+        out.windows.reserve(static_cast<std::size_t>(span_us / analyzer_cfg.window_micro) + 2);
+        out.events.reserve(out.windows.capacity() + 1);
+
+        CaptureSink capture(out);
+        RuntimeProcess processor(analyzer_cfg, breath_cfg);
+        processor.AttachSink(&capture);
+
+        std::uint64_t now_us = 0;
+        ManualClock clock(now_us);
+        ReplaySampler feed(samples, clock);
+
+        ReplaySampler::Reset();
+        const std::uint64_t allocs_before = g_alloc_count.load(std::memory_order_relaxed);
+        const std::uint64_t bytes_before = g_alloc_bytes.load(std::memory_order_relaxed);
+        const auto start = std::chrono::steady_clock::now();
+        {
+            ProcessRunner<ReplaySampler, RuntimeProcess, ManualClock> runner(feed, Consumer_Config{}, processor, clock);
+            runner.run();
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        out.allocs = g_alloc_count.load(std::memory_order_relaxed) - allocs_before;
+        out.alloc_bytes = g_alloc_bytes.load(std::memory_order_relaxed) - bytes_before;
+        out.dropped = feed.dropped();
+        ReplaySampler::Reset();
+
+        out.samples = samples.size();
+        return seconds;
+    }
+
+    bool WriteGolden(const std::string& path, const std::string& source, const TraceOutput& out)
+    {
+        // First --update into a fresh --golden-dir.
+        std::error_code dir_error;
+        const std::filesystem::path parent = std::filesystem::path(path).parent_path();
+        if (!parent.empty()) {std::filesystem::create_directories(parent, dir_error);}
+
+        std::FILE* file = std::fopen(path.c_str(), "w");
+        if (file == nullptr)
+        {
+            fmt::print(stderr, "Error: cannot write golden {}\n", path);
+            return false;
+        }
+
+        fmt::print(file, "# drunk_regress golden v1\n# source: {}\n", source);
+        fmt::print(file, "perf,{},{},{:.1f},{},{}\n", out.samples, out.dropped, out.samples_per_s, out.allocs, out.alloc_bytes);
+        for (const WindowRow& w : out.windows)
+        {
+            fmt::print(file, "w,{},{},{},{:.17g},{:.17g},{:.17g}\n", w.start_us, w.end_us, w.stable ? 1 : 0, w.mean, w.stddev, w.drift_per_sec);
+        }
+        for (const EventRow& e : out.events)
+        {
+            fmt::print(file, "e,{},{},{:.17g},{},{},{:.17g}\n", e.t_us, e.state, e.peak_volts, e.start_us, e.end_us, e.peak_voltage);
+        }
+
+        const bool bOk = std::ferror(file) == 0;
+        return (std::fclose(file) == 0) && bOk;
+    }
+
+    bool ReadGolden(const std::string& path, TraceOutput& out)
+    {
+        std::FILE* file = std::fopen(path.c_str(), "r");
+        if (file == nullptr)
+        {
+            fmt::print(stderr, "Error: no golden {} (run with --update first)\n", path);
+            return false;
+        }
+
+        char line[512];
+        std::size_t line_no = 0;
+        bool bOk = true;
+        while (bOk && std::fgets(line, sizeof(line), file) != nullptr)
+        {
+            ++line_no;
+            if (line[0] == '#' || line[0] == '\n') {continue;}
+
+            int stable = 0;
+            WindowRow w{};
+            EventRow e{};
+            if (std::sscanf(line, "perf,%" SCNu64 ",%" SCNu64 ",%lf,%" SCNu64 ",%" SCNu64, &out.samples, &out.dropped, &out.samples_per_s, &out.allocs, &out.alloc_bytes) == 5) {continue;}
+            if (std::sscanf(line, "w,%" SCNu64 ",%" SCNu64 ",%d,%lf,%lf,%lf", &w.start_us, &w.end_us, &stable, &w.mean, &w.stddev, &w.drift_per_sec) == 6)
+            {
+                w.stable = (stable != 0);
+                out.windows.push_back(w);
+                continue;
+            }
+            if (std::sscanf(line, "e,%" SCNu64 ",%d,%lf,%" SCNu64 ",%" SCNu64 ",%lf", &e.t_us, &e.state, &e.peak_volts, &e.start_us, &e.end_us, &e.peak_voltage) == 6)
+            {
+                out.events.push_back(e);
+                continue;
+            }
+
+            fmt::print(stderr, "Error: {}:{} unreadable golden line\n", path, line_no);
+            bOk = false;
+        }
+
+        std::fclose(file);
+        return bOk;
+    }
+
+    bool Near(double golden, double actual, const Tolerance& tol)
+    {
+        return std::abs(golden - actual) <= std::max(tol.abs, tol.rel * std::abs(golden));
+    }
+
+    bool NearUs(std::uint64_t golden, std::uint64_t actual, const Tolerance& tol)
+    {
+        return ((golden > actual) ? golden - actual : actual - golden) <= tol.time_us;
+    }
+
+    // Prints the first few differences, returns how many rows differ.
+    std::size_t DiffOutputs(const std::string& name, const TraceOutput& golden, const TraceOutput& actual, const Tolerance& tol)
+    {
+        constexpr std::size_t MaxReported = 5;
+        std::size_t mismatches = 0;
+
+        auto report = [&]() { return ++mismatches <= MaxReported; };
+
+        if (golden.windows.size() != actual.windows.size())
+        {
+            if (report()) {fmt::print(stderr, "  {}: {} windows, golden has {}\n", name, actual.windows.size(), golden.windows.size());}
+        }
+        for (std::size_t i = 0; i < std::min(golden.windows.size(), actual.windows.size()); ++i)
+        {
+            const WindowRow& g = golden.windows[i];
+            const WindowRow& a = actual.windows[i];
+            if (!NearUs(g.start_us, a.start_us, tol) || !NearUs(g.end_us, a.end_us, tol) || g.stable != a.stable ||
+                !Near(g.mean, a.mean, tol) || !Near(g.stddev, a.stddev, tol) || !Near(g.drift_per_sec, a.drift_per_sec, tol))
+            {
+                if (report()) {fmt::print(stderr, "  {}: window {} end_us {}: stable {}->{} mean {:.9g}->{:.9g} sd {:.9g}->{:.9g}\n", name, i, g.end_us,
+                    g.stable, a.stable, g.mean, a.mean, g.stddev, a.stddev);}
+            }
+        }
+
+        if (golden.events.size() != actual.events.size())
+        {
+            if (report()) {fmt::print(stderr, "  {}: {} events, golden has {}\n", name, actual.events.size(), golden.events.size());}
+        }
+        for (std::size_t i = 0; i < std::min(golden.events.size(), actual.events.size()); ++i)
+        {
+            const EventRow& g = golden.events[i];
+            const EventRow& a = actual.events[i];
+            if (!NearUs(g.t_us, a.t_us, tol) || g.state != a.state || !NearUs(g.start_us, a.start_us, tol) || !NearUs(g.end_us, a.end_us, tol) ||
+                !Near(g.peak_volts, a.peak_volts, tol) || !Near(g.peak_voltage, a.peak_voltage, tol))
+            {
+                if (report()) {fmt::print(stderr, "  {}: event {}: t_us {}->{} state {}->{} peak {:.9g}->{:.9g}\n", name, i, g.t_us, a.t_us, g.state, a.state,
+                    g.peak_volts, a.peak_volts);}
+            }
+        }
+
+        if (mismatches > MaxReported) {fmt::print(stderr, "  {}: ... {} more\n", name, mismatches - MaxReported);}
+        return mismatches;
+    }
+
+    std::string GoldenPath(const std::string& recording, const std::string& golden_dir)
+    {
+        if (golden_dir.empty()) {return recording + ".golden";}
+        return (std::filesystem::path(golden_dir) / std::filesystem::path(recording).filename()).string() + ".golden";
+    }
+
+    void PrintUsage(const char* argv0)
+    {
+        fmt::print("usage: {} [--update] [--golden-dir dir] [--abs-tol x] [--rel-tol x] [--time-tol-us n] [--repeat n]\n"
+                   "          [--max-slowdown pct] [--max-alloc-growth n] <recording>...\n", argv0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool bUpdate = false;
+    std::string golden_dir;
+    Tolerance tol{};
+    std::size_t repeat = 3;
+    double max_slowdown_pct = -1.0; // < 0 = report only
+    long long max_alloc_growth = -1;
+    std::vector<std::string> recordings;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = (i + 1 < argc);
+        if (std::strcmp(argv[i], "--update") == 0) {bUpdate = true;}
+        else if (std::strcmp(argv[i], "--golden-dir") == 0 && has_value) {golden_dir = argv[++i];}
+        else if (std::strcmp(argv[i], "--abs-tol") == 0 && has_value) {tol.abs = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--rel-tol") == 0 && has_value) {tol.rel = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--time-tol-us") == 0 && has_value) {tol.time_us = std::strtoull(argv[++i], nullptr, 10);}
+        else if (std::strcmp(argv[i], "--repeat") == 0 && has_value) {repeat = std::max<std::size_t>(1, std::strtoull(argv[++i], nullptr, 10));}
+        else if (std::strcmp(argv[i], "--max-slowdown") == 0 && has_value) {max_slowdown_pct = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--max-alloc-growth") == 0 && has_value) {max_alloc_growth = std::strtoll(argv[++i], nullptr, 10);}
+        else if (argv[i][0] != '-') {recordings.emplace_back(argv[i]);}
+        else
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (recordings.empty())
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    bool bIoError = false;
+    bool bMismatch = false;
+    bool bPerfFail = false;
+    std::uint64_t total_samples = 0;
+    double total_seconds = 0.0;
+
+    for (const std::string& recording : recordings)
+    {
+        std::vector<Sample> samples;
+        std::int64_t wall_minus_mono_us = 0;
+        std::uint32_t header_hz = 0;
+        if (!LoadRecording(recording, samples, wall_minus_mono_us, &header_hz))
+        {
+            bIoError = true;
+            continue;
+        }
+        const double sample_hz = ReplaySampleRateHz(recording, header_hz, samples);
+
+        // First run is the one that gets diffed, the rest only tighten the timing.
+        TraceOutput actual;
+        double best_s = RunTrace(samples, sample_hz, actual);
+        const std::uint64_t allocs = actual.allocs;
+        for (std::size_t r = 1; r < repeat; ++r)
+        {
+            TraceOutput again;
+            best_s = std::min(best_s, RunTrace(samples, sample_hz, again));
+        }
+        actual.allocs = allocs;
+        actual.samples_per_s = (best_s > 0.0) ? static_cast<double>(actual.samples) / best_s : 0.0;
+        total_samples += actual.samples;
+        total_seconds += best_s;
+
+        const std::string golden_path = GoldenPath(recording, golden_dir);
+        if (bUpdate)
+        {
+            if (!WriteGolden(golden_path, recording, actual))
+            {
+                bIoError = true;
+                continue;
+            }
+            fmt::print("{}: wrote {} ({} windows, {} events, {:.2f} M samples/s, {} allocs)\n", recording, golden_path,
+                actual.windows.size(), actual.events.size(), actual.samples_per_s / 1e6, actual.allocs);
+            continue;
+        }
+
+        TraceOutput golden;
+        if (!ReadGolden(golden_path, golden))
+        {
+            bIoError = true;
+            continue;
+        }
+
+        const std::size_t mismatches = DiffOutputs(recording, golden, actual, tol);
+        bMismatch = bMismatch || (mismatches > 0);
+
+        const double speed_pct = (golden.samples_per_s > 0.0) ? 100.0 * (actual.samples_per_s / golden.samples_per_s - 1.0) : 0.0;
+        const auto alloc_delta = static_cast<long long>(actual.allocs) - static_cast<long long>(golden.allocs);
+        const bool bSlow = (max_slowdown_pct >= 0.0) && (-speed_pct > max_slowdown_pct);
+        const bool bAllocs = (max_alloc_growth >= 0) && (alloc_delta > max_alloc_growth);
+        bPerfFail = bPerfFail || bSlow || bAllocs;
+
+        fmt::print("{}: {} windows, {} events {} | {:.2f} M samples/s ({:+.1f}%{}) | {} allocs ({:+}{}), {} dropped\n", recording,
+            actual.windows.size(), actual.events.size(), (mismatches == 0) ? "OK" : fmt::format("MISMATCH ({})", mismatches),
+            actual.samples_per_s / 1e6, speed_pct, bSlow ? " SLOW" : "", actual.allocs, alloc_delta, bAllocs ? " GROWTH" : "", actual.dropped);
+    }
+
+    fmt::print("{} recordings, {} samples, {:.3f}s best-of-{} replay ({:.2f} M samples/s)\n", recordings.size(), total_samples,
+        total_seconds, repeat, (total_seconds > 0.0) ? static_cast<double>(total_samples) / total_seconds / 1e6 : 0.0);
+
+    if (bIoError) {return 1;}
+    if (bMismatch) {return 2;}
+    if (bPerfFail) {return 3;}
+    return 0;
+}
@@ -0,0 +1,196 @@
+// drunk_siggen: write a synthetic MQ-3 session as a .drec recording plus the .labels drunk_tune scores against.
+//
+//   drunk_siggen <out.drec> [--hours h] [--every s] [--first s] [--blow s] [--bac list] [--breath start_s:dur_s:bac]...
+//                [--seed n] [--rate hz] [--baseline v] [--rise s] [--decay s] [--warmup v] [--drift v_per_h] [--walk v]
+//                [--white v] [--pink v] [--hum v] [--hum-hz hz] [--glitch p] [--clean]
+//                [--vapor-every s] [--vapor-first s] [--vapor-mg list] [--vapor-rise list] [--vapor start_s:mg_l[:rise_s:hold_s:fall_s]]...
+//
+// Blows come from --every/--bac (cycled, --every 0 for none) and any explicit --breath entries. Vapor events (room
+// air with alcohol in it, no blow, not labeled) come from --vapor-every (off by default, first one halfway between the
+// first two blows unless --vapor-first) cycling --vapor-mg and --vapor-rise, plus any explicit --vapor entries. --glitch sets the dropped / stale read
+// probability (railed reads are a fifth of that), --clean turns every noise source, drift, warmup and glitch off.
+#include "config_settings.h"
+#include "recording.h"
+#include "signal_gen.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/core.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    using namespace DrunkAPI;
+
+    bool ParseList(const char* text, std::vector<double>& out)
+    {
+        out.clear();
+        const char* cursor = text;
+        while (*cursor != '\0')
+        {
+            char* end = nullptr;
+            const double value = std::strtod(cursor, &end);
+            if (end == cursor) {return false;}
+            out.push_back(value);
+            cursor = (*end == ',') ? end + 1 : end;
+        }
+        return !out.empty();
+    }
+
+    bool WriteLabels(const std::string& path, const SignalGenerator& generator)
+    {
+        std::FILE* file = std::fopen(path.c_str(), "w");
+        if (file == nullptr)
+        {
+            fmt::print(stderr, "Error: cannot write labels {}\n", path);
+            return false;
+        }
+
+        const std::uint64_t start_us = generator.GetConfig().start_us;
+        fmt::print(file, "start_us,end_us,bac\n");
+        for (const BreathSpec& breath : generator.Script())
+        {
+            const auto begin_us = start_us + static_cast<std::uint64_t>(breath.start_s * 1e6);
+            const auto end_us = begin_us + static_cast<std::uint64_t>(breath.duration_s * 1e6);
+            fmt::print(file, "{},{},{:.6f}\n", begin_us, end_us, breath.bac);
+        }
+
+        const bool bOk = std::ferror(file) == 0;
+        return (std::fclose(file) == 0) && bOk;
+    }
+
+    void PrintUsage(const char* argv0)
+    {
+        fmt::print("usage: {} <out.drec> [--hours h] [--every s] [--first s] [--blow s] [--bac list] [--breath start_s:dur_s:bac]...\n"
+                   "          [--seed n] [--rate hz] [--baseline v] [--rise s] [--decay s] [--warmup v] [--drift v_per_h] [--walk v]\n"
+                   "          [--white v] [--pink v] [--hum v] [--hum-hz hz] [--glitch p] [--clean]\n"
+                   "          [--vapor-every s] [--vapor-first s] [--vapor-mg list] [--vapor-rise list] [--vapor start_s:mg_l[:rise_s:hold_s:fall_s]]...\n", argv0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Signal_Config cfg{};
+    std::string out_path;
+    double hours = 1.0;
+    double every_s = 300.0;
+    double first_s = 240.0; // After the heater warmup and the analyzer's warmup windows
+    double blow_s = 3.0;
+    std::vector<double> bacs{0.02, 0.05, 0.08, 0.12};
+    std::vector<BreathSpec> extra;
+    double vapor_every_s = 0.0;
+    double vapor_first_s = -1.0;
+    std::vector<double> vapor_mg{1e-6, 3e-6, 8e-6};
+    std::vector<double> vapor_rise{2.0, 6.0, 15.0, 4.0};
+    std::vector<VaporSpec> vapor;
+    bool bClean = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = (i + 1 < argc);
+        bool bOk = true;
+        if (std::strcmp(argv[i], "--hours") == 0 && has_value) {hours = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--every") == 0 && has_value) {every_s = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--first") == 0 && has_value) {first_s = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--blow") == 0 && has_value) {blow_s = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--bac") == 0 && has_value) {bOk = ParseList(argv[++i], bacs);}
+        else if (std::strcmp(argv[i], "--breath") == 0 && has_value)
+        {
+            BreathSpec breath{};
+            bOk = std::sscanf(argv[++i], "%lf:%lf:%lf", &breath.start_s, &breath.duration_s, &breath.bac) == 3;
+            extra.push_back(breath);
+        }
+        else if (std::strcmp(argv[i], "--vapor-every") == 0 && has_value) {vapor_every_s = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--vapor-first") == 0 && has_value) {vapor_first_s = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--vapor-mg") == 0 && has_value) {bOk = ParseList(argv[++i], vapor_mg);}
+        else if (std::strcmp(argv[i], "--vapor-rise") == 0 && has_value) {bOk = ParseList(argv[++i], vapor_rise);}
+        else if (std::strcmp(argv[i], "--vapor") == 0 && has_value)
+        {
+            VaporSpec spec{};
+            const int fields = std::sscanf(argv[++i], "%lf:%lf:%lf:%lf:%lf", &spec.start_s, &spec.mg_l, &spec.rise_s, &spec.hold_s, &spec.fall_s);
+            bOk = fields == 2 || fields == 5;
+            vapor.push_back(spec);
+        }
+        else if (std::strcmp(argv[i], "--seed") == 0 && has_value) {cfg.seed = std::strtoull(argv[++i], nullptr, 10);}
+        else if (std::strcmp(argv[i], "--rate") == 0 && has_value) {cfg.sample_rate_hz = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--baseline") == 0 && has_value) {cfg.baseline_volts = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--rise") == 0 && has_value) {cfg.rise_tau_s = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--decay") == 0 && has_value) {cfg.decay_tau_s = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--warmup") == 0 && has_value) {cfg.warmup_volts = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--drift") == 0 && has_value) {cfg.drift_volts_per_hour = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--walk") == 0 && has_value) {cfg.random_walk_volts = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--white") == 0 && has_value) {cfg.white_volts = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--pink") == 0 && has_value) {cfg.pink_volts = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--hum") == 0 && has_value) {cfg.hum_volts = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--hum-hz") == 0 && has_value) {cfg.hum_hz = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--glitch") == 0 && has_value)
+        {
+            cfg.drop_prob = std::strtod(argv[++i], nullptr);
+            cfg.stale_prob = cfg.drop_prob;
+            cfg.rail_prob = cfg.drop_prob / 5.0;
+        }
+        else if (std::strcmp(argv[i], "--clean") == 0) {bClean = true;}
+        else if (argv[i][0] != '-' && out_path.empty()) {out_path = argv[i];}
+        else {bOk = false;}
+
+        if (!bOk)
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (out_path.empty() || hours <= 0.0 || cfg.sample_rate_hz <= 0.0)
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    if (bClean)
+    {
+        cfg.jitter_us = 0.0;
+        cfg.warmup_volts = cfg.drift_volts_per_hour = cfg.random_walk_volts = 0.0;
+        cfg.white_volts = cfg.pink_volts = cfg.hum_volts = 0.0;
+        cfg.drop_prob = cfg.stale_prob = cfg.rail_prob = 0.0;
+    }
+
+    const double session_s = hours * 3600.0;
+    std::vector<BreathSpec> script = MakeBreathScript(session_s, every_s, bacs, blow_s, first_s);
+    script.insert(script.end(), extra.begin(), extra.end());
+
+    if (vapor_first_s < 0.0) {vapor_first_s = first_s + (vapor_every_s / 2.0);}
+    cfg.vapor = MakeVaporScript(session_s, vapor_every_s, vapor_mg, vapor_rise, vapor_first_s);
+    cfg.vapor.insert(cfg.vapor.end(), vapor.begin(), vapor.end());
+
+    SignalGenerator generator(cfg, std::move(script));
+    RecordingWriter writer;
+    if (!writer.Open(out_path, static_cast<std::uint32_t>(cfg.sample_rate_hz), 0)) {return 1;}
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto reads = static_cast<std::uint64_t>(session_s * cfg.sample_rate_hz);
+    std::uint64_t written = 0;
+
+    // Chunked so a day long session doesn't sit in memory.
+    constexpr std::size_t Chunk = 1U << 16U;
+    std::vector<Sample> chunk;
+    for (std::uint64_t done = 0; done < reads; done += Chunk)
+    {
+        chunk.clear();
+        generator.Generate(chunk, static_cast<std::size_t>(std::min<std::uint64_t>(Chunk, reads - done)));
+        writer.OnSamples(chunk.data(), chunk.size());
+        written += chunk.size();
+    }
+    writer.Close();
+
+    if (!WriteLabels(out_path + ".labels", generator)) {return 1;}
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fmt::print(stderr, "{}: {:.2f} h, {} samples ({} dropped reads), {} breaths, {} vapor events in {:.3f}s ({:.0f}x real time)\n", out_path, hours,
+        written, generator.Dropped(), generator.Script().size(), generator.GetConfig().vapor.size(), seconds, (seconds > 0.0) ? session_s / seconds : 0.0);
+    return 0;
+}
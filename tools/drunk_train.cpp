@@ -0,0 +1,407 @@
+// drunk_train: fit the breath classifier (breath_classifier.h) over labeled recordings and write its constexpr table.
+//
+//   drunk_train [--out model.h] [--l2 lambda] [--iters n] [--rate r] [--passes n] [--threshold p] [--tolerance ms] <recording>...
+//
+// Labels are drunk_tune's: <recording>.labels next to each recording, one breath per line start_us,end_us[,bac], no
+// labels file = clean air. Every candidate the MQ-3 path turns up (a Processing run that got past min_blow_time_us) is
+// a training row, labeled a breath when it overlaps a labeled blow (within --tolerance) and room vapor otherwise.
+//
+// Pass 1 replays with the classifier off, so every false trigger is followed by a Cooldown. With it on the analyzer
+// goes back to Ready instead and sees the rest of the vapor as new candidates, so each further pass replays with the
+// model so far and adds what it turns up. The fit is an L2 regularized logistic regression on standardized inputs,
+// batch gradient descent with the classes weighted equally (there are a lot more breaths than vapor in most sets).
+//
+// Prints leave one recording out cross validation, the confusion matrix on everything and the ns per Score(), then
+// writes the table with --out (source/breath_classifier_model.h is what the app compiles in).
+#include "analyzer.h"
+#include "breath_classifier.h"
+#include "config_settings.h"
+#include "recording.h"
+#include "window_replay.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/core.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using namespace DrunkAPI;
+
+    struct Label
+    {
+        std::uint64_t start_us = 0;
+        std::uint64_t end_us = 0;
+    };
+
+    struct Trace
+    {
+        std::string path;
+        std::vector<Label> labels;
+        std::vector<WindowResult> windows;
+    };
+
+    struct Row
+    {
+        std::array<double, BreathFeatureCount> inputs{};
+        bool bBreath = false;
+        std::size_t trace = 0;
+    };
+
+    struct Fit_Config
+    {
+        double l2 = 1e-3;
+        std::size_t iters = 3000;
+        double rate = 0.5;
+    };
+
+    struct Confusion
+    {
+        std::size_t true_pos = 0; // Breath kept
+        std::size_t false_neg = 0; // Breath thrown away
+        std::size_t true_neg = 0; // Vapor thrown away
+        std::size_t false_pos = 0; // Vapor kept
+
+        void Add(bool bBreath, bool bKept)
+        {
+            if (bBreath) {++(bKept ? true_pos : false_neg);}
+            else {++(bKept ? false_pos : true_neg);}
+        }
+    };
+
+    std::vector<Label> LoadLabels(const std::string& path)
+    {
+        std::vector<Label> labels;
+        std::FILE* file = std::fopen(path.c_str(), "r");
+        if (file == nullptr) {return labels;}
+
+        char line[256];
+        while (std::fgets(line, sizeof(line), file) != nullptr)
+        {
+            unsigned long long start_us = 0;
+            unsigned long long end_us = 0;
+            if (std::sscanf(line, "%llu,%llu", &start_us, &end_us) < 2) {continue;} // Header, comment
+            labels.push_back({start_us, end_us});
+        }
+        std::fclose(file);
+        return labels;
+    }
+
+    bool OverlapsLabel(const Trace& trace, std::uint64_t start_us, std::uint64_t end_us, std::uint64_t tolerance_us)
+    {
+        return std::any_of(trace.labels.begin(), trace.labels.end(), [&](const Label& label)
+        {
+            return start_us <= label.end_us + tolerance_us && end_us + tolerance_us >= label.start_us;
+        });
+    }
+
+    // Every candidate one replay of the trace turns up, with or without a model vetting them.
+    void CollectCandidates(const Trace& trace, std::size_t trace_index, const BreathModel* model, std::uint64_t tolerance_us, std::vector<Row>& rows)
+    {
+        BreathAnalyzer_Config cfg{};
+        cfg.bPrintStatus = false;
+        cfg.bClassify = model != nullptr;
+
+        BreathAnalyzer analyzer(cfg);
+        if (model != nullptr) {analyzer.SetModel(*model);}
+        BreathResult snapshot{};
+        BreathEvent event{};
+
+        for (const WindowResult& window : trace.windows)
+        {
+            const std::uint64_t before = analyzer.Candidates();
+            analyzer.AnalyzeBreath(window, snapshot, event);
+            if (analyzer.Candidates() == before) {continue;}
+
+            const BreathFeatures& features = analyzer.LastFeatures();
+            const std::uint64_t end_us = window.window_end_us;
+            const std::uint64_t start_us = end_us - std::min(end_us, static_cast<std::uint64_t>(features.duration_s * 1e6));
+
+            Row row{};
+            row.inputs = BreathModelInputs(features);
+            row.bBreath = OverlapsLabel(trace, start_us, end_us, tolerance_us);
+            row.trace = trace_index;
+            rows.push_back(row);
+        }
+    }
+
+    // `skip_trace` is left out of the fit (cross validation), SIZE_MAX = fit on everything.
+    BreathModel Fit(const std::vector<Row>& rows, std::size_t skip_trace, const Fit_Config& fit)
+    {
+        BreathModel model{};
+        std::size_t count = 0;
+        std::size_t breaths = 0;
+        for (const Row& row : rows)
+        {
+            if (row.trace == skip_trace) {continue;}
+            ++count;
+            if (row.bBreath) {++breaths;}
+            for (std::size_t f = 0; f < BreathFeatureCount; ++f) {model.mean[f] += row.inputs[f];}
+        }
+        if (count == 0 || breaths == 0 || breaths == count) {return model;}
+
+        for (double& mean : model.mean) {mean /= static_cast<double>(count);}
+        std::array<double, BreathFeatureCount> var{};
+        for (const Row& row : rows)
+        {
+            if (row.trace == skip_trace) {continue;}
+            for (std::size_t f = 0; f < BreathFeatureCount; ++f) {var[f] += (row.inputs[f] - model.mean[f]) * (row.inputs[f] - model.mean[f]);}
+        }
+        for (std::size_t f = 0; f < BreathFeatureCount; ++f)
+        {
+            // main() refuses a flat feature on the full set, this only keeps a leave one out fold from dividing by zero.
+            const double sd = std::sqrt(var[f] / static_cast<double>(count));
+            model.scale[f] = (sd > 1e-6) ? sd : 1.0;
+        }
+
+        // Balanced: each class carries half the loss no matter how many rows it has.
+        const double breath_weight = 0.5 / static_cast<double>(breaths);
+        const double vapor_weight = 0.5 / static_cast<double>(count - breaths);
+
+        std::vector<std::array<double, BreathFeatureCount>> z;
+        std::vector<double> y;
+        std::vector<double> w;
+        for (const Row& row : rows)
+        {
+            if (row.trace == skip_trace) {continue;}
+            std::array<double, BreathFeatureCount> standardized{};
+            for (std::size_t f = 0; f < BreathFeatureCount; ++f) {standardized[f] = (row.inputs[f] - model.mean[f]) / model.scale[f];}
+            z.push_back(standardized);
+            y.push_back(row.bBreath ? 1.0 : 0.0);
+            w.push_back(row.bBreath ? breath_weight : vapor_weight);
+        }
+
+        for (std::size_t iter = 0; iter < fit.iters; ++iter)
+        {
+            std::array<double, BreathFeatureCount> grad{};
+            double grad_bias = 0.0;
+            for (std::size_t i = 0; i < z.size(); ++i)
+            {
+                double logit = model.bias;
+                for (std::size_t f = 0; f < BreathFeatureCount; ++f) {logit += model.weight[f] * z[i][f];}
+                const double err = w[i] * ((1.0 / (1.0 + std::exp(-logit))) - y[i]);
+                for (std::size_t f = 0; f < BreathFeatureCount; ++f) {grad[f] += err * z[i][f];}
+                grad_bias += err;
+            }
+            for (std::size_t f = 0; f < BreathFeatureCount; ++f) {model.weight[f] -= fit.rate * (grad[f] + (fit.l2 * model.weight[f]));}
+            model.bias -= fit.rate * grad_bias;
+        }
+        return model;
+    }
+
+    // Spread of each input over every row, what Fit() scales by when it sees the whole set.
+    std::array<double, BreathFeatureCount> FeatureSpread(const std::vector<Row>& rows)
+    {
+        std::array<double, BreathFeatureCount> mean{};
+        std::array<double, BreathFeatureCount> spread{};
+        if (rows.empty()) {return spread;}
+        for (const Row& row : rows)
+        {
+            for (std::size_t f = 0; f < BreathFeatureCount; ++f) {mean[f] += row.inputs[f];}
+        }
+        for (double& m : mean) {m /= static_cast<double>(rows.size());}
+        for (const Row& row : rows)
+        {
+            for (std::size_t f = 0; f < BreathFeatureCount; ++f) {spread[f] += (row.inputs[f] - mean[f]) * (row.inputs[f] - mean[f]);}
+        }
+        for (double& sd : spread) {sd = std::sqrt(sd / static_cast<double>(rows.size()));}
+        return spread;
+    }
+
+    // Rows already hold BreathModelInputs, same math as BreathModel::Logit from there.
+    double ScoreInputs(const BreathModel& model, const std::array<double, BreathFeatureCount>& inputs)
+    {
+        double logit = model.bias;
+        for (std::size_t f = 0; f < BreathFeatureCount; ++f) {logit += model.weight[f] * ((inputs[f] - model.mean[f]) / model.scale[f]);}
+        return 1.0 / (1.0 + std::exp(-logit));
+    }
+
+    void PrintConfusion(const char* title, const Confusion& c)
+    {
+        const std::size_t breaths = c.true_pos + c.false_neg;
+        const std::size_t vapor = c.true_neg + c.false_pos;
+        fmt::print("{}: breaths kept {}/{}, vapor rejected {}/{} ({} breaths lost, {} false triggers left)\n", title,
+            c.true_pos, breaths, c.true_neg, vapor, c.false_neg, c.false_pos);
+    }
+
+    bool WriteModel(const std::string& path, const BreathModel& model, std::size_t rows, std::size_t traces)
+    {
+        std::FILE* file = std::fopen(path.c_str(), "w");
+        if (file == nullptr)
+        {
+            fmt::print(stderr, "Error: cannot write model {}\n", path);
+            return false;
+        }
+
+        auto row = [](const std::array<double, BreathFeatureCount>& values)
+        {
+            std::string text = "{";
+            for (std::size_t f = 0; f < BreathFeatureCount; ++f) {text += fmt::format("{}{:.9g}", (f == 0) ? "" : ", ", values[f]);}
+            return text + "}";
+        };
+
+        fmt::print(file, "#pragma once\n#include \"breath_classifier.h\"\n\n");
+        fmt::print(file, "// Generated by drunk_train, don't edit. Regenerate with drunk_train --out source/breath_classifier_model.h <recording>...\n"
+            "// (the recordings the shipped table came from are made by the drunk_siggen loop under Breath Classifier in README.md)\n");
+        std::string inputs;
+        for (std::size_t f = 0; f < BreathFeatureCount; ++f) {inputs += fmt::format("{}{}", (f == 0) ? "" : ", ", BreathFeatureNames[f]);}
+        fmt::print(file, "// {} candidates from {} recordings. Inputs: {}\n", rows, traces, inputs);
+        fmt::print(file, "namespace DrunkAPI\n{{\n    inline constexpr BreathModel DefaultBreathModel{{\n");
+        fmt::print(file, "        {},\n        {},\n        {},\n        {:.9g},\n    }};\n}}\n", row(model.mean), row(model.scale), row(model.weight), model.bias);
+
+        const bool bOk = std::ferror(file) == 0;
+        return (std::fclose(file) == 0) && bOk;
+    }
+
+    void PrintUsage(const char* argv0)
+    {
+        fmt::print("usage: {} [--out model.h] [--l2 lambda] [--iters n] [--rate r] [--passes n] [--threshold p] [--tolerance ms] <recording>...\n", argv0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    using namespace DrunkAPI;
+
+    Fit_Config fit{};
+    std::string out_path;
+    std::size_t passes = 2;
+    double threshold = Config::ClassifyThreshold;
+    double tolerance_ms = 2000.0;
+    std::vector<Trace> traces;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = (i + 1 < argc);
+        bool bOk = true;
+        if (std::strcmp(argv[i], "--out") == 0 && has_value) {out_path = argv[++i];}
+        else if (std::strcmp(argv[i], "--l2") == 0 && has_value) {fit.l2 = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--iters") == 0 && has_value) {fit.iters = std::strtoull(argv[++i], nullptr, 10);}
+        else if (std::strcmp(argv[i], "--rate") == 0 && has_value) {fit.rate = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--passes") == 0 && has_value) {passes = std::max<std::size_t>(1, std::strtoull(argv[++i], nullptr, 10));}
+        else if (std::strcmp(argv[i], "--threshold") == 0 && has_value) {threshold = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--tolerance") == 0 && has_value) {tolerance_ms = std::strtod(argv[++i], nullptr);}
+        else if (argv[i][0] != '-')
+        {
+            traces.emplace_back();
+            traces.back().path = argv[i];
+        }
+        else {bOk = false;}
+
+        if (!bOk)
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (traces.empty())
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    // Windows once per recording, at the live window size.
+    Analyzer_Config analyzer_cfg{};
+    analyzer_cfg.bDebugPrint = false;
+    for (Trace& trace : traces)
+    {
+        std::vector<Sample> samples;
+        std::int64_t wall_minus_mono_us = 0;
+        std::uint32_t header_hz = 0;
+        if (!LoadRecording(trace.path, samples, wall_minus_mono_us, &header_hz)) {return 1;}
+        trace.labels = LoadLabels(trace.path + ".labels");
+        if (trace.labels.empty()) {fmt::print(stderr, "{}: no labels, treated as clean air\n", trace.path);}
+        if (samples.empty()) {continue;}
+
+        std::vector<WindowChunk> chunks = MakeWindowChunks(samples.size(), samples.size());
+        AccumulateChunk(samples, chunks.front(), analyzer_cfg.window_micro);
+        trace.windows = FinalizeWindows(MergeChunks(samples, chunks, analyzer_cfg.window_micro), samples.front().t_us,
+            AtSampleRate(analyzer_cfg, ReplaySampleRateHz(trace.path, header_hz, samples)));
+    }
+
+    const auto tolerance_us = static_cast<std::uint64_t>(tolerance_ms * 1000.0);
+    std::vector<Row> rows;
+    BreathModel model{};
+
+    for (std::size_t pass = 0; pass < passes; ++pass)
+    {
+        const std::size_t before = rows.size();
+        for (std::size_t t = 0; t < traces.size(); ++t) {CollectCandidates(traces[t], t, (pass == 0) ? nullptr : &model, tolerance_us, rows);}
+
+        const auto breaths = static_cast<std::size_t>(std::count_if(rows.begin() + static_cast<std::ptrdiff_t>(before), rows.end(), [](const Row& row) { return row.bBreath; }));
+        fmt::print("pass {}: {} candidates ({} breaths, {} vapor)\n", pass + 1, rows.size() - before, breaths, rows.size() - before - breaths);
+        model = Fit(rows, SIZE_MAX, fit);
+    }
+
+    const auto breath_rows = static_cast<std::size_t>(std::count_if(rows.begin(), rows.end(), [](const Row& row) { return row.bBreath; }));
+    if (breath_rows == 0 || breath_rows == rows.size())
+    {
+        fmt::print(stderr, "Error: need both breaths and vapor candidates to train on ({} of {} are breaths)\n", breath_rows, rows.size());
+        return 1;
+    }
+
+    // A feature that doesn't move in the training set would ship with a made up scale and weight 0, and then any real
+    // recording where it does move is scored off a column the model never learned. Better to stop here and ask for
+    // more varied recordings.
+    constexpr double MinFeatureSpread = 1e-3;
+    const std::array<double, BreathFeatureCount> spread = FeatureSpread(rows);
+    bool bFlat = false;
+    for (std::size_t f = 0; f < BreathFeatureCount; ++f)
+    {
+        if (spread[f] >= MinFeatureSpread) {continue;}
+        fmt::print(stderr, "Error: {} barely moves over these {} candidates (sd {:.3g}), record sessions where it varies\n", BreathFeatureNames[f], rows.size(), spread[f]);
+        bFlat = true;
+    }
+    if (bFlat) {return 1;}
+
+    // Leave one recording out, each recording scored by a model that never saw it.
+    if (traces.size() > 1)
+    {
+        Confusion cv{};
+        for (std::size_t t = 0; t < traces.size(); ++t)
+        {
+            const BreathModel held_out = Fit(rows, t, fit);
+            for (const Row& row : rows)
+            {
+                if (row.trace == t) {cv.Add(row.bBreath, ScoreInputs(held_out, row.inputs) >= threshold);}
+            }
+        }
+        PrintConfusion("leave one out", cv);
+    }
+
+    Confusion all{};
+    for (const Row& row : rows) {all.Add(row.bBreath, ScoreInputs(model, row.inputs) >= threshold);}
+    PrintConfusion("training set", all);
+
+    for (std::size_t f = 0; f < BreathFeatureCount; ++f) {fmt::print("  {:<16} weight {:+.3f}\n", BreathFeatureNames[f], model.weight[f]);}
+    fmt::print("  {:<16} {:+.3f}\n", "bias", model.bias);
+
+    // Inference cost, the way the analyzer calls it (features -> inputs -> score).
+    std::vector<BreathFeatures> features(64);
+    for (std::size_t i = 0; i < features.size(); ++i)
+    {
+        const double k = static_cast<double>(i) / static_cast<double>(features.size());
+        features[i] = {0.05 + k, 0.5 + (4.0 * k), 5.0, 0.1 + (2.0 * k), k, 0.5 * k};
+    }
+    constexpr std::size_t Scores = 1U << 20U;
+    double sink = 0.0;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < Scores; ++i) {sink += model.Score(features[i & 63U]);}
+    const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / static_cast<double>(Scores);
+    fmt::print("Score(): {:.1f} ns ({:.3f})\n", ns, sink / static_cast<double>(Scores));
+
+    if (!out_path.empty())
+    {
+        if (!WriteModel(out_path, model, rows.size(), traces.size())) {return 1;}
+        fmt::print("wrote {}\n", out_path);
+    }
+    return 0;
+}
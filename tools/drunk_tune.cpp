@@ -0,0 +1,360 @@
+// drunk_tune: grid search BreathAnalyzer_Config over labeled recordings and print the Pareto front.
+//
+//   drunk_tune [--threads N] [--window list] [--rise list] [--sigma list] [--alpha list] [--cooldown list]
+//              [--tolerance ms] [--all] <recording>...
+//
+// A list is either "a,b,c" or "from:to:step". Labels live next to each recording in <recording>.labels, one breath
+// per line: start_us,end_us[,bac] (same steady_clock stamps as the samples, bac may be left out). A recording with
+// no labels file is treated as clean air, so anything detected in it counts as a false trigger.
+//
+// Window stats only depend on the window size, so they're built once per (recording, window) and every breath config
+// with that window replays the cached windows. The grid is then spread over a work stealing pool.
+//
+// Scores (all minimized): missed breaths, false triggers, mean time from blow start to result, mean |BAC error|.
+// A config that matched no breath has no latency or BAC error to speak of, it gets +inf for both so "detect nothing"
+// can't sit on the front by being unbeatable there. Configs with the exact same scores are one front point, printed
+// once (the first in grid order) with how many configs share it.
+#include "config_settings.h"
+#include "mq3_helper.h"
+#include "recording.h"
+#include "thread_pool.h"
+#include "window_replay.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/core.h>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace
+{
+    using namespace DrunkAPI;
+
+    struct Label
+    {
+        std::uint64_t start_us = 0;
+        std::uint64_t end_us = 0;
+        double bac = -1.0; // < 0 when unknown
+    };
+
+    struct Trace
+    {
+        std::string path;
+        std::vector<Sample> samples;
+        double sample_hz = Config::SampleRate_Hz; // ReplaySampleRateHz
+        std::vector<Label> labels;
+        std::vector<std::vector<WindowResult>> windows; // Per window size
+    };
+
+    struct TuneConfig
+    {
+        std::size_t window_index = 0;
+        BreathAnalyzer_Config breath{};
+    };
+
+    struct TuneScore
+    {
+        std::uint32_t misses = 0;
+        std::uint32_t false_triggers = 0;
+        double latency_ms = 0.0;
+        double bac_error = 0.0;
+    };
+
+    bool ParseList(const char* text, std::vector<double>& out)
+    {
+        out.clear();
+        double from = 0.0;
+        double to = 0.0;
+        double step = 0.0;
+        if (std::sscanf(text, "%lf:%lf:%lf", &from, &to, &step) == 3)
+        {
+            if (step <= 0.0 || to < from) {return false;}
+            // Count the steps instead of accumulating so 0.1 increments don't drift off the end.
+            const auto count = static_cast<std::size_t>(std::floor(((to - from) / step) + 1e-9)) + 1;
+            for (std::size_t i = 0; i < count; ++i) {out.push_back(from + (static_cast<double>(i) * step));}
+            return true;
+        }
+
+        const char* cursor = text;
+        while (*cursor != '\0')
+        {
+            char* next = nullptr;
+            out.push_back(std::strtod(cursor, &next));
+            if (next == cursor) {return false;}
+            cursor = (*next == ',') ? next + 1 : next;
+        }
+        return !out.empty();
+    }
+
+    std::vector<Label> LoadLabels(const std::string& path)
+    {
+        std::vector<Label> labels;
+        std::FILE* file = std::fopen(path.c_str(), "r");
+        if (file == nullptr) {return labels;}
+
+        char line[256];
+        while (std::fgets(line, sizeof(line), file) != nullptr)
+        {
+            Label label{};
+            unsigned long long start_us = 0;
+            unsigned long long end_us = 0;
+            const int fields = std::sscanf(line, "%llu,%llu,%lf", &start_us, &end_us, &label.bac);
+            if (fields < 2) {continue;} // Header, comment
+            label.start_us = start_us;
+            label.end_us = end_us;
+            if (fields < 3) {label.bac = -1.0;}
+            labels.push_back(label);
+        }
+        std::fclose(file);
+        return labels;
+    }
+
+    // Every window threshold in the analyzer is per window, min samples has to follow the window length.
+    Analyzer_Config WindowConfig(std::uint32_t window_us)
+    {
+        Analyzer_Config cfg{};
+        cfg.window_micro = window_us;
+        cfg.min_window_sample_size = std::max<std::size_t>(1, Config::MinWindowSamples * window_us / Config::WindowUs);
+        cfg.bDebugPrint = false;
+        return cfg;
+    }
+
+    void ScoreTrace(const Trace& trace, const std::vector<ReplayEvent>& events, std::uint64_t tolerance_us, TuneScore& score, std::uint32_t& matched, std::uint32_t& bac_matched)
+    {
+        std::vector<bool> bUsed(trace.labels.size(), false);
+
+        for (const ReplayEvent& replay : events)
+        {
+            if (replay.event.State != BreathAnalyzerState::Analyzed) {continue;}
+
+            bool bMatched = false;
+            for (std::size_t i = 0; i < trace.labels.size() && !bMatched; ++i)
+            {
+                const Label& label = trace.labels[i];
+                if (bUsed[i] || replay.event.start_us > label.end_us + tolerance_us || replay.event.end_us + tolerance_us < label.start_us) {continue;}
+
+                bUsed[i] = true;
+                bMatched = true;
+                ++matched;
+                score.latency_ms += static_cast<double>(static_cast<std::int64_t>(replay.t_us) - static_cast<std::int64_t>(label.start_us)) / 1000.0;
+
+                if (label.bac >= 0.0)
+                {
+                    score.bac_error += std::abs(MQ3::adc3v3_to_bac(replay.event.peak_voltage, Config::RLoad, Config::Ro_Air) - label.bac);
+                    ++bac_matched;
+                }
+            }
+
+            if (!bMatched) {++score.false_triggers;}
+        }
+
+        score.misses += static_cast<std::uint32_t>(std::count(bUsed.begin(), bUsed.end(), false));
+    }
+
+    bool Dominates(const TuneScore& lhs, const TuneScore& rhs)
+    {
+        const bool bNoWorse = lhs.misses <= rhs.misses && lhs.false_triggers <= rhs.false_triggers && lhs.latency_ms <= rhs.latency_ms && lhs.bac_error <= rhs.bac_error;
+        const bool bBetter = lhs.misses < rhs.misses || lhs.false_triggers < rhs.false_triggers || lhs.latency_ms < rhs.latency_ms || lhs.bac_error < rhs.bac_error;
+        return bNoWorse && bBetter;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    using namespace DrunkAPI;
+
+    std::size_t thread_count = std::thread::hardware_concurrency();
+    std::vector<double> window_s = {0.5, 1.0, 2.0};
+    std::vector<double> rise = {0.02, 0.03, 0.04, 0.05, 0.06, 0.07, 0.08, 0.09, 0.10};
+    std::vector<double> sigma = {1.0, 1.5, 2.0, 2.5, 3.0, 3.5, 4.0, 4.5, 5.0};
+    std::vector<double> alpha = {0.02, 0.05, 0.10};
+    std::vector<double> cooldown = {10, 15, 20, 25, 30};
+    double tolerance_ms = 2000.0;
+    bool bPrintAll = false;
+    std::vector<std::unique_ptr<Trace>> traces;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = (i + 1 < argc);
+        bool bOk = true;
+        if (std::strcmp(argv[i], "--threads") == 0 && has_value) {thread_count = std::strtoull(argv[++i], nullptr, 10);}
+        else if (std::strcmp(argv[i], "--window") == 0 && has_value) {bOk = ParseList(argv[++i], window_s);}
+        else if (std::strcmp(argv[i], "--rise") == 0 && has_value) {bOk = ParseList(argv[++i], rise);}
+        else if (std::strcmp(argv[i], "--sigma") == 0 && has_value) {bOk = ParseList(argv[++i], sigma);}
+        else if (std::strcmp(argv[i], "--alpha") == 0 && has_value) {bOk = ParseList(argv[++i], alpha);}
+        else if (std::strcmp(argv[i], "--cooldown") == 0 && has_value) {bOk = ParseList(argv[++i], cooldown);}
+        else if (std::strcmp(argv[i], "--tolerance") == 0 && has_value) {tolerance_ms = std::strtod(argv[++i], nullptr);}
+        else if (std::strcmp(argv[i], "--all") == 0) {bPrintAll = true;}
+        else if (argv[i][0] != '-')
+        {
+            traces.push_back(std::make_unique<Trace>());
+            traces.back()->path = argv[i];
+        }
+        else {bOk = false;}
+
+        if (!bOk)
+        {
+            fmt::print("usage: {} [--threads N] [--window s] [--rise v] [--sigma k] [--alpha a] [--cooldown n] [--tolerance ms] [--all] <recording>...\n"
+                       "  lists are \"a,b,c\" or \"from:to:step\"\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (traces.empty())
+    {
+        fmt::print("usage: {} [options] <recording>...\n", argv[0]);
+        return 1;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    const auto t_start = Clock::now();
+
+    for (const auto& trace : traces)
+    {
+        std::int64_t wall_minus_mono_us = 0;
+        std::uint32_t header_hz = 0;
+        if (!LoadRecording(trace->path, trace->samples, wall_minus_mono_us, &header_hz)) {return 1;}
+        trace->sample_hz = ReplaySampleRateHz(trace->path, header_hz, trace->samples);
+        trace->labels = LoadLabels(trace->path + ".labels");
+        if (trace->labels.empty()) {fmt::print(stderr, "{}: no labels, treated as clean air\n", trace->path);}
+    }
+
+    WorkStealingPool pool(thread_count);
+
+    // 1) Window stats + results once per (trace, window size)
+    std::vector<std::uint32_t> window_us;
+    for (const double seconds : window_s) {window_us.push_back(static_cast<std::uint32_t>(std::llround(seconds * 1e6)));}
+
+    for (const auto& trace : traces)
+    {
+        trace->windows.resize(window_us.size());
+        if (trace->samples.empty()) {continue;}
+        for (std::size_t w = 0; w < window_us.size(); ++w)
+        {
+            pool.Submit([tr = trace.get(), w, window = window_us[w]]
+            {
+                std::vector<WindowChunk> chunks = MakeWindowChunks(tr->samples.size(), tr->samples.size());
+                AccumulateChunk(tr->samples, chunks.front(), window);
+                tr->windows[w] = FinalizeWindows(MergeChunks(tr->samples, chunks, window), tr->samples.front().t_us, AtSampleRate(WindowConfig(window), tr->sample_hz));
+            });
+        }
+    }
+    pool.Wait();
+    const auto t_windows = Clock::now();
+
+    // 2) Grid. Blow times and warmup are in windows/us and stay at their defaults.
+    std::vector<TuneConfig> grid;
+    for (std::size_t w = 0; w < window_us.size(); ++w)
+    {
+        for (const double rise_v : rise)
+        {
+            for (const double k : sigma)
+            {
+                for (const double a : alpha)
+                {
+                    for (const double cool : cooldown)
+                    {
+                        TuneConfig cfg{};
+                        cfg.window_index = w;
+                        cfg.breath.start_delta_v = rise_v;
+                        cfg.breath.start_k_sigma = k;
+                        cfg.breath.baseline_alpha = a;
+                        cfg.breath.cooldown_stable_windows = static_cast<std::uint16_t>(cool);
+                        cfg.breath.bPrintStatus = false;
+                        grid.push_back(cfg);
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<TuneScore> scores(grid.size());
+    const auto tolerance_us = static_cast<std::uint64_t>(tolerance_ms * 1000.0);
+    constexpr std::size_t ConfigsPerTask = 16;
+
+    for (std::size_t begin = 0; begin < grid.size(); begin += ConfigsPerTask)
+    {
+        pool.Submit([&, begin]
+        {
+            const std::size_t end = std::min(begin + ConfigsPerTask, grid.size());
+            for (std::size_t c = begin; c < end; ++c)
+            {
+                TuneScore score{};
+                std::uint32_t matched = 0;
+                std::uint32_t bac_matched = 0;
+                for (const auto& trace : traces)
+                {
+                    ScoreTrace(*trace, ReplayBreaths(trace->windows[grid[c].window_index], grid[c].breath), tolerance_us, score, matched, bac_matched);
+                }
+                constexpr double Unmatched = std::numeric_limits<double>::infinity();
+                score.latency_ms = (matched > 0) ? score.latency_ms / matched : Unmatched;
+                score.bac_error = (bac_matched > 0) ? score.bac_error / bac_matched : Unmatched;
+                scores[c] = score;
+            }
+        });
+    }
+    pool.Wait();
+    const auto t_grid = Clock::now();
+
+    // 3) Pareto front (a few thousand points, the O(n^2) scan is nothing next to the replays). Identical score
+    // vectors collapse onto the first config that has them.
+    using ScoreKey = std::tuple<std::uint32_t, std::uint32_t, double, double>;
+    auto key = [&scores](std::size_t c) { return ScoreKey{scores[c].misses, scores[c].false_triggers, scores[c].latency_ms, scores[c].bac_error}; };
+
+    std::map<ScoreKey, std::size_t> ties; // Configs per distinct score vector
+    std::vector<bool> bRepresentative(grid.size(), false);
+    for (std::size_t c = 0; c < grid.size(); ++c)
+    {
+        bRepresentative[c] = ++ties[key(c)] == 1;
+    }
+
+    std::vector<bool> bOnFront(grid.size(), true);
+    std::vector<std::size_t> rows;
+    std::size_t front_size = 0;
+    std::size_t front_configs = 0;
+    for (std::size_t c = 0; c < grid.size(); ++c)
+    {
+        for (std::size_t other = 0; other < grid.size() && bOnFront[c]; ++other)
+        {
+            bOnFront[c] = !Dominates(scores[other], scores[c]);
+        }
+        front_configs += bOnFront[c] ? 1U : 0U;
+        front_size += (bOnFront[c] && bRepresentative[c]) ? 1U : 0U;
+        if (bPrintAll || (bOnFront[c] && bRepresentative[c])) {rows.push_back(c);}
+    }
+
+    std::sort(rows.begin(), rows.end(), [&](std::size_t lhs, std::size_t rhs)
+    {
+        const std::uint32_t lhs_errors = scores[lhs].misses + scores[lhs].false_triggers;
+        const std::uint32_t rhs_errors = scores[rhs].misses + scores[rhs].false_triggers;
+        return (lhs_errors != rhs_errors) ? lhs_errors < rhs_errors : scores[lhs].latency_ms < scores[rhs].latency_ms;
+    });
+
+    fmt::print("window_us,start_delta_v,start_k_sigma,baseline_alpha,cooldown_windows,misses,false_triggers,latency_ms,bac_error,pareto,same_score\n");
+    for (const std::size_t c : rows)
+    {
+        const BreathAnalyzer_Config& breath = grid[c].breath;
+        fmt::print("{},{:.4f},{:.3f},{:.4f},{},{},{},{:.1f},{:.6g},{},{}\n", window_us[grid[c].window_index], breath.start_delta_v, breath.start_k_sigma,
+            breath.baseline_alpha, breath.cooldown_stable_windows, scores[c].misses, scores[c].false_triggers, scores[c].latency_ms, scores[c].bac_error,
+            bOnFront[c] ? 1 : 0, ties[key(c)]);
+    }
+    std::fflush(stdout);
+
+    auto seconds = [](Clock::time_point from, Clock::time_point to) { return std::chrono::duration<double>(to - from).count(); };
+    std::size_t label_count = 0;
+    for (const auto& trace : traces) {label_count += trace->labels.size();}
+
+    fmt::print(stderr, "{} traces ({} labeled breaths), {} configs on {} threads: windows {:.3f}s, grid {:.3f}s ({:.0f} configs/s), {} points on the Pareto front ({} configs)\n",
+        traces.size(), label_count, grid.size(), pool.Size(), seconds(t_start, t_windows), seconds(t_windows, t_grid),
+        static_cast<double>(grid.size()) / std::max(1e-9, seconds(t_windows, t_grid)), front_size, front_configs);
+    return 0;
+}